@@ -0,0 +1,510 @@
+#include "AnTcpClient.hpp"
+
+#include <algorithm>
+
+AnTcpClientResponse& AnTcpClientResponse::operator=(AnTcpClientResponse&& other) noexcept
+{
+    if (this != &other)
+    {
+        Reset();
+        Pool = std::move(other.Pool);
+        Buffer = other.Buffer;
+        Size = other.Size;
+        Type = other.Type;
+        Valid = other.Valid;
+
+        if (!Buffer.Data)
+        {
+            memcpy(Inline, other.Inline, Size);
+        }
+
+        other.Buffer = AnTcpPooledBuffer{};
+        other.Size = 0;
+        other.Valid = false;
+    }
+
+    return *this;
+}
+
+char* AnTcpClientResponse::Allocate(const std::shared_ptr<AnTcpBufferPool>& pool, AnTcpMessageType type, size_t size) noexcept
+{
+    Reset();
+
+    if (size > ANTCP_CLIENT_INLINE_RESPONSE_SIZE)
+    {
+        Buffer = pool->Acquire(size);
+
+        if (!Buffer.Data)
+        {
+            return nullptr;
+        }
+
+        Pool = pool;
+    }
+
+    Size = size;
+    Type = type;
+    Valid = true;
+    return Buffer.Data ? Buffer.Data : Inline;
+}
+
+void AnTcpClientResponse::Reset() noexcept
+{
+    if (Buffer.Data)
+    {
+        Pool->Release(Buffer);
+    }
+
+    Pool.reset();
+    Size = 0;
+    Type = 0;
+    Valid = false;
+}
+
+bool AnTcpClientFuture::IsReady() const noexcept
+{
+    if (!Request)
+    {
+        return false;
+    }
+
+    std::lock_guard lock(Client->Mutex);
+    return Request->Done;
+}
+
+AnTcpClientResponse AnTcpClientFuture::Get() noexcept
+{
+    if (!Request)
+    {
+        return AnTcpClientResponse();
+    }
+
+    // the request is done when the connection failed too, the response is invalid then
+    Client->ReadUntil([this]() { return Request->Done; }, std::chrono::steady_clock::time_point::max());
+
+    AnTcpClientResponse response = std::move(Request->Response);
+    Request.reset();
+    return response;
+}
+
+bool AnTcpClientFuture::WaitFor(std::chrono::milliseconds timeout) noexcept
+{
+    return Request && Client->ReadUntil([this]() { return Request->Done; }, std::chrono::steady_clock::now() + timeout);
+}
+
+bool AnTcpClient::Connect(const std::string& ip, const std::string& port, int frameVersion) noexcept
+{
+    Disconnect();
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    addrinfo* addrResult{ nullptr };
+
+    if (getaddrinfo(ip.c_str(), port.c_str(), &hints, &addrResult) != 0)
+    {
+        return false;
+    }
+
+    for (addrinfo* entry = addrResult; entry && Socket == INVALID_SOCKET; entry = entry->ai_next)
+    {
+        Socket = socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
+
+        if (Socket != INVALID_SOCKET && connect(Socket, entry->ai_addr, static_cast<int>(entry->ai_addrlen)) == SOCKET_ERROR)
+        {
+            closesocket(Socket);
+            Socket = INVALID_SOCKET;
+        }
+    }
+
+    freeaddrinfo(addrResult);
+
+    if (Socket == INVALID_SOCKET)
+    {
+        return false;
+    }
+
+    // requests are small and every one of them waits for its response
+    AnTcpSetNoDelay(Socket, true);
+
+    FrameVersion = ANTCP_FRAME_VERSION_1;
+    NextRequestId = 1;
+    InputEnd = 0;
+    HasPartial = false;
+    Failed = false;
+
+    if (frameVersion >= ANTCP_FRAME_VERSION_2)
+    {
+        // answered in the old framing, every frame after it uses the new one
+        const AnTcpClientResponse response = Send(ANTCP_MESSAGE_NEGOTIATE, frameVersion);
+
+        if (!response.IsValid() || response.GetType() != ANTCP_MESSAGE_NEGOTIATE)
+        {
+            Disconnect();
+            return false;
+        }
+
+        FrameVersion = response.As<int>();
+    }
+
+    return true;
+}
+
+void AnTcpClient::Disconnect() noexcept
+{
+    if (Socket == INVALID_SOCKET)
+    {
+        return;
+    }
+
+    Fail();
+
+    {
+        std::unique_lock lock(Mutex);
+        ReadDone.wait(lock, [this]() { return !Reading; });
+    }
+
+    closesocket(Socket);
+    Socket = INVALID_SOCKET;
+    Partial = AnTcpClientResponse();
+}
+
+AnTcpClientFuture AnTcpClient::SendAsync(AnTcpMessageType type, const void* data, size_t size) noexcept
+{
+    auto request = std::make_shared<AnTcpClientRequest>();
+    Queue(request, type, data, size);
+    return AnTcpClientFuture(this, std::move(request));
+}
+
+bool AnTcpClient::SendAsync(AnTcpMessageType type, const void* data, size_t size, std::function<void(AnTcpClientResponse&)> callback) noexcept
+{
+    auto request = std::make_shared<AnTcpClientRequest>();
+    request->Callback = std::move(callback);
+    return Queue(request, type, data, size);
+}
+
+bool AnTcpClient::Poll(std::chrono::milliseconds timeout) noexcept
+{
+    // a single read, or waiting for the one of another thread
+    bool read = false;
+
+    ReadUntil([&read]()
+    {
+        const bool done = read;
+        read = true;
+        return done;
+    }, std::chrono::steady_clock::now() + timeout);
+
+    return IsConnected();
+}
+
+bool AnTcpClient::Wait() noexcept
+{
+    return ReadUntil([this]() { return InFlight.empty(); }, std::chrono::steady_clock::time_point::max()) && IsConnected();
+}
+
+bool AnTcpClient::Queue(const std::shared_ptr<AnTcpClientRequest>& request, AnTcpMessageType type, const void* data, size_t size) noexcept
+{
+    if (MaxInFlight > 0 && InFlightCount.load(std::memory_order_relaxed) >= MaxInFlight)
+    {
+        bool reading = false;
+
+        {
+            std::lock_guard lock(Mutex);
+            reading = Reading && Reader == std::this_thread::get_id();
+        }
+
+        // callbacks run on the reading thread, it can't wait for itself
+        if (!reading)
+        {
+            ReadUntil([this]() { return InFlight.size() < MaxInFlight || Failed.load(std::memory_order_relaxed); }, std::chrono::steady_clock::time_point::max());
+        }
+    }
+
+    bool registered = false;
+    bool sent = false;
+
+    {
+        std::lock_guard sendLock(SendMutex);
+
+        {
+            std::lock_guard lock(Mutex);
+
+            if (Socket != INVALID_SOCKET && !Failed.load(std::memory_order_relaxed))
+            {
+                // published frames use request id 0
+                request->Id = NextRequestId++;
+                NextRequestId += NextRequestId == 0 ? 1 : 0;
+                InFlight.push_back(request);
+                InFlightCount.store(InFlight.size(), std::memory_order_relaxed);
+                registered = true;
+            }
+            else
+            {
+                request->Done = true;
+            }
+        }
+
+        if (registered)
+        {
+            // size | type | request id with frame version 2, followed by the payload
+            char header[sizeof(AnTcpSizeType) + sizeof(AnTcpMessageType) + sizeof(AnTcpRequestId)];
+            const size_t headerSize = sizeof(AnTcpMessageType) + (FrameVersion >= ANTCP_FRAME_VERSION_2 ? sizeof(AnTcpRequestId) : 0);
+            const AnTcpSizeType packetSize = static_cast<AnTcpSizeType>(headerSize + size);
+            memcpy(header, &packetSize, sizeof(AnTcpSizeType));
+            header[sizeof(AnTcpSizeType)] = type;
+            memcpy(header + sizeof(AnTcpSizeType) + sizeof(AnTcpMessageType), &request->Id, sizeof(AnTcpRequestId));
+
+            AnTcpIoVec buffers[]{ AnTcpMakeIoVec(header, sizeof(AnTcpSizeType) + headerSize), AnTcpMakeIoVec(data, size) };
+            sent = AnTcpSendVector(Socket, buffers, size > 0 ? 2 : 1);
+        }
+    }
+
+    // callbacks may send, so they never run while the send mutex is locked
+    if (!registered && request->Callback)
+    {
+        request->Callback(request->Response);
+    }
+    else if (registered && !sent)
+    {
+        Fail();
+    }
+
+    return sent;
+}
+
+bool AnTcpClient::ReadUntil(const std::function<bool()>& done, std::chrono::steady_clock::time_point deadline) noexcept
+{
+    const bool forever = deadline == std::chrono::steady_clock::time_point::max();
+    std::unique_lock lock(Mutex);
+
+    while (!done())
+    {
+        const auto now = std::chrono::steady_clock::now();
+
+        if (Failed.load(std::memory_order_relaxed) || now >= deadline)
+        {
+            return false;
+        }
+
+        if (Reading)
+        {
+            if (forever)
+            {
+                ReadDone.wait(lock);
+            }
+            else
+            {
+                ReadDone.wait_until(lock, deadline);
+            }
+
+            continue;
+        }
+
+        Reading = true;
+        Reader = std::this_thread::get_id();
+        lock.unlock();
+
+        const int timeout = forever ? -1 : static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count());
+
+        if (!ReadResponses(timeout))
+        {
+            Fail();
+        }
+
+        lock.lock();
+        Reading = false;
+        Reader = std::thread::id();
+        ReadDone.notify_all();
+    }
+
+    return true;
+}
+
+bool AnTcpClient::ReadResponses(int timeout) noexcept
+{
+    if (timeout >= 0)
+    {
+        AnTcpPollFd pollFd{ Socket, POLLIN, 0 };
+        const int ready = AnTcpPoll(&pollFd, 1, timeout);
+
+        if (ready == 0)
+        {
+            return true;
+        }
+
+        if (ready == SOCKET_ERROR)
+        {
+            return false;
+        }
+    }
+
+    if (HasPartial)
+    {
+        const auto receivedBytes = recv(Socket, Partial.Buffer.Data + PartialReceived, static_cast<int>(Partial.Size - PartialReceived), 0);
+
+        if (receivedBytes <= 0)
+        {
+            return false;
+        }
+
+        PartialReceived += static_cast<size_t>(receivedBytes);
+
+        if (PartialReceived == Partial.Size)
+        {
+            HasPartial = false;
+            Dispatch(std::move(Partial), PartialId);
+        }
+
+        return true;
+    }
+
+    const auto receivedBytes = recv(Socket, Input.get() + InputEnd, static_cast<int>(ANTCP_CLIENT_RECEIVE_BUFFER_SIZE - InputEnd), 0);
+
+    if (receivedBytes <= 0)
+    {
+        return false;
+    }
+
+    InputEnd += static_cast<size_t>(receivedBytes);
+
+    const size_t headerSize = sizeof(AnTcpMessageType) + (FrameVersion >= ANTCP_FRAME_VERSION_2 ? sizeof(AnTcpRequestId) : 0);
+    size_t offset = 0;
+
+    while (InputEnd - offset >= sizeof(AnTcpSizeType) + headerSize)
+    {
+        AnTcpSizeType packetSize = 0;
+        memcpy(&packetSize, Input.get() + offset, sizeof(AnTcpSizeType));
+
+        if (packetSize < static_cast<AnTcpSizeType>(headerSize))
+        {
+            return false;
+        }
+
+        const char* packet = Input.get() + offset + sizeof(AnTcpSizeType);
+        const size_t payloadSize = static_cast<size_t>(packetSize) - headerSize;
+        const size_t available = std::min(payloadSize, InputEnd - offset - sizeof(AnTcpSizeType) - headerSize);
+
+        // wait for the rest, unless the response never fits into the input buffer
+        if (available < payloadSize && sizeof(AnTcpSizeType) + static_cast<size_t>(packetSize) <= ANTCP_CLIENT_RECEIVE_BUFFER_SIZE)
+        {
+            break;
+        }
+
+        AnTcpRequestId id = 0;
+
+        if (headerSize > sizeof(AnTcpMessageType))
+        {
+            memcpy(&id, packet + sizeof(AnTcpMessageType), sizeof(AnTcpRequestId));
+        }
+
+        AnTcpClientResponse response;
+        char* payload = response.Allocate(Pool, packet[0], payloadSize);
+
+        if (!payload)
+        {
+            return false;
+        }
+
+        memcpy(payload, packet + headerSize, available);
+        offset += sizeof(AnTcpSizeType) + headerSize + available;
+
+        if (available < payloadSize)
+        {
+            // the rest goes straight into the pooled buffer of the response
+            Partial = std::move(response);
+            PartialId = id;
+            PartialReceived = available;
+            HasPartial = true;
+            break;
+        }
+
+        Dispatch(std::move(response), id);
+    }
+
+    // keep the incomplete response at the start of the buffer
+    memmove(Input.get(), Input.get() + offset, InputEnd - offset);
+    InputEnd -= offset;
+    return true;
+}
+
+void AnTcpClient::Dispatch(AnTcpClientResponse&& response, AnTcpRequestId id) noexcept
+{
+    // published frames may arrive between any two responses, they carry no request id
+    if (response.Type == ANTCP_MESSAGE_PUBLISH && id == 0)
+    {
+        if (OnPublished && response.Size >= sizeof(AnTcpTopic))
+        {
+            const std::span<const char> data = response.GetData();
+            AnTcpTopic topic = 0;
+            memcpy(&topic, data.data(), sizeof(AnTcpTopic));
+            OnPublished(topic, data.subspan(sizeof(AnTcpTopic)));
+        }
+
+        return;
+    }
+
+    std::shared_ptr<AnTcpClientRequest> request;
+
+    {
+        std::lock_guard lock(Mutex);
+
+        // responses mostly arrive in order, so the request is usually the first one
+        const auto match = FrameVersion >= ANTCP_FRAME_VERSION_2
+            ? std::find_if(InFlight.begin(), InFlight.end(), [id](const std::shared_ptr<AnTcpClientRequest>& entry) { return entry->Id == id; })
+            : InFlight.begin();
+
+        if (match == InFlight.end())
+        {
+            return;
+        }
+
+        request = std::move(*match);
+        InFlight.erase(match);
+        InFlightCount.store(InFlight.size(), std::memory_order_relaxed);
+        request->Response = std::move(response);
+        request->Done = true;
+    }
+
+    if (request->Callback)
+    {
+        request->Callback(request->Response);
+    }
+}
+
+void AnTcpClient::Fail() noexcept
+{
+    std::deque<std::shared_ptr<AnTcpClientRequest>> failed;
+
+    {
+        std::lock_guard lock(Mutex);
+
+        if (Failed.exchange(true))
+        {
+            return;
+        }
+
+        failed.swap(InFlight);
+        InFlightCount.store(0, std::memory_order_relaxed);
+
+        for (const std::shared_ptr<AnTcpClientRequest>& request : failed)
+        {
+            request->Done = true;
+        }
+    }
+
+    // wakes the thread that waits in recv()
+    shutdown(Socket, SD_BOTH);
+
+    for (const std::shared_ptr<AnTcpClientRequest>& request : failed)
+    {
+        if (request->Callback)
+        {
+            request->Callback(request->Response);
+        }
+    }
+
+    ReadDone.notify_all();
+}
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include "../../AnTCP.Server/src/AnTcpServer.hpp"
+
+// responses up to that size are stored in the response itself, bigger ones in a buffer of the pool
+constexpr size_t ANTCP_CLIENT_INLINE_RESPONSE_SIZE = 64;
+
+// size of the receive buffer of every connection, bigger responses are received into their pooled buffer directly
+constexpr size_t ANTCP_CLIENT_RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+// requests a connection keeps in flight by default before SendAsync() waits for a response
+constexpr size_t ANTCP_CLIENT_DEFAULT_MAX_IN_FLIGHT = 1024;
+
+/// <summary>
+/// Response of the server. Small responses are stored inline, bigger ones in a buffer of the
+/// buffer pool of their client, which goes back to the pool when the response is destroyed.
+/// </summary>
+class AnTcpClientResponse
+{
+    friend class AnTcpClient;
+
+private:
+    std::shared_ptr<AnTcpBufferPool> Pool;
+    AnTcpPooledBuffer Buffer;
+    size_t Size;
+    AnTcpMessageType Type;
+    bool Valid;
+    alignas(8) char Inline[ANTCP_CLIENT_INLINE_RESPONSE_SIZE];
+
+public:
+    AnTcpClientResponse() noexcept
+        : Pool(),
+        Buffer(),
+        Size(0),
+        Type(0),
+        Valid(false),
+        Inline()
+    {}
+
+    ~AnTcpClientResponse()
+    {
+        Reset();
+    }
+
+    AnTcpClientResponse(AnTcpClientResponse&& other) noexcept
+        : AnTcpClientResponse()
+    {
+        *this = std::move(other);
+    }
+
+    AnTcpClientResponse& operator=(AnTcpClientResponse&& other) noexcept;
+
+    AnTcpClientResponse(const AnTcpClientResponse&) = delete;
+    AnTcpClientResponse& operator=(const AnTcpClientResponse&) = delete;
+
+    /// <summary>
+    /// Whether the response arrived, false if the connection failed before.
+    /// </summary>
+    inline bool IsValid() const noexcept { return Valid; }
+
+    inline AnTcpMessageType GetType() const noexcept { return Type; }
+
+    /// <summary>
+    /// Whether the server was over a limit and did not run the request, the data is the
+    /// message type of the request followed by the reason, see AnTcpBusyReason.
+    /// </summary>
+    inline bool IsBusy() const noexcept { return Type == ANTCP_MESSAGE_BUSY; }
+
+    /// <summary>
+    /// Whether the request waited on the server longer than its deadline and was dropped.
+    /// </summary>
+    inline bool IsTimeout() const noexcept { return Type == ANTCP_MESSAGE_TIMEOUT; }
+
+    /// <summary>
+    /// Get the payload, it stays valid while the response exists.
+    /// </summary>
+    inline std::span<const char> GetData() const noexcept
+    {
+        return std::span<const char>(Buffer.Data ? Buffer.Data : Inline, Size);
+    }
+
+    /// <summary>
+    /// Read the payload as a trivially copyable type, missing bytes are zero.
+    /// </summary>
+    template <typename T>
+    inline T As() const noexcept
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be read from a response");
+
+        T value{};
+        memcpy(&value, GetData().data(), std::min(sizeof(T), Size));
+        return value;
+    }
+
+private:
+    /// <summary>
+    /// Make room for a payload of size bytes, taken from the pool if it does not fit inline.
+    /// </summary>
+    /// <returns>Where to write the payload, null if the pool could not provide a buffer.</returns>
+    char* Allocate(const std::shared_ptr<AnTcpBufferPool>& pool, AnTcpMessageType type, size_t size) noexcept;
+
+    void Reset() noexcept;
+};
+
+/// <summary>
+/// A request that was sent, shared by the client and the future that waits for it.
+/// </summary>
+struct AnTcpClientRequest
+{
+    AnTcpRequestId Id = 0;
+
+    // guarded by the mutex of the client
+    bool Done = false;
+    AnTcpClientResponse Response;
+    std::function<void(AnTcpClientResponse&)> Callback;
+};
+
+class AnTcpClient;
+
+/// <summary>
+/// Response of a request sent with AnTcpClient::SendAsync(). Nobody reads the connection in the
+/// background: the thread that waits for a response reads all responses that arrive meanwhile,
+/// other waiting threads sleep until it got theirs too.
+/// </summary>
+class AnTcpClientFuture
+{
+private:
+    AnTcpClient* Client;
+    std::shared_ptr<AnTcpClientRequest> Request;
+
+public:
+    AnTcpClientFuture() noexcept
+        : Client(nullptr),
+        Request()
+    {}
+
+    AnTcpClientFuture(AnTcpClient* client, std::shared_ptr<AnTcpClientRequest> request) noexcept
+        : Client(client),
+        Request(std::move(request))
+    {}
+
+    /// <summary>
+    /// Whether the future belongs to a request, the response can only be taken once.
+    /// </summary>
+    inline bool IsValid() const noexcept { return Request != nullptr; }
+
+    /// <summary>
+    /// Whether the response arrived or the connection failed, does not read the connection.
+    /// </summary>
+    bool IsReady() const noexcept;
+
+    /// <summary>
+    /// Wait for the response.
+    /// </summary>
+    /// <returns>The response, invalid if the connection failed.</returns>
+    AnTcpClientResponse Get() noexcept;
+
+    /// <summary>
+    /// Wait for the response until the timeout elapsed.
+    /// </summary>
+    /// <returns>True if the response arrived or the connection failed, false on timeout.</returns>
+    bool WaitFor(std::chrono::milliseconds timeout) noexcept;
+};
+
+/// <summary>
+/// Connection to an AnTCP server. Multiple threads may send on it at once and every request can have
+/// many others in flight, the responses are matched by their request id. Responses are read by the
+/// threads that wait for them, there is no receive thread.
+/// </summary>
+class AnTcpClient
+{
+    friend class AnTcpClientFuture;
+
+private:
+    SOCKET Socket;
+    std::shared_ptr<AnTcpBufferPool> Pool;
+
+    // framing the server agreed to, see ANTCP_FRAME_VERSION_2
+    int FrameVersion;
+    size_t MaxInFlight;
+
+    // sending is serialized, so requests are registered in the order they are sent
+    std::mutex SendMutex;
+    AnTcpRequestId NextRequestId;
+
+    // guards the requests in flight and who reads
+    std::mutex Mutex;
+    std::condition_variable ReadDone;
+    std::deque<std::shared_ptr<AnTcpClientRequest>> InFlight;
+    std::atomic<size_t> InFlightCount;
+    bool Reading;
+    std::thread::id Reader;
+    std::atomic<bool> Failed;
+
+    // only used by the thread that reads
+    std::unique_ptr<char[]> Input;
+    size_t InputEnd;
+
+    // response that did not fit into the input buffer, the rest is received into it directly
+    AnTcpClientResponse Partial;
+    AnTcpRequestId PartialId;
+    size_t PartialReceived;
+    bool HasPartial;
+
+public:
+    /// <summary>
+    /// Called on the thread that reads with the topic and payload of every published frame.
+    /// </summary>
+    std::function<void(AnTcpTopic, std::span<const char>)> OnPublished;
+
+    /// <param name="pool">Pool for big responses, shared by the connections of an AnTcpClientPool, null creates one.</param>
+    explicit AnTcpClient(std::shared_ptr<AnTcpBufferPool> pool = nullptr) noexcept
+        : Socket(INVALID_SOCKET),
+        Pool(pool ? std::move(pool) : std::make_shared<AnTcpBufferPool>()),
+        FrameVersion(ANTCP_FRAME_VERSION_1),
+        MaxInFlight(ANTCP_CLIENT_DEFAULT_MAX_IN_FLIGHT),
+        SendMutex(),
+        NextRequestId(1),
+        Mutex(),
+        ReadDone(),
+        InFlight(),
+        InFlightCount(0),
+        Reading(false),
+        Reader(),
+        Failed(false),
+        Input(new char[ANTCP_CLIENT_RECEIVE_BUFFER_SIZE]),
+        InputEnd(0),
+        Partial(),
+        PartialId(0),
+        PartialReceived(0),
+        HasPartial(false),
+        OnPublished(nullptr)
+    {}
+
+    ~AnTcpClient()
+    {
+        Disconnect();
+    }
+
+    AnTcpClient(const AnTcpClient&) = delete;
+    AnTcpClient& operator=(const AnTcpClient&) = delete;
+
+    /// <summary>
+    /// Connect to a server and negotiate the framing, on windows WSAStartup() has to be called before.
+    /// </summary>
+    /// <param name="frameVersion">Framing to ask for, responses are matched in order with ANTCP_FRAME_VERSION_1,
+    /// so requests in flight need a server that answers them in order then.</param>
+    /// <returns>True if connected, false if not.</returns>
+    bool Connect(const std::string& ip, const std::string& port, int frameVersion = ANTCP_FRAME_VERSION_2) noexcept;
+
+    /// <summary>
+    /// Close the connection, requests in flight get an invalid response. No other thread may use the client meanwhile.
+    /// </summary>
+    void Disconnect() noexcept;
+
+    /// <summary>
+    /// Whether the connection is open and did not fail.
+    /// </summary>
+    inline bool IsConnected() const noexcept { return Socket != INVALID_SOCKET && !Failed.load(std::memory_order_relaxed); }
+
+    inline int GetFrameVersion() const noexcept { return FrameVersion; }
+
+    /// <summary>
+    /// Get the number of requests that wait for their response.
+    /// </summary>
+    inline size_t GetInFlight() const noexcept { return InFlightCount.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Set how many requests may be in flight, SendAsync() reads responses until there is room again. Without
+    /// a limit a client that sends much more than it reads can block, once the server waits for it to read.
+    /// </summary>
+    /// <param name="maxInFlight">Limit, 0 disables it.</param>
+    inline void SetMaxInFlight(size_t maxInFlight) noexcept { MaxInFlight = maxInFlight; }
+
+    /// <summary>
+    /// Send a request and wait for its response.
+    /// </summary>
+    /// <returns>The response, invalid if the connection failed.</returns>
+    inline AnTcpClientResponse Send(AnTcpMessageType type, const void* data, size_t size) noexcept
+    {
+        return SendAsync(type, data, size).Get();
+    }
+
+    template <typename T>
+    inline AnTcpClientResponse Send(AnTcpMessageType type, const T& data) noexcept
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be sent as they are");
+        return Send(type, &data, sizeof(T));
+    }
+
+    /// <summary>
+    /// Send a request without waiting for its response.
+    /// </summary>
+    /// <returns>Future of the response.</returns>
+    AnTcpClientFuture SendAsync(AnTcpMessageType type, const void* data, size_t size) noexcept;
+
+    template <typename T>
+    inline AnTcpClientFuture SendAsync(AnTcpMessageType type, const T& data) noexcept
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be sent as they are");
+        return SendAsync(type, &data, sizeof(T));
+    }
+
+    /// <summary>
+    /// Send a request and call a function with its response. The callback runs on the thread that
+    /// reads the response, inside Poll(), Wait() or while another request waits, it must not wait
+    /// for responses itself. It is called exactly once, with an invalid response if the connection failed.
+    /// </summary>
+    /// <returns>True if the request was sent, false if not.</returns>
+    bool SendAsync(AnTcpMessageType type, const void* data, size_t size, std::function<void(AnTcpClientResponse&)> callback) noexcept;
+
+    /// <summary>
+    /// Read the responses that arrive within the timeout, which runs their callbacks.
+    /// </summary>
+    /// <returns>True if the connection is alive, false if not.</returns>
+    bool Poll(std::chrono::milliseconds timeout) noexcept;
+
+    /// <summary>
+    /// Read responses until every request in flight got one.
+    /// </summary>
+    /// <returns>True if the connection is alive, false if not.</returns>
+    bool Wait() noexcept;
+
+    /// <summary>
+    /// Subscribe to a topic, published frames are handed to OnPublished.
+    /// </summary>
+    /// <returns>True if subscribed, false if already subscribed, over the topic limit or the connection failed.</returns>
+    inline bool Subscribe(AnTcpTopic topic) noexcept
+    {
+        return Send(ANTCP_MESSAGE_SUBSCRIBE, topic).As<bool>();
+    }
+
+    /// <summary>
+    /// Unsubscribe from a topic, frames that were already sent may still arrive.
+    /// </summary>
+    /// <returns>True if unsubscribed, false if not subscribed or the connection failed.</returns>
+    inline bool Unsubscribe(AnTcpTopic topic) noexcept
+    {
+        return Send(ANTCP_MESSAGE_UNSUBSCRIBE, topic).As<bool>();
+    }
+
+private:
+    /// <summary>
+    /// Register a request and send it.
+    /// </summary>
+    /// <returns>True if it was sent, false if the connection failed, the request is done then.</returns>
+    bool Queue(const std::shared_ptr<AnTcpClientRequest>& request, AnTcpMessageType type, const void* data, size_t size) noexcept;
+
+    /// <summary>
+    /// Read responses until done returns true or the deadline passed. Only one thread reads at a
+    /// time, the others sleep until it finished a read. done is called with the mutex locked.
+    /// </summary>
+    /// <returns>What done returned last.</returns>
+    bool ReadUntil(const std::function<bool()>& done, std::chrono::steady_clock::time_point deadline) noexcept;
+
+    /// <summary>
+    /// Read once from the socket and hand out all complete responses.
+    /// </summary>
+    /// <param name="timeout">How long to wait for data in milliseconds, -1 waits forever.</param>
+    /// <returns>True if the connection is alive, false if not.</returns>
+    bool ReadResponses(int timeout) noexcept;
+
+    /// <summary>
+    /// Complete the request a response belongs to, or hand a published frame to OnPublished.
+    /// </summary>
+    void Dispatch(AnTcpClientResponse&& response, AnTcpRequestId id) noexcept;
+
+    /// <summary>
+    /// Mark the connection as failed and complete every request in flight with an invalid response.
+    /// </summary>
+    void Fail() noexcept;
+};
@@ -0,0 +1,63 @@
+#include "AnTcpClientPool.hpp"
+
+bool AnTcpClientPool::Connect(const std::string& ip, const std::string& port, size_t count, int frameVersion) noexcept
+{
+    Disconnect();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Clients.push_back(std::make_unique<AnTcpClient>(Pool));
+        Clients.back()->SetMaxInFlight(MaxInFlight);
+
+        if (!Clients.back()->Connect(ip, port, frameVersion))
+        {
+            Disconnect();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void AnTcpClientPool::Disconnect() noexcept
+{
+    // the destructors close the connections
+    Clients.clear();
+}
+
+AnTcpClient& AnTcpClientPool::Get() noexcept
+{
+    const size_t start = NextClient.fetch_add(1, std::memory_order_relaxed);
+    AnTcpClient* best = Clients[start % Clients.size()].get();
+    size_t bestInFlight = SIZE_MAX;
+
+    for (size_t i = 0; i < Clients.size(); ++i)
+    {
+        AnTcpClient* client = Clients[(start + i) % Clients.size()].get();
+        const size_t inFlight = client->GetInFlight();
+
+        if (client->IsConnected() && inFlight < bestInFlight)
+        {
+            best = client;
+            bestInFlight = inFlight;
+
+            // can't get any better
+            if (inFlight == 0)
+            {
+                break;
+            }
+        }
+    }
+
+    return *best;
+}
+
+void AnTcpClientPool::SetMaxInFlight(size_t maxInFlight) noexcept
+{
+    MaxInFlight = maxInFlight;
+
+    for (const std::unique_ptr<AnTcpClient>& client : Clients)
+    {
+        client->SetMaxInFlight(maxInFlight);
+    }
+}
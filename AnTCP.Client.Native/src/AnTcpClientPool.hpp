@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AnTcpClient.hpp"
+
+/// <summary>
+/// Fixed set of connections to one server that share a buffer pool. Every request goes to the
+/// connection with the fewest requests in flight, connections that failed are skipped.
+/// </summary>
+class AnTcpClientPool
+{
+private:
+    std::shared_ptr<AnTcpBufferPool> Pool;
+    std::vector<std::unique_ptr<AnTcpClient>> Clients;
+
+    size_t MaxInFlight;
+
+    // where Get() starts to look, so connections with the same load take turns
+    std::atomic<size_t> NextClient;
+
+public:
+    AnTcpClientPool() noexcept
+        : Pool(std::make_shared<AnTcpBufferPool>()),
+        Clients(),
+        MaxInFlight(ANTCP_CLIENT_DEFAULT_MAX_IN_FLIGHT),
+        NextClient(0)
+    {}
+
+    AnTcpClientPool(const AnTcpClientPool&) = delete;
+    AnTcpClientPool& operator=(const AnTcpClientPool&) = delete;
+
+    /// <summary>
+    /// Open the connections, see AnTcpClient::Connect().
+    /// </summary>
+    /// <returns>True if every connection was opened, false if not, none are open then.</returns>
+    bool Connect(const std::string& ip, const std::string& port, size_t count, int frameVersion = ANTCP_FRAME_VERSION_2) noexcept;
+
+    /// <summary>
+    /// Close all connections, no other thread may use the pool meanwhile.
+    /// </summary>
+    void Disconnect() noexcept;
+
+    inline size_t GetSize() const noexcept { return Clients.size(); }
+
+    /// <summary>
+    /// Get the connection with the fewest requests in flight, the pool has to be connected.
+    /// </summary>
+    AnTcpClient& Get() noexcept;
+
+    /// <summary>
+    /// Set the limit of requests in flight of every connection, connected now or later, see AnTcpClient::SetMaxInFlight().
+    /// </summary>
+    void SetMaxInFlight(size_t maxInFlight) noexcept;
+
+    inline AnTcpClientResponse Send(AnTcpMessageType type, const void* data, size_t size) noexcept
+    {
+        return Get().Send(type, data, size);
+    }
+
+    template <typename T>
+    inline AnTcpClientResponse Send(AnTcpMessageType type, const T& data) noexcept
+    {
+        return Get().Send(type, data);
+    }
+
+    inline AnTcpClientFuture SendAsync(AnTcpMessageType type, const void* data, size_t size) noexcept
+    {
+        return Get().SendAsync(type, data, size);
+    }
+
+    template <typename T>
+    inline AnTcpClientFuture SendAsync(AnTcpMessageType type, const T& data) noexcept
+    {
+        return Get().SendAsync(type, data);
+    }
+
+    inline bool SendAsync(AnTcpMessageType type, const void* data, size_t size, std::function<void(AnTcpClientResponse&)> callback) noexcept
+    {
+        return Get().SendAsync(type, data, size, std::move(callback));
+    }
+};
@@ -22,7 +22,8 @@ namespace AnTCP.Client.Sample
 
             while (true)
             {
-                Console.ReadKey();
+                // b sends one request of every type as batch, any other key a single request
+                ConsoleKeyInfo key = Console.ReadKey();
 
                 if (!client.IsConnected)
                 {
@@ -44,28 +45,35 @@ namespace AnTCP.Client.Sample
 
                     Console.WriteLine($"\n>> Sending: {data.Item1}, {data.Item2}");
 
+                    if (key.Key == ConsoleKey.B)
+                    {
+                        AnTcpBatch batch = new();
+
+                        foreach (MessageType type in Enum.GetValues<MessageType>())
+                        {
+                            batch.Add((byte)type, data);
+                        }
+
+                        Stopwatch batchSw = Stopwatch.StartNew();
+                        AnTcpBatchResponse responses = client.SendBatch(batch);
+                        batchSw.Stop();
+
+                        Console.WriteLine($">> Batch Response ({batchSw.Elapsed}): {responses.Count} responses");
+
+                        foreach (AnTcpResponse batchResponse in responses)
+                        {
+                            PrintResponse(batchResponse);
+                        }
+
+                        continue;
+                    }
+
                     Stopwatch sw = Stopwatch.StartNew();
                     AnTcpResponse response = client.Send((byte)new Random().Next(0, 4), data);
                     sw.Stop();
 
                     Console.WriteLine($">> Response ({sw.Elapsed}): {response.Length} bytes | Type: {(MessageType)response.Type}");
-
-                    switch ((MessageType)response.Type)
-                    {
-                        case MessageType.Add:
-                        case MessageType.Subtract:
-                        case MessageType.Multiply:
-                            Console.WriteLine($">> Data: {response.As<int>()}");
-                            break;
-
-                        case MessageType.MinAvgMax:
-                            float[] array = response.AsArray<float>();
-                            Console.WriteLine($">> Data Array[{array.Length}]: {JsonSerializer.Serialize(array)}");
-                            break;
-
-                        default:
-                            break;
-                    }
+                    PrintResponse(response);
                 }
                 catch
                 {
@@ -75,5 +83,25 @@ namespace AnTCP.Client.Sample
             }
 
         }
+
+        private static void PrintResponse(AnTcpResponse response)
+        {
+            switch ((MessageType)response.Type)
+            {
+                case MessageType.Add:
+                case MessageType.Subtract:
+                case MessageType.Multiply:
+                    Console.WriteLine($">> Data: {response.As<int>()}");
+                    break;
+
+                case MessageType.MinAvgMax:
+                    float[] array = response.AsArray<float>();
+                    Console.WriteLine($">> Data Array[{array.Length}]: {JsonSerializer.Serialize(array)}");
+                    break;
+
+                default:
+                    break;
+            }
+        }
     }
 }
\ No newline at end of file
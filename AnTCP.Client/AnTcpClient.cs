@@ -8,6 +8,44 @@ namespace AnTCP.Client
 {
     public unsafe class AnTcpClient(string ip, int port)
     {
+        /// <summary>
+        /// Reserved message type of batches, see SendBatch().
+        /// </summary>
+        public const byte BatchMessageType = 0xFD;
+
+        /// <summary>
+        /// Reserved message type the server answers with instead of running a request
+        /// that exceeded one of its limits, see AnTcpResponse.IsBusy.
+        /// </summary>
+        public const byte BusyMessageType = 0xFB;
+
+        /// <summary>
+        /// Reserved message type the server answers with instead of running a request
+        /// that waited longer than its deadline, see AnTcpResponse.IsTimeout.
+        /// </summary>
+        public const byte TimeoutMessageType = 0xFA;
+
+        /// <summary>
+        /// Reserved message type to subscribe to a topic, see Subscribe().
+        /// </summary>
+        public const byte SubscribeMessageType = 0xF9;
+
+        /// <summary>
+        /// Reserved message type to unsubscribe from a topic, see Unsubscribe().
+        /// </summary>
+        public const byte UnsubscribeMessageType = 0xF8;
+
+        /// <summary>
+        /// Reserved message type of the frames the server pushes to the subscribers of a topic.
+        /// </summary>
+        public const byte PublishMessageType = 0xF7;
+
+        /// <summary>
+        /// Called with the topic and data of every published frame that arrives while
+        /// waiting for a response, use ReceivePublished() to wait for them otherwise.
+        /// </summary>
+        public event Action<uint, byte[]> OnPublished;
+
         public string Ip { get; private set; } = ip;
 
         public bool IsConnected => Client != null && Client.Connected;
@@ -49,12 +87,12 @@ namespace AnTCP.Client
         public AnTcpResponse Send<T>(byte type, T data) where T : unmanaged
         {
             int size = sizeof(T);
-            return SendData
+            return new AnTcpResponse(SendData
             (
                 BitConverter.GetBytes(size + 1).AsSpan(),
                 new ReadOnlySpan<byte>(&type, 1),
                 new ReadOnlySpan<byte>(&data, size)
-            );
+            ));
         }
 
         /// <summary>
@@ -65,21 +103,89 @@ namespace AnTCP.Client
         /// <returns>Server response</returns>
         public AnTcpResponse SendBytes(byte type, ReadOnlySpan<byte> data)
         {
-            return SendData
+            return new AnTcpResponse(SendData
             (
                 BitConverter.GetBytes(data.Length + 1).AsSpan(), 
                 new Span<byte>(&type, 1), 
                 data
+            ));
+        }
+
+        /// <summary>
+        /// Send all requests of a batch with a single packet, the server
+        /// answers them with a single packet too.
+        /// </summary>
+        /// <param name="batch">Requests to send</param>
+        /// <returns>Server responses, in the order of the requests</returns>
+        public AnTcpBatchResponse SendBatch(AnTcpBatch batch)
+        {
+            byte type = BatchMessageType;
+            byte[] response = SendData
+            (
+                BitConverter.GetBytes(batch.Data.Length + 1).AsSpan(),
+                new ReadOnlySpan<byte>(&type, 1),
+                batch.Data
             );
+
+            // skip the type of the batch response
+            return new AnTcpBatchResponse(response.AsMemory(1));
+        }
+
+        /// <summary>
+        /// Subscribe to a topic, the server pushes everything published to it from now on.
+        /// </summary>
+        /// <param name="topic">Topic to subscribe to</param>
+        /// <returns>True if subscribed, false if already subscribed or over the topic limit</returns>
+        public bool Subscribe(uint topic)
+        {
+            return Send(SubscribeMessageType, topic).As<bool>();
+        }
+
+        /// <summary>
+        /// Unsubscribe from a topic, frames that were already sent may still arrive.
+        /// </summary>
+        /// <param name="topic">Topic to unsubscribe from</param>
+        /// <returns>True if unsubscribed, false if not subscribed</returns>
+        public bool Unsubscribe(uint topic)
+        {
+            return Send(UnsubscribeMessageType, topic).As<bool>();
+        }
+
+        /// <summary>
+        /// Wait for the next published frame, for clients that only listen.
+        /// </summary>
+        /// <returns>Topic and data of the frame</returns>
+        public (uint Topic, byte[] Data) ReceivePublished()
+        {
+            byte[] frame = Reader.ReadBytes(Reader.ReadInt32());
+
+            if (frame.Length < 5 || frame[0] != PublishMessageType)
+            {
+                throw new InvalidDataException("Expected a published frame");
+            }
+
+            return (BitConverter.ToUInt32(frame, 1), frame[5..]);
         }
 
         [MethodImpl(MethodImplOptions.AggressiveInlining)]
-        private AnTcpResponse SendData(ReadOnlySpan<byte> size, ReadOnlySpan<byte> type, ReadOnlySpan<byte> data)
+        private byte[] SendData(ReadOnlySpan<byte> size, ReadOnlySpan<byte> type, ReadOnlySpan<byte> data)
         {
             Stream.Write(size);
             Stream.Write(type);
             Stream.Write(data);
-            return new AnTcpResponse(Reader.ReadBytes(Reader.ReadInt32()));
+
+            while (true)
+            {
+                byte[] frame = Reader.ReadBytes(Reader.ReadInt32());
+
+                // published frames may arrive in front of the response
+                if (frame.Length < 5 || frame[0] != PublishMessageType)
+                {
+                    return frame;
+                }
+
+                OnPublished?.Invoke(BitConverter.ToUInt32(frame, 1), frame[5..]);
+            }
         }
     }
 }
\ No newline at end of file
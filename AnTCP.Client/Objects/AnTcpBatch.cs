@@ -0,0 +1,58 @@
+﻿using System;
+using System.Buffers;
+
+namespace AnTCP.Client.Objects
+{
+    /// <summary>
+    /// Collects many requests that are sent to the server with a single packet, see AnTcpClient.SendBatch().
+    /// </summary>
+    public unsafe class AnTcpBatch
+    {
+        /// <summary>
+        /// Number of requests in the batch.
+        /// </summary>
+        public int Count { get; private set; }
+
+        /// <summary>
+        /// Framed requests: size | type | data
+        /// </summary>
+        public ReadOnlySpan<byte> Data => Buffer.WrittenSpan;
+
+        private ArrayBufferWriter<byte> Buffer { get; } = new();
+
+        /// <summary>
+        /// Add a request to the batch, data can be any unmanaged type.
+        /// </summary>
+        /// <typeparam name="T">Unmanaged type of the data</typeparam>
+        /// <param name="type">Message type</param>
+        /// <param name="data">Data to send</param>
+        public void Add<T>(byte type, T data) where T : unmanaged
+        {
+            AddBytes(type, new ReadOnlySpan<byte>(&data, sizeof(T)));
+        }
+
+        /// <summary>
+        /// Add a request with a byte array to the batch.
+        /// </summary>
+        /// <param name="type">Message type</param>
+        /// <param name="data">Data to send</param>
+        public void AddBytes(byte type, ReadOnlySpan<byte> data)
+        {
+            Span<byte> frame = Buffer.GetSpan(data.Length + 5);
+            BitConverter.TryWriteBytes(frame, data.Length + 1);
+            frame[4] = type;
+            data.CopyTo(frame[5..]);
+            Buffer.Advance(data.Length + 5);
+            Count++;
+        }
+
+        /// <summary>
+        /// Remove all requests, the batch can be reused afterwards.
+        /// </summary>
+        public void Clear()
+        {
+            Buffer.ResetWrittenCount();
+            Count = 0;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+﻿using System;
+
+namespace AnTCP.Client.Objects
+{
+    public readonly ref struct AnTcpBatchResponse(Memory<byte> memory)
+    {
+        /// <summary>
+        /// Framed responses of all requests of the batch: size | type | data
+        /// </summary>
+        public Memory<byte> Data { get; } = memory;
+
+        /// <summary>
+        /// Number of responses, callbacks may send none or more than one per request.
+        /// </summary>
+        public int Count
+        {
+            get
+            {
+                int count = 0;
+
+                foreach (AnTcpResponse _ in this)
+                {
+                    count++;
+                }
+
+                return count;
+            }
+        }
+
+        /// <summary>
+        /// Iterate over the responses in the order of the requests.
+        /// </summary>
+        public Enumerator GetEnumerator() => new(Data);
+
+        public ref struct Enumerator(Memory<byte> memory)
+        {
+            private Memory<byte> Remaining = memory;
+
+            public AnTcpResponse Current { get; private set; }
+
+            public bool MoveNext()
+            {
+                if (Remaining.Length < 5)
+                {
+                    return false;
+                }
+
+                int size = BitConverter.ToInt32(Remaining.Span);
+                Current = new AnTcpResponse(Remaining.Slice(4, size));
+                Remaining = Remaining[(4 + size)..];
+                return true;
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -20,6 +20,18 @@ namespace AnTCP.Client.Objects
         /// </summary>
         public byte Type { get; } = memory.Span[0];
 
+        /// <summary>
+        /// Whether the server was over a limit and did not run the request, try again later.
+        /// Data is the message type of the request followed by the reason.
+        /// </summary>
+        public bool IsBusy => Type == AnTcpClient.BusyMessageType;
+
+        /// <summary>
+        /// Whether the request waited on the server longer than its deadline and was dropped.
+        /// Data is the message type of the request.
+        /// </summary>
+        public bool IsTimeout => Type == AnTcpClient.TimeoutMessageType;
+
         /// <summary>
         /// Retrieve the data as any unmanaged type or struct.
         /// </summary>
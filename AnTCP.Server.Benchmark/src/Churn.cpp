@@ -0,0 +1,18 @@
+#include "Main.hpp"
+
+
+bool Reconnect(Connection& connection, const BenchmarkOptions& options) noexcept
+{
+    // reset instead of a graceful close, thousands of closed sockets per second would use up the local ports in TIME_WAIT
+    const linger lingerOption{ 1, 0 };
+    setsockopt(connection.Socket, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&lingerOption), sizeof(lingerOption));
+    closesocket(connection.Socket);
+
+    connection.Socket = Connect(options);
+    connection.InputEnd = 0;
+    connection.Output.clear();
+    connection.OutputStart = 0;
+    connection.Used = false;
+
+    return connection.Socket != INVALID_SOCKET;
+}
@@ -0,0 +1,221 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+bool RunClientComparison(const BenchmarkOptions& options)
+{
+    const std::vector<MessageType> mix = BuildMix(options);
+    const std::vector<char> echoPayload(options.EchoSize, 'A');
+    const unsigned int poolThreads = options.Threads > 0 ? options.Threads : options.Connections;
+
+    constexpr size_t MODE_COUNT = 4;
+    constexpr const char* MODE_NAMES[MODE_COUNT]{ "sequential", "futures", "callbacks", "pool" };
+    std::array<ClientResult, MODE_COUNT> results{};
+    bool connected = true;
+
+    std::cout << ">> native client, " << options.Warmup << " s warmup and " << options.Duration << " s measured per mode, futures and callbacks with depth "
+        << options.Depth << ", pool of " << options.Connections << " connections on " << poolThreads << " threads" << std::endl;
+
+    const auto schedule = [&options]()
+    {
+        const auto measureStart = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Warmup));
+        return std::make_pair(measureStart, measureStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Duration)));
+    };
+
+    const auto send = [](AnTcpClient& client, const BenchmarkRequest& request)
+    {
+        return client.Send(static_cast<AnTcpMessageType>(request.Pending.Type), request.GetData(), request.Size);
+    };
+
+    for (size_t mode = 0; mode < 3 && connected; ++mode)
+    {
+        AnTcpClient client;
+
+        if (!client.Connect(options.Ip, options.Port))
+        {
+            connected = false;
+            break;
+        }
+
+        std::mt19937 random(static_cast<unsigned int>(mode + 1));
+        ClientResult& result = results[mode];
+        const auto [measureStart, end] = schedule();
+
+        if (mode == 0)
+        {
+            // one request at a time, like a plain request/response client
+            while (client.IsConnected() && Clock::now() < end)
+            {
+                const BenchmarkRequest request = MakeRequest(random, options, mix, echoPayload, Clock::now());
+                RecordClientResponse(options, request.Pending, send(client, request), measureStart, result);
+            }
+        }
+        else if (mode == 1)
+        {
+            std::deque<std::pair<AnTcpClientFuture, PendingRequest>> inFlight;
+
+            while (true)
+            {
+                while (client.IsConnected() && inFlight.size() < options.Depth && Clock::now() < end)
+                {
+                    const BenchmarkRequest request = MakeRequest(random, options, mix, echoPayload, Clock::now());
+                    inFlight.emplace_back(client.SendAsync(static_cast<AnTcpMessageType>(request.Pending.Type), request.GetData(), request.Size), request.Pending);
+                }
+
+                if (inFlight.empty())
+                {
+                    break;
+                }
+
+                RecordClientResponse(options, inFlight.front().second, inFlight.front().first.Get(), measureStart, result);
+                inFlight.pop_front();
+            }
+        }
+        else
+        {
+            // SendAsync() reads responses, and runs their callbacks, while --depth requests are in flight
+            client.SetMaxInFlight(options.Depth);
+
+            while (client.IsConnected() && Clock::now() < end)
+            {
+                const BenchmarkRequest request = MakeRequest(random, options, mix, echoPayload, Clock::now());
+                client.SendAsync(static_cast<AnTcpMessageType>(request.Pending.Type), request.GetData(), request.Size,
+                    [&options, &result, measureStart, pending = request.Pending](AnTcpClientResponse& response)
+                    {
+                        RecordClientResponse(options, pending, response, measureStart, result);
+                    });
+            }
+
+            client.Wait();
+        }
+
+        connected = client.IsConnected();
+    }
+
+    if (connected)
+    {
+        AnTcpClientPool pool;
+        connected = pool.Connect(options.Ip, options.Port, options.Connections);
+
+        if (connected)
+        {
+            const auto [measureStart, end] = schedule();
+            std::vector<ClientResult> threadResults(poolThreads);
+            std::vector<std::thread> threads;
+
+            for (unsigned int i = 0; i < poolThreads; ++i)
+            {
+                threads.emplace_back([&, i]()
+                {
+                    std::mt19937 random(i + 1);
+
+                    // threads that share a connection take turns reading it
+                    while (Clock::now() < end)
+                    {
+                        const BenchmarkRequest request = MakeRequest(random, options, mix, echoPayload, Clock::now());
+                        AnTcpClient& client = pool.Get();
+
+                        if (!client.IsConnected())
+                        {
+                            threadResults[i].Errors++;
+                            break;
+                        }
+
+                        RecordClientResponse(options, request.Pending, send(client, request), measureStart, threadResults[i]);
+                    }
+                });
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            for (const ClientResult& threadResult : threadResults)
+            {
+                results[3].Requests += threadResult.Requests;
+                results[3].Errors += threadResult.Errors;
+                results[3].Latency.Merge(threadResult.Latency);
+            }
+        }
+    }
+
+    if (!connected)
+    {
+        std::cout << ">> Failed to connect to " << options.Ip << ":" << options.Port << std::endl;
+        return false;
+    }
+
+    const auto microseconds = [](uint64_t nanoseconds) { return nanoseconds / 1000.0; };
+    const double seconds = options.Duration;
+
+    std::cout << std::endl << std::right << std::setw(12) << "mode" << std::setw(12) << "requests" << std::setw(12) << "req/s" << std::setw(10) << "speedup"
+        << std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us" << std::setw(10) << "p99.9 us" << std::setw(10) << "max us"
+        << std::setw(8) << "errors" << std::endl;
+
+    for (size_t mode = 0; mode < MODE_COUNT; ++mode)
+    {
+        const ClientResult& result = results[mode];
+
+        // relative to sequential requests
+        std::cout << std::fixed << std::setw(12) << MODE_NAMES[mode]
+            << std::setw(12) << result.Requests
+            << std::setw(12) << std::setprecision(0) << result.Requests / seconds
+            << std::setw(10) << std::setprecision(2) << (results[0].Requests > 0 ? static_cast<double>(result.Requests) / results[0].Requests : 0.0)
+            << std::setw(10) << std::setprecision(1) << microseconds(result.Latency.GetPercentile(50.0))
+            << std::setw(10) << microseconds(result.Latency.GetPercentile(90.0))
+            << std::setw(10) << microseconds(result.Latency.GetPercentile(99.0))
+            << std::setw(10) << microseconds(result.Latency.GetPercentile(99.9))
+            << std::setw(10) << microseconds(result.Latency.GetMax())
+            << std::setw(8) << result.Errors << std::endl;
+    }
+
+    return std::all_of(results.begin(), results.end(), [](const ClientResult& result) { return result.Errors == 0; });
+}
+
+void RecordClientResponse(const BenchmarkOptions& options, const PendingRequest& request, const AnTcpClientResponse& response, Clock::time_point measureStart, ClientResult& result)
+{
+    if (request.Start < measureStart)
+    {
+        return;
+    }
+
+    const auto now = Clock::now();
+    const size_t size = response.GetData().size();
+
+    // busy and timeout responses, and invalid ones of a failed connection, have another type
+    bool valid = response.IsValid() && response.GetType() == static_cast<AnTcpMessageType>(request.Type);
+
+    switch (request.Type)
+    {
+    case MessageType::ADD:
+    case MessageType::SUBTRACT:
+    case MessageType::MULTIPLY:
+    case MessageType::DELAY:
+        valid = valid && size == sizeof(int) && response.As<int>() == request.Expected;
+        break;
+
+    case MessageType::MIN_AVG_MAX:
+        valid = valid && size == 3 * sizeof(float);
+        break;
+
+    case MessageType::ECHO:
+        valid = valid && size == options.EchoSize;
+        break;
+
+    case MessageType::HASH:
+        valid = valid && size == HASH_DIGEST_SIZE;
+        break;
+
+    case MessageType::POINTS:
+        valid = valid && size == request.Expected * POINT_SIZE;
+        break;
+    }
+
+    result.Requests++;
+    result.Errors += valid ? 0 : 1;
+    result.Latency.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - request.Start).count()));
+}
@@ -0,0 +1,321 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+bool RunFanOut(const BenchmarkOptions& options)
+{
+    const unsigned int threadCount = std::min(options.Subscribers, options.Threads > 0 ? options.Threads : std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::vector<Subscriber>> subscribers(threadCount);
+    std::vector<SOCKET> slowSubscribers;
+    std::vector<char> response;
+    char topic[sizeof(AnTcpTopic)]{};
+    memcpy(topic, &FAN_OUT_TOPIC, sizeof(AnTcpTopic));
+
+    for (unsigned int i = 0; i < options.Subscribers + options.SlowSubscribers; ++i)
+    {
+        const SOCKET connectionSocket = Connect(options);
+
+        if (connectionSocket == INVALID_SOCKET || !Exchange(connectionSocket, ANTCP_MESSAGE_SUBSCRIBE, topic, sizeof(topic), response)
+            || response.size() != 2 || response[0] != ANTCP_MESSAGE_SUBSCRIBE || response[1] != 1)
+        {
+            std::cout << ">> Failed to subscribe to " << (options.UnixPath.empty() ? options.Ip + ":" + options.Port : options.UnixPath) << std::endl;
+            return false;
+        }
+
+        if (i >= options.Subscribers)
+        {
+            // a small receive buffer fills up after a few frames
+            const int bufferSize = 4096;
+            setsockopt(connectionSocket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+            slowSubscribers.push_back(connectionSocket);
+            continue;
+        }
+
+        Subscriber subscriber{};
+        subscriber.Socket = connectionSocket;
+        subscriber.Input.resize(std::max<size_t>(64 * 1024, 2 * (sizeof(AnTcpSizeType) + 1 + sizeof(AnTcpTopic) + options.PublishSize)));
+        subscribers[i % threadCount].push_back(std::move(subscriber));
+    }
+
+    const SOCKET publisher = Connect(options);
+
+    if (publisher == INVALID_SOCKET)
+    {
+        std::cout << ">> Failed to connect the publisher" << std::endl;
+        return false;
+    }
+
+    std::cout << ">> " << options.Subscribers << " subscribers on " << threadCount << " threads, " << options.SlowSubscribers << " slow subscribers, "
+        << (options.Rate > 0.0 ? "fixed rate " + std::to_string(static_cast<long long>(options.Rate)) + " publishes/s" : std::string("closed loop"))
+        << ", " << options.PublishSize << " byte frames, " << options.Warmup << " s warmup, " << options.Duration << " s measured" << std::endl;
+
+    const auto start = Clock::now();
+    const auto measureStart = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Warmup));
+    const auto end = measureStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Duration));
+
+    std::atomic<bool> running = true;
+    std::vector<FanOutResult> results(threadCount);
+    std::vector<std::thread> threads;
+
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back(RunSubscribers, std::ref(subscribers[i]), std::ref(results[i]), measureStart, std::cref(running));
+    }
+
+    // topic | sequence | timestamp | padding, the sample publishes everything after the topic
+    std::vector<char> request(sizeof(AnTcpTopic) + options.PublishSize, 0);
+    memcpy(request.data(), &FAN_OUT_TOPIC, sizeof(AnTcpTopic));
+
+    const auto interval = options.Rate > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.Rate)) : Clock::duration::zero();
+    auto next = start;
+    uint64_t sequence = 0;
+    uint64_t measuredPublishes = 0;
+    bool published = true;
+
+    while (published && next < end)
+    {
+        if (interval > Clock::duration::zero())
+        {
+            std::this_thread::sleep_until(next);
+        }
+
+        // the latency of the fixed rate mode starts at the scheduled time
+        const auto publishTime = interval > Clock::duration::zero() ? next : Clock::now();
+        const int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(publishTime.time_since_epoch()).count();
+        memcpy(request.data() + sizeof(AnTcpTopic), &sequence, sizeof(uint64_t));
+        memcpy(request.data() + sizeof(AnTcpTopic) + sizeof(uint64_t), &timestamp, sizeof(int64_t));
+
+        // answered once the frame is queued for every subscriber
+        published = Exchange(publisher, PUBLISH_MESSAGE_TYPE, request.data(), request.size(), response) && response.size() == 1 + sizeof(int);
+        measuredPublishes += published && publishTime >= measureStart ? 1 : 0;
+        ++sequence;
+        next = interval > Clock::duration::zero() ? next + interval : Clock::now();
+    }
+
+    // frames still on their way are counted, then the subscribers stop
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    running = false;
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    FanOutResult total{};
+
+    for (const FanOutResult& result : results)
+    {
+        total.Frames += result.Frames;
+        total.Bytes += result.Bytes;
+        total.Missing += result.Missing;
+        total.Errors += result.Errors;
+        total.Disconnects += result.Disconnects;
+        total.Latency.Merge(result.Latency);
+    }
+
+    const auto microseconds = [](uint64_t nanoseconds) { return nanoseconds / 1000.0; };
+    const double seconds = options.Duration;
+
+    std::cout << std::endl << std::right << std::setw(12) << "publishes" << std::setw(12) << "pub/s" << std::setw(12) << "frames"
+        << std::setw(12) << "frames/s" << std::setw(10) << "MB/s" << std::setw(10) << "p50 us" << std::setw(10) << "p90 us"
+        << std::setw(10) << "p99 us" << std::setw(10) << "p99.9 us" << std::setw(10) << "max us" << std::setw(10) << "missing" << std::setw(8) << "errors" << std::endl;
+
+    std::cout << std::fixed << std::setw(12) << measuredPublishes
+        << std::setw(12) << std::setprecision(0) << measuredPublishes / seconds
+        << std::setw(12) << total.Frames
+        << std::setw(12) << total.Frames / seconds
+        << std::setw(10) << std::setprecision(1) << total.Bytes / seconds / 1000000.0
+        << std::setw(10) << microseconds(total.Latency.GetPercentile(50.0))
+        << std::setw(10) << microseconds(total.Latency.GetPercentile(90.0))
+        << std::setw(10) << microseconds(total.Latency.GetPercentile(99.0))
+        << std::setw(10) << microseconds(total.Latency.GetPercentile(99.9))
+        << std::setw(10) << microseconds(total.Latency.GetMax())
+        << std::setw(10) << total.Missing
+        << std::setw(8) << total.Errors << std::endl;
+
+    if (total.Disconnects > 0 || !published)
+    {
+        std::cout << ">> " << total.Disconnects << " subscribers were lost" << (published ? "" : ", the publisher failed") << std::endl;
+    }
+
+    for (SOCKET connectionSocket : slowSubscribers)
+    {
+        closesocket(connectionSocket);
+    }
+
+    closesocket(publisher);
+    return published && total.Errors == 0 && total.Disconnects == 0;
+}
+
+void RunSubscribers(std::vector<Subscriber>& subscribers, FanOutResult& result, Clock::time_point measureStart, const std::atomic<bool>& running)
+{
+    std::vector<AnTcpPollFd> pollFds;
+
+    for (const Subscriber& subscriber : subscribers)
+    {
+        pollFds.push_back(AnTcpPollFd{ subscriber.Socket, POLLIN, 0 });
+    }
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        if (PollFor(pollFds.data(), pollFds.size(), std::chrono::milliseconds(10)) <= 0)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < subscribers.size(); ++i)
+        {
+            Subscriber& subscriber = subscribers[i];
+
+            if (subscriber.Socket == INVALID_SOCKET || (pollFds[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+            {
+                continue;
+            }
+
+            const auto receivedBytes = recv(subscriber.Socket, subscriber.Input.data() + subscriber.InputEnd, static_cast<int>(subscriber.Input.size() - subscriber.InputEnd), 0);
+
+            if (receivedBytes == 0 || (receivedBytes == SOCKET_ERROR && !AnTcpWouldBlock()))
+            {
+                result.Disconnects++;
+                closesocket(subscriber.Socket);
+                subscriber.Socket = INVALID_SOCKET;
+
+                // poll ignores negative sockets
+                pollFds[i].fd = INVALID_SOCKET;
+                continue;
+            }
+
+            if (receivedBytes > 0)
+            {
+                subscriber.InputEnd += static_cast<size_t>(receivedBytes);
+
+                if (!ProcessPublished(subscriber, result, measureStart, Clock::now()))
+                {
+                    result.Errors++;
+                    subscriber.InputEnd = 0;
+                }
+            }
+        }
+    }
+
+    for (Subscriber& subscriber : subscribers)
+    {
+        if (subscriber.Socket != INVALID_SOCKET)
+        {
+            closesocket(subscriber.Socket);
+        }
+    }
+}
+
+bool ProcessPublished(Subscriber& subscriber, FanOutResult& result, Clock::time_point measureStart, Clock::time_point now)
+{
+    size_t offset = 0;
+
+    while (subscriber.InputEnd - offset >= sizeof(AnTcpSizeType))
+    {
+        AnTcpSizeType packetSize = 0;
+        memcpy(&packetSize, subscriber.Input.data() + offset, sizeof(AnTcpSizeType));
+
+        if (packetSize < static_cast<AnTcpSizeType>(1 + sizeof(AnTcpTopic) + PUBLISH_HEADER_SIZE) || static_cast<size_t>(packetSize) > subscriber.Input.size() - sizeof(AnTcpSizeType))
+        {
+            return false;
+        }
+
+        if (subscriber.InputEnd - offset < sizeof(AnTcpSizeType) + packetSize)
+        {
+            break;
+        }
+
+        const char* packet = subscriber.Input.data() + offset + sizeof(AnTcpSizeType);
+        AnTcpTopic topic = 0;
+        uint64_t sequence = 0;
+        int64_t timestamp = 0;
+        memcpy(&topic, packet + 1, sizeof(AnTcpTopic));
+        memcpy(&sequence, packet + 1 + sizeof(AnTcpTopic), sizeof(uint64_t));
+        memcpy(&timestamp, packet + 1 + sizeof(AnTcpTopic) + sizeof(uint64_t), sizeof(int64_t));
+
+        if (packet[0] != ANTCP_MESSAGE_PUBLISH || topic != FAN_OUT_TOPIC || sequence < subscriber.NextSequence)
+        {
+            return false;
+        }
+
+        const Clock::time_point publishTime{ std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(timestamp)) };
+
+        if (publishTime >= measureStart)
+        {
+            result.Frames++;
+            result.Bytes += sizeof(AnTcpSizeType) + static_cast<size_t>(packetSize);
+            result.Missing += sequence - subscriber.NextSequence;
+            result.Latency.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - publishTime).count()));
+        }
+
+        subscriber.NextSequence = sequence + 1;
+        offset += sizeof(AnTcpSizeType) + packetSize;
+    }
+
+    // keep the incomplete frame at the start of the buffer
+    memmove(subscriber.Input.data(), subscriber.Input.data() + offset, subscriber.InputEnd - offset);
+    subscriber.InputEnd -= offset;
+    return true;
+}
+
+bool Exchange(SOCKET connectionSocket, char type, const void* data, size_t size, std::vector<char>& response)
+{
+    const AnTcpSizeType packetSize = static_cast<AnTcpSizeType>(size + 1);
+    AnTcpIoVec buffers[]{ AnTcpMakeIoVec(&packetSize, sizeof(AnTcpSizeType)), AnTcpMakeIoVec(&type, 1), AnTcpMakeIoVec(data, size) };
+
+    if (!AnTcpSendVector(connectionSocket, buffers, size > 0 ? 3 : 2))
+    {
+        return false;
+    }
+
+    // size first, then the rest, the socket is non-blocking
+    char sizeBuffer[sizeof(AnTcpSizeType)]{};
+    size_t received = 0;
+    AnTcpSizeType responseSize = -1;
+
+    while (responseSize < 0 || received < static_cast<size_t>(responseSize))
+    {
+        char* target = responseSize < 0 ? sizeBuffer + received : response.data() + received;
+        const size_t wanted = responseSize < 0 ? sizeof(AnTcpSizeType) - received : static_cast<size_t>(responseSize) - received;
+        const auto receivedBytes = recv(connectionSocket, target, static_cast<int>(wanted), 0);
+
+        if (receivedBytes == 0 || (receivedBytes == SOCKET_ERROR && !AnTcpWouldBlock()))
+        {
+            return false;
+        }
+
+        if (receivedBytes == SOCKET_ERROR)
+        {
+            AnTcpPollFd pollFd{ connectionSocket, POLLIN, 0 };
+
+            if (AnTcpPoll(&pollFd, 1, 5000) <= 0)
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        received += static_cast<size_t>(receivedBytes);
+
+        if (responseSize < 0 && received == sizeof(AnTcpSizeType))
+        {
+            memcpy(&responseSize, sizeBuffer, sizeof(AnTcpSizeType));
+
+            if (responseSize <= 0)
+            {
+                return false;
+            }
+
+            response.resize(static_cast<size_t>(responseSize));
+            received = 0;
+        }
+    }
+
+    return true;
+}
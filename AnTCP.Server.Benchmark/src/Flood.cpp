@@ -0,0 +1,56 @@
+#include "Main.hpp"
+
+#include <iomanip>
+#include <iostream>
+
+bool OpenFloodConnections(const BenchmarkOptions& options, BenchmarkOptions& floodOptions, std::vector<Connection>& floodConnections)
+{
+    floodOptions = options;
+    floodOptions.Connections = options.Flood;
+    floodOptions.Depth = options.FloodDepth;
+    floodOptions.Rate = 0.0;
+    floodOptions.BatchSize = 1;
+    floodOptions.Churn = false;
+    floodOptions.SharedMemory = false;
+    floodOptions.Mix = !options.FloodMix.empty() ? options.FloodMix : options.Mix;
+
+    for (unsigned int i = 0; i < options.Flood; ++i)
+    {
+        Connection connection{};
+        connection.Socket = Connect(options);
+
+        if (connection.Socket == INVALID_SOCKET)
+        {
+            return false;
+        }
+
+        connection.Input.resize(64 * 1024);
+        connection.Random.seed(options.Connections + i + 1);
+        floodConnections.push_back(std::move(connection));
+    }
+
+    return true;
+}
+
+void PrintFloodResult(const BenchmarkOptions& options, const ThreadResult& result, double seconds)
+{
+    uint64_t requests = 0;
+    uint64_t busy = 0;
+    uint64_t timedOut = 0;
+
+    for (const TypeResult& typeResult : result.Types)
+    {
+        requests += typeResult.Requests;
+        busy += typeResult.Busy;
+        timedOut += typeResult.TimedOut;
+    }
+
+    std::cout << ">> Flood: " << options.Connections << " connections at depth " << options.Depth << ", " << requests << " answered ("
+        << std::setprecision(0) << requests / seconds << " req/s), " << busy << " busy (" << busy / seconds << " req/s), "
+        << timedOut << " timed out (" << timedOut / seconds << " req/s)" << std::endl;
+
+    if (result.Disconnects > 0)
+    {
+        std::cout << ">> " << result.Disconnects << " flood connections were lost" << std::endl;
+    }
+}
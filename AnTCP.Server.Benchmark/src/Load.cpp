@@ -0,0 +1,771 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+bool RunLoad(const BenchmarkOptions& options)
+{
+    // a thread can only sleep on one response ring
+    const unsigned int threadCount = options.SharedMemory ? options.Connections
+        : std::min(options.Connections, options.Threads > 0 ? options.Threads : std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::vector<Connection>> connections(threadCount);
+
+    for (unsigned int i = 0; i < options.Connections; ++i)
+    {
+        Connection connection{};
+        connection.Socket = Connect(options);
+
+        if (connection.Socket == INVALID_SOCKET)
+        {
+            std::cout << ">> Failed to connect to " << (options.UnixPath.empty() ? options.Ip + ":" + options.Port : options.UnixPath) << std::endl;
+            return false;
+        }
+
+        if (options.SharedMemory && !OpenSharedMemory(connection, options))
+        {
+            std::cout << ">> Failed to move the connection to shared memory, is the server running with --shm?" << std::endl;
+            return false;
+        }
+
+        connection.Input.resize(64 * 1024);
+        connection.Random.seed(i + 1);
+        connections[i % threadCount].push_back(std::move(connection));
+    }
+
+    // the flooders get their own thread, so they can't slow down the measured connections on the client side
+    BenchmarkOptions floodOptions{};
+    std::vector<Connection> floodConnections;
+
+    if (!OpenFloodConnections(options, floodOptions, floodConnections))
+    {
+        std::cout << ">> Failed to connect the flood connections" << std::endl;
+        return false;
+    }
+
+    const auto start = Clock::now();
+    const auto measureStart = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Warmup));
+    const auto end = measureStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Duration));
+
+    if (options.Rate > 0.0)
+    {
+        // spread the first requests over one interval, so the connections don't send in lockstep
+        const double interval = options.Connections / options.Rate;
+
+        for (std::vector<Connection>& threadConnections : connections)
+        {
+            for (Connection& connection : threadConnections)
+            {
+                const double offset = std::uniform_real_distribution<double>(0.0, interval)(connection.Random);
+                connection.NextSend = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(offset));
+            }
+        }
+    }
+
+    std::cout << ">> " << options.Connections << (options.SharedMemory ? " shared memory" : "") << " connections on " << threadCount << " threads, "
+        << (options.Rate > 0.0 ? "fixed rate " + std::to_string(static_cast<long long>(options.Rate)) + " req/s" : "closed loop depth " + std::to_string(options.Depth))
+        << ", " << options.Warmup << " s warmup, " << options.Duration << " s measured" << std::endl;
+
+    std::vector<ThreadResult> results(threadCount);
+    std::vector<std::thread> threads;
+
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back(RunConnections, std::cref(options), std::ref(connections[i]), std::ref(results[i]), measureStart, end);
+    }
+
+    ThreadResult floodResult{};
+
+    if (!floodConnections.empty())
+    {
+        threads.emplace_back(RunConnections, std::cref(floodOptions), std::ref(floodConnections), std::ref(floodResult), measureStart, end);
+    }
+
+    size_t memoryBefore = 0;
+    size_t threadsStart = 0;
+    size_t threadsEnd = 0;
+    double cpuTimeBefore = 0.0;
+
+    if (options.ServerPid > 0)
+    {
+        std::this_thread::sleep_until(measureStart);
+        memoryBefore = GetResidentMemory(options.ServerPid);
+        threadsStart = GetThreadCount(options.ServerPid);
+        cpuTimeBefore = GetCpuTime(options.ServerPid);
+
+        // a little before the end, the connections close right after it and their threads are gone
+        std::this_thread::sleep_until(end - std::min<Clock::duration>(std::chrono::milliseconds(100), (end - measureStart) / 10));
+        threadsEnd = GetThreadCount(options.ServerPid);
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    PrintResults(options, results, options.Duration);
+
+    if (!floodConnections.empty())
+    {
+        PrintFloodResult(floodOptions, floodResult, options.Duration);
+    }
+
+    if (options.ServerPid > 0)
+    {
+        const size_t memoryAfter = GetResidentMemory(options.ServerPid);
+        std::cout << ">> Server memory: " << memoryBefore << " KB before, " << memoryAfter << " KB after the measurement ("
+            << std::showpos << static_cast<long long>(memoryAfter) - static_cast<long long>(memoryBefore) << std::noshowpos << " KB)" << std::endl;
+
+        std::cout << ">> Server threads: " << threadsStart << " at the start, " << threadsEnd << " at the end of the measurement" << std::endl;
+
+        // includes the few requests that finished after the measurement
+        const double cpuTime = GetCpuTime(options.ServerPid) - cpuTimeBefore;
+        uint64_t requests = 0;
+
+        for (const ThreadResult& result : results)
+        {
+            for (const TypeResult& type : result.Types)
+            {
+                requests += type.Requests;
+            }
+        }
+
+        std::cout << ">> Server cpu time: " << std::setprecision(2) << cpuTime << " s, "
+            << std::setprecision(1) << (requests > 0 ? cpuTime * 1000000.0 / requests : 0.0) << " us per request" << std::endl;
+    }
+
+    return std::none_of(results.begin(), results.end(), [](const ThreadResult& result)
+    {
+        return result.Disconnects > 0 || std::any_of(result.Types.begin(), result.Types.end(), [](const TypeResult& type) { return type.Errors > 0; });
+    });
+}
+
+SOCKET Connect(const BenchmarkOptions& options, bool wait)
+{
+    sockaddr_storage address{};
+    socklen_t addressSize = 0;
+
+    if (!options.UnixPath.empty())
+    {
+#if ANTCP_HAS_UNIX_SOCKETS
+        sockaddr_un* unixAddress = reinterpret_cast<sockaddr_un*>(&address);
+        unixAddress->sun_family = AF_UNIX;
+
+        if (options.UnixPath.size() >= sizeof(unixAddress->sun_path))
+        {
+            return INVALID_SOCKET;
+        }
+
+        memcpy(unixAddress->sun_path, options.UnixPath.c_str(), options.UnixPath.size());
+        addressSize = static_cast<socklen_t>(sizeof(sockaddr_un));
+#else
+        return INVALID_SOCKET;
+#endif
+    }
+    else
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+
+        addrinfo* addrResult{ nullptr };
+
+        if (getaddrinfo(options.Ip.c_str(), options.Port.c_str(), &hints, &addrResult) != 0)
+        {
+            return INVALID_SOCKET;
+        }
+
+        memcpy(&address, addrResult->ai_addr, addrResult->ai_addrlen);
+        addressSize = static_cast<socklen_t>(addrResult->ai_addrlen);
+        freeaddrinfo(addrResult);
+    }
+
+    SOCKET connectionSocket = socket(address.ss_family, SOCK_STREAM, 0);
+
+    if (connectionSocket == INVALID_SOCKET)
+    {
+        return INVALID_SOCKET;
+    }
+
+    if (!wait)
+    {
+        AnTcpSetNonBlocking(connectionSocket);
+    }
+
+    if (connect(connectionSocket, reinterpret_cast<const sockaddr*>(&address), addressSize) == SOCKET_ERROR)
+    {
+#ifdef _WIN32
+        const bool pending = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        const bool pending = errno == EINPROGRESS;
+#endif
+
+        if (wait || !pending)
+        {
+            closesocket(connectionSocket);
+            return INVALID_SOCKET;
+        }
+    }
+
+    // measure the server, not nagle's algorithm
+    if (address.ss_family != AF_UNIX)
+    {
+        AnTcpSetNoDelay(connectionSocket, true);
+    }
+
+    AnTcpSetNonBlocking(connectionSocket);
+    return connectionSocket;
+}
+
+std::vector<MessageType> BuildMix(const BenchmarkOptions& options)
+{
+    std::vector<MessageType> mix;
+
+    for (const auto& [type, weight] : options.Mix)
+    {
+        mix.insert(mix.end(), weight, type);
+    }
+
+    return mix;
+}
+
+void QueueRequest(Connection& connection, const BenchmarkOptions& options, const std::vector<MessageType>& mix, const std::vector<char>& echoPayload, Clock::time_point start)
+{
+    if (options.BatchSize <= 1)
+    {
+        AppendRequest(connection, options, mix, echoPayload, start);
+        return;
+    }
+
+    // the size is patched in after the requests were appended
+    const size_t batchStart = connection.Output.size();
+    connection.Output.resize(batchStart + sizeof(AnTcpSizeType));
+    connection.Output.push_back(ANTCP_MESSAGE_BATCH);
+
+    for (unsigned int i = 0; i < options.BatchSize; ++i)
+    {
+        AppendRequest(connection, options, mix, echoPayload, start);
+    }
+
+    connection.InFlight[connection.InFlight.size() - options.BatchSize].Batch = options.BatchSize;
+
+    const AnTcpSizeType packetSize = static_cast<AnTcpSizeType>(connection.Output.size() - batchStart - sizeof(AnTcpSizeType));
+    memcpy(connection.Output.data() + batchStart, &packetSize, sizeof(AnTcpSizeType));
+}
+
+BenchmarkRequest MakeRequest(std::mt19937& random, const BenchmarkOptions& options, const std::vector<MessageType>& mix, const std::vector<char>& echoPayload, Clock::time_point start)
+{
+    const MessageType type = mix[random() % mix.size()];
+    BenchmarkRequest request{ PendingRequest{ type, start, 0 }, { static_cast<int>(random() % 1000), static_cast<int>(random() % 1000) + 1 }, nullptr, 2 * sizeof(int) };
+    int* values = request.Values;
+    int& expected = request.Pending.Expected;
+
+    switch (type)
+    {
+    case MessageType::ADD:
+        expected = values[0] + values[1];
+        break;
+
+    case MessageType::SUBTRACT:
+        expected = values[0] - values[1];
+        break;
+
+    case MessageType::MULTIPLY:
+        expected = values[0] * values[1];
+        break;
+
+    case MessageType::ECHO:
+        request.Payload = echoPayload.data();
+        request.Size = options.EchoSize;
+        break;
+
+    case MessageType::HASH:
+        // hot keys have a zero in the second value, random keys almost never
+        if (std::uniform_real_distribution<double>(0.0, 1.0)(random) < options.Repeat)
+        {
+            values[0] = static_cast<int>(random() % options.Keys);
+            values[1] = 0;
+        }
+        else
+        {
+            values[0] = static_cast<int>(random());
+            values[1] = static_cast<int>(random() | 1);
+        }
+        break;
+
+    case MessageType::POINTS:
+        values[0] = options.Points;
+        request.Size = sizeof(int);
+        expected = options.Points;
+        break;
+
+    case MessageType::DELAY:
+        values[0] = options.Delay;
+        expected = values[1];
+        break;
+
+    default:
+        break;
+    }
+
+    return request;
+}
+
+void AppendRequest(Connection& connection, const BenchmarkOptions& options, const std::vector<MessageType>& mix, const std::vector<char>& echoPayload, Clock::time_point start)
+{
+    const BenchmarkRequest request = MakeRequest(connection.Random, options, mix, echoPayload, start);
+    const AnTcpSizeType packetSize = static_cast<AnTcpSizeType>(request.Size) + 1;
+    const char messageType = static_cast<char>(request.Pending.Type);
+    const char* payload = request.GetData();
+
+    connection.Output.insert(connection.Output.end(), reinterpret_cast<const char*>(&packetSize), reinterpret_cast<const char*>(&packetSize) + sizeof(packetSize));
+    connection.Output.push_back(messageType);
+    connection.Output.insert(connection.Output.end(), payload, payload + request.Size);
+    connection.InFlight.push_back(request.Pending);
+}
+
+bool FlushOutput(Connection& connection)
+{
+    while (connection.OutputStart < connection.Output.size())
+    {
+        const auto sentBytes = send(connection.Socket, connection.Output.data() + connection.OutputStart, static_cast<int>(connection.Output.size() - connection.OutputStart), ANTCP_SEND_FLAGS);
+
+        if (sentBytes == SOCKET_ERROR)
+        {
+            return AnTcpWouldBlock();
+        }
+
+        connection.OutputStart += static_cast<size_t>(sentBytes);
+    }
+
+    connection.Output.clear();
+    connection.OutputStart = 0;
+    return true;
+}
+
+bool ReceiveResponses(Connection& connection, ThreadResult& result, Clock::time_point measureStart)
+{
+    while (true)
+    {
+        const auto receivedBytes = recv(connection.Socket, connection.Input.data() + connection.InputEnd, static_cast<int>(connection.Input.size() - connection.InputEnd), 0);
+
+        if (receivedBytes == 0)
+        {
+            return false;
+        }
+
+        if (receivedBytes < 0)
+        {
+            return AnTcpWouldBlock();
+        }
+
+        connection.InputEnd += static_cast<size_t>(receivedBytes);
+
+        // one timestamp per recv(), every response in it arrived at the same time
+        if (!ProcessResponses(connection, result, measureStart, Clock::now()))
+        {
+            return false;
+        }
+    }
+}
+
+bool ProcessResponses(Connection& connection, ThreadResult& result, Clock::time_point measureStart, Clock::time_point now)
+{
+    size_t inputStart = 0;
+
+    while (connection.InputEnd - inputStart >= sizeof(AnTcpSizeType))
+    {
+        AnTcpSizeType packetSize = 0;
+        memcpy(&packetSize, connection.Input.data() + inputStart, sizeof(packetSize));
+
+        if (packetSize < 1 || connection.InFlight.empty())
+        {
+            return false;
+        }
+
+        const size_t frameSize = sizeof(packetSize) + packetSize;
+
+        if (connection.InputEnd - inputStart < frameSize)
+        {
+            // make room for the whole frame, big echo responses don't fit into the default buffer
+            connection.Input.resize(std::max(connection.Input.size(), frameSize));
+            break;
+        }
+
+        const char* response = connection.Input.data() + inputStart + sizeof(packetSize);
+        inputStart += frameSize;
+
+        if (response[0] == ANTCP_MESSAGE_BUSY && packetSize > 1 && response[1] == static_cast<char>(ANTCP_MESSAGE_BATCH))
+        {
+            // the client was over its rate limit, none of the requests of the batch ran
+            const unsigned int batch = connection.InFlight.front().Batch;
+
+            for (unsigned int i = 0; i < batch && !connection.InFlight.empty(); ++i)
+            {
+                const PendingRequest request = connection.InFlight.front();
+                connection.InFlight.pop_front();
+
+                if (request.Start >= measureStart)
+                {
+                    result.Types[static_cast<size_t>(request.Type)].Busy++;
+                }
+            }
+
+            continue;
+        }
+
+        if (response[0] != ANTCP_MESSAGE_BATCH)
+        {
+            const PendingRequest request = connection.InFlight.front();
+            connection.InFlight.pop_front();
+            RecordResponse(request, response, packetSize, now, measureStart, result);
+            continue;
+        }
+
+        // the responses of the requests of a batch use the same framing
+        for (AnTcpSizeType offset = 1; offset < packetSize;)
+        {
+            AnTcpSizeType subPacketSize = 0;
+            memcpy(&subPacketSize, response + offset, sizeof(subPacketSize));
+
+            if (subPacketSize < 1 || subPacketSize > packetSize - offset - static_cast<AnTcpSizeType>(sizeof(subPacketSize)) || connection.InFlight.empty())
+            {
+                return false;
+            }
+
+            const PendingRequest request = connection.InFlight.front();
+            connection.InFlight.pop_front();
+            RecordResponse(request, response + offset + sizeof(subPacketSize), subPacketSize, now, measureStart, result);
+            offset += sizeof(subPacketSize) + subPacketSize;
+        }
+    }
+
+    // move the incomplete frame to the front
+    connection.InputEnd -= inputStart;
+    memmove(connection.Input.data(), connection.Input.data() + inputStart, connection.InputEnd);
+    return true;
+}
+
+void RecordResponse(const PendingRequest& request, const char* response, AnTcpSizeType packetSize, Clock::time_point now, Clock::time_point measureStart, ThreadResult& result)
+{
+    if (request.Start < measureStart)
+    {
+        return;
+    }
+
+    const size_t frameSize = sizeof(packetSize) + packetSize;
+    TypeResult& typeResult = result.Types[static_cast<size_t>(request.Type)];
+
+    // the server was over a limit and did not run the request
+    if (response[0] == ANTCP_MESSAGE_BUSY)
+    {
+        const bool valid = packetSize == 1 + sizeof(AnTcpBusyResponse) && response[1] == static_cast<char>(request.Type);
+        typeResult.Busy++;
+        typeResult.BytesIn += frameSize;
+        typeResult.Errors += valid ? 0 : 1;
+        return;
+    }
+
+    // the request waited on the server longer than its deadline and was dropped
+    if (response[0] == ANTCP_MESSAGE_TIMEOUT)
+    {
+        const bool valid = packetSize == 1 + sizeof(AnTcpMessageType) && response[1] == static_cast<char>(request.Type);
+        typeResult.TimedOut++;
+        typeResult.BytesIn += frameSize;
+        typeResult.Errors += valid ? 0 : 1;
+        return;
+    }
+
+    typeResult.Requests++;
+    typeResult.BytesIn += frameSize;
+    typeResult.Latency.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - request.Start).count()));
+
+    bool valid = response[0] == static_cast<char>(request.Type);
+
+    switch (request.Type)
+    {
+    case MessageType::ADD:
+    case MessageType::SUBTRACT:
+    case MessageType::MULTIPLY:
+    case MessageType::DELAY:
+    {
+        int value = 0;
+        valid = valid && packetSize == 1 + sizeof(int);
+        memcpy(&value, response + 1, std::min<size_t>(packetSize - 1, sizeof(int)));
+        valid = valid && value == request.Expected;
+        typeResult.BytesOut += sizeof(AnTcpSizeType) + 1 + 2 * sizeof(int);
+        break;
+    }
+
+    case MessageType::MIN_AVG_MAX:
+        valid = valid && packetSize == 1 + 3 * sizeof(float);
+        typeResult.BytesOut += sizeof(AnTcpSizeType) + 1 + 2 * sizeof(int);
+        break;
+
+    case MessageType::ECHO:
+        // the echo response has the size of the request
+        typeResult.BytesOut += frameSize;
+        break;
+
+    case MessageType::HASH:
+        valid = valid && packetSize == 1 + HASH_DIGEST_SIZE;
+        typeResult.BytesOut += sizeof(AnTcpSizeType) + 1 + 2 * sizeof(int);
+        break;
+
+    case MessageType::POINTS:
+        valid = valid && static_cast<size_t>(packetSize) == 1 + request.Expected * POINT_SIZE;
+        typeResult.BytesOut += sizeof(AnTcpSizeType) + 1 + sizeof(int);
+        break;
+    }
+
+    typeResult.Errors += valid ? 0 : 1;
+}
+
+void RunConnections(const BenchmarkOptions& options, std::vector<Connection>& connections, ThreadResult& result, Clock::time_point measureStart, Clock::time_point end)
+{
+    if (options.SharedMemory)
+    {
+        // main() gives every shared memory connection its own thread
+        RunSharedMemoryConnection(options, connections.front(), result, measureStart, end);
+        return;
+    }
+
+    const std::vector<MessageType> mix = BuildMix(options);
+    const std::vector<char> echoPayload(options.EchoSize, 'A');
+    const auto interval = options.Rate > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Connections / options.Rate)) : Clock::duration::zero();
+
+    std::vector<AnTcpPollFd> pollFds;
+    std::vector<Connection*> pollConnections;
+
+    const auto disconnect = [&result](Connection& connection)
+    {
+        closesocket(connection.Socket);
+        connection.Socket = INVALID_SOCKET;
+        connection.InFlight.clear();
+        result.Disconnects++;
+    };
+
+    while (true)
+    {
+        const auto now = Clock::now();
+
+        if (now >= end)
+        {
+            break;
+        }
+
+        auto nextWakeup = std::min(end, now + std::chrono::milliseconds(100));
+        pollFds.clear();
+        pollConnections.clear();
+
+        for (Connection& connection : connections)
+        {
+            if (connection.Socket == INVALID_SOCKET)
+            {
+                continue;
+            }
+
+            if (interval > Clock::duration::zero())
+            {
+                // requests that are late are sent right away but keep their scheduled start time
+                while (connection.NextSend <= now)
+                {
+                    QueueRequest(connection, options, mix, echoPayload, connection.NextSend);
+                    connection.NextSend += interval;
+                }
+
+                nextWakeup = std::min(nextWakeup, connection.NextSend);
+            }
+            else
+            {
+                if (options.Churn && connection.Used && connection.InFlight.empty())
+                {
+                    // the connect is part of the latency of the next request
+                    if (!Reconnect(connection, options))
+                    {
+                        result.Disconnects++;
+                        continue;
+                    }
+
+                    result.Connects += now >= measureStart ? 1 : 0;
+                }
+
+                while (connection.InFlight.size() < options.Depth && !(options.Churn && connection.Used))
+                {
+                    QueueRequest(connection, options, mix, echoPayload, now);
+                    connection.Used = true;
+                }
+            }
+
+            if (!FlushOutput(connection))
+            {
+                disconnect(connection);
+                continue;
+            }
+
+            const short events = POLLIN | (connection.Output.empty() ? 0 : POLLOUT);
+            pollFds.push_back(AnTcpPollFd{ connection.Socket, events, 0 });
+            pollConnections.push_back(&connection);
+        }
+
+        if (pollFds.empty())
+        {
+            break;
+        }
+
+        if (PollFor(pollFds.data(), pollFds.size(), nextWakeup - now) <= 0)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < pollFds.size(); ++i)
+        {
+            Connection& connection = *pollConnections[i];
+
+            if ((pollFds[i].revents & (POLLIN | POLLERR | POLLHUP)) && !ReceiveResponses(connection, result, measureStart))
+            {
+                disconnect(connection);
+            }
+        }
+    }
+
+    for (Connection& connection : connections)
+    {
+        if (connection.Socket != INVALID_SOCKET)
+        {
+            closesocket(connection.Socket);
+        }
+    }
+}
+
+void PrintResults(const BenchmarkOptions& options, const std::vector<ThreadResult>& results, double seconds)
+{
+    TypeResult total{};
+    std::array<TypeResult, MESSAGE_TYPE_COUNT> types{};
+    uint64_t disconnects = 0;
+    uint64_t connects = 0;
+
+    for (const ThreadResult& result : results)
+    {
+        disconnects += result.Disconnects;
+        connects += result.Connects;
+
+        for (size_t i = 0; i < MESSAGE_TYPE_COUNT; ++i)
+        {
+            for (TypeResult* typeResult : { &types[i], &total })
+            {
+                typeResult->Requests += result.Types[i].Requests;
+                typeResult->BytesOut += result.Types[i].BytesOut;
+                typeResult->BytesIn += result.Types[i].BytesIn;
+                typeResult->Errors += result.Types[i].Errors;
+                typeResult->Busy += result.Types[i].Busy;
+                typeResult->TimedOut += result.Types[i].TimedOut;
+                typeResult->Latency.Merge(result.Types[i].Latency);
+            }
+        }
+    }
+
+    std::cout << std::endl << std::left << std::setw(11) << "type" << std::right
+        << std::setw(12) << "requests" << std::setw(12) << "req/s" << std::setw(10) << "MB/s"
+        << std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us"
+        << std::setw(10) << "p99.9 us" << std::setw(10) << "max us" << std::setw(8) << "errors" << std::setw(10) << "busy" << std::setw(10) << "timeout" << std::endl;
+
+    const auto printRow = [seconds](const char* name, const TypeResult& typeResult)
+    {
+        const auto microseconds = [](uint64_t nanoseconds) { return nanoseconds / 1000.0; };
+
+        std::cout << std::left << std::setw(11) << name << std::right << std::fixed
+            << std::setw(12) << typeResult.Requests
+            << std::setw(12) << std::setprecision(0) << typeResult.Requests / seconds
+            << std::setw(10) << std::setprecision(1) << (typeResult.BytesIn + typeResult.BytesOut) / seconds / 1000000.0
+            << std::setw(10) << microseconds(typeResult.Latency.GetPercentile(50.0))
+            << std::setw(10) << microseconds(typeResult.Latency.GetPercentile(90.0))
+            << std::setw(10) << microseconds(typeResult.Latency.GetPercentile(99.0))
+            << std::setw(10) << microseconds(typeResult.Latency.GetPercentile(99.9))
+            << std::setw(10) << microseconds(typeResult.Latency.GetMax())
+            << std::setw(8) << typeResult.Errors
+            << std::setw(10) << typeResult.Busy
+            << std::setw(10) << typeResult.TimedOut << std::endl;
+    };
+
+    for (const auto& [type, weight] : options.Mix)
+    {
+        printRow(MESSAGE_TYPE_NAMES[static_cast<size_t>(type)], types[static_cast<size_t>(type)]);
+    }
+
+    printRow("total", total);
+
+    if (options.Churn || options.Storm > 0)
+    {
+        std::cout << ">> " << connects << " connections opened, " << std::setprecision(0) << connects / seconds << " connections/s" << std::endl;
+    }
+
+    if (disconnects > 0)
+    {
+        std::cout << ">> " << disconnects << " connections were lost" << std::endl;
+    }
+}
+
+size_t GetProcessStatus(int pid, const char* field) noexcept
+{
+#if defined(__linux__)
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    const size_t fieldLength = strlen(field);
+    std::string line;
+
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, fieldLength, field) == 0 && line.size() > fieldLength && line[fieldLength] == ':')
+        {
+            return std::strtoull(line.c_str() + fieldLength + 1, nullptr, 10);
+        }
+    }
+#endif
+
+    return 0;
+}
+
+size_t GetResidentMemory(int pid) noexcept
+{
+    return GetProcessStatus(pid, "VmRSS");
+}
+
+size_t GetThreadCount(int pid) noexcept
+{
+    return GetProcessStatus(pid, "Threads");
+}
+
+double GetCpuTime(int pid) noexcept
+{
+#if defined(__linux__)
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+
+    if (!std::getline(stat, line))
+    {
+        return 0.0;
+    }
+
+    // the name in parentheses may contain spaces, utime and stime are the 12th and 13th field after it
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    unsigned long long ticks = 0;
+
+    for (int i = 1; i <= 13 && fields >> field; ++i)
+    {
+        if (i >= 12)
+        {
+            ticks += std::strtoull(field.c_str(), nullptr, 10);
+        }
+    }
+
+    return static_cast<double>(ticks) / sysconf(_SC_CLK_TCK);
+#else
+    return 0.0;
+#endif
+}
@@ -0,0 +1,400 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options{};
+
+    if (!ParseArguments(argc, argv, options))
+    {
+        std::cout << "Usage: AnTCP.Server.Benchmark [--ip=127.0.0.1] [--port=47110] [--connections=16] [--threads=0]" << std::endl
+            << "                              [--duration=10] [--warmup=1] [--rate=0] [--depth=1] [--echo-size=1024]" << std::endl
+            << "                              [--mix=add:1,subtract:1,multiply:1,minavgmax:1,echo:1,hash:1,points:1,delay:1]" << std::endl
+            << "                              [--repeat=0] [--keys=1000] [--points=341] [--delay=10] [--batch-size=1] [--churn]" << std::endl
+            << "                              [--server-pid=pid] [--shm[=spin-us]] [--unix=path] [--storm=count]" << std::endl
+            << "                              [--flood=connections] [--flood-depth=64] [--flood-mix=hash:1]" << std::endl
+            << "                              [--table[=readers]] [--swap-rate=0]" << std::endl
+            << "                              [--subscribers=count] [--slow-subscribers=0] [--publish-size=64]" << std::endl
+            << "                              [--replay=path] [--speed=1] [--client]" << std::endl
+            << "                              [--ping-pong] [--cores=0,1] [--spin-time=50] [--busy-poll=50]" << std::endl
+            << "                              [--ramp=connections] [--ramp-steps=10] [--receive]" << std::endl
+            << std::endl
+            << "Without --rate every connection keeps --depth requests in flight (closed loop). With --rate" << std::endl
+            << "the requests are sent on a fixed schedule and latency is measured from the scheduled time." << std::endl
+            << "With --churn every connection is closed after one request and a new one is opened." << std::endl
+            << "--repeat is the share of hash requests that use one of --keys hot keys, use it to measure the response cache." << std::endl
+            << "With --batch-size every packet carries that many requests, --depth and --rate count packets then." << std::endl
+            << "With --shm the connections move to shared memory rings (server needs --shm), each one on its own thread." << std::endl
+            << "With --storm that many connections are opened at once, --connections of them connecting at a time, and every" << std::endl
+            << "one sends a single add request. The table shows connect to response latency, --duration is the time limit." << std::endl
+            << "Delay requests are answered by a task after --delay ms, responses come back in the order the tasks finish," << std::endl
+            << "so don't mix them with other types when a connection has more than one request in flight." << std::endl
+            << "--flood opens that many extra connections that send as fast as they can, the table only shows the others." << std::endl
+            << "Requests the server rejected because of its limits are counted as busy, they are not part of the latency." << std::endl
+            << "Requests the server dropped because they waited longer than their deadline are counted as timeout." << std::endl
+            << "--table needs no server, it looks up callbacks on that many threads for --duration seconds each, in an unordered" << std::endl
+            << "map of std::function, in a plain table, in the callback registry and in the registry while a writer publishes" << std::endl
+            << "--swap-rate versions per second." << std::endl
+            << "--subscribers opens that many connections that subscribe to a topic, and one that publishes --publish-size" << std::endl
+            << "frames to it through the sample, closed loop or --rate publishes per second. The table shows publish to" << std::endl
+            << "receive latency, --slow-subscribers are subscribed too but never read." << std::endl
+            << "--replay sends the requests of a traffic log captured by the sample with --capture again, at the original" << std::endl
+            << "timing or --speed times as fast. --speed=0 sends as fast as possible, --connections captured connections at" << std::endl
+            << "a time with up to --depth requests in flight. Responses that differ from the captured ones are reported." << std::endl
+            << "--client sends the mix with the native client library, one request at a time, with --depth futures and" << std::endl
+            << "callbacks in flight on one connection, and from --threads threads (default --connections) sharing a pool of" << std::endl
+            << "--connections connections. Every way runs for --warmup and --duration seconds." << std::endl
+            << "--ping-pong needs no server, it starts one in this process on --ip and --port and sends one add request at a" << std::endl
+            << "time for --warmup and --duration seconds, with every I/O backend once without and once with the low latency" << std::endl
+            << "mode: I/O threads pinned to --cores that poll for --spin-time us before they block, and --busy-poll us of" << std::endl
+            << "busy polling on accepted sockets. Without io_uring support the io_uring rows use the event loop." << std::endl
+            << "--ramp needs no server either, it starts one in this process per I/O backend on --ip and --port and opens up" << std::endl
+            << "to that many idle connections in --ramp-steps steps, printing the threads and the memory of the process." << std::endl
+            << "--receive needs no server either, it starts one in this process per I/O backend on --ip and --port and sends add" << std::endl
+            << "requests on --connections connections at depth 1 and at --depth, printing messages per second and the recv()" << std::endl
+            << "and poll, epoll_wait or io_uring_enter calls the server made per message." << std::endl;
+        return 1;
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData{};
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        std::cout << ">> WSAStartup() failed" << std::endl;
+        return 1;
+    }
+#endif
+
+    bool succeeded = false;
+
+    if (options.TableReaders > 0)
+    {
+        succeeded = RunTableBenchmark(options);
+    }
+    else if (options.PingPong)
+    {
+        succeeded = RunPingPong(options);
+    }
+    else if (options.Client)
+    {
+        succeeded = RunClientComparison(options);
+    }
+    else if (!options.ReplayPath.empty())
+    {
+        succeeded = RunReplay(options);
+    }
+    else if (options.Subscribers > 0)
+    {
+        succeeded = RunFanOut(options);
+    }
+    else if (options.Storm > 0)
+    {
+        succeeded = RunStorm(options);
+    }
+    else if (options.Ramp > 0)
+    {
+        succeeded = RunRamp(options);
+    }
+    else if (options.Receive)
+    {
+        succeeded = RunReceive(options);
+    }
+    else
+    {
+        succeeded = RunLoad(options);
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+
+    return succeeded ? 0 : 1;
+}
+
+bool ParseArguments(int argc, char** argv, BenchmarkOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const size_t separator = argument.find('=');
+        const std::string name = argument.substr(0, separator);
+        const std::string value = separator != std::string::npos ? argument.substr(separator + 1) : "";
+
+        if (argument == "--churn")
+        {
+            options.Churn = true;
+            continue;
+        }
+
+        if (argument == "--client")
+        {
+            options.Client = true;
+            continue;
+        }
+
+        if (argument == "--ping-pong")
+        {
+            options.PingPong = true;
+            continue;
+        }
+
+        if (argument == "--receive")
+        {
+            options.Receive = true;
+            continue;
+        }
+
+        if (name == "--shm")
+        {
+            options.SharedMemory = true;
+            options.SpinTime = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+            continue;
+        }
+
+        if (value.empty())
+        {
+            std::cout << ">> Missing value: " << argument << std::endl;
+            return false;
+        }
+
+        if (name == "--ip")
+        {
+            options.Ip = value;
+        }
+        else if (name == "--port")
+        {
+            options.Port = value;
+        }
+        else if (name == "--connections")
+        {
+            options.Connections = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--threads")
+        {
+            options.Threads = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--duration")
+        {
+            options.Duration = std::max(0.1, std::atof(value.c_str()));
+        }
+        else if (name == "--warmup")
+        {
+            options.Warmup = std::max(0.0, std::atof(value.c_str()));
+        }
+        else if (name == "--rate")
+        {
+            options.Rate = std::max(0.0, std::atof(value.c_str()));
+        }
+        else if (name == "--depth")
+        {
+            options.Depth = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--echo-size")
+        {
+            options.EchoSize = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (name == "--repeat")
+        {
+            options.Repeat = std::clamp(std::atof(value.c_str()), 0.0, 1.0);
+        }
+        else if (name == "--keys")
+        {
+            options.Keys = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--points")
+        {
+            options.Points = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (name == "--delay")
+        {
+            options.Delay = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (name == "--batch-size")
+        {
+            options.BatchSize = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--unix")
+        {
+            options.UnixPath = value;
+        }
+        else if (name == "--storm")
+        {
+            options.Storm = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--server-pid")
+        {
+            options.ServerPid = std::atoi(value.c_str());
+        }
+        else if (name == "--table")
+        {
+            options.TableReaders = value.empty() ? std::max(1u, std::thread::hardware_concurrency()) : std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--swap-rate")
+        {
+            options.SwapRate = std::max(0.0, std::atof(value.c_str()));
+        }
+        else if (name == "--subscribers")
+        {
+            options.Subscribers = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--slow-subscribers")
+        {
+            options.SlowSubscribers = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--publish-size")
+        {
+            options.PublishSize = std::max<size_t>(PUBLISH_HEADER_SIZE, std::strtoull(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--replay")
+        {
+            options.ReplayPath = value;
+        }
+        else if (name == "--speed")
+        {
+            options.Speed = std::max(0.0, std::atof(value.c_str()));
+        }
+        else if (name == "--cores")
+        {
+            options.Cores = AnTcpParseCores(value);
+        }
+        else if (name == "--spin-time")
+        {
+            options.ServerSpinTime = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--busy-poll")
+        {
+            options.BusyPoll = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--ramp")
+        {
+            options.Ramp = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--ramp-steps")
+        {
+            options.RampSteps = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--mix")
+        {
+            if (!ParseMix(value, options.Mix))
+            {
+                return false;
+            }
+        }
+        else if (name == "--flood")
+        {
+            options.Flood = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--flood-depth")
+        {
+            options.FloodDepth = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--flood-mix")
+        {
+            if (!ParseMix(value, options.FloodMix))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            std::cout << ">> Unknown argument: " << argument << std::endl;
+            return false;
+        }
+    }
+
+    if (options.Churn && options.Rate > 0.0)
+    {
+        std::cout << ">> --churn runs a closed loop and can not be combined with --rate" << std::endl;
+        return false;
+    }
+
+    if (options.Storm > 0 && (options.Churn || options.SharedMemory || options.Rate > 0.0))
+    {
+        std::cout << ">> --storm can not be combined with --churn, --shm or --rate" << std::endl;
+        return false;
+    }
+
+    if (options.Subscribers > 0 && (options.Churn || options.SharedMemory || options.Storm > 0))
+    {
+        std::cout << ">> --subscribers can not be combined with --churn, --shm or --storm" << std::endl;
+        return false;
+    }
+
+    if (!options.ReplayPath.empty() && (options.Churn || options.SharedMemory || options.Storm > 0 || options.Subscribers > 0 || options.TableReaders > 0))
+    {
+        std::cout << ">> --replay can not be combined with --churn, --shm, --storm, --subscribers or --table" << std::endl;
+        return false;
+    }
+
+    if (options.Client && (options.Churn || options.SharedMemory || options.Storm > 0 || options.Subscribers > 0 || options.TableReaders > 0
+        || !options.ReplayPath.empty() || !options.UnixPath.empty() || options.Rate > 0.0 || options.BatchSize > 1 || options.Flood > 0))
+    {
+        std::cout << ">> --client runs a closed loop over tcp and can not be combined with --churn, --shm, --storm, --subscribers, --table," << std::endl
+            << "   --replay, --unix, --rate, --batch-size or --flood" << std::endl;
+        return false;
+    }
+
+    if (options.PingPong && (options.Client || options.Churn || options.SharedMemory || options.Storm > 0 || options.Subscribers > 0 || options.TableReaders > 0
+        || !options.ReplayPath.empty() || !options.UnixPath.empty() || options.Rate > 0.0 || options.BatchSize > 1 || options.Flood > 0))
+    {
+        std::cout << ">> --ping-pong runs its own server and a single connection over tcp, it can not be combined with --client, --churn," << std::endl
+            << "   --shm, --storm, --subscribers, --table, --replay, --unix, --rate, --batch-size or --flood" << std::endl;
+        return false;
+    }
+
+    if (options.Ramp > 0 && (options.PingPong || options.Client || options.Churn || options.SharedMemory || options.Storm > 0 || options.Subscribers > 0
+        || options.TableReaders > 0 || !options.ReplayPath.empty() || !options.UnixPath.empty() || options.Rate > 0.0 || options.BatchSize > 1 || options.Flood > 0))
+    {
+        std::cout << ">> --ramp runs its own server over tcp, it can not be combined with --ping-pong, --client, --churn, --shm, --storm," << std::endl
+            << "   --subscribers, --table, --replay, --unix, --rate, --batch-size or --flood" << std::endl;
+        return false;
+    }
+
+    if (options.Receive && (options.Ramp > 0 || options.PingPong || options.Client || options.Churn || options.SharedMemory || options.Storm > 0
+        || options.Subscribers > 0 || options.TableReaders > 0 || !options.ReplayPath.empty() || !options.UnixPath.empty() || options.Rate > 0.0 || options.Flood > 0))
+    {
+        std::cout << ">> --receive runs its own server and a closed loop over tcp, it can not be combined with --ramp, --ping-pong, --client," << std::endl
+            << "   --churn, --shm, --storm, --subscribers, --table, --replay, --unix, --rate or --flood" << std::endl;
+        return false;
+    }
+
+    if (options.SharedMemory && (options.Churn || !ANTCP_HAS_SHARED_MEMORY))
+    {
+        std::cout << ">> --shm is only available on linux and can not be combined with --churn" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool ParseMix(const std::string& value, std::vector<std::pair<MessageType, unsigned int>>& mix)
+{
+    mix.clear();
+    size_t position = 0;
+
+    while (position < value.size())
+    {
+        const size_t next = std::min(value.find(',', position), value.size());
+        const std::string entry = value.substr(position, next - position);
+        const size_t separator = entry.find(':');
+        const std::string name = entry.substr(0, separator);
+        const unsigned long weight = separator != std::string::npos ? std::strtoul(entry.c_str() + separator + 1, nullptr, 10) : 1;
+
+        const auto typeName = std::find_if(std::begin(MESSAGE_TYPE_NAMES), std::end(MESSAGE_TYPE_NAMES), [&name](const char* typeName) { return name == typeName; });
+
+        if (typeName == std::end(MESSAGE_TYPE_NAMES) || weight == 0)
+        {
+            std::cout << ">> Invalid mix entry: " << entry << std::endl;
+            return false;
+        }
+
+        mix.emplace_back(static_cast<MessageType>(typeName - std::begin(MESSAGE_TYPE_NAMES)), static_cast<unsigned int>(weight));
+        position = next + 1;
+    }
+
+    return !mix.empty();
+}
@@ -0,0 +1,636 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../AnTCP.Client.Native/src/AnTcpClient.hpp"
+#include "../../AnTCP.Client.Native/src/AnTcpClientPool.hpp"
+#include "../../AnTCP.Server/src/AnTcpServer.hpp"
+
+// message types of the AnTCP.Server.Sample
+enum class MessageType
+{
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    MIN_AVG_MAX,
+    ECHO,
+    HASH,
+    POINTS,
+    DELAY
+};
+
+constexpr size_t MESSAGE_TYPE_COUNT = 8;
+constexpr const char* MESSAGE_TYPE_NAMES[MESSAGE_TYPE_COUNT]{ "add", "subtract", "multiply", "minavgmax", "echo", "hash", "points", "delay" };
+
+// message type of the sample that publishes its payload after the topic, not part of the mix
+constexpr char PUBLISH_MESSAGE_TYPE = 9;
+
+// topic of the fan out mode
+constexpr AnTcpTopic FAN_OUT_TOPIC = 1;
+
+// sequence number and timestamp at the start of every published frame
+constexpr size_t PUBLISH_HEADER_SIZE = 2 * sizeof(uint64_t);
+
+// size of the digest returned by the hash callback
+constexpr size_t HASH_DIGEST_SIZE = 4 * sizeof(uint64_t);
+
+// size of a point returned by the points callback, three floats
+constexpr size_t POINT_SIZE = 3 * sizeof(float);
+
+// a replayed connection that got nothing back for that long gives up on its requests
+constexpr std::chrono::seconds REPLAY_TIMEOUT{ 5 };
+
+// differing responses of a replay that are printed in detail
+constexpr uint64_t REPLAY_PRINTED_DIFFS = 5;
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchmarkOptions
+{
+    std::string Ip = "127.0.0.1";
+    std::string Port = "47110";
+
+    // path of a unix socket of the server, used instead of the ip and port when set
+    std::string UnixPath;
+    unsigned int Connections = 16;
+
+    // load generator threads, 0 uses one per hardware thread but never more than connections
+    unsigned int Threads = 0;
+
+    double Duration = 10.0;
+
+    // seconds at the start that are not measured
+    double Warmup = 1.0;
+
+    // requests per second over all connections, 0 runs a closed loop that sends as fast as responses come back
+    double Rate = 0.0;
+
+    // requests in flight per connection in the closed loop
+    unsigned int Depth = 1;
+
+    // payload size of echo requests
+    size_t EchoSize = 1024;
+
+    // share of hash requests that use one of the hot keys, the others use random keys that are (almost) never repeated
+    double Repeat = 0.0;
+
+    // number of hot keys for hash requests
+    unsigned int Keys = 1000;
+
+    // points per points response, 341 are about 4 KB
+    int Points = 341;
+
+    // how long the server waits before it answers a delay request, in milliseconds
+    int Delay = 10;
+
+    // requests sent together in one batch packet, 1 sends every request in its own packet
+    unsigned int BatchSize = 1;
+
+    // message types and their weights
+    std::vector<std::pair<MessageType, unsigned int>> Mix{ { MessageType::ADD, 1 } };
+
+    // extra connections that send as fast as they can on their own thread, next to the measured ones. They
+    // keep --flood-depth requests of the flood mix in flight, empty uses the mix of the measured connections
+    unsigned int Flood = 0;
+    unsigned int FloodDepth = 64;
+    std::vector<std::pair<MessageType, unsigned int>> FloodMix;
+
+    // close every connection after one request and open a new one
+    bool Churn = false;
+
+    // move every connection to shared memory rings, each one gets its own thread then (linux only)
+    bool SharedMemory = false;
+
+    // how long to poll the response ring before sleeping on a futex, in microseconds
+    unsigned int SpinTime = 0;
+
+    // open that many connections as fast as possible and measure how fast the server accepts them,
+    // --connections handshakes are in flight at once and the connections stay open until all are done
+    unsigned int Storm = 0;
+
+    // process id of a local server, its memory, threads and cpu usage during the measurement are printed (linux only)
+    int ServerPid = 0;
+
+    // look up callbacks on that many threads in this process instead of connecting to a server, compares an unordered
+    // map of std::function and a plain callback table with AnTcpCallbackRegistry, once without and once with a writer
+    unsigned int TableReaders = 0;
+
+    // versions the writer of the table benchmark publishes per second, 0 publishes as fast as it can
+    double SwapRate = 0.0;
+
+    // connections that subscribe to a topic while one more connection publishes to it, --rate counts
+    // publishes then. Slow subscribers never read, so the server has to apply its slow subscriber policy
+    unsigned int Subscribers = 0;
+    unsigned int SlowSubscribers = 0;
+
+    // payload size of the published frames, at least the sequence number and the timestamp
+    size_t PublishSize = 64;
+
+    // traffic log of a server started with --capture, its requests are sent again instead of the mix
+    std::string ReplayPath;
+
+    // speed of the replay relative to the capture, 0 sends as fast as possible: --connections captured
+    // connections at a time, each with up to --depth requests in flight
+    double Speed = 1.0;
+
+    // compare the ways to use the native client with requests of the mix: sequential requests, --depth futures
+    // or callbacks in flight on one connection, and --threads threads that share a pool of --connections
+    bool Client = false;
+
+    // start a server in this process and send one add request at a time over loopback, once per I/O backend
+    // with the low latency mode off and on. The mode pins the I/O threads to --cores and lets them poll for
+    // --spin-time microseconds before they block, accepted sockets busy poll for --busy-poll microseconds
+    bool PingPong = false;
+    std::vector<unsigned int> Cores;
+    unsigned int ServerSpinTime = ANTCP_LOW_LATENCY_SPIN_TIME;
+    unsigned int BusyPoll = ANTCP_LOW_LATENCY_BUSY_POLL;
+
+    // start a server in this process per I/O backend and open up to that many idle connections to it in --ramp-steps
+    // steps, each one sends a single add request. The threads and the memory of the process are printed after every step
+    unsigned int Ramp = 0;
+    unsigned int RampSteps = 10;
+
+    // start a server in this process per I/O backend and send add requests on --connections connections, at depth 1 and
+    // at --depth. Prints messages per second and the recv() and wait syscalls the I/O threads of the server made per message
+    bool Receive = false;
+};
+
+/// <summary>
+/// Request that was sent and waits for its response.
+/// </summary>
+struct PendingRequest
+{
+    MessageType Type;
+
+    // when the request was sent, or was supposed to be sent in the fixed rate mode
+    Clock::time_point Start;
+
+    // expected result of integer requests
+    int Expected;
+
+    // requests of the batch the request is the first one of, a busy batch takes the place of all of their responses
+    unsigned int Batch = 1;
+};
+
+struct Connection
+{
+    SOCKET Socket = INVALID_SOCKET;
+    std::vector<char> Input;
+    size_t InputEnd = 0;
+    std::vector<char> Output;
+    size_t OutputStart = 0;
+    std::deque<PendingRequest> InFlight;
+    Clock::time_point NextSend{};
+    std::mt19937 Random;
+
+    // whether a request was sent on the current socket, used by the churn mode
+    bool Used = false;
+
+    // rings used instead of the socket in the shared memory mode
+    AnTcpSharedMemory* SharedMemory = nullptr;
+};
+
+/// <summary>
+/// Connection of the fan out mode that receives the published frames.
+/// </summary>
+struct Subscriber
+{
+    SOCKET Socket = INVALID_SOCKET;
+    std::vector<char> Input;
+    size_t InputEnd = 0;
+
+    // sequence number of the next frame, frames the server dropped show up as gaps
+    uint64_t NextSequence = 0;
+};
+
+/// <summary>
+/// What the subscribers of a thread received in the fan out mode.
+/// </summary>
+struct FanOutResult
+{
+    uint64_t Frames = 0;
+    uint64_t Bytes = 0;
+
+    // frames that never arrived, the server dropped or coalesced them
+    uint64_t Missing = 0;
+    uint64_t Errors = 0;
+    uint64_t Disconnects = 0;
+
+    // publish to receive
+    AnTcpHistogram Latency;
+};
+
+/// <summary>
+/// Request of a traffic log and the responses the log recorded for it.
+/// </summary>
+struct ReplayRequest
+{
+    const AnTcpTrafficRecord* Record = nullptr;
+    std::vector<const AnTcpTrafficRecord*> Responses;
+
+    // id the request was sent with in frame version 2
+    bool HasId = false;
+    AnTcpRequestId Id = 0;
+
+    // when the request was sent, or was supposed to be sent when the original timing is kept
+    Clock::time_point Start{};
+
+    // responses that came back so far
+    size_t Received = 0;
+};
+
+/// <summary>
+/// Connection of the replay mode, it sends the requests of one captured connection.
+/// </summary>
+struct ReplayConnection
+{
+    AnTcpConnectionId Id = 0;
+    std::vector<ReplayRequest> Requests;
+    size_t NextRequest = 0;
+
+    // when the captured connection was closed, it stays open until its last response when the log has no close
+    int64_t CloseTime = std::numeric_limits<int64_t>::max();
+
+    // socket and buffers, the rest of it is not used
+    Connection Link;
+
+    // framing of the responses, switches when a negotiate response arrives
+    int FrameVersion = ANTCP_FRAME_VERSION_1;
+    std::deque<ReplayRequest*> InFlight;
+    Clock::time_point LastReceive{};
+    bool Done = false;
+};
+
+struct ReplayResult
+{
+    uint64_t Requests = 0;
+    uint64_t Responses = 0;
+
+    // responses whose type or payload is not the captured one, by the type of their request
+    uint64_t Diffs = 0;
+    std::array<uint64_t, 256> TypeDiffs{};
+
+    // requests that never got all their responses and responses no request waited for
+    uint64_t Missing = 0;
+    uint64_t Unexpected = 0;
+
+    // connections that failed
+    uint64_t Errors = 0;
+
+    // request to first response
+    AnTcpHistogram Latency;
+};
+
+/// <summary>
+/// Request of a random type of the mix before it is sent.
+/// </summary>
+struct BenchmarkRequest
+{
+    PendingRequest Pending;
+    int Values[2];
+
+    // the echo payload for echo requests, null sends the values
+    const char* Payload;
+    size_t Size;
+
+    inline const char* GetData() const noexcept { return Payload ? Payload : reinterpret_cast<const char*>(Values); }
+};
+
+struct ClientResult
+{
+    uint64_t Requests = 0;
+
+    // wrong responses, busy and timeout responses and requests the connection failed
+    uint64_t Errors = 0;
+    AnTcpHistogram Latency;
+};
+
+/// <summary>
+/// Round trips of one configuration of the ping-pong mode and how the I/O threads of its server spent their time.
+/// </summary>
+struct PingPongResult
+{
+    const char* Backend = "";
+    bool LowLatency = false;
+    ClientResult Client;
+    std::vector<AnTcpIoThreadStats> Threads;
+};
+
+/// <summary>
+/// Threads and memory of the process at one step of the ramp mode.
+/// </summary>
+struct RampStep
+{
+    const char* Backend = "";
+    size_t Connections = 0;
+    size_t Threads = 0;
+    size_t Memory = 0;
+};
+
+/// <summary>
+/// Throughput of one configuration of the receive mode and the receive syscalls of its server.
+/// </summary>
+struct ReceiveResult
+{
+    const char* Backend = "";
+    unsigned int Depth = 1;
+
+    // responses in the measurement, and the messages the server received over its whole run
+    uint64_t Requests = 0;
+    uint64_t Messages = 0;
+    uint64_t Errors = 0;
+    AnTcpReceiveStats Syscalls;
+};
+
+/// <summary>
+/// Connection of the storm mode, it sends one request as soon as it is established.
+/// </summary>
+struct StormConnection
+{
+    SOCKET Socket = INVALID_SOCKET;
+    Clock::time_point Start{};
+    bool Connected = false;
+    int Expected = 0;
+
+    // the add response: size | type | int
+    char Response[sizeof(AnTcpSizeType) + 1 + sizeof(int)]{ 0 };
+    size_t ResponseSize = 0;
+};
+
+struct TypeResult
+{
+    uint64_t Requests = 0;
+    uint64_t BytesOut = 0;
+    uint64_t BytesIn = 0;
+    uint64_t Errors = 0;
+
+    // requests the server answered with ANTCP_MESSAGE_BUSY, they are not in the latency
+    uint64_t Busy = 0;
+
+    // requests the server answered with ANTCP_MESSAGE_TIMEOUT, they are not in the latency either
+    uint64_t TimedOut = 0;
+    AnTcpHistogram Latency;
+};
+
+struct ThreadResult
+{
+    std::array<TypeResult, MESSAGE_TYPE_COUNT> Types;
+
+    // connections that failed or were closed by the server
+    uint64_t Disconnects = 0;
+
+    // connections opened after the start of the measurement
+    uint64_t Connects = 0;
+};
+
+/// <summary>
+/// Read the command line options.
+/// </summary>
+/// <returns>True if all options were valid, false if not.</returns>
+bool ParseArguments(int argc, char** argv, BenchmarkOptions& options);
+
+/// <summary>
+/// Parse a message mix like "add:4,echo:1".
+/// </summary>
+/// <returns>True if the mix was valid, false if not.</returns>
+bool ParseMix(const std::string& value, std::vector<std::pair<MessageType, unsigned int>>& mix);
+
+/// <summary>
+/// Run the mix on the connections, closed loop or at a fixed rate, next to the flood connections.
+/// </summary>
+/// <returns>True if every response was correct and no connection was lost, false if not.</returns>
+bool RunLoad(const BenchmarkOptions& options);
+
+/// <summary>
+/// Open a non-blocking connection to the server.
+/// </summary>
+/// <param name="wait">False to return while the connection is still being established.</param>
+/// <returns>The socket, INVALID_SOCKET if the connection failed.</returns>
+SOCKET Connect(const BenchmarkOptions& options, bool wait = true);
+
+/// <summary>
+/// Ask the server to move a connection to shared memory and map the rings, the socket must be connected.
+/// </summary>
+/// <returns>True if the connection uses shared memory now, false if not.</returns>
+bool OpenSharedMemory(Connection& connection, const BenchmarkOptions& options);
+
+/// <summary>
+/// Wait for socket events with a sub millisecond timeout where the platform supports it.
+/// </summary>
+inline int PollFor(AnTcpPollFd* pollFds, size_t count, Clock::duration timeout) noexcept
+{
+#if defined(__linux__)
+    const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+    const timespec time{ static_cast<time_t>(nanoseconds / 1000000000), static_cast<long>(nanoseconds % 1000000000) };
+    return ppoll(pollFds, static_cast<nfds_t>(count), &time, nullptr);
+#else
+    return AnTcpPoll(pollFds, count, static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(timeout).count()));
+#endif
+}
+
+/// <summary>
+/// Build the weighted message mix, picking a random entry of it picks a type with its weight.
+/// </summary>
+std::vector<MessageType> BuildMix(const BenchmarkOptions& options);
+
+/// <summary>
+/// Append a packet to the output buffer of a connection, a single request of a random
+/// type of the mix or a batch of them.
+/// </summary>
+void QueueRequest(Connection& connection, const BenchmarkOptions& options, const std::vector<MessageType>& mix, const std::vector<char>& echoPayload, Clock::time_point start);
+
+/// <summary>
+/// Pick a random type of the mix and build the payload of a request of it.
+/// </summary>
+BenchmarkRequest MakeRequest(std::mt19937& random, const BenchmarkOptions& options, const std::vector<MessageType>& mix, const std::vector<char>& echoPayload, Clock::time_point start);
+
+/// <summary>
+/// Append a request of a random type of the mix to the output buffer of a connection.
+/// Requests inside a batch use the same framing.
+/// </summary>
+void AppendRequest(Connection& connection, const BenchmarkOptions& options, const std::vector<MessageType>& mix, const std::vector<char>& echoPayload, Clock::time_point start);
+
+/// <summary>
+/// Check a response and count it in the results of its message type.
+/// </summary>
+/// <param name="response">Type and payload of the response.</param>
+/// <param name="packetSize">Size of the type and payload.</param>
+/// <param name="measureStart">Responses of requests sent before are not counted.</param>
+void RecordResponse(const PendingRequest& request, const char* response, AnTcpSizeType packetSize, Clock::time_point now, Clock::time_point measureStart, ThreadResult& result);
+
+/// <summary>
+/// Close the socket of a connection and open a new one, used by the churn mode.
+/// </summary>
+/// <returns>True if the new connection is open, false if not.</returns>
+bool Reconnect(Connection& connection, const BenchmarkOptions& options) noexcept;
+
+/// <summary>
+/// Read a numeric field of /proc/<pid>/status, the unit is dropped.
+/// </summary>
+/// <param name="field">Name of the field without the colon.</param>
+/// <returns>The value, 0 if it could not be read.</returns>
+size_t GetProcessStatus(int pid, const char* field) noexcept;
+
+/// <summary>
+/// Get the resident memory of a process in KB.
+/// </summary>
+/// <returns>Memory in KB, 0 if it could not be read.</returns>
+size_t GetResidentMemory(int pid) noexcept;
+
+/// <summary>
+/// Get the user and system cpu time a process used so far in seconds.
+/// </summary>
+/// <returns>Cpu time in seconds, 0 if it could not be read.</returns>
+double GetCpuTime(int pid) noexcept;
+
+/// <summary>
+/// Get the number of threads of a process.
+/// </summary>
+/// <returns>Thread count, 0 if it could not be read.</returns>
+size_t GetThreadCount(int pid) noexcept;
+
+/// <summary>
+/// Send as much of the output buffer as the socket takes.
+/// </summary>
+/// <returns>True if the connection is alive, false if not.</returns>
+bool FlushOutput(Connection& connection);
+
+/// <summary>
+/// Receive and match all complete responses.
+/// </summary>
+/// <returns>True if the connection is alive, false if not.</returns>
+bool ReceiveResponses(Connection& connection, ThreadResult& result, Clock::time_point measureStart);
+
+/// <summary>
+/// Match all complete responses in the input buffer and keep the incomplete one.
+/// </summary>
+/// <param name="now">When the responses arrived.</param>
+/// <returns>True if the responses were valid, false if not.</returns>
+bool ProcessResponses(Connection& connection, ThreadResult& result, Clock::time_point measureStart, Clock::time_point now);
+
+/// <summary>
+/// Drive a group of connections until the benchmark ends.
+/// </summary>
+void RunConnections(const BenchmarkOptions& options, std::vector<Connection>& connections, ThreadResult& result, Clock::time_point measureStart, Clock::time_point end);
+
+/// <summary>
+/// Drive a connection that uses shared memory until the benchmark ends, the thread
+/// sleeps on the response ring in between.
+/// </summary>
+void RunSharedMemoryConnection(const BenchmarkOptions& options, Connection& connection, ThreadResult& result, Clock::time_point measureStart, Clock::time_point end);
+
+/// <summary>
+/// Open the connections of the storm mode and measure how long the server takes to accept them.
+/// </summary>
+/// <returns>True if every connection was accepted, false if not.</returns>
+bool RunStorm(const BenchmarkOptions& options);
+
+/// <summary>
+/// Measure the read side of the callback registry against a plain callback table, see BenchmarkOptions::TableReaders.
+/// </summary>
+/// <returns>True if every lookup found its callback, false if not.</returns>
+bool RunTableBenchmark(const BenchmarkOptions& options);
+
+/// <summary>
+/// Publish frames to a topic while the subscribers receive them, see BenchmarkOptions::Subscribers.
+/// </summary>
+/// <returns>True if every subscriber got every frame it was sent intact, false if not.</returns>
+bool RunFanOut(const BenchmarkOptions& options);
+
+/// <summary>
+/// Receive the published frames of a group of subscribers until the benchmark ends.
+/// </summary>
+/// <param name="measureStart">Frames published before are not counted.</param>
+void RunSubscribers(std::vector<Subscriber>& subscribers, FanOutResult& result, Clock::time_point measureStart, const std::atomic<bool>& running);
+
+/// <summary>
+/// Check the published frames in the input buffer of a subscriber and keep the incomplete one.
+/// </summary>
+/// <returns>True if the frames were valid, false if not.</returns>
+bool ProcessPublished(Subscriber& subscriber, FanOutResult& result, Clock::time_point measureStart, Clock::time_point now);
+
+/// <summary>
+/// Send a frame on a connected socket and wait for one response frame, used to set up the fan out mode.
+/// </summary>
+/// <param name="response">Type and payload of the response.</param>
+/// <returns>True if the response arrived, false if not.</returns>
+bool Exchange(SOCKET connectionSocket, char type, const void* data, size_t size, std::vector<char>& response);
+
+/// <summary>
+/// Send the requests of a traffic log again and compare the responses with the captured ones, see BenchmarkOptions::ReplayPath.
+/// </summary>
+/// <returns>True if every request got the responses it got when it was captured, false if not.</returns>
+bool RunReplay(const BenchmarkOptions& options);
+
+/// <summary>
+/// Group the records of a traffic log by their connection and assign the captured responses to their requests. Responses
+/// of frame version 2 are found by their request id, the others are assigned in order, which is only a guess for
+/// requests that are answered out of order or more than once.
+/// </summary>
+/// <param name="skipped">Requests that can't be replayed, shared memory switches.</param>
+void LoadReplay(const std::vector<AnTcpTrafficRecord>& records, std::vector<ReplayConnection>& connections, uint64_t& skipped);
+
+/// <summary>
+/// Match all complete responses of a replayed connection with its requests and keep the incomplete one.
+/// </summary>
+/// <param name="compare">Whether the log holds the responses, if not every request is expected to get one.</param>
+/// <returns>True if the responses were valid, false if not.</returns>
+bool ProcessReplayResponses(ReplayConnection& connection, ReplayResult& result, bool compare, Clock::time_point now);
+
+/// <summary>
+/// Measure the native client sequentially, pipelined with futures and callbacks and with a pool, see BenchmarkOptions::Client.
+/// </summary>
+/// <returns>True if every response was correct, false if not.</returns>
+bool RunClientComparison(const BenchmarkOptions& options);
+
+/// <summary>
+/// Check a response of the native client comparison and count it.
+/// </summary>
+/// <param name="measureStart">Responses of requests sent before are not counted.</param>
+void RecordClientResponse(const BenchmarkOptions& options, const PendingRequest& request, const AnTcpClientResponse& response, Clock::time_point measureStart, ClientResult& result);
+
+/// <summary>
+/// Measure round trips to a server in this process with the low latency mode off and on, see BenchmarkOptions::PingPong.
+/// </summary>
+/// <returns>True if every response was correct, false if not.</returns>
+bool RunPingPong(const BenchmarkOptions& options);
+
+/// <summary>
+/// Measure the threads and the memory of a server in this process while idle connections are opened, see BenchmarkOptions::Ramp.
+/// </summary>
+/// <returns>True if every connection got its response, false if not.</returns>
+bool RunRamp(const BenchmarkOptions& options);
+
+/// <summary>
+/// Measure the messages per second and the receive syscalls per message of a server in this process, see BenchmarkOptions::Receive.
+/// </summary>
+/// <returns>True if every response was correct and no connection was lost, false if not.</returns>
+bool RunReceive(const BenchmarkOptions& options);
+
+/// <summary>
+/// Open a share of the storm connections, keeping up to window handshakes in flight.
+/// </summary>
+/// <param name="sockets">The accepted connections, they are closed by the caller once every thread is done.</param>
+/// <param name="end">Connections that are not accepted until then count as lost.</param>
+void RunStormConnections(const BenchmarkOptions& options, unsigned int count, unsigned int window, ThreadResult& result, std::vector<SOCKET>& sockets, Clock::time_point end);
+
+void PrintResults(const BenchmarkOptions& options, const std::vector<ThreadResult>& results, double seconds);
+
+/// <summary>
+/// Open the flood connections, see BenchmarkOptions::Flood.
+/// </summary>
+/// <param name="floodOptions">Receives the options the flood connections run with.</param>
+/// <returns>True if every flood connection is open, false if not.</returns>
+bool OpenFloodConnections(const BenchmarkOptions& options, BenchmarkOptions& floodOptions, std::vector<Connection>& floodConnections);
+
+/// <summary>
+/// Print how many requests of the flood connections were answered, how many got a busy response and how many timed out.
+/// </summary>
+void PrintFloodResult(const BenchmarkOptions& options, const ThreadResult& result, double seconds);
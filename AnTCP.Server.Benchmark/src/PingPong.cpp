@@ -0,0 +1,133 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+bool RunPingPong(const BenchmarkOptions& options)
+{
+    constexpr size_t BACKEND_COUNT = 3;
+    constexpr AnTcpIoBackend BACKENDS[BACKEND_COUNT]{ AnTcpIoBackend::ThreadPerClient, AnTcpIoBackend::EventLoop, AnTcpIoBackend::IoUring };
+    constexpr const char* BACKEND_NAMES[BACKEND_COUNT]{ "threads", "event-loop", "io_uring" };
+
+    const std::vector<MessageType> mix{ MessageType::ADD };
+    const std::vector<char> echoPayload;
+    std::vector<PingPongResult> results;
+
+    std::cout << ">> ping-pong over " << options.Ip << ":" << options.Port << ", " << options.Warmup << " s warmup and " << options.Duration
+        << " s measured per run, low latency mode with " << options.ServerSpinTime << " us spin time, " << options.BusyPoll << " us busy poll";
+
+    for (size_t i = 0; i < options.Cores.size(); ++i)
+    {
+        std::cout << (i == 0 ? " and cores " : ",") << options.Cores[i];
+    }
+
+    std::cout << std::endl;
+
+    for (size_t backend = 0; backend < BACKEND_COUNT; ++backend)
+    {
+        for (const bool lowLatency : { false, true })
+        {
+            AnTcpServer server(options.Ip, options.Port);
+            server.AddCallback(static_cast<AnTcpMessageType>(MessageType::ADD), [](ClientHandler* handler, AnTcpMessageType type, const void* data, int)
+            {
+                handler->SendDataVar(type, static_cast<const int*>(data)[0] + static_cast<const int*>(data)[1]);
+            });
+
+            // one I/O thread is enough for a single connection
+            server.SetIoBackend(BACKENDS[backend], 1);
+            server.SetNoDelay(true);
+            server.SetLowLatency(lowLatency, options.Cores, std::chrono::microseconds(options.ServerSpinTime), std::chrono::microseconds(options.BusyPoll));
+
+            AnTcpError error = AnTcpError::Success;
+            std::thread serverThread([&server, &error]() { error = server.Run(); });
+
+            PingPongResult& result = results.emplace_back();
+            result.Backend = BACKEND_NAMES[backend];
+            result.LowLatency = lowLatency;
+
+            {
+                AnTcpClient client;
+                const auto connectEnd = Clock::now() + std::chrono::seconds(2);
+
+                // the server may still be opening its listener
+                while (!client.Connect(options.Ip, options.Port) && Clock::now() < connectEnd)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+
+                if (!client.IsConnected())
+                {
+                    result.Client.Errors++;
+                }
+
+                std::mt19937 random(static_cast<unsigned int>(backend + 1));
+                const auto measureStart = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Warmup));
+                const auto end = measureStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Duration));
+
+                while (client.IsConnected() && Clock::now() < end)
+                {
+                    const BenchmarkRequest request = MakeRequest(random, options, mix, echoPayload, Clock::now());
+                    RecordClientResponse(options, request.Pending, client.Send(static_cast<AnTcpMessageType>(request.Pending.Type), request.GetData(), request.Size), measureStart, result.Client);
+                }
+
+                // the client closes first, so the port is not kept in TIME_WAIT by the server for the next run
+            }
+
+            server.Stop();
+            serverThread.join();
+
+            if (error != AnTcpError::Success)
+            {
+                std::cout << ">> Failed to start the server on " << options.Ip << ":" << options.Port << std::endl;
+                return false;
+            }
+
+            result.Threads = server.GetIoThreadStats();
+        }
+    }
+
+    const auto microseconds = [](uint64_t nanoseconds) { return nanoseconds / 1000.0; };
+
+    std::cout << std::endl << std::left << std::setw(12) << "backend" << std::setw(13) << "low latency" << std::right << std::setw(12) << "requests"
+        << std::setw(12) << "req/s" << std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us" << std::setw(10) << "p99.9 us"
+        << std::setw(10) << "max us" << std::setw(8) << "errors" << std::endl;
+
+    for (const PingPongResult& result : results)
+    {
+        std::cout << std::left << std::setw(12) << result.Backend << std::setw(13) << (result.LowLatency ? "on" : "off") << std::right << std::fixed
+            << std::setw(12) << result.Client.Requests
+            << std::setw(12) << std::setprecision(0) << result.Client.Requests / options.Duration
+            << std::setw(10) << std::setprecision(1) << microseconds(result.Client.Latency.GetPercentile(50.0))
+            << std::setw(10) << microseconds(result.Client.Latency.GetPercentile(90.0))
+            << std::setw(10) << microseconds(result.Client.Latency.GetPercentile(99.0))
+            << std::setw(10) << microseconds(result.Client.Latency.GetPercentile(99.9))
+            << std::setw(10) << microseconds(result.Client.Latency.GetMax())
+            << std::setw(8) << result.Client.Errors << std::endl;
+    }
+
+    // warmup included, the counters run for the whole life of the server
+    std::cout << std::endl << std::left << std::setw(12) << "backend" << std::setw(16) << "I/O thread" << std::right << std::setw(6) << "core"
+        << std::setw(10) << "spin %" << std::setw(10) << "work %" << std::setw(10) << "blocked %" << std::setw(12) << "spin hits" << std::setw(10) << "blocks" << std::endl;
+
+    for (const PingPongResult& result : results)
+    {
+        for (const AnTcpIoThreadStats& stats : result.Threads)
+        {
+            const std::string name = stats.Type == AnTcpIoThreadType::EventLoop ? "event loop " + std::to_string(stats.Index)
+                : stats.Type == AnTcpIoThreadType::IoUring ? "io_uring " + std::to_string(stats.Index) : "client threads";
+            const double total = std::max(1.0, static_cast<double>(stats.SpinTime + stats.WorkTime + stats.BlockedTime)) / 100.0;
+
+            std::cout << std::left << std::setw(12) << result.Backend << std::setw(16) << name << std::right << std::fixed
+                << std::setw(6) << (stats.Core >= 0 ? std::to_string(stats.Core) : "-")
+                << std::setw(10) << std::setprecision(1) << stats.SpinTime / total
+                << std::setw(10) << stats.WorkTime / total
+                << std::setw(10) << stats.BlockedTime / total
+                << std::setw(12) << stats.SpinHits
+                << std::setw(10) << stats.Blocks << std::endl;
+        }
+    }
+
+    return std::all_of(results.begin(), results.end(), [](const PingPongResult& result) { return result.Client.Errors == 0; });
+}
@@ -0,0 +1,158 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+bool RunRamp(const BenchmarkOptions& options)
+{
+    constexpr size_t BACKEND_COUNT = 3;
+
+    // memory a backend freed is reused by the next one, so the thread per client backend that needs the most runs last
+    constexpr AnTcpIoBackend BACKENDS[BACKEND_COUNT]{ AnTcpIoBackend::EventLoop, AnTcpIoBackend::IoUring, AnTcpIoBackend::ThreadPerClient };
+    constexpr const char* BACKEND_NAMES[BACKEND_COUNT]{ "event-loop", "io_uring", "threads" };
+
+#ifdef _WIN32
+    const int pid = static_cast<int>(GetCurrentProcessId());
+#else
+    const int pid = static_cast<int>(getpid());
+#endif
+
+    std::vector<RampStep> steps;
+    bool valid = true;
+
+    std::cout << ">> Ramping up to " << options.Ramp << " idle connections in " << options.RampSteps << " steps over " << options.Ip << ":" << options.Port
+        << ", every I/O backend with its default thread count" << std::endl;
+
+    for (size_t backend = 0; backend < BACKEND_COUNT && valid; ++backend)
+    {
+        AnTcpServer server(options.Ip, options.Port);
+        server.AddCallback(static_cast<AnTcpMessageType>(MessageType::ADD), [](ClientHandler* handler, AnTcpMessageType type, const void* data, int)
+        {
+            handler->SendDataVar(type, static_cast<const int*>(data)[0] + static_cast<const int*>(data)[1]);
+        });
+
+        server.SetIoBackend(BACKENDS[backend]);
+        server.SetNoDelay(true);
+
+        AnTcpError error = AnTcpError::Success;
+        std::thread serverThread([&server, &error]() { error = server.Run(); });
+
+        // the server may still be opening its listener, a probe connection tells when it accepts
+        const auto connectEnd = Clock::now() + std::chrono::seconds(2);
+        SOCKET probe = INVALID_SOCKET;
+
+        while ((probe = Connect(options)) == INVALID_SOCKET && Clock::now() < connectEnd)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        // waits until the server has exactly that many connections, the thread of a closed one is gone shortly after
+        const auto settle = [&server](size_t connections)
+        {
+            const auto end = Clock::now() + std::chrono::seconds(5);
+
+            while (server.GetConnectionCount() != connections && Clock::now() < end)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            return server.GetConnectionCount() == connections;
+        };
+
+        std::vector<SOCKET> sockets;
+
+        if (probe != INVALID_SOCKET)
+        {
+            closesocket(probe);
+            valid = settle(0);
+            steps.push_back(RampStep{ BACKEND_NAMES[backend], 0, GetThreadCount(pid), GetResidentMemory(pid) });
+        }
+        else
+        {
+            valid = false;
+        }
+
+        for (unsigned int step = 1; step <= options.RampSteps && valid; ++step)
+        {
+            const size_t target = static_cast<size_t>(options.Ramp) * step / options.RampSteps;
+
+            while (sockets.size() < target && valid)
+            {
+                const SOCKET connectionSocket = Connect(options);
+
+                if (connectionSocket == INVALID_SOCKET)
+                {
+                    std::cout << ">> Failed to open connection " << sockets.size() + 1 << ", is the limit of open files high enough?" << std::endl;
+                    valid = false;
+                    break;
+                }
+
+                sockets.push_back(connectionSocket);
+
+                // one request, so every connection was served once before it idles
+                const int values[2]{ static_cast<int>(sockets.size()), 1 };
+                std::vector<char> response;
+                int result = 0;
+
+                if (Exchange(connectionSocket, static_cast<char>(MessageType::ADD), values, sizeof(values), response) && response.size() == 1 + sizeof(int))
+                {
+                    memcpy(&result, response.data() + 1, sizeof(result));
+                }
+
+                valid = result == values[0] + values[1];
+            }
+
+            valid = valid && settle(target);
+
+            if (valid)
+            {
+                steps.push_back(RampStep{ BACKEND_NAMES[backend], target, GetThreadCount(pid), GetResidentMemory(pid) });
+            }
+        }
+
+        // the client closes first, so the port is not kept in TIME_WAIT by the server for the next backend
+        for (const SOCKET connectionSocket : sockets)
+        {
+            closesocket(connectionSocket);
+        }
+
+        server.Stop();
+        serverThread.join();
+
+        if (error != AnTcpError::Success)
+        {
+            std::cout << ">> Failed to start the server on " << options.Ip << ":" << options.Port << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << std::endl << std::left << std::setw(12) << "backend" << std::right << std::setw(13) << "connections" << std::setw(10) << "threads"
+        << std::setw(14) << "memory KB" << std::setw(12) << "KB/conn" << std::endl;
+
+    const RampStep* baseline = nullptr;
+
+    for (const RampStep& step : steps)
+    {
+        // the rows of a backend are compared with its first one, before any connection was open
+        baseline = step.Connections == 0 ? &step : baseline;
+        const double perConnection = step.Connections > 0
+            ? (static_cast<double>(step.Memory) - static_cast<double>(baseline->Memory)) / static_cast<double>(step.Connections) : 0.0;
+
+        std::cout << std::left << std::setw(12) << step.Backend << std::right << std::fixed
+            << std::setw(13) << step.Connections
+            << std::setw(10) << step.Threads
+            << std::setw(14) << step.Memory
+            << std::setw(12) << std::setprecision(1) << perConnection << std::endl;
+    }
+
+    if (!valid)
+    {
+        std::cout << ">> A connection failed or got a wrong response" << std::endl;
+    }
+
+    return valid;
+}
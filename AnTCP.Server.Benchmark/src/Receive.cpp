@@ -0,0 +1,148 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+bool RunReceive(const BenchmarkOptions& options)
+{
+    constexpr size_t BACKEND_COUNT = 3;
+    constexpr AnTcpIoBackend BACKENDS[BACKEND_COUNT]{ AnTcpIoBackend::ThreadPerClient, AnTcpIoBackend::EventLoop, AnTcpIoBackend::IoUring };
+    constexpr const char* BACKEND_NAMES[BACKEND_COUNT]{ "threads", "event-loop", "io_uring" };
+
+    const unsigned int threadCount = std::min(options.Connections, options.Threads > 0 ? options.Threads : std::max(1u, std::thread::hardware_concurrency()));
+
+    // one request in flight shows the syscalls of a lone message, deeper pipelines let one recv() take many
+    std::vector<unsigned int> depths{ 1 };
+
+    if (options.Depth > 1)
+    {
+        depths.push_back(options.Depth);
+    }
+
+    std::vector<ReceiveResult> results;
+
+    std::cout << ">> Receive path over " << options.Ip << ":" << options.Port << ", " << options.Connections << " connections on " << threadCount << " threads, "
+        << options.Warmup << " s warmup and " << options.Duration << " s measured per run" << std::endl;
+
+    for (size_t backend = 0; backend < BACKEND_COUNT; ++backend)
+    {
+        for (const unsigned int depth : depths)
+        {
+            AnTcpServer server(options.Ip, options.Port);
+            server.AddCallback(static_cast<AnTcpMessageType>(MessageType::ADD), [](ClientHandler* handler, AnTcpMessageType type, const void* data, int)
+            {
+                handler->SendDataVar(type, static_cast<const int*>(data)[0] + static_cast<const int*>(data)[1]);
+            });
+
+            server.SetIoBackend(BACKENDS[backend]);
+            server.SetNoDelay(true);
+
+            AnTcpError error = AnTcpError::Success;
+            std::thread serverThread([&server, &error]() { error = server.Run(); });
+
+            ReceiveResult& result = results.emplace_back();
+            result.Backend = BACKEND_NAMES[backend];
+            result.Depth = depth;
+
+            BenchmarkOptions runOptions = options;
+            runOptions.Depth = depth;
+            runOptions.Mix = { { MessageType::ADD, 1 } };
+
+            std::vector<std::vector<Connection>> connections(threadCount);
+            const auto connectEnd = Clock::now() + std::chrono::seconds(2);
+
+            for (unsigned int i = 0; i < options.Connections; ++i)
+            {
+                Connection connection{};
+
+                // the server may still be opening its listener
+                while ((connection.Socket = Connect(options)) == INVALID_SOCKET && i == 0 && Clock::now() < connectEnd)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+
+                if (connection.Socket == INVALID_SOCKET)
+                {
+                    result.Errors++;
+                    break;
+                }
+
+                connection.Input.resize(64 * 1024);
+                connection.Random.seed(i + 1);
+                connections[i % threadCount].push_back(std::move(connection));
+            }
+
+            std::vector<ThreadResult> threadResults(threadCount);
+
+            if (result.Errors == 0)
+            {
+                const auto measureStart = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Warmup));
+                const auto end = measureStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Duration));
+                std::vector<std::thread> threads;
+
+                for (unsigned int i = 0; i < threadCount; ++i)
+                {
+                    threads.emplace_back(RunConnections, std::cref(runOptions), std::ref(connections[i]), std::ref(threadResults[i]), measureStart, end);
+                }
+
+                for (std::thread& thread : threads)
+                {
+                    thread.join();
+                }
+            }
+
+            // the client closes first, so the port is not kept in TIME_WAIT by the server for the next run
+            for (const std::vector<Connection>& threadConnections : connections)
+            {
+                for (const Connection& connection : threadConnections)
+                {
+                    closesocket(connection.Socket);
+                }
+            }
+
+            // the I/O threads add their syscalls when they exit, so they are complete once Run() returned
+            server.Stop();
+            serverThread.join();
+
+            if (error != AnTcpError::Success)
+            {
+                std::cout << ">> Failed to start the server on " << options.Ip << ":" << options.Port << std::endl;
+                return false;
+            }
+
+            for (const ThreadResult& threadResult : threadResults)
+            {
+                const TypeResult& typeResult = threadResult.Types[static_cast<size_t>(MessageType::ADD)];
+                result.Requests += typeResult.Requests;
+                result.Errors += typeResult.Errors + threadResult.Disconnects;
+            }
+
+            const AnTcpMetricsSnapshot metrics = server.GetMetrics();
+            const AnTcpMessageMetrics* messageMetrics = metrics.Get(static_cast<AnTcpMessageType>(MessageType::ADD));
+            result.Messages = messageMetrics ? messageMetrics->Requests : 0;
+            result.Syscalls = server.GetReceiveStats();
+        }
+    }
+
+    // warmup included, the server counts its syscalls and messages over its whole run
+    std::cout << std::endl << std::left << std::setw(12) << "backend" << std::right << std::setw(8) << "depth" << std::setw(14) << "messages"
+        << std::setw(12) << "msg/s" << std::setw(12) << "recv/msg" << std::setw(12) << "waits/msg" << std::setw(14) << "syscalls/msg" << std::setw(8) << "errors" << std::endl;
+
+    for (const ReceiveResult& result : results)
+    {
+        const double messages = std::max(1.0, static_cast<double>(result.Messages));
+
+        std::cout << std::left << std::setw(12) << result.Backend << std::right << std::fixed
+            << std::setw(8) << result.Depth
+            << std::setw(14) << result.Messages
+            << std::setw(12) << std::setprecision(0) << result.Requests / options.Duration
+            << std::setw(12) << std::setprecision(3) << result.Syscalls.Receives / messages
+            << std::setw(12) << result.Syscalls.Waits / messages
+            << std::setw(14) << (result.Syscalls.Receives + result.Syscalls.Waits) / messages
+            << std::setw(8) << result.Errors << std::endl;
+    }
+
+    return std::all_of(results.begin(), results.end(), [](const ReceiveResult& result) { return result.Errors == 0; });
+}
@@ -0,0 +1,472 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+bool RunReplay(const BenchmarkOptions& options)
+{
+    AnTcpTrafficLogReader reader;
+
+    if (!reader.Open(options.ReplayPath))
+    {
+        std::cout << ">> Failed to open the traffic log " << options.ReplayPath << std::endl;
+        return false;
+    }
+
+    const std::vector<AnTcpTrafficRecord> records = reader.GetRecords();
+    const bool compare = (reader.GetHeader().Flags & ANTCP_TRAFFIC_LOG_RESPONSES) != 0;
+    std::vector<ReplayConnection> connections;
+    uint64_t skipped = 0;
+    LoadReplay(records, connections, skipped);
+
+    size_t requestCount = 0;
+
+    for (const ReplayConnection& connection : connections)
+    {
+        requestCount += connection.Requests.size();
+    }
+
+    std::ostringstream mode;
+
+    if (options.Speed == 0.0)
+    {
+        mode << "as fast as possible, " << options.Connections << " connections at a time with depth " << options.Depth;
+    }
+    else
+    {
+        mode << (options.Speed == 1.0 ? "original timing" : std::to_string(options.Speed) + "x speed");
+    }
+
+    std::cout << ">> Replaying " << requestCount << " requests of " << connections.size() << " connections captured over "
+        << std::fixed << std::setprecision(2) << (records.empty() ? 0.0 : records.back().Time / 1000000000.0) << " s, " << mode.str() << std::endl
+        << ">> " << (compare ? "Comparing the responses with the captured ones" : "The log has no responses, every request is expected to get one")
+        << (skipped > 0 ? ", " + std::to_string(skipped) + " shared memory requests are skipped" : std::string()) << std::endl;
+
+    ReplayResult result{};
+    std::vector<AnTcpPollFd> pollFds;
+    std::vector<ReplayConnection*> polled;
+    size_t done = 0;
+    unsigned int open = 0;
+    const auto start = Clock::now();
+
+    // times of the log are nanoseconds since the capture started
+    const auto scheduled = [&options, start](int64_t time)
+    {
+        return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::nano>(time / options.Speed));
+    };
+
+    const auto finish = [&done, &open](ReplayConnection& connection)
+    {
+        if (connection.Link.Socket != INVALID_SOCKET)
+        {
+            closesocket(connection.Link.Socket);
+            connection.Link.Socket = INVALID_SOCKET;
+            open--;
+        }
+
+        connection.Done = true;
+        done++;
+    };
+
+    const auto fail = [&result, &finish](ReplayConnection& connection)
+    {
+        result.Errors++;
+        result.Missing += connection.InFlight.size() + connection.Requests.size() - connection.NextRequest;
+        connection.InFlight.clear();
+        finish(connection);
+    };
+
+    while (done < connections.size())
+    {
+        const auto now = Clock::now();
+        auto wakeup = now + std::chrono::milliseconds(10);
+        pollFds.clear();
+        polled.clear();
+
+        // the connections are ordered by their first record, so the earliest ones are opened first
+        for (ReplayConnection& connection : connections)
+        {
+            if (connection.Done)
+            {
+                continue;
+            }
+
+            while (connection.NextRequest < connection.Requests.size())
+            {
+                ReplayRequest& request = connection.Requests[connection.NextRequest];
+                auto sendTime = now;
+
+                if (options.Speed > 0.0)
+                {
+                    sendTime = scheduled(request.Record->Time);
+
+                    if (sendTime > now)
+                    {
+                        wakeup = std::min(wakeup, sendTime);
+                        break;
+                    }
+                }
+                else if (connection.InFlight.size() >= options.Depth || (connection.Link.Socket == INVALID_SOCKET && open >= options.Connections))
+                {
+                    break;
+                }
+
+                if (connection.Link.Socket == INVALID_SOCKET)
+                {
+                    connection.Link.Socket = Connect(options);
+
+                    if (connection.Link.Socket == INVALID_SOCKET)
+                    {
+                        fail(connection);
+                        break;
+                    }
+
+                    connection.Link.Input.resize(64 * 1024);
+                    open++;
+                }
+
+                // size | type | request id with frame version 2 | payload, exactly as the client sent it
+                const AnTcpSizeType packetSize = static_cast<AnTcpSizeType>(request.Record->Size);
+                const char* sizeBytes = reinterpret_cast<const char*>(&packetSize);
+                connection.Link.Output.insert(connection.Link.Output.end(), sizeBytes, sizeBytes + sizeof(AnTcpSizeType));
+                connection.Link.Output.insert(connection.Link.Output.end(), request.Record->Data, request.Record->Data + request.Record->Size);
+                request.Start = sendTime;
+                result.Requests++;
+                connection.NextRequest++;
+
+                // requests the server did not answer when they were captured are not waited for
+                if (!compare || !request.Responses.empty())
+                {
+                    if (connection.InFlight.empty())
+                    {
+                        connection.LastReceive = now;
+                    }
+
+                    connection.InFlight.push_back(&request);
+                }
+            }
+
+            if (connection.Done)
+            {
+                continue;
+            }
+
+            if (connection.Link.Socket == INVALID_SOCKET)
+            {
+                // waits for its first request or its turn, unless it has none
+                if (connection.Requests.empty())
+                {
+                    finish(connection);
+                }
+
+                continue;
+            }
+
+            if (!FlushOutput(connection.Link))
+            {
+                fail(connection);
+                continue;
+            }
+
+            if (connection.NextRequest == connection.Requests.size() && connection.InFlight.empty() && connection.Link.Output.empty())
+            {
+                // the original timing keeps the connection open until the captured one was closed
+                const auto closeTime = options.Speed > 0.0 && connection.CloseTime != std::numeric_limits<int64_t>::max() ? scheduled(connection.CloseTime) : now;
+
+                if (closeTime <= now)
+                {
+                    finish(connection);
+                    continue;
+                }
+
+                wakeup = std::min(wakeup, closeTime);
+            }
+            else if (!connection.InFlight.empty() && now - connection.LastReceive > REPLAY_TIMEOUT)
+            {
+                fail(connection);
+                continue;
+            }
+
+            pollFds.push_back(AnTcpPollFd{ connection.Link.Socket, static_cast<short>(POLLIN | (connection.Link.Output.empty() ? 0 : POLLOUT)), 0 });
+            polled.push_back(&connection);
+        }
+
+        if (pollFds.empty())
+        {
+            if (done < connections.size())
+            {
+                std::this_thread::sleep_until(wakeup);
+            }
+
+            continue;
+        }
+
+        if (PollFor(pollFds.data(), pollFds.size(), std::max(Clock::duration::zero(), wakeup - Clock::now())) <= 0)
+        {
+            continue;
+        }
+
+        const auto received = Clock::now();
+
+        for (size_t i = 0; i < polled.size(); ++i)
+        {
+            if ((pollFds[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+            {
+                continue;
+            }
+
+            ReplayConnection& connection = *polled[i];
+            Connection& link = connection.Link;
+            bool alive = true;
+
+            while (alive)
+            {
+                const auto receivedBytes = recv(link.Socket, link.Input.data() + link.InputEnd, static_cast<int>(link.Input.size() - link.InputEnd), 0);
+
+                if (receivedBytes == 0 || (receivedBytes == SOCKET_ERROR && !AnTcpWouldBlock()))
+                {
+                    alive = false;
+                    break;
+                }
+
+                if (receivedBytes == SOCKET_ERROR)
+                {
+                    break;
+                }
+
+                link.InputEnd += static_cast<size_t>(receivedBytes);
+                connection.LastReceive = received;
+                alive = ProcessReplayResponses(connection, result, compare, received);
+            }
+
+            if (!alive)
+            {
+                fail(connection);
+            }
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const auto microseconds = [](uint64_t nanoseconds) { return nanoseconds / 1000.0; };
+
+    std::cout << std::endl << std::right << std::setw(12) << "requests" << std::setw(12) << "req/s" << std::setw(12) << "responses"
+        << std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us" << std::setw(10) << "p99.9 us" << std::setw(10) << "max us"
+        << std::setw(8) << "diffs" << std::setw(10) << "missing" << std::setw(12) << "unexpected" << std::setw(8) << "errors" << std::endl;
+
+    std::cout << std::fixed << std::setw(12) << result.Requests
+        << std::setw(12) << std::setprecision(0) << result.Requests / seconds
+        << std::setw(12) << result.Responses
+        << std::setw(10) << std::setprecision(1) << microseconds(result.Latency.GetPercentile(50.0))
+        << std::setw(10) << microseconds(result.Latency.GetPercentile(90.0))
+        << std::setw(10) << microseconds(result.Latency.GetPercentile(99.0))
+        << std::setw(10) << microseconds(result.Latency.GetPercentile(99.9))
+        << std::setw(10) << microseconds(result.Latency.GetMax())
+        << std::setw(8) << result.Diffs
+        << std::setw(10) << result.Missing
+        << std::setw(12) << result.Unexpected
+        << std::setw(8) << result.Errors << std::endl << std::endl;
+
+    std::cout << ">> Replay took " << std::setprecision(2) << seconds << " s" << std::endl;
+
+    for (size_t type = 0; type < result.TypeDiffs.size(); ++type)
+    {
+        if (result.TypeDiffs[type] > 0)
+        {
+            std::cout << ">> " << result.TypeDiffs[type] << " responses to type " << type
+                << (type < MESSAGE_TYPE_COUNT ? std::string(" (") + MESSAGE_TYPE_NAMES[type] + ")" : std::string()) << " differ" << std::endl;
+        }
+    }
+
+    return result.Diffs == 0 && result.Missing == 0 && result.Unexpected == 0 && result.Errors == 0;
+}
+
+void LoadReplay(const std::vector<AnTcpTrafficRecord>& records, std::vector<ReplayConnection>& connections, uint64_t& skipped)
+{
+    std::unordered_map<AnTcpConnectionId, size_t> indices;
+
+    // per connection: the first request without a response for frame version 1, and the latest request of every id for version 2
+    std::vector<size_t> unanswered;
+    std::vector<std::unordered_map<AnTcpRequestId, size_t>> ids;
+
+    for (const AnTcpTrafficRecord& record : records)
+    {
+        const auto [entry, added] = indices.try_emplace(record.Connection, connections.size());
+
+        if (added)
+        {
+            connections.emplace_back();
+            connections.back().Id = record.Connection;
+            unanswered.push_back(0);
+            ids.emplace_back();
+        }
+
+        ReplayConnection& connection = connections[entry->second];
+
+        if (record.Kind == AnTcpTrafficRecordKind::Close)
+        {
+            connection.CloseTime = record.Time;
+            continue;
+        }
+
+        // the rings of a shared memory connection can't be replayed, its requests continue over the socket
+        if (record.Size == 0 || record.Data[0] == ANTCP_MESSAGE_SHARED_MEMORY)
+        {
+            skipped += record.Kind == AnTcpTrafficRecordKind::Request ? 1 : 0;
+            continue;
+        }
+
+        if (record.Kind == AnTcpTrafficRecordKind::Request)
+        {
+            ReplayRequest request{};
+            request.Record = &record;
+            request.HasId = record.FrameVersion >= ANTCP_FRAME_VERSION_2 && record.Size >= sizeof(AnTcpMessageType) + sizeof(AnTcpRequestId);
+
+            if (request.HasId)
+            {
+                memcpy(&request.Id, record.Data + sizeof(AnTcpMessageType), sizeof(AnTcpRequestId));
+                ids[entry->second][request.Id] = connection.Requests.size();
+            }
+
+            connection.Requests.push_back(std::move(request));
+            continue;
+        }
+
+        if (record.Kind != AnTcpTrafficRecordKind::Response || record.Size < sizeof(AnTcpMessageType) + sizeof(AnTcpRequestId))
+        {
+            continue;
+        }
+
+        ReplayRequest* request = nullptr;
+
+        if (record.FrameVersion >= ANTCP_FRAME_VERSION_2)
+        {
+            AnTcpRequestId id = 0;
+            memcpy(&id, record.Data + sizeof(AnTcpMessageType), sizeof(AnTcpRequestId));
+            const auto match = ids[entry->second].find(id);
+            request = match != ids[entry->second].end() ? &connection.Requests[match->second] : nullptr;
+        }
+        else
+        {
+            size_t& next = unanswered[entry->second];
+
+            while (next < connection.Requests.size() && connection.Requests[next].HasId)
+            {
+                ++next;
+            }
+
+            // more responses than requests belong to the last one
+            request = next < connection.Requests.size() ? &connection.Requests[next++] : (!connection.Requests.empty() ? &connection.Requests.back() : nullptr);
+        }
+
+        if (request)
+        {
+            request->Responses.push_back(&record);
+        }
+    }
+}
+
+bool ProcessReplayResponses(ReplayConnection& connection, ReplayResult& result, bool compare, Clock::time_point now)
+{
+    Connection& link = connection.Link;
+    size_t offset = 0;
+
+    while (link.InputEnd - offset >= sizeof(AnTcpSizeType))
+    {
+        // a negotiate response changes the framing of the following ones
+        const size_t headerSize = sizeof(AnTcpMessageType) + (connection.FrameVersion >= ANTCP_FRAME_VERSION_2 ? sizeof(AnTcpRequestId) : 0);
+        AnTcpSizeType packetSize = 0;
+        memcpy(&packetSize, link.Input.data() + offset, sizeof(AnTcpSizeType));
+
+        if (packetSize < static_cast<AnTcpSizeType>(headerSize))
+        {
+            return false;
+        }
+
+        if (link.InputEnd - offset < sizeof(AnTcpSizeType) + packetSize)
+        {
+            // the incomplete response is moved to the start of the buffer below, make sure it fits
+            link.Input.resize(std::max(link.Input.size(), sizeof(AnTcpSizeType) + static_cast<size_t>(packetSize)));
+            break;
+        }
+
+        const char* packet = link.Input.data() + offset + sizeof(AnTcpSizeType);
+        const char* payload = packet + headerSize;
+        const size_t payloadSize = static_cast<size_t>(packetSize) - headerSize;
+        AnTcpRequestId id = 0;
+
+        if (headerSize > sizeof(AnTcpMessageType))
+        {
+            memcpy(&id, packet + sizeof(AnTcpMessageType), sizeof(AnTcpRequestId));
+        }
+
+        offset += sizeof(AnTcpSizeType) + packetSize;
+
+        // frames of the topics the connection subscribed to are no responses
+        if (packet[0] == ANTCP_MESSAGE_PUBLISH)
+        {
+            continue;
+        }
+
+        const auto match = connection.FrameVersion >= ANTCP_FRAME_VERSION_2
+            ? std::find_if(connection.InFlight.begin(), connection.InFlight.end(), [id](const ReplayRequest* request) { return request->HasId && request->Id == id; })
+            : connection.InFlight.begin();
+
+        if (match == connection.InFlight.end())
+        {
+            result.Unexpected++;
+            continue;
+        }
+
+        ReplayRequest& request = **match;
+        result.Responses++;
+
+        if (request.Received == 0)
+        {
+            result.Latency.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - request.Start).count()));
+        }
+
+        if (compare)
+        {
+            // type | request id | payload
+            const AnTcpTrafficRecord& expected = *request.Responses[request.Received];
+            const char* expectedPayload = expected.Data + sizeof(AnTcpMessageType) + sizeof(AnTcpRequestId);
+            const size_t expectedSize = expected.Size - sizeof(AnTcpMessageType) - sizeof(AnTcpRequestId);
+
+            if (packet[0] != expected.Data[0] || payloadSize != expectedSize || memcmp(payload, expectedPayload, payloadSize) != 0)
+            {
+                const auto type = static_cast<uint8_t>(request.Record->Data[0]);
+                result.Diffs++;
+                result.TypeDiffs[type]++;
+
+                if (result.Diffs <= REPLAY_PRINTED_DIFFS)
+                {
+                    std::cout << ">> Response " << request.Received + 1 << " to request " << &request - connection.Requests.data() + 1 << " (type " << +type
+                        << ") of connection " << connection.Id << " differs: expected type " << +static_cast<uint8_t>(expected.Data[0]) << " with "
+                        << expectedSize << " bytes, got type " << +static_cast<uint8_t>(packet[0]) << " with " << payloadSize << " bytes" << std::endl;
+                }
+            }
+        }
+
+        request.Received++;
+
+        if (packet[0] == ANTCP_MESSAGE_NEGOTIATE && payloadSize == sizeof(int))
+        {
+            memcpy(&connection.FrameVersion, payload, sizeof(int));
+        }
+
+        if (request.Received >= (compare ? request.Responses.size() : 1))
+        {
+            connection.InFlight.erase(match);
+        }
+    }
+
+    // keep the incomplete response at the start of the buffer
+    memmove(link.Input.data(), link.Input.data() + offset, link.InputEnd - offset);
+    link.InputEnd -= offset;
+    return true;
+}
@@ -0,0 +1,157 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+bool OpenSharedMemory(Connection& connection, const BenchmarkOptions& options)
+{
+    const AnTcpSizeType requestSize = 1;
+    char request[sizeof(AnTcpSizeType) + 1]{ 0 };
+    memcpy(request, &requestSize, sizeof(requestSize));
+    request[sizeof(AnTcpSizeType)] = ANTCP_MESSAGE_SHARED_MEMORY;
+
+    if (!AnTcpSendAll(connection.Socket, request, sizeof(request)))
+    {
+        return false;
+    }
+
+    // the socket is non-blocking, the response is the name of the segment
+    std::vector<char> response;
+    AnTcpSizeType packetSize = 0;
+
+    while (response.size() < sizeof(AnTcpSizeType) || response.size() < sizeof(AnTcpSizeType) + packetSize)
+    {
+        AnTcpPollFd pollFd{ connection.Socket, POLLIN, 0 };
+        char buffer[256];
+
+        if (AnTcpPoll(&pollFd, 1, 5000) <= 0)
+        {
+            return false;
+        }
+
+        const auto receivedBytes = recv(connection.Socket, buffer, sizeof(buffer), 0);
+
+        if (receivedBytes == 0 || (receivedBytes < 0 && !AnTcpWouldBlock()))
+        {
+            return false;
+        }
+
+        if (receivedBytes < 0)
+        {
+            continue;
+        }
+
+        response.insert(response.end(), buffer, buffer + receivedBytes);
+
+        if (response.size() >= sizeof(AnTcpSizeType))
+        {
+            memcpy(&packetSize, response.data(), sizeof(packetSize));
+
+            if (packetSize < 1 || packetSize > 1024)
+            {
+                return false;
+            }
+        }
+    }
+
+    const std::string name(response.data() + sizeof(AnTcpSizeType) + 1, packetSize - 1);
+
+    // an empty name means the server keeps using the socket
+    if (response[sizeof(AnTcpSizeType)] != ANTCP_MESSAGE_SHARED_MEMORY || name.empty())
+    {
+        return false;
+    }
+
+    connection.SharedMemory = new AnTcpSharedMemory();
+
+    if (!connection.SharedMemory->Open(name, std::chrono::microseconds(options.SpinTime)))
+    {
+        delete connection.SharedMemory;
+        connection.SharedMemory = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+void RunSharedMemoryConnection(const BenchmarkOptions& options, Connection& connection, ThreadResult& result, Clock::time_point measureStart, Clock::time_point end)
+{
+    const std::vector<MessageType> mix = BuildMix(options);
+    const std::vector<char> echoPayload(options.EchoSize, 'A');
+    const auto interval = options.Rate > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Connections / options.Rate)) : Clock::duration::zero();
+
+    AnTcpSharedRing& requests = connection.SharedMemory->GetRequests();
+    AnTcpSharedRing& responses = connection.SharedMemory->GetResponses();
+
+    while (true)
+    {
+        const auto now = Clock::now();
+
+        if (now >= end)
+        {
+            break;
+        }
+
+        auto nextWakeup = end;
+
+        if (interval > Clock::duration::zero())
+        {
+            while (connection.NextSend <= now)
+            {
+                QueueRequest(connection, options, mix, echoPayload, connection.NextSend);
+                connection.NextSend += interval;
+            }
+
+            nextWakeup = std::min(nextWakeup, connection.NextSend);
+        }
+        else
+        {
+            while (connection.InFlight.size() < options.Depth)
+            {
+                QueueRequest(connection, options, mix, echoPayload, now);
+            }
+        }
+
+        // blocks while the request ring is full, like a blocking send()
+        if (!connection.Output.empty() && !requests.Write(connection.Output.data(), connection.Output.size()))
+        {
+            result.Disconnects++;
+            break;
+        }
+
+        connection.Output.clear();
+
+        if (!responses.WaitForReadable(1, nextWakeup - now))
+        {
+            if (connection.SharedMemory->IsClosed())
+            {
+                result.Disconnects++;
+                break;
+            }
+
+            continue;
+        }
+
+        // one timestamp per wakeup, like one per recv() on the socket
+        const auto receiveTime = Clock::now();
+        const size_t readable = responses.GetReadable();
+        connection.Input.resize(std::max(connection.Input.size(), connection.InputEnd + readable));
+        responses.Copy(connection.Input.data() + connection.InputEnd, readable);
+        responses.Consume(readable);
+        connection.InputEnd += readable;
+
+        if (!ProcessResponses(connection, result, measureStart, receiveTime))
+        {
+            result.Disconnects++;
+            break;
+        }
+    }
+
+    connection.InFlight.clear();
+    connection.SharedMemory->Close();
+    delete connection.SharedMemory;
+    connection.SharedMemory = nullptr;
+
+    closesocket(connection.Socket);
+    connection.Socket = INVALID_SOCKET;
+}
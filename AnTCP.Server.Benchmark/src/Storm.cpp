@@ -0,0 +1,182 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+bool RunStorm(const BenchmarkOptions& options)
+{
+    const unsigned int threadCount = std::min({ options.Connections, options.Storm, options.Threads > 0 ? options.Threads : std::max(1u, std::thread::hardware_concurrency()) });
+
+    std::cout << ">> Opening " << options.Storm << " connections, " << options.Connections << " at a time on " << threadCount << " threads" << std::endl;
+
+    std::vector<ThreadResult> results(threadCount);
+    std::vector<std::vector<SOCKET>> sockets(threadCount);
+    std::vector<std::thread> threads;
+
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Duration));
+
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        // spread the remainders over the first threads
+        const unsigned int count = options.Storm / threadCount + (i < options.Storm % threadCount ? 1 : 0);
+        const unsigned int window = std::max(1u, options.Connections / threadCount + (i < options.Connections % threadCount ? 1 : 0));
+        threads.emplace_back(RunStormConnections, std::cref(options), count, window, std::ref(results[i]), std::ref(sockets[i]), end);
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    PrintResults(options, results, seconds);
+
+    size_t accepted = 0;
+
+    for (std::vector<SOCKET>& threadSockets : sockets)
+    {
+        accepted += threadSockets.size();
+
+        for (SOCKET connectionSocket : threadSockets)
+        {
+            // reset instead of a graceful close, so repeated runs don't run out of local ports
+            const linger lingerOption{ 1, 0 };
+            setsockopt(connectionSocket, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&lingerOption), sizeof(lingerOption));
+            closesocket(connectionSocket);
+        }
+    }
+
+    return accepted == options.Storm;
+}
+
+void RunStormConnections(const BenchmarkOptions& options, unsigned int count, unsigned int window, ThreadResult& result, std::vector<SOCKET>& sockets, Clock::time_point end)
+{
+    std::mt19937 random(count ^ window);
+    std::vector<StormConnection> pending;
+    std::vector<AnTcpPollFd> pollFds;
+    unsigned int started = 0;
+
+    sockets.reserve(count);
+
+    while (started < count || !pending.empty())
+    {
+        if (Clock::now() >= end)
+        {
+            // handshakes that did not finish in time and connections that were never started
+            for (const StormConnection& connection : pending)
+            {
+                closesocket(connection.Socket);
+            }
+
+            result.Disconnects += pending.size() + (count - started);
+            return;
+        }
+
+        while (started < count && pending.size() < window)
+        {
+            StormConnection connection{};
+            connection.Start = Clock::now();
+            connection.Socket = Connect(options, false);
+            ++started;
+
+            if (connection.Socket == INVALID_SOCKET)
+            {
+                result.Disconnects++;
+                continue;
+            }
+
+            pending.push_back(connection);
+        }
+
+        pollFds.clear();
+
+        for (const StormConnection& connection : pending)
+        {
+            pollFds.push_back(AnTcpPollFd{ connection.Socket, static_cast<short>(connection.Connected ? POLLIN : POLLOUT), 0 });
+        }
+
+        if (PollFor(pollFds.data(), pollFds.size(), std::chrono::milliseconds(100)) <= 0)
+        {
+            continue;
+        }
+
+        // backwards, so removing a connection only moves one that was already handled
+        for (size_t i = pending.size(); i-- > 0;)
+        {
+            StormConnection& connection = pending[i];
+
+            if (pollFds[i].revents == 0)
+            {
+                continue;
+            }
+
+            bool failed = false;
+            bool done = false;
+
+            if (!connection.Connected)
+            {
+                int error = 0;
+                socklen_t errorSize = static_cast<socklen_t>(sizeof(error));
+                getsockopt(connection.Socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &errorSize);
+
+                if (error != 0)
+                {
+                    failed = true;
+                }
+                else
+                {
+                    // the response proves that the server accepted the connection and set up its handler
+                    const int values[2]{ static_cast<int>(random() % 1000), static_cast<int>(random() % 1000) };
+                    const AnTcpSizeType packetSize = 1 + sizeof(values);
+                    char request[sizeof(AnTcpSizeType) + 1 + sizeof(values)]{ 0 };
+                    memcpy(request, &packetSize, sizeof(packetSize));
+                    request[sizeof(AnTcpSizeType)] = static_cast<char>(MessageType::ADD);
+                    memcpy(request + sizeof(AnTcpSizeType) + 1, values, sizeof(values));
+
+                    connection.Connected = true;
+                    connection.Expected = values[0] + values[1];
+                    failed = !AnTcpSendAll(connection.Socket, request, sizeof(request));
+                }
+            }
+            else
+            {
+                const auto received = recv(connection.Socket, connection.Response + connection.ResponseSize, static_cast<int>(sizeof(connection.Response) - connection.ResponseSize), 0);
+
+                if (received > 0)
+                {
+                    connection.ResponseSize += static_cast<size_t>(received);
+
+                    if (connection.ResponseSize == sizeof(connection.Response))
+                    {
+                        AnTcpSizeType packetSize = 0;
+                        memcpy(&packetSize, connection.Response, sizeof(packetSize));
+
+                        RecordResponse(PendingRequest{ MessageType::ADD, connection.Start, connection.Expected }, connection.Response + sizeof(AnTcpSizeType), packetSize, Clock::now(), connection.Start, result);
+                        result.Connects++;
+                        sockets.push_back(connection.Socket);
+                        done = true;
+                    }
+                }
+                else
+                {
+                    failed = received == 0 || !AnTcpWouldBlock();
+                }
+            }
+
+            if (failed)
+            {
+                result.Disconnects++;
+                closesocket(connection.Socket);
+            }
+
+            if (failed || done)
+            {
+                connection = pending.back();
+                pending.pop_back();
+            }
+        }
+    }
+}
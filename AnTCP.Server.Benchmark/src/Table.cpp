@@ -0,0 +1,164 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+bool RunTableBenchmark(const BenchmarkOptions& options)
+{
+    // the callbacks count their calls in the payload, two of them so the writer has something to swap
+    static constexpr AnTcpCallbackFunction callbacks[2]
+    {
+        [](ClientHandler*, AnTcpMessageType, const void* data, int) { ++*static_cast<uint64_t*>(const_cast<void*>(data)); },
+        [](ClientHandler*, AnTcpMessageType, const void* data, int) { *static_cast<uint64_t*>(const_cast<void*>(data)) += 1; }
+    };
+
+    // outside of the function, so the lookups can't be hoisted out of the loop. The map is
+    // how packets were dispatched before the table, a std::function per message type
+    static std::unordered_map<AnTcpMessageType, AnTcpCallback> callbackMap;
+    static AnTcpCallbackTable plainTable{};
+    AnTcpCallbackRegistry registry;
+
+    const auto fill = [](AnTcpCallbackTable& table, AnTcpCallbackFunction callback)
+    {
+        for (size_t i = 0; i < MESSAGE_TYPE_COUNT; ++i)
+        {
+            table[i].Function = callback;
+        }
+
+        return true;
+    };
+
+    for (size_t i = 0; i < MESSAGE_TYPE_COUNT; ++i)
+    {
+        callbackMap[static_cast<AnTcpMessageType>(i)] = callbacks[0];
+    }
+
+    fill(plainTable, callbacks[0]);
+    registry.Update([&fill](AnTcpCallbackTable& table) { return fill(table, callbacks[0]); });
+
+    std::cout << ">> Looking up callbacks on " << options.TableReaders << " threads for " << options.Duration << " s per table" << std::endl << std::endl
+        << std::left << std::setw(18) << "table" << std::right << std::setw(14) << "lookups" << std::setw(14) << "lookups/s"
+        << std::setw(12) << "ns/lookup" << std::setw(12) << "versions/s" << std::endl;
+
+    bool valid = true;
+
+    const auto measure = [&options, &valid](const char* name, auto lookup, auto write)
+    {
+        std::atomic<bool> running = true;
+        std::vector<uint64_t> counts(options.TableReaders, 0);
+        std::vector<uint64_t> lookups(options.TableReaders, 0);
+        std::vector<std::thread> threads;
+        uint64_t versions = 0;
+
+        for (unsigned int i = 0; i < options.TableReaders; ++i)
+        {
+            threads.emplace_back([&running, &lookup, &count = counts[i], &lookupCount = lookups[i]]()
+            {
+                uint64_t local = 0;
+                uint64_t done = 0;
+
+                while (running.load(std::memory_order_relaxed))
+                {
+                    // a few lookups per check of the flag, the types change so every lookup is a new one
+                    for (unsigned int type = 0; type < 64; ++type)
+                    {
+                        lookup(static_cast<AnTcpMessageType>(type % MESSAGE_TYPE_COUNT), &local);
+                    }
+
+                    done += 64;
+                }
+
+                count = local;
+                lookupCount = done;
+            });
+        }
+
+        const auto start = Clock::now();
+        const auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.Duration));
+        versions = write(end);
+
+        std::this_thread::sleep_until(end);
+        running = false;
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        uint64_t total = 0;
+
+        for (unsigned int i = 0; i < options.TableReaders; ++i)
+        {
+            total += lookups[i];
+
+            // every lookup has to call a callback, none may be lost while the versions change
+            valid = valid && counts[i] == lookups[i];
+        }
+
+        std::cout << std::left << std::setw(18) << name << std::right << std::fixed
+            << std::setw(14) << total
+            << std::setw(14) << std::setprecision(0) << total / seconds
+            << std::setw(12) << std::setprecision(2) << seconds * options.TableReaders * 1000000000.0 / std::max<uint64_t>(1, total)
+            << std::setw(12) << std::setprecision(0) << versions / seconds << std::endl;
+    };
+
+    const auto noWriter = [](Clock::time_point) { return uint64_t{ 0 }; };
+
+    measure("unordered_map", [](AnTcpMessageType type, uint64_t* count)
+    {
+        if (callbackMap.contains(type))
+        {
+            callbackMap.at(type)(nullptr, type, count, 0);
+        }
+    }, noWriter);
+
+    measure("array", [](AnTcpMessageType type, uint64_t* count)
+    {
+        plainTable[AnTcpCallbackIndex(type)](nullptr, type, count, 0);
+    }, noWriter);
+
+    measure("registry", [&registry](AnTcpMessageType type, uint64_t* count)
+    {
+        const AnTcpCallbackRegistry::Reader reader = registry.Read();
+        reader[type](nullptr, type, count, 0);
+    }, noWriter);
+
+    measure("registry+writer", [&registry](AnTcpMessageType type, uint64_t* count)
+    {
+        const AnTcpCallbackRegistry::Reader reader = registry.Read();
+        reader[type](nullptr, type, count, 0);
+    }, [&options, &registry, &fill](Clock::time_point end)
+    {
+        // publishes on this thread, alternating between the two callbacks
+        const auto interval = options.SwapRate > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.SwapRate)) : Clock::duration::zero();
+        auto next = Clock::now();
+        uint64_t versions = 0;
+
+        while (Clock::now() < end)
+        {
+            registry.Update([&fill, versions](AnTcpCallbackTable& table) { return fill(table, callbacks[versions % 2]); });
+            versions++;
+
+            if (interval > Clock::duration::zero())
+            {
+                next += interval;
+                std::this_thread::sleep_until(next);
+            }
+        }
+
+        return versions;
+    });
+
+    std::cout << ">> " << registry.GetVersionCount() << " versions published, " << registry.GetRetiredCount() << " not deleted yet" << std::endl;
+
+    if (!valid)
+    {
+        std::cout << ">> Lookups went missing" << std::endl;
+    }
+
+    return valid;
+}
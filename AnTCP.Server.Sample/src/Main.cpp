@@ -1,7 +1,26 @@
 #include "Main.hpp"
 
-int main()
+#include <csignal>
+
+int main(int argc, char** argv)
 {
+    SampleOptions options{};
+
+    if (!ParseArguments(argc, argv, options))
+    {
+        std::cout << "Usage: AnTCP.Server.Sample [--ip=127.0.0.1] [--port=47110] [--quiet] [--event-loop[=threads]]" << std::endl
+            << "                           [--io-uring[=threads]] [--nodelay] [--batch] [--max-packet-size=bytes]" << std::endl
+            << "                           [--max-connections=count] [--queue-connections] [--cache[=bytes]] [--single-flight]" << std::endl
+            << "                           [--writer] [--shm[=spin-us]] [--ipv6[=::1]] [--unix=path] [--listeners=count]" << std::endl
+            << "                           [--rate-limit=per-second[:burst]] [--hash-rate-limit=per-second] [--max-in-flight=count]" << std::endl
+            << "                           [--pooled] [--priorities] [--hash-deadline=ms] [--workers=count] [--swap[=per-second]]" << std::endl
+            << "                           [--push-policy=drop-oldest|coalesce-latest|disconnect] [--push-queue=frames]" << std::endl
+            << "                           [--capture=path] [--capture-responses] [--low-latency[=cores]] [--spin-time=us]" << std::endl
+            << "                           [--busy-poll=us]" << std::endl;
+        return 1;
+    }
+
+#ifdef _WIN32
     SetConsoleTitle(L"AnTCP.Server Sample");
 
     if (!SetConsoleCtrlHandler(SigIntHandler, 1))
@@ -9,26 +28,471 @@ int main()
         std::cout << ">> SetConsoleCtrlHandler() failed: " << GetLastError() << std::endl;
         return 1;
     }
+#else
+    std::signal(SIGINT, SigIntHandler);
+    std::signal(SIGTERM, SigIntHandler);
+#endif
+
+    Server = new AnTcpServer(options.Ip, options.Port);
+
+    if (!options.Ipv6Address.empty())
+    {
+        Server->AddListener(options.Ipv6Address, std::to_string(options.Port));
+    }
+
+    if (!options.UnixPath.empty())
+    {
+        Server->AddUnixListener(options.UnixPath);
+    }
+
+    Server->SetListenerShards(options.ListenerShards);
+
+    if (!Quiet)
+    {
+        Server->SetOnClientConnected(ConnectedCallback);
+        Server->SetOnClientDisconnected(DisconnectedCallback);
+    }
+
+    Server->SetIoBackend(options.IoBackend, options.IoThreadCount);
+    Server->SetNoDelay(options.NoDelay);
+    Server->SetBatchResponses(options.BatchResponses);
+    Server->SetMaxPacketSize(options.MaxPacketSize);
+    Server->SetMaxConnections(options.MaxConnections, options.ConnectionLimitMode);
+    Server->SetSharedMemory(options.SharedMemory, ANTCP_SHARED_MEMORY_RING_SIZE, std::chrono::microseconds(options.SharedMemorySpinTime));
+    Server->SetLowLatency(options.LowLatency, options.LowLatencyCores, std::chrono::microseconds(options.SpinTime), std::chrono::microseconds(options.BusyPoll));
+
+    // requests over the limits get a busy response, a flooding client can't starve the others
+    if (options.RateLimit > 0.0)
+    {
+        Server->SetConnectionRateLimit(options.RateLimit, options.RateBurst);
+    }
+
+    if (options.HashRateLimit > 0.0)
+    {
+        Server->SetMessageRateLimit((char)MessageType::HASH, options.HashRateLimit);
+    }
+
+    if (options.MaxInFlight > 0)
+    {
+        Server->SetMaxInFlight(options.MaxInFlight);
+    }
+
+    // the arithmetic and the hash callbacks share the worker pool, with priorities the cheap ones skip the queued hashes
+    AnTcpCallbackOptions queryOptions{};
+    queryOptions.Dispatch = options.Pooled ? AnTcpDispatchMode::Pooled : AnTcpDispatchMode::Inline;
+    queryOptions.Priority = options.Priorities ? AnTcpPriority::High : AnTcpPriority::Normal;
+    Server->SetWorkerCount(options.WorkerCount);
+
+    Server->AddCallback((char)MessageType::ADD, AddCallback, queryOptions);
+    Server->AddCallback((char)MessageType::SUBTRACT, SubtractCallback, queryOptions);
+    Server->AddCallback((char)MessageType::MULTIPLY, MultiplyCallback, queryOptions);
+    Server->AddCallback((char)MessageType::MIN_AVG_MAX, MinAvgMaxCallback, queryOptions);
+    Server->AddCallback((char)MessageType::ECHO, EchoCallback);
+
+    // the digest only depends on the payload, so its responses can be cached
+    AnTcpCallbackOptions hashOptions{};
+    hashOptions.Dispatch = queryOptions.Dispatch;
+    hashOptions.Priority = options.Priorities ? AnTcpPriority::Bulk : AnTcpPriority::Normal;
+    hashOptions.Deadline = options.HashDeadline;
+    hashOptions.Cacheable = options.Cache;
+    hashOptions.SingleFlight = options.SingleFlight;
+    Server->SetResponseCacheSize(options.CacheSize);
+    Server->AddCallback((char)MessageType::HASH, HashCallback, hashOptions);
+    Server->AddCallback((char)MessageType::POINTS, PointsCallback);
+
+    // bots subscribe to topics with the protocol messages, this lets them publish too
+    Server->SetSlowSubscriberPolicy(options.PushPolicy, options.PushQueueLimit);
+    Server->AddCallback((char)MessageType::PUBLISH, PublishCallback);
+
+    // suspends until its timer fired, the I/O threads serve other requests meanwhile
+    Timer = new DelayTimer();
+    Server->AddTaskCallback((char)MessageType::DELAY, DelayTask);
+
+    // swaps the arithmetic callbacks while the clients use them, requests run either the old or the new ones
+    CallbackSwapper* swapper = options.SwapRate != 0.0 ? new CallbackSwapper(queryOptions, options.SwapRate) : nullptr;
+
+    std::cout << ">> Starting server on: " << options.Ip << ":" << std::to_string(options.Port) << std::endl;
+
+    if (!options.Ipv6Address.empty())
+    {
+        std::cout << ">> Starting server on: [" << options.Ipv6Address << "]:" << std::to_string(options.Port) << std::endl;
+    }
+
+    if (!options.UnixPath.empty())
+    {
+        std::cout << ">> Starting server on: " << options.UnixPath << std::endl;
+    }
+
+    if (!options.CapturePath.empty() && !Server->StartTrafficLog(options.CapturePath, options.CaptureResponses))
+    {
+        std::cout << ">> Failed to create the traffic log " << options.CapturePath << std::endl;
+        return 1;
+    }
+
+    const AnTcpError error = Server->Run();
+
+    if (swapper)
+    {
+        swapper->Stop();
+        const auto [versions, retired] = Server->GetCallbackVersions();
+        std::cout << ">> Callback table: " << swapper->GetSwapCount() << " swaps, " << versions << " versions published, "
+            << retired << " not deleted yet" << std::endl;
+        delete swapper;
+    }
+
+    if (error != AnTcpError::Success)
+    {
+        std::cout << ">> Failed to start the server" << std::endl;
+        return 1;
+    }
+
+    std::cout << ">> Hash callback ran " << HashCount << " times, " << Server->GetCoalescedRequestCount() << " requests were coalesced" << std::endl;
+
+    std::cout << ">> Delay tasks: at most " << MaxSuspendedDelays << " were suspended at once" << std::endl;
+    std::cout << ">> " << Server->GetRejectedRequestCount() << " requests got a busy response, "
+        << Server->GetTimedOutRequestCount() << " timed out" << std::endl;
+
+    if (!options.CapturePath.empty())
+    {
+        Server->StopTrafficLog();
+        const AnTcpTrafficLogStats stats = Server->GetTrafficLogStats();
+        std::cout << ">> Traffic log: " << stats.Records << " records, " << stats.Bytes << " bytes captured into "
+            << options.CapturePath << ", " << stats.Dropped << " dropped" << std::endl;
+    }
 
-    const std::string ip = "127.0.0.1";
-    const unsigned short port = 47110;
+    const AnTcpPubSubStats pubSubStats = Server->GetPubSubStats();
+
+    if (pubSubStats.Published > 0)
+    {
+        std::cout << ">> Publish: " << pubSubStats.Published << " frames published, " << pubSubStats.Sent << " sent, "
+            << pubSubStats.Dropped << " dropped, " << pubSubStats.Coalesced << " coalesced, "
+            << pubSubStats.Disconnected << " slow subscribers disconnected" << std::endl;
+    }
 
-    Server = new AnTcpServer(ip, port);
+    for (const AnTcpIoThreadStats& stats : Server->GetIoThreadStats())
+    {
+        const char* type = stats.Type == AnTcpIoThreadType::EventLoop ? "event loop" : stats.Type == AnTcpIoThreadType::IoUring ? "io_uring" : "client threads";
+        const double total = std::max(1.0, static_cast<double>(stats.SpinTime + stats.WorkTime + stats.BlockedTime));
 
-    Server->SetOnClientConnected(ConnectedCallback);
-    Server->SetOnClientDisconnected(DisconnectedCallback);
+        std::cout << ">> I/O " << type << " " << stats.Index << (stats.Core >= 0 ? " on core " + std::to_string(stats.Core) : "") << ": "
+            << std::fixed << std::setprecision(1) << 100.0 * stats.SpinTime / total << "% spinning, " << 100.0 * stats.WorkTime / total << "% working, "
+            << 100.0 * stats.BlockedTime / total << "% blocked, " << stats.SpinHits << " waits ended while spinning, " << stats.Blocks << " blocked" << std::endl;
+    }
 
-    Server->AddCallback((char)MessageType::ADD, AddCallback);
-    Server->AddCallback((char)MessageType::SUBTRACT, SubtractCallback);
-    Server->AddCallback((char)MessageType::MULTIPLY, MultiplyCallback);
-    Server->AddCallback((char)MessageType::MIN_AVG_MAX, MinAvgMaxCallback);
+    if (options.Cache)
+    {
+        const AnTcpResponseCacheStats stats = Server->GetResponseCacheStats();
+        std::cout << ">> Response cache: " << stats.Hits << " hits, " << stats.Misses << " misses, "
+            << stats.Evictions << " evictions, " << stats.Entries << " entries" << std::endl;
+    }
 
-    std::cout << ">> Starting server on: " << ip << ":" << std::to_string(port) << std::endl;
-    Server->Run();
+    // every task finished before Run() returned, they keep their clients alive
+    delete Timer;
 
     std::cout << ">> Stopped server..." << std::endl;
 }
 
+bool ParseArguments(int argc, char** argv, SampleOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const size_t separator = argument.find('=');
+        const std::string name = argument.substr(0, separator);
+        const std::string value = separator != std::string::npos ? argument.substr(separator + 1) : "";
+
+        if (name == "--ip" && !value.empty())
+        {
+            options.Ip = value;
+        }
+        else if (name == "--port" && !value.empty())
+        {
+            options.Port = static_cast<unsigned short>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--quiet")
+        {
+            Quiet = true;
+        }
+        else if (name == "--event-loop")
+        {
+            options.IoBackend = AnTcpIoBackend::EventLoop;
+            options.IoThreadCount = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--io-uring")
+        {
+            options.IoBackend = AnTcpIoBackend::IoUring;
+            options.IoThreadCount = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--nodelay")
+        {
+            options.NoDelay = true;
+        }
+        else if (name == "--batch")
+        {
+            options.BatchResponses = true;
+        }
+        else if (name == "--max-packet-size" && !value.empty())
+        {
+            options.MaxPacketSize = std::atoi(value.c_str());
+        }
+        else if (name == "--max-connections" && !value.empty())
+        {
+            options.MaxConnections = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (name == "--queue-connections")
+        {
+            options.ConnectionLimitMode = AnTcpConnectionLimitMode::Queue;
+        }
+        else if (name == "--cache")
+        {
+            options.Cache = true;
+
+            if (!value.empty())
+            {
+                options.CacheSize = std::strtoull(value.c_str(), nullptr, 10);
+            }
+        }
+        else if (name == "--single-flight")
+        {
+            options.SingleFlight = true;
+        }
+        else if (name == "--writer")
+        {
+            UseWriter = true;
+        }
+        else if (name == "--shm")
+        {
+            options.SharedMemory = true;
+            options.SharedMemorySpinTime = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--low-latency")
+        {
+            options.LowLatency = true;
+            options.LowLatencyCores = AnTcpParseCores(value);
+        }
+        else if (name == "--spin-time" && !value.empty())
+        {
+            options.SpinTime = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--busy-poll" && !value.empty())
+        {
+            options.BusyPoll = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--ipv6")
+        {
+            options.Ipv6Address = !value.empty() ? value : "::1";
+        }
+        else if (name == "--unix" && !value.empty())
+        {
+            options.UnixPath = value;
+        }
+        else if (name == "--listeners" && !value.empty())
+        {
+            options.ListenerShards = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--rate-limit" && !value.empty())
+        {
+            // per-second[:burst]
+            const size_t colon = value.find(':');
+            options.RateLimit = std::atof(value.substr(0, colon).c_str());
+            options.RateBurst = colon != std::string::npos ? std::atof(value.substr(colon + 1).c_str()) : 0.0;
+        }
+        else if (name == "--hash-rate-limit" && !value.empty())
+        {
+            options.HashRateLimit = std::atof(value.c_str());
+        }
+        else if (name == "--max-in-flight" && !value.empty())
+        {
+            options.MaxInFlight = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (name == "--pooled")
+        {
+            options.Pooled = true;
+        }
+        else if (name == "--priorities")
+        {
+            options.Pooled = true;
+            options.Priorities = true;
+        }
+        else if (name == "--hash-deadline" && !value.empty())
+        {
+            options.HashDeadline = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--workers" && !value.empty())
+        {
+            options.WorkerCount = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (name == "--swap")
+        {
+            // without a rate the swapper publishes as fast as it can
+            options.SwapRate = !value.empty() ? std::atof(value.c_str()) : -1.0;
+        }
+        else if (name == "--push-policy" && (value == "drop-oldest" || value == "coalesce-latest" || value == "disconnect"))
+        {
+            options.PushPolicy = value == "drop-oldest" ? AnTcpSlowSubscriberPolicy::DropOldest
+                : value == "coalesce-latest" ? AnTcpSlowSubscriberPolicy::CoalesceLatest : AnTcpSlowSubscriberPolicy::Disconnect;
+        }
+        else if (name == "--capture" && !value.empty())
+        {
+            options.CapturePath = value;
+        }
+        else if (name == "--capture-responses")
+        {
+            options.CaptureResponses = true;
+        }
+        else if (name == "--push-queue" && !value.empty())
+        {
+            options.PushQueueLimit = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else
+        {
+            std::cout << ">> Unknown argument: " << argument << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+DelayTimer::~DelayTimer()
+{
+    {
+        std::lock_guard lock(Mutex);
+        Stopping = true;
+    }
+
+    Changed.notify_one();
+    Thread.join();
+
+    for (auto& [deadline, completion] : Timers)
+    {
+        completion.Complete();
+    }
+}
+
+AnTcpCompletion<> DelayTimer::After(std::chrono::milliseconds delay)
+{
+    AnTcpCompletion<> completion;
+
+    {
+        std::lock_guard lock(Mutex);
+        Timers.emplace(std::chrono::steady_clock::now() + delay, completion);
+    }
+
+    Changed.notify_one();
+    return completion;
+}
+
+void DelayTimer::Run()
+{
+    std::vector<AnTcpCompletion<>> expired;
+    std::unique_lock lock(Mutex);
+
+    while (!Stopping)
+    {
+        if (Timers.empty())
+        {
+            Changed.wait(lock);
+            continue;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const auto end = Timers.upper_bound(now);
+
+        if (end == Timers.begin())
+        {
+            Changed.wait_until(lock, Timers.begin()->first);
+            continue;
+        }
+
+        for (auto timer = Timers.begin(); timer != end; ++timer)
+        {
+            expired.push_back(std::move(timer->second));
+        }
+
+        Timers.erase(Timers.begin(), end);
+
+        // the tasks resume and send their responses on this thread, without the lock held
+        lock.unlock();
+
+        for (AnTcpCompletion<>& completion : expired)
+        {
+            completion.Complete();
+        }
+
+        expired.clear();
+        lock.lock();
+    }
+}
+
+CallbackSwapper::~CallbackSwapper()
+{
+    Stop();
+}
+
+void CallbackSwapper::Stop()
+{
+    {
+        std::lock_guard lock(Mutex);
+        Stopping = true;
+    }
+
+    Changed.notify_one();
+
+    if (Thread.joinable())
+    {
+        Thread.join();
+    }
+}
+
+void CallbackSwapper::Run()
+{
+    const auto interval = std::chrono::duration<double>(Rate > 0.0 ? 1.0 / Rate : 0.0);
+    std::unique_lock lock(Mutex);
+
+    while (!Changed.wait_for(lock, interval, [this] { return Stopping; }))
+    {
+        lock.unlock();
+
+        if (Swaps % 2 == 0)
+        {
+            // all three at once, a request never sees a mix of both sets
+            Server->UpdateCallbacks([this](AnTcpCallbackTable& table)
+            {
+                table[AnTcpCallbackIndex((char)MessageType::ADD)] = AnTcpCallbackEntry{ .Callback = [](ClientHandler* handler, char type, const void* data, int)
+                {
+                    handler->SendDataVar(type, static_cast<const int*>(data)[0] + static_cast<const int*>(data)[1]);
+                }, .Options = Options };
+
+                table[AnTcpCallbackIndex((char)MessageType::SUBTRACT)] = AnTcpCallbackEntry{ .Callback = [](ClientHandler* handler, char type, const void* data, int)
+                {
+                    handler->SendDataVar(type, static_cast<const int*>(data)[0] - static_cast<const int*>(data)[1]);
+                }, .Options = Options };
+
+                table[AnTcpCallbackIndex((char)MessageType::MULTIPLY)] = AnTcpCallbackEntry{ .Callback = [](ClientHandler* handler, char type, const void* data, int)
+                {
+                    handler->SendDataVar(type, static_cast<const int*>(data)[0] * static_cast<const int*>(data)[1]);
+                }, .Options = Options };
+
+                table[AnTcpCallbackIndex((char)MessageType::SPARE)] = AnTcpCallbackEntry{ .Function = SpareCallback };
+                return true;
+            });
+        }
+        else
+        {
+            // one after the other, every call publishes a version of its own
+            Server->ReplaceCallback((char)MessageType::ADD, AddCallback, Options);
+            Server->ReplaceCallback((char)MessageType::SUBTRACT, SubtractCallback, Options);
+            Server->ReplaceCallback((char)MessageType::MULTIPLY, MultiplyCallback, Options);
+            Server->RemoveCallback((char)MessageType::SPARE);
+        }
+
+        lock.lock();
+        Swaps++;
+    }
+}
+
+#ifdef _WIN32
 int __stdcall SigIntHandler(unsigned long signal)
 {
     if (signal == CTRL_C_EVENT || signal == CTRL_CLOSE_EVENT)
@@ -39,6 +503,13 @@ int __stdcall SigIntHandler(unsigned long signal)
 
     return 1;
 }
+#else
+void SigIntHandler(int)
+{
+    // Stop() only sets a flag, writes to a pipe and shuts the listen sockets down, no locks or allocations
+    Server->Stop();
+}
+#endif
 
 void ConnectedCallback(ClientHandler* handler)
 {
@@ -50,37 +521,169 @@ void DisconnectedCallback(ClientHandler* handler)
     std::cout << ">> <- Client Disconnected: " << handler->GetIpAddress() << ":" << handler->GetPort() << " <" << handler->GetId() << ">" << std::endl;
 }
 
-void AddCallback(ClientHandler* handler, char type, const void* data, int size)
+void AddCallback(ClientHandler* handler, char type, const void* data, int)
 {
-    std::cout << ">> ADD: " << static_cast<const int*>(data)[0] << " + " << static_cast<const int*>(data)[1] << std::endl;
+    if (!Quiet)
+    {
+        std::cout << ">> ADD: " << static_cast<const int*>(data)[0] << " + " << static_cast<const int*>(data)[1] << std::endl;
+    }
+
     const int c = static_cast<const int*>(data)[0] + static_cast<const int*>(data)[1];
     handler->SendDataVar(type, c);
 }
 
-void SubtractCallback(ClientHandler* handler, char type, const void* data, int size)
+void SubtractCallback(ClientHandler* handler, char type, const void* data, int)
 {
-    std::cout << ">> SUB: " << static_cast<const int*>(data)[0] << " - " << static_cast<const int*>(data)[1] << std::endl;
+    if (!Quiet)
+    {
+        std::cout << ">> SUB: " << static_cast<const int*>(data)[0] << " - " << static_cast<const int*>(data)[1] << std::endl;
+    }
+
     const int c = static_cast<const int*>(data)[0] - static_cast<const int*>(data)[1];
     handler->SendDataVar(type, c);
 }
 
-void MultiplyCallback(ClientHandler* handler, char type, const void* data, int size)
+void MultiplyCallback(ClientHandler* handler, char type, const void* data, int)
 {
-    std::cout << ">> MUL: " << static_cast<const int*>(data)[0] << " * " << static_cast<const int*>(data)[1] << std::endl;
+    if (!Quiet)
+    {
+        std::cout << ">> MUL: " << static_cast<const int*>(data)[0] << " * " << static_cast<const int*>(data)[1] << std::endl;
+    }
+
     const int c = static_cast<const int*>(data)[0] * static_cast<const int*>(data)[1];
     handler->SendDataVar(type, c);
 }
 
-void MinAvgMaxCallback(ClientHandler* handler, char type, const void* data, int size)
+void MinAvgMaxCallback(ClientHandler* handler, char type, const void* data, int)
 {
-    std::cout << ">> MAM: " << static_cast<const int*>(data)[0] << " | " << static_cast<const int*>(data)[1] << std::endl;
-    const float a = static_cast<const float>(static_cast<const int*>(data)[0]);
-    const float b = static_cast<const float>(static_cast<const int*>(data)[1]);
+    if (!Quiet)
+    {
+        std::cout << ">> MAM: " << static_cast<const int*>(data)[0] << " | " << static_cast<const int*>(data)[1] << std::endl;
+    }
+
+    const float a = static_cast<float>(static_cast<const int*>(data)[0]);
+    const float b = static_cast<float>(static_cast<const int*>(data)[1]);
 
-    float c[3];
-    c[0] = std::min(a, b);
-    c[2] = std::max(a, b);
-    c[1] = (c[2] + c[0]) / 2;
+    // written straight into the output buffer, no temporary array needed
+    AnTcpResponseWriter writer = handler->BeginResponse(type);
+    writer.AppendVar(std::min(a, b));
+    writer.AppendVar((std::min(a, b) + std::max(a, b)) / 2);
+    writer.AppendVar(std::max(a, b));
+    writer.Commit();
+}
+
+void EchoCallback(ClientHandler* handler, char type, const void* data, int size)
+{
+    if (!Quiet)
+    {
+        std::cout << ">> ECHO: " << size << " bytes" << std::endl;
+    }
 
-    handler->SendData(type, c, sizeof(c));
+    handler->SendData(type, data, size);
 }
+
+void HashCallback(ClientHandler* handler, char type, const void* data, int size)
+{
+    if (!Quiet)
+    {
+        std::cout << ">> HASH: " << size << " bytes" << std::endl;
+    }
+
+    HashCount++;
+
+    // fnv-1a over the payload, repeated to stand in for a lookup that is expensive to compute
+    uint64_t digest[4] = { 14695981039346656037ull, 0, 0, 0 };
+
+    for (int round = 0; round < HASH_ROUNDS; ++round)
+    {
+        for (int i = 0; i < size; ++i)
+        {
+            digest[0] = (digest[0] ^ static_cast<const unsigned char*>(data)[i]) * 1099511628211ull;
+        }
+
+        digest[1 + round % 3] ^= digest[0];
+    }
+
+    handler->SendData(type, digest, sizeof(digest));
+}
+
+void PointsCallback(ClientHandler* handler, char type, const void* data, int)
+{
+    const int count = std::clamp(static_cast<const int*>(data)[0], 0, MAX_POINTS);
+
+    if (!Quiet)
+    {
+        std::cout << ">> POINTS: " << count << std::endl;
+    }
+
+    if (UseWriter)
+    {
+        AnTcpResponseWriter writer = handler->BeginResponse(type);
+        char* points = writer.Reserve(count * sizeof(Point));
+
+        for (int i = 0; i < count; ++i)
+        {
+            const Point point{ i * 0.5f, i * 0.25f, 1.0f };
+            memcpy(points + i * sizeof(Point), &point, sizeof(Point));
+        }
+
+        writer.Commit();
+    }
+    else
+    {
+        std::vector<Point> points(count);
+
+        for (int i = 0; i < count; ++i)
+        {
+            points[i] = Point{ i * 0.5f, i * 0.25f, 1.0f };
+        }
+
+        handler->SendData(type, points.data(), points.size() * sizeof(Point));
+    }
+}
+
+AnTcpTask DelayTask(ClientHandler* handler, char type, const void* data, int)
+{
+    // the payload stays valid until the task finished, the task owns a copy of it
+    const int delay = std::clamp(static_cast<const int*>(data)[0], 0, MAX_DELAY);
+    const int value = static_cast<const int*>(data)[1];
+
+    if (!Quiet)
+    {
+        std::cout << ">> DELAY: " << delay << " ms" << std::endl;
+    }
+
+    const uint64_t suspended = ++SuspendedDelays;
+    uint64_t maxSuspended = MaxSuspendedDelays.load(std::memory_order_relaxed);
+
+    while (suspended > maxSuspended && !MaxSuspendedDelays.compare_exchange_weak(maxSuspended, suspended, std::memory_order_relaxed))
+    {
+    }
+
+    co_await Timer->After(std::chrono::milliseconds(delay));
+    --SuspendedDelays;
+
+    // still answers the request, the task resumed on the timer thread
+    handler->SendDataVar(type, value);
+}
+
+void SpareCallback(ClientHandler* handler, char type, const void* data, int size)
+{
+    handler->SendData(type, data, size);
+}
+
+void PublishCallback(ClientHandler* handler, char type, const void* data, int size)
+{
+    if (size < static_cast<int>(sizeof(AnTcpTopic)))
+    {
+        handler->SendDataVar(type, 0);
+        return;
+    }
+
+    AnTcpTopic topic = 0;
+    memcpy(&topic, data, sizeof(AnTcpTopic));
+
+    // answered with the number of subscribers that got the frame queued
+    const size_t subscribers = Server->Publish(topic, static_cast<const char*>(data) + sizeof(AnTcpTopic), size - sizeof(AnTcpTopic));
+    handler->SendDataVar(type, static_cast<int>(subscribers));
+}
\ No newline at end of file
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <condition_variable>
+#include <iomanip>
+#include <map>
+
 #include "../../AnTCP.Server/src/AnTcpServer.hpp"
 
 enum class MessageType
@@ -7,13 +11,212 @@ enum class MessageType
     ADD,
     SUBTRACT,
     MULTIPLY,
-    MIN_AVG_MAX
+    MIN_AVG_MAX,
+    ECHO,
+    HASH,
+    POINTS,
+    DELAY,
+    // only there now and then while the callbacks are swapped
+    SPARE,
+    // publishes the payload after the topic to the subscribers of the topic
+    PUBLISH
+};
+
+// rounds of the hash callback, makes it expensive enough to be worth caching
+constexpr int HASH_ROUNDS = 20000;
+
+// how often the hash callback really ran, cached and coalesced requests don't count
+inline std::atomic<uint64_t> HashCount = 0;
+
+// most points the points callback sends, 16 MB
+constexpr int MAX_POINTS = 16 * 1024 * 1024 / 12;
+
+struct Point
+{
+    float X;
+    float Y;
+    float Z;
 };
 
+// longest delay a delay request may ask for in milliseconds
+constexpr int MAX_DELAY = 10000;
+
+// delay tasks that wait for their timer and the most that waited at once
+inline std::atomic<uint64_t> SuspendedDelays = 0;
+inline std::atomic<uint64_t> MaxSuspendedDelays = 0;
+
+/// <summary>
+/// Completes the completions awaited by delay tasks once their time is up, the tasks resume on
+/// its thread. Stands in for the database or service a real task would wait for.
+/// </summary>
+class DelayTimer
+{
+private:
+    std::mutex Mutex;
+    std::condition_variable Changed;
+
+    // completions with the same deadline are completed in the order they were added
+    std::multimap<std::chrono::steady_clock::time_point, AnTcpCompletion<>> Timers;
+    bool Stopping;
+    std::thread Thread;
+
+public:
+    DelayTimer()
+        : Mutex(),
+        Changed(),
+        Timers(),
+        Stopping(false),
+        Thread(&DelayTimer::Run, this)
+    {}
+
+    /// <summary>
+    /// Stop the thread, completions that are still waiting are completed right away.
+    /// </summary>
+    ~DelayTimer();
+
+    /// <summary>
+    /// Get a completion that is completed after a delay.
+    /// </summary>
+    AnTcpCompletion<> After(std::chrono::milliseconds delay);
+
+private:
+    void Run();
+};
+
+inline DelayTimer* Timer = nullptr;
+
+// serialize the points straight into the output buffer instead of a temporary vector
+inline bool UseWriter = false;
+
 // global pointer used to stop server in the SigIntHandler function
 inline AnTcpServer* Server = nullptr;
 
+// don't print every request, printing is way slower than the server when benchmarking
+inline bool Quiet = false;
+
+struct SampleOptions
+{
+    std::string Ip = "127.0.0.1";
+    unsigned short Port = 47110;
+    AnTcpIoBackend IoBackend = AnTcpIoBackend::ThreadPerClient;
+    unsigned int IoThreadCount = 0;
+    bool NoDelay = false;
+    bool BatchResponses = false;
+
+    // big enough for the echo benchmark of the load generator
+    int MaxPacketSize = 16 * 1024 * 1024;
+    // 0 means unlimited
+    size_t MaxConnections = 0;
+    AnTcpConnectionLimitMode ConnectionLimitMode = AnTcpConnectionLimitMode::Reject;
+
+    // cache the responses of the hash callback
+    bool Cache = false;
+    size_t CacheSize = ANTCP_RESPONSE_CACHE_DEFAULT_SIZE;
+
+    // run the hash callback once for identical requests that arrive at the same time
+    bool SingleFlight = false;
+
+    // offer shared memory rings to local clients and how long their threads poll before sleeping
+    bool SharedMemory = false;
+    unsigned int SharedMemorySpinTime = 0;
+
+    // let the I/O threads poll before they block, pinned to the cores if any are given
+    bool LowLatency = false;
+    std::vector<unsigned int> LowLatencyCores;
+    unsigned int SpinTime = ANTCP_LOW_LATENCY_SPIN_TIME;
+    unsigned int BusyPoll = ANTCP_LOW_LATENCY_BUSY_POLL;
+
+    // additional listeners, empty ones are not used
+    std::string Ipv6Address;
+    std::string UnixPath;
+
+    // number of SO_REUSEPORT sockets per tcp listener, each accepts on its own thread
+    unsigned int ListenerShards = 1;
+
+    // requests per second of every client and of all hash requests together, 0 means unlimited
+    double RateLimit = 0.0;
+    double RateBurst = 0.0;
+    double HashRateLimit = 0.0;
+
+    // requests that may run at once, 0 means unlimited
+    size_t MaxInFlight = 0;
+
+    // run the arithmetic and hash callbacks on the worker pool, optionally with the cheap ones in the high lane
+    bool Pooled = false;
+    bool Priorities = false;
+    unsigned int WorkerCount = 0;
+
+    // milliseconds a hash request may wait for a worker before it gets a timeout response, 0 means forever
+    unsigned int HashDeadline = 0;
+
+    // callback table versions the swapper publishes per second while clients send requests, 0 disables it
+    double SwapRate = 0.0;
+
+    // what happens to subscribers that read slower than frames are published
+    AnTcpSlowSubscriberPolicy PushPolicy = AnTcpSlowSubscriberPolicy::DropOldest;
+    size_t PushQueueLimit = ANTCP_PUSH_QUEUE_DEFAULT_LIMIT;
+
+    // file every received frame is captured into, optionally with the responses, empty disables the capture
+    std::string CapturePath;
+    bool CaptureResponses = false;
+};
+
+/// <summary>
+/// Swaps the arithmetic callbacks for equivalent ones and back while the server runs, the clients
+/// must not notice. Stands in for a service that reloads its handlers without a restart.
+/// </summary>
+class CallbackSwapper
+{
+private:
+    std::mutex Mutex;
+    std::condition_variable Changed;
+    bool Stopping;
+    AnTcpCallbackOptions Options;
+    double Rate;
+    uint64_t Swaps;
+    std::thread Thread;
+
+public:
+    CallbackSwapper(AnTcpCallbackOptions options, double rate)
+        : Mutex(),
+        Changed(),
+        Stopping(false),
+        Options(options),
+        Rate(rate),
+        Swaps(0),
+        Thread(&CallbackSwapper::Run, this)
+    {}
+
+    /// <summary>
+    /// Stop the thread, the callbacks stay the way they were swapped last.
+    /// </summary>
+    ~CallbackSwapper();
+
+    /// <summary>
+    /// Get the number of swaps, every swap publishes a few versions. Only valid after the swapper was stopped.
+    /// </summary>
+    inline uint64_t GetSwapCount() const noexcept { return Swaps; }
+
+    /// <summary>
+    /// Stop swapping and wait for the thread.
+    /// </summary>
+    void Stop();
+
+private:
+    void Run();
+};
+
+#ifdef _WIN32
 int __stdcall SigIntHandler(unsigned long signal);
+#else
+void SigIntHandler(int signal);
+#endif
+
+/// <summary>
+/// Read the command line options.
+/// </summary>
+/// <returns>True if all options were valid, false if not.</returns>
+bool ParseArguments(int argc, char** argv, SampleOptions& options);
 
 void ConnectedCallback(ClientHandler* handler);
 void DisconnectedCallback(ClientHandler* handler);
@@ -21,4 +224,10 @@ void DisconnectedCallback(ClientHandler* handler);
 void AddCallback(ClientHandler* handler, char type, const void* data, int size);
 void SubtractCallback(ClientHandler* handler, char type, const void* data, int size);
 void MultiplyCallback(ClientHandler* handler, char type, const void* data, int size);
-void MinAvgMaxCallback(ClientHandler* handler, char type, const void* data, int size);
\ No newline at end of file
+void MinAvgMaxCallback(ClientHandler* handler, char type, const void* data, int size);
+void EchoCallback(ClientHandler* handler, char type, const void* data, int size);
+void HashCallback(ClientHandler* handler, char type, const void* data, int size);
+void PointsCallback(ClientHandler* handler, char type, const void* data, int size);
+AnTcpTask DelayTask(ClientHandler* handler, char type, const void* data, int size);
+void SpareCallback(ClientHandler* handler, char type, const void* data, int size);
+void PublishCallback(ClientHandler* handler, char type, const void* data, int size);
\ No newline at end of file
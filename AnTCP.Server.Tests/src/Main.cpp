@@ -0,0 +1,163 @@
+#include "Main.hpp"
+
+#include <cstring>
+
+// every test, ctest runs them one at a time by name
+constexpr TestCase TESTS[]
+{
+    { "receive-split", TestReceiveSplit },
+    { "single-flight", TestSingleFlight },
+    { "single-flight-stress", TestSingleFlightStress },
+    { "task-suspend", TestTaskSuspend },
+    { "callback-swap", TestCallbackSwap },
+    { "push-slow-subscriber", TestPushSlowSubscriber },
+    { "push-corked", TestPushCorked },
+};
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+    WSADATA wsaData{};
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        std::cout << ">> WSAStartup() failed" << std::endl;
+        return 1;
+    }
+#endif
+
+    size_t run = 0;
+    size_t failed = 0;
+
+    for (const TestCase& test : TESTS)
+    {
+        // without arguments every test runs
+        if (argc > 1 && strcmp(argv[1], test.Name) != 0)
+        {
+            continue;
+        }
+
+        const bool passed = test.Function();
+        std::cout << ">> " << test.Name << ": " << (passed ? "passed" : "failed") << std::endl;
+
+        run++;
+        failed += passed ? 0 : 1;
+    }
+
+    if (run == 0)
+    {
+        std::cout << ">> Unknown test: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    return failed == 0 ? 0 : 1;
+}
+
+std::vector<char> MakeFrame(AnTcpMessageType type, const void* data, size_t size)
+{
+    const AnTcpSizeType packetSize = static_cast<AnTcpSizeType>(sizeof(AnTcpMessageType) + size);
+    std::vector<char> frame(sizeof(AnTcpSizeType) + packetSize);
+
+    memcpy(frame.data(), &packetSize, sizeof(AnTcpSizeType));
+    frame[sizeof(AnTcpSizeType)] = type;
+    memcpy(frame.data() + sizeof(AnTcpSizeType) + sizeof(AnTcpMessageType), data, size);
+    return frame;
+}
+
+bool CreateSocketPair(SOCKET(&sockets)[2])
+{
+#if ANTCP_HAS_UNIX_SOCKETS
+    return socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0;
+#else
+    const SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (listenSocket == INVALID_SOCKET)
+    {
+        return false;
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int addressSize = sizeof(address);
+
+    sockets[0] = INVALID_SOCKET;
+    sockets[1] = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (bind(listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != SOCKET_ERROR
+        && getsockname(listenSocket, reinterpret_cast<sockaddr*>(&address), &addressSize) != SOCKET_ERROR
+        && listen(listenSocket, 1) != SOCKET_ERROR
+        && connect(sockets[1], reinterpret_cast<sockaddr*>(&address), sizeof(address)) != SOCKET_ERROR)
+    {
+        sockets[0] = accept(listenSocket, nullptr, nullptr);
+    }
+
+    closesocket(listenSocket);
+
+    if (sockets[0] == INVALID_SOCKET)
+    {
+        closesocket(sockets[1]);
+        return false;
+    }
+
+    // the tests split their writes on purpose, nagle would merge them again
+    AnTcpSetNoDelay(sockets[1], true);
+    return true;
+#endif
+}
+
+std::string GetFreePort()
+{
+    const SOCKET probe = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (probe == INVALID_SOCKET)
+    {
+        return {};
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressSize = sizeof(address);
+
+    // the kernel picks a port that nobody uses, it stays free after we closed it for a while
+    const bool bound = bind(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != SOCKET_ERROR
+        && getsockname(probe, reinterpret_cast<sockaddr*>(&address), &addressSize) != SOCKET_ERROR;
+
+    closesocket(probe);
+    return bound ? std::to_string(ntohs(address.sin_port)) : std::string();
+}
+
+bool ConnectClient(AnTcpClient& client, const std::string& port, int frameVersion)
+{
+    const auto end = Clock::now() + TEST_TIMEOUT;
+
+    while (!client.Connect("127.0.0.1", port, frameVersion))
+    {
+        if (Clock::now() >= end)
+        {
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return true;
+}
+
+bool WaitUntil(const std::function<bool()>& condition)
+{
+    const auto end = Clock::now() + TEST_TIMEOUT;
+
+    while (!condition())
+    {
+        if (Clock::now() >= end)
+        {
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../../AnTCP.Client.Native/src/AnTcpClient.hpp"
+#include "../../AnTCP.Server/src/AnTcpServer.hpp"
+
+// fails the running test, the location and the condition are printed
+#define TEST_CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::cout << ">> " << __FILE__ << ":" << __LINE__ << ": check failed: " << #condition << std::endl; \
+            return false; \
+        } \
+    } while (false)
+
+// how long a test waits for responses before it fails
+constexpr std::chrono::seconds TEST_TIMEOUT{ 10 };
+
+typedef std::chrono::steady_clock Clock;
+
+typedef bool (*TestFunction)();
+
+struct TestCase
+{
+    const char* Name;
+    TestFunction Function;
+};
+
+/// <summary>
+/// Lets the tests feed data into the receive path of a handler without an I/O backend, it is a friend of ClientHandler.
+/// </summary>
+class AnTcpTestAccess
+{
+public:
+    static inline bool Receive(ClientHandler& handler) noexcept { return handler.Receive(); }
+
+    static inline bool ProcessReceived(ClientHandler& handler, const char* data, size_t size) noexcept { return handler.ProcessReceived(data, size); }
+
+    /// <summary>
+    /// Take the responses that were buffered while the handler processed a receive batch of the io_uring backend.
+    /// </summary>
+    static inline std::vector<char> TakeOutput(ClientHandler& handler) noexcept
+    {
+        std::lock_guard lock(handler.SendMutex);
+        return std::exchange(handler.OutputBuffer, {});
+    }
+
+    /// <summary>
+    /// Get the number of requests that hold an in flight slot, only counted while there is a limit.
+    /// </summary>
+    static inline size_t GetInFlight(const AnTcpServer& server) noexcept { return server.Admission.GetInFlight(); }
+};
+
+/// <summary>
+/// Runs a server on a thread of its own until it goes out of scope.
+/// </summary>
+class TestServerThread
+{
+private:
+    AnTcpServer& Server;
+    std::thread Thread;
+
+public:
+    explicit TestServerThread(AnTcpServer& server) noexcept
+        : Server(server),
+        Thread([&server]() { server.Run(); })
+    {}
+
+    ~TestServerThread()
+    {
+        Server.Stop();
+        Thread.join();
+    }
+
+    TestServerThread(const TestServerThread&) = delete;
+    TestServerThread& operator=(const TestServerThread&) = delete;
+};
+
+/// <summary>
+/// Build a frame of version 1: size | type | payload.
+/// </summary>
+std::vector<char> MakeFrame(AnTcpMessageType type, const void* data, size_t size);
+
+/// <summary>
+/// Connect two stream sockets to each other, a unix socket pair where available and loopback tcp otherwise.
+/// </summary>
+/// <returns>True if the sockets were created, false if not.</returns>
+bool CreateSocketPair(SOCKET(&sockets)[2]);
+
+/// <summary>
+/// Get a loopback port that is free right now, so tests running at the same time or right
+/// after each other don't fight over a port or wait for its TIME_WAIT.
+/// </summary>
+/// <returns>The port, empty if none was found.</returns>
+std::string GetFreePort();
+
+/// <summary>
+/// Connect a client to a test server on the loopback, the server may still be opening its listener.
+/// </summary>
+/// <returns>True if the client is connected, false if not.</returns>
+bool ConnectClient(AnTcpClient& client, const std::string& port, int frameVersion = ANTCP_FRAME_VERSION_2);
+
+/// <summary>
+/// Wait until a condition becomes true or the test timeout elapsed.
+/// </summary>
+/// <returns>True if the condition became true, false on timeout.</returns>
+bool WaitUntil(const std::function<bool()>& condition);
+
+/// <summary>
+/// Feed a big packet between two small ones, split at every byte boundary, into the receive paths of the
+/// recv() based backends and of io_uring, and check that every echoed payload comes back in one piece.
+/// </summary>
+bool TestReceiveSplit();
+
+/// <summary>
+/// Let followers of a blocked flight pile up and check that they don't take a thread, keep their in
+/// flight slot and get the responses of the leader, the ones without request ids in order.
+/// </summary>
+bool TestSingleFlight();
+
+/// <summary>
+/// Hammer single flight callbacks with identical requests from clients of both frame versions
+/// and check every response, and the order of the responses of frame version 1 clients.
+/// </summary>
+bool TestSingleFlightStress();
+
+/// <summary>
+/// Suspend thousands of tasks at once, on the I/O threads and on the workers, check that they hold
+/// no thread while suspended, then resume them from other threads and check every response.
+/// </summary>
+bool TestTaskSuspend();
+
+/// <summary>
+/// Add, replace, update and remove callbacks while clients send requests, every request has to be
+/// answered by a callback that was not destroyed yet, and the replaced versions have to be deleted.
+/// </summary>
+bool TestCallbackSwap();
+
+/// <summary>
+/// Publish more to a subscriber than its socket takes while it doesn't read, then let it read and
+/// check that the queued frames are sent without another publish.
+/// </summary>
+bool TestPushSlowSubscriber();
+
+/// <summary>
+/// Publish to a corked subscriber, check that the held back frames are limited like the queued ones
+/// and that both are sent once it is uncorked.
+/// </summary>
+bool TestPushCorked();
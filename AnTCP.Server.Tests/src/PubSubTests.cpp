@@ -0,0 +1,149 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// callbacks that cork and uncork the responses of their client, the client is corked once it got the answer
+constexpr AnTcpMessageType CORK_MESSAGE_TYPE = 0;
+constexpr AnTcpMessageType UNCORK_MESSAGE_TYPE = 1;
+
+constexpr AnTcpTopic PUSH_TOPIC = 7;
+
+// frames the slow subscriber doesn't read at first, together far more than the socket buffers take
+constexpr uint32_t SLOW_FRAMES = 32;
+constexpr size_t SLOW_FRAME_SIZE = 1024 * 1024;
+
+// frames published while the subscriber is corked
+constexpr uint32_t CORKED_FRAMES = 20;
+
+// frames a subscriber may have queued, and as many held back while it is corked
+constexpr size_t PUSH_QUEUE_LIMIT = 4;
+
+/// <summary>
+/// Publish a frame that starts with its sequence number.
+/// </summary>
+static size_t PublishSequence(AnTcpServer& server, uint32_t sequence, size_t size)
+{
+    std::vector<char> payload(size);
+    memcpy(payload.data(), &sequence, sizeof(sequence));
+    return server.Publish(PUSH_TOPIC, payload.data(), payload.size());
+}
+
+/// <summary>
+/// Collect the sequence numbers of the frames a client gets.
+/// </summary>
+static void CollectSequences(AnTcpClient& client, std::vector<uint32_t>& sequences)
+{
+    client.OnPublished = [&sequences](AnTcpTopic topic, std::span<const char> data)
+    {
+        uint32_t sequence = UINT32_MAX;
+
+        if (topic == PUSH_TOPIC && data.size() >= sizeof(sequence))
+        {
+            memcpy(&sequence, data.data(), sizeof(sequence));
+        }
+
+        sequences.push_back(sequence);
+    };
+}
+
+bool TestPushSlowSubscriber()
+{
+    const std::string port = GetFreePort();
+    TEST_CHECK(!port.empty());
+
+    AnTcpServer server("127.0.0.1", port);
+    server.SetIoBackend(AnTcpIoBackend::EventLoop, 1);
+    server.SetSlowSubscriberPolicy(AnTcpSlowSubscriberPolicy::DropOldest, PUSH_QUEUE_LIMIT);
+
+    TestServerThread serverThread(server);
+
+    AnTcpClient subscriber;
+    std::vector<uint32_t> sequences;
+    CollectSequences(subscriber, sequences);
+
+    TEST_CHECK(ConnectClient(subscriber, port));
+    TEST_CHECK(subscriber.Subscribe(PUSH_TOPIC));
+
+    // the subscriber doesn't read meanwhile, its socket fills up and the frames queue behind it
+    for (uint32_t sequence = 0; sequence < SLOW_FRAMES; ++sequence)
+    {
+        TEST_CHECK(PublishSequence(server, sequence, SLOW_FRAME_SIZE) == 1);
+    }
+
+    TEST_CHECK(server.GetPubSubStats().Dropped > 0);
+
+    // nothing is published anymore, the queue has to be sent once the socket is writable again
+    TEST_CHECK(WaitUntil([&subscriber, &sequences]()
+    {
+        return subscriber.Poll(std::chrono::milliseconds(10)) && !sequences.empty() && sequences.back() == SLOW_FRAMES - 1;
+    }));
+
+    TEST_CHECK(std::is_sorted(sequences.begin(), sequences.end()) && std::adjacent_find(sequences.begin(), sequences.end()) == sequences.end());
+
+    const AnTcpPubSubStats stats = server.GetPubSubStats();
+    TEST_CHECK(stats.Published == SLOW_FRAMES);
+    TEST_CHECK(stats.Sent == sequences.size());
+    TEST_CHECK(stats.Sent + stats.Dropped == SLOW_FRAMES);
+    return true;
+}
+
+bool TestPushCorked()
+{
+    const std::string port = GetFreePort();
+    TEST_CHECK(!port.empty());
+
+    AnTcpServer server("127.0.0.1", port);
+    server.SetIoBackend(AnTcpIoBackend::EventLoop, 1);
+    server.SetSlowSubscriberPolicy(AnTcpSlowSubscriberPolicy::DropOldest, PUSH_QUEUE_LIMIT);
+
+    server.AddCallback(CORK_MESSAGE_TYPE, [](ClientHandler* handler, AnTcpMessageType type, const void*, int)
+    {
+        handler->Cork();
+        handler->SendDataVar(type, true);
+        handler->Flush();
+    });
+
+    server.AddCallback(UNCORK_MESSAGE_TYPE, [](ClientHandler* handler, AnTcpMessageType type, const void*, int)
+    {
+        handler->Uncork();
+        handler->SendDataVar(type, true);
+    });
+
+    TestServerThread serverThread(server);
+
+    AnTcpClient subscriber;
+    std::vector<uint32_t> sequences;
+    CollectSequences(subscriber, sequences);
+
+    TEST_CHECK(ConnectClient(subscriber, port));
+    TEST_CHECK(subscriber.Subscribe(PUSH_TOPIC));
+    TEST_CHECK(subscriber.Send(CORK_MESSAGE_TYPE, true).As<bool>());
+
+    // the held back frames count against the limit, the later ones queue up and the oldest of them are dropped
+    for (uint32_t sequence = 0; sequence < CORKED_FRAMES; ++sequence)
+    {
+        TEST_CHECK(PublishSequence(server, sequence, sizeof(sequence)) == 1);
+    }
+
+    TEST_CHECK(server.GetPubSubStats().Dropped == CORKED_FRAMES - 2 * PUSH_QUEUE_LIMIT);
+
+    // the held back frames go out with the flush, the queued ones right after it
+    TEST_CHECK(subscriber.Send(UNCORK_MESSAGE_TYPE, true).As<bool>());
+    TEST_CHECK(WaitUntil([&subscriber, &sequences]()
+    {
+        return subscriber.Poll(std::chrono::milliseconds(10)) && sequences.size() == 2 * PUSH_QUEUE_LIMIT;
+    }));
+
+    for (uint32_t i = 0; i < PUSH_QUEUE_LIMIT; ++i)
+    {
+        TEST_CHECK(sequences[i] == i);
+        TEST_CHECK(sequences[PUSH_QUEUE_LIMIT + i] == CORKED_FRAMES - PUSH_QUEUE_LIMIT + i);
+    }
+
+    const AnTcpPubSubStats stats = server.GetPubSubStats();
+    TEST_CHECK(stats.Sent == 2 * PUSH_QUEUE_LIMIT);
+    TEST_CHECK(stats.Sent + stats.Dropped == CORKED_FRAMES);
+    return true;
+}
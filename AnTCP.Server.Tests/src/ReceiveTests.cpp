@@ -0,0 +1,115 @@
+#include "Main.hpp"
+
+// message type of the callback that sends the payload back
+constexpr AnTcpMessageType ECHO_MESSAGE_TYPE = 0;
+
+// payload of the big packet, it spans multiple receive buffers
+constexpr size_t BIG_PAYLOAD_SIZE = 3 * ANTCP_RECEIVE_BUFFER_SIZE + 123;
+
+/// <summary>
+/// Build a small, a big and another small echo frame. Echoed frames of version 1 are the frames themselves.
+/// </summary>
+static std::vector<char> MakeStream()
+{
+    std::vector<char> payload(BIG_PAYLOAD_SIZE);
+
+    // a pattern that does not repeat at the size of the receive buffer, so shifted chunks don't compare equal
+    for (size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<char>((i * 31) % 251);
+    }
+
+    const char first[]{ 'a', 'b', 'c' };
+    const char last[]{ 'x', 'y' };
+
+    std::vector<char> stream = MakeFrame(ECHO_MESSAGE_TYPE, first, sizeof(first));
+    const std::vector<char> big = MakeFrame(ECHO_MESSAGE_TYPE, payload.data(), payload.size());
+    const std::vector<char> small = MakeFrame(ECHO_MESSAGE_TYPE, last, sizeof(last));
+
+    stream.insert(stream.end(), big.begin(), big.end());
+    stream.insert(stream.end(), small.begin(), small.end());
+    return stream;
+}
+
+/// <summary>
+/// Let the handler receive until its socket is empty.
+/// </summary>
+static bool ReceiveAll(ClientHandler& handler, SOCKET socket)
+{
+    AnTcpPollFd pollFd{ socket, POLLIN, 0 };
+
+    while (AnTcpPoll(&pollFd, 1, 0) > 0)
+    {
+        if (!AnTcpTestAccess::Receive(handler))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TestReceiveSplit()
+{
+    AnTcpServer server;
+    server.SetMaxPacketSize(static_cast<AnTcpSizeType>(2 * BIG_PAYLOAD_SIZE));
+    server.AddCallback(ECHO_MESSAGE_TYPE, [](ClientHandler* handler, AnTcpMessageType type, const void* data, int size)
+    {
+        handler->SendData(type, data, static_cast<size_t>(size));
+    });
+
+    const std::vector<char> stream = MakeStream();
+
+    // the handlers are driven by the test, the event loop is never started
+    std::atomic<bool> shouldExit(false);
+    AnTcpReceiveCounters receiveCounters;
+    AnTcpEventLoop eventLoop(shouldExit, receiveCounters);
+
+    {
+        // the io_uring backend hands over what the kernel received, the responses stay buffered until its next submission
+        ClientHandler handler(&server, 1, INVALID_SOCKET, sockaddr_storage{}, &eventLoop);
+
+        for (size_t split = 1; split < stream.size(); ++split)
+        {
+            TEST_CHECK(AnTcpTestAccess::ProcessReceived(handler, stream.data(), split));
+            TEST_CHECK(AnTcpTestAccess::ProcessReceived(handler, stream.data() + split, stream.size() - split));
+            TEST_CHECK(AnTcpTestAccess::TakeOutput(handler) == stream);
+        }
+    }
+
+    SOCKET sockets[2];
+    TEST_CHECK(CreateSocketPair(sockets));
+    TEST_CHECK(AnTcpSetNonBlocking(sockets[0]) && AnTcpSetNonBlocking(sockets[1]));
+
+    {
+        // the thread per client and event loop backends recv() from the socket, the handler closes its end
+        ClientHandler handler(&server, 2, sockets[0], sockaddr_storage{}, &eventLoop);
+        std::vector<char> received(stream.size());
+
+        for (size_t split = 1; split < stream.size(); ++split)
+        {
+            TEST_CHECK(AnTcpSendAll(sockets[1], stream.data(), split));
+            TEST_CHECK(ReceiveAll(handler, sockets[0]));
+            TEST_CHECK(AnTcpSendAll(sockets[1], stream.data() + split, stream.size() - split));
+            TEST_CHECK(ReceiveAll(handler, sockets[0]));
+
+            size_t receivedBytes = 0;
+            const auto end = Clock::now() + TEST_TIMEOUT;
+
+            while (receivedBytes < received.size() && Clock::now() < end)
+            {
+                AnTcpPollFd pollFd{ sockets[1], POLLIN, 0 };
+                AnTcpPoll(&pollFd, 1, 100);
+
+                const auto result = recv(sockets[1], received.data() + receivedBytes, static_cast<int>(received.size() - receivedBytes), 0);
+                TEST_CHECK(result > 0 || (result < 0 && AnTcpWouldBlock()));
+                receivedBytes += result > 0 ? static_cast<size_t>(result) : 0;
+            }
+
+            TEST_CHECK(received == stream);
+        }
+    }
+
+    closesocket(sockets[1]);
+    return true;
+}
@@ -0,0 +1,249 @@
+#include "Main.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+// callbacks that are replaced all the time, on the I/O threads and on the workers
+constexpr AnTcpMessageType SWAP_MESSAGE_TYPE = 0;
+constexpr AnTcpMessageType POOLED_SWAP_MESSAGE_TYPE = 1;
+
+// pooled callback that is added and removed all the time
+constexpr AnTcpMessageType CYCLE_MESSAGE_TYPE = 2;
+
+// clients and requests of the load, every request has to be answered by a callback that is alive
+constexpr unsigned int SWAP_CLIENTS = 6;
+constexpr unsigned int SWAP_ROUNDS = 20;
+constexpr unsigned int SWAP_REQUESTS = 64;
+
+// how long the probe waits for a request of the cycled type, it is dropped when its callback was removed while it was queued
+constexpr auto CYCLE_TIMEOUT = std::chrono::milliseconds(200);
+
+// marks of a callback that is alive and of one that was destroyed
+constexpr uint32_t CANARY_ALIVE = 0xA11CE5ED;
+constexpr uint32_t CANARY_DEAD = 0xDEADDEAD;
+constexpr size_t CANARY_MARKS = 16;
+
+// callbacks alive right now, all of them have to be destroyed together with the server
+static std::atomic<int> LiveCanaries(0);
+
+/// <summary>
+/// Captured by the callbacks, it overwrites its marks when it is destroyed. A callback that runs after
+/// the version that holds it was deleted sees the dead marks or freed memory, which the sanitizers catch.
+/// </summary>
+struct Canary
+{
+    std::vector<uint32_t> Marks;
+
+    Canary()
+        : Marks(CANARY_MARKS, CANARY_ALIVE)
+    {
+        LiveCanaries++;
+    }
+
+    Canary(const Canary& other)
+        : Marks(other.Marks)
+    {
+        LiveCanaries++;
+    }
+
+    Canary& operator=(const Canary&) = delete;
+
+    ~Canary()
+    {
+        std::fill(Marks.begin(), Marks.end(), CANARY_DEAD);
+        LiveCanaries--;
+    }
+
+    inline bool IsAlive() const noexcept
+    {
+        return Marks.size() == CANARY_MARKS && std::all_of(Marks.begin(), Marks.end(), [](uint32_t mark) { return mark == CANARY_ALIVE; });
+    }
+};
+
+/// <summary>
+/// Callback that answers with the payload while its canary is alive, and with CANARY_DEAD otherwise.
+/// </summary>
+static auto MakeCanaryCallback()
+{
+    return [canary = Canary()](ClientHandler* handler, AnTcpMessageType type, const void* data, int)
+    {
+        // gives the swapping threads a chance to retire the version while it runs
+        std::this_thread::yield();
+
+        const uint32_t value = *static_cast<const uint32_t*>(data);
+        handler->SendDataVar(type, canary.IsAlive() ? value : CANARY_DEAD);
+    };
+}
+
+bool TestCallbackSwap()
+{
+    const std::string port = GetFreePort();
+    TEST_CHECK(!port.empty());
+
+    {
+        AnTcpServer server("127.0.0.1", port);
+        server.SetIoBackend(AnTcpIoBackend::EventLoop, 2);
+        server.SetWorkerCount(4);
+
+        AnTcpCallbackOptions pooledOptions{};
+        pooledOptions.Dispatch = AnTcpDispatchMode::Pooled;
+
+        // pooled callbacks have to be there before Run(), or there are no workers
+        TEST_CHECK(server.AddCallback(SWAP_MESSAGE_TYPE, MakeCanaryCallback()));
+        TEST_CHECK(server.AddCallback(POOLED_SWAP_MESSAGE_TYPE, MakeCanaryCallback(), pooledOptions));
+        TEST_CHECK(server.AddCallback(CYCLE_MESSAGE_TYPE, MakeCanaryCallback(), pooledOptions));
+
+        TestServerThread serverThread(server);
+        std::atomic<bool> loaded(false);
+        std::atomic<unsigned int> failed(0);
+        std::atomic<unsigned int> updates(0);
+        std::atomic<unsigned int> cycled(0);
+        std::vector<std::thread> swappers;
+
+        // one callback at a time
+        swappers.emplace_back([&server, &loaded, &failed, &updates, &pooledOptions]()
+        {
+            for (unsigned int i = 0; !loaded; ++i)
+            {
+                const bool replaced = i % 2 == 0
+                    ? server.ReplaceCallback(SWAP_MESSAGE_TYPE, MakeCanaryCallback())
+                    : server.ReplaceCallback(POOLED_SWAP_MESSAGE_TYPE, MakeCanaryCallback(), pooledOptions);
+
+                failed += replaced ? 0 : 1;
+                updates++;
+            }
+        });
+
+        // both callbacks at once
+        swappers.emplace_back([&server, &loaded, &failed, &updates]()
+        {
+            while (!loaded)
+            {
+                const bool updated = server.UpdateCallbacks([](AnTcpCallbackTable& table)
+                {
+                    table[AnTcpCallbackIndex(SWAP_MESSAGE_TYPE)].Callback = MakeCanaryCallback();
+                    table[AnTcpCallbackIndex(POOLED_SWAP_MESSAGE_TYPE)].Callback = MakeCanaryCallback();
+                    return true;
+                });
+
+                failed += updated ? 0 : 1;
+                updates++;
+            }
+        });
+
+        // the cycled callback is gone for short moments, long enough for requests to run into them
+        swappers.emplace_back([&server, &loaded, &failed, &updates, &pooledOptions]()
+        {
+            while (!loaded)
+            {
+                failed += server.RemoveCallback(CYCLE_MESSAGE_TYPE) ? 0 : 1;
+                std::this_thread::yield();
+                failed += server.AddCallback(CYCLE_MESSAGE_TYPE, MakeCanaryCallback(), pooledOptions) ? 0 : 1;
+                updates += 2;
+
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+            }
+        });
+
+        // requests of a removed message type close the connection or are dropped, the probe connects again
+        swappers.emplace_back([&port, &loaded, &failed, &cycled]()
+        {
+            AnTcpClient probe;
+
+            for (uint32_t value = 0; !loaded; ++value)
+            {
+                if (!probe.IsConnected() && !ConnectClient(probe, port))
+                {
+                    failed++;
+                    return;
+                }
+
+                AnTcpClientFuture future = probe.SendAsync(CYCLE_MESSAGE_TYPE, value);
+                const AnTcpClientResponse response = future.WaitFor(CYCLE_TIMEOUT) ? future.Get() : AnTcpClientResponse{};
+
+                if (!response.IsValid())
+                {
+                    probe.Disconnect();
+                    continue;
+                }
+
+                failed += response.GetType() == CYCLE_MESSAGE_TYPE && response.As<uint32_t>() == value ? 0 : 1;
+                cycled++;
+            }
+        });
+
+        std::vector<std::thread> clients;
+
+        for (unsigned int i = 0; i < SWAP_CLIENTS; ++i)
+        {
+            clients.emplace_back([&port, &failed, i]()
+            {
+                // half of the clients run their pooled requests in a strand
+                AnTcpClient client;
+
+                if (!ConnectClient(client, port, i % 2 == 0 ? ANTCP_FRAME_VERSION_1 : ANTCP_FRAME_VERSION_2))
+                {
+                    failed++;
+                    return;
+                }
+
+                for (unsigned int round = 0; round < SWAP_ROUNDS; ++round)
+                {
+                    std::vector<AnTcpClientFuture> futures;
+
+                    for (uint32_t request = 0; request < SWAP_REQUESTS; ++request)
+                    {
+                        futures.push_back(client.SendAsync(request % 2 == 0 ? SWAP_MESSAGE_TYPE : POOLED_SWAP_MESSAGE_TYPE, round * SWAP_REQUESTS + request));
+                    }
+
+                    for (uint32_t request = 0; request < SWAP_REQUESTS; ++request)
+                    {
+                        if (!futures[request].WaitFor(std::chrono::duration_cast<std::chrono::milliseconds>(TEST_TIMEOUT)))
+                        {
+                            failed++;
+                            return;
+                        }
+
+                        const AnTcpClientResponse response = futures[request].Get();
+
+                        if (!response.IsValid()
+                            || response.GetType() != (request % 2 == 0 ? SWAP_MESSAGE_TYPE : POOLED_SWAP_MESSAGE_TYPE)
+                            || response.As<uint32_t>() != round * SWAP_REQUESTS + request)
+                        {
+                            failed++;
+                            return;
+                        }
+                    }
+                }
+            });
+        }
+
+        for (std::thread& client : clients)
+        {
+            client.join();
+        }
+
+        // the probe needs some requests that reached the cycled callback, the threads are joined either way
+        const bool probed = WaitUntil([&cycled]() { return cycled >= 10; });
+        loaded = true;
+
+        for (std::thread& swapper : swappers)
+        {
+            swapper.join();
+        }
+
+        TEST_CHECK(probed);
+        TEST_CHECK(failed == 0);
+        TEST_CHECK(server.GetCallbackVersions().first == updates + 5);
+
+        // once the last requests of the probe are gone, an update deletes every replaced version
+        TEST_CHECK(WaitUntil([&server]()
+        {
+            return server.ReplaceCallback(SWAP_MESSAGE_TYPE, MakeCanaryCallback()) && server.GetCallbackVersions().second == 0;
+        }));
+    }
+
+    TEST_CHECK(LiveCanaries == 0);
+    return true;
+}
@@ -0,0 +1,210 @@
+#include "Main.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+// single flight callbacks on the I/O threads and on the workers, they answer with the key they got
+constexpr AnTcpMessageType FLIGHT_MESSAGE_TYPE = 0;
+constexpr AnTcpMessageType POOLED_FLIGHT_MESSAGE_TYPE = 1;
+
+// pooled callback that sends the payload back
+constexpr AnTcpMessageType ECHO_MESSAGE_TYPE = 2;
+
+// clients and requests of the stress test, the keys repeat so that many requests are identical
+constexpr unsigned int STRESS_CLIENTS = 8;
+constexpr unsigned int STRESS_ROUNDS = 20;
+constexpr unsigned int STRESS_REQUESTS = 64;
+constexpr uint32_t STRESS_KEYS = 4;
+
+/// <summary>
+/// Wait for a response and check that it is the one the request expects.
+/// </summary>
+static bool CheckResponse(AnTcpClientFuture& future, AnTcpMessageType type, uint32_t value)
+{
+    TEST_CHECK(future.WaitFor(std::chrono::duration_cast<std::chrono::milliseconds>(TEST_TIMEOUT)));
+
+    const AnTcpClientResponse response = future.Get();
+    TEST_CHECK(response.IsValid());
+    TEST_CHECK(response.GetType() == type);
+    TEST_CHECK(response.GetData().size() == sizeof(uint32_t));
+    TEST_CHECK(response.As<uint32_t>() == value);
+    return true;
+}
+
+bool TestSingleFlight()
+{
+    const std::string port = GetFreePort();
+    TEST_CHECK(!port.empty());
+
+    std::atomic<bool> open(false);
+    std::atomic<unsigned int> leaders(0);
+
+    AnTcpServer server("127.0.0.1", port);
+    server.SetIoBackend(AnTcpIoBackend::EventLoop, 1);
+
+    // one worker for the leader and one for everything else, a follower that blocks would starve it
+    server.SetWorkerCount(2);
+
+    // in flight requests are only counted while there is a limit
+    server.SetMaxInFlight(1000);
+
+    AnTcpCallbackOptions flightOptions{};
+    flightOptions.SingleFlight = true;
+    flightOptions.Dispatch = AnTcpDispatchMode::Pooled;
+
+    server.AddCallback(POOLED_FLIGHT_MESSAGE_TYPE, [&open, &leaders](ClientHandler* handler, AnTcpMessageType type, const void* data, int size)
+    {
+        leaders++;
+
+        while (!open)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        handler->SendData(type, data, static_cast<size_t>(size));
+    }, flightOptions);
+
+    AnTcpCallbackOptions echoOptions{};
+    echoOptions.Dispatch = AnTcpDispatchMode::Pooled;
+
+    server.AddCallback(ECHO_MESSAGE_TYPE, [](ClientHandler* handler, AnTcpMessageType type, const void* data, int size)
+    {
+        handler->SendData(type, data, static_cast<size_t>(size));
+    }, echoOptions);
+
+    TestServerThread serverThread(server);
+
+    // opens the gate when a check fails, the server can't stop while the leader is blocked
+    struct GateGuard
+    {
+        std::atomic<bool>& Open;
+        ~GateGuard() { Open = true; }
+    } gateGuard{ open };
+
+    AnTcpClient leader;
+    AnTcpClient ordered;
+    AnTcpClient unordered;
+    AnTcpClient other;
+
+    TEST_CHECK(ConnectClient(leader, port));
+    TEST_CHECK(ConnectClient(ordered, port, ANTCP_FRAME_VERSION_1));
+    TEST_CHECK(ConnectClient(unordered, port));
+    TEST_CHECK(ConnectClient(other, port));
+
+    const uint32_t key = 42;
+    const uint32_t echo = 7;
+
+    AnTcpClientFuture leading = leader.SendAsync(POOLED_FLIGHT_MESSAGE_TYPE, key);
+    TEST_CHECK(WaitUntil([&leaders]() { return leaders == 1; }));
+
+    // the echo of the frame version 1 client has to wait for the flight in front of it
+    AnTcpClientFuture orderedFlight = ordered.SendAsync(POOLED_FLIGHT_MESSAGE_TYPE, key);
+    AnTcpClientFuture orderedEcho = ordered.SendAsync(ECHO_MESSAGE_TYPE, echo);
+    AnTcpClientFuture unorderedFlights[]{ unordered.SendAsync(POOLED_FLIGHT_MESSAGE_TYPE, key), unordered.SendAsync(POOLED_FLIGHT_MESSAGE_TYPE, key) };
+
+    TEST_CHECK(WaitUntil([&server]() { return server.GetCoalescedRequestCount() == 3; }));
+
+    // the followers left the second worker, so it still serves other requests
+    AnTcpClientFuture otherEcho = other.SendAsync(ECHO_MESSAGE_TYPE, echo);
+    TEST_CHECK(CheckResponse(otherEcho, ECHO_MESSAGE_TYPE, echo));
+
+    // the leader, its three followers and the queued echo are still in flight
+    TEST_CHECK(WaitUntil([&server]() { return AnTcpTestAccess::GetInFlight(server) == 5; }));
+    TEST_CHECK(!orderedEcho.WaitFor(std::chrono::milliseconds(50)));
+
+    open = true;
+
+    TEST_CHECK(CheckResponse(leading, POOLED_FLIGHT_MESSAGE_TYPE, key));
+    TEST_CHECK(CheckResponse(orderedFlight, POOLED_FLIGHT_MESSAGE_TYPE, key));
+    TEST_CHECK(CheckResponse(orderedEcho, ECHO_MESSAGE_TYPE, echo));
+    TEST_CHECK(CheckResponse(unorderedFlights[0], POOLED_FLIGHT_MESSAGE_TYPE, key));
+    TEST_CHECK(CheckResponse(unorderedFlights[1], POOLED_FLIGHT_MESSAGE_TYPE, key));
+
+    TEST_CHECK(leaders == 1);
+    TEST_CHECK(WaitUntil([&server]() { return AnTcpTestAccess::GetInFlight(server) == 0; }));
+    return true;
+}
+
+bool TestSingleFlightStress()
+{
+    const std::string port = GetFreePort();
+    TEST_CHECK(!port.empty());
+
+    AnTcpServer server("127.0.0.1", port);
+    server.SetIoBackend(AnTcpIoBackend::EventLoop, 2);
+    server.SetWorkerCount(4);
+    server.SetMaxInFlight(STRESS_CLIENTS * STRESS_REQUESTS * 2);
+
+    for (const AnTcpMessageType flightType : { FLIGHT_MESSAGE_TYPE, POOLED_FLIGHT_MESSAGE_TYPE })
+    {
+        AnTcpCallbackOptions options{};
+        options.SingleFlight = true;
+        options.Dispatch = flightType == POOLED_FLIGHT_MESSAGE_TYPE ? AnTcpDispatchMode::Pooled : AnTcpDispatchMode::Inline;
+
+        server.AddCallback(flightType, [](ClientHandler* handler, AnTcpMessageType type, const void* data, int size)
+        {
+            // long enough for identical requests to pile up
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            handler->SendData(type, data, static_cast<size_t>(size));
+        }, options);
+    }
+
+    AnTcpCallbackOptions echoOptions{};
+    echoOptions.Dispatch = AnTcpDispatchMode::Pooled;
+
+    server.AddCallback(ECHO_MESSAGE_TYPE, [](ClientHandler* handler, AnTcpMessageType type, const void* data, int size)
+    {
+        handler->SendData(type, data, static_cast<size_t>(size));
+    }, echoOptions);
+
+    TestServerThread serverThread(server);
+    std::atomic<unsigned int> failed(0);
+    std::vector<std::thread> threads;
+
+    for (unsigned int i = 0; i < STRESS_CLIENTS; ++i)
+    {
+        threads.emplace_back([&port, &failed, i]()
+        {
+            // half of the clients match responses by their order
+            AnTcpClient client;
+            const bool connected = ConnectClient(client, port, i % 2 == 0 ? ANTCP_FRAME_VERSION_1 : ANTCP_FRAME_VERSION_2);
+
+            for (unsigned int round = 0; connected && round < STRESS_ROUNDS; ++round)
+            {
+                std::vector<std::pair<AnTcpMessageType, uint32_t>> requests;
+                std::vector<AnTcpClientFuture> futures;
+
+                for (unsigned int request = 0; request < STRESS_REQUESTS; ++request)
+                {
+                    // every third request is an echo with a unique value, it must not overtake a flight
+                    const AnTcpMessageType type = request % 3 == 2 ? ECHO_MESSAGE_TYPE : request % 2 == 0 ? FLIGHT_MESSAGE_TYPE : POOLED_FLIGHT_MESSAGE_TYPE;
+                    const uint32_t value = type == ECHO_MESSAGE_TYPE ? 1000 + request : (request + round) % STRESS_KEYS;
+
+                    requests.emplace_back(type, value);
+                    futures.push_back(client.SendAsync(type, value));
+                }
+
+                for (size_t request = 0; request < futures.size(); ++request)
+                {
+                    if (!CheckResponse(futures[request], requests[request].first, requests[request].second))
+                    {
+                        failed++;
+                        return;
+                    }
+                }
+            }
+
+            failed += connected ? 0 : 1;
+        });
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    TEST_CHECK(failed == 0);
+    TEST_CHECK(server.GetCoalescedRequestCount() > 0);
+    TEST_CHECK(WaitUntil([&server]() { return AnTcpTestAccess::GetInFlight(server) == 0; }));
+    return true;
+}
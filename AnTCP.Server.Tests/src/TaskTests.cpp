@@ -0,0 +1,198 @@
+#include "Main.hpp"
+
+#include <cstdint>
+#include <fstream>
+
+// tasks that wait for a completion of the test, started on the I/O threads and on the workers
+constexpr AnTcpMessageType PARK_MESSAGE_TYPE = 0;
+constexpr AnTcpMessageType POOLED_PARK_MESSAGE_TYPE = 1;
+
+// pooled callback that sends the payload back
+constexpr AnTcpMessageType ECHO_MESSAGE_TYPE = 2;
+
+// every client keeps all of its tasks suspended at once, below the requests a client has in flight
+constexpr unsigned int TASK_CLIENTS = 4;
+constexpr unsigned int TASK_REQUESTS = 1000;
+
+// threads of the test that complete the suspended tasks, the tasks resume on them
+constexpr unsigned int TASK_COMPLETERS = 2;
+
+/// <summary>
+/// Task that is suspended and the value it answers with.
+/// </summary>
+struct ParkedTask
+{
+    uint32_t Value;
+    AnTcpCompletion<uint32_t> Completion;
+};
+
+// task functions can't capture, so the suspended tasks are collected here
+static std::mutex ParkedMutex;
+static std::vector<ParkedTask> Parked;
+
+/// <summary>
+/// The value the test completes a task with, the task answers with it.
+/// </summary>
+static constexpr uint32_t GetResult(uint32_t value) noexcept
+{
+    return value * 3 + 1;
+}
+
+static AnTcpTask ParkTask(ClientHandler* handler, AnTcpMessageType type, const void* data, int)
+{
+    const uint32_t value = *static_cast<const uint32_t*>(data);
+    AnTcpCompletion<uint32_t> completion;
+
+    {
+        std::lock_guard lock(ParkedMutex);
+        Parked.push_back(ParkedTask{ value, completion });
+    }
+
+    const uint32_t result = co_await completion;
+    handler->SendDataVar(type, result);
+}
+
+/// <summary>
+/// Get the number of threads of the process.
+/// </summary>
+/// <returns>The number of threads, 0 where it is not known.</returns>
+static size_t GetThreadCount()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+
+    while (std::getline(status, line))
+    {
+        if (line.rfind("Threads:", 0) == 0)
+        {
+            return std::stoul(line.substr(8));
+        }
+    }
+
+    return 0;
+}
+
+bool TestTaskSuspend()
+{
+    const std::string port = GetFreePort();
+    TEST_CHECK(!port.empty());
+
+    Parked.clear();
+
+    AnTcpServer server("127.0.0.1", port);
+    server.SetIoBackend(AnTcpIoBackend::EventLoop, 2);
+    server.SetWorkerCount(2);
+
+    // in flight requests are only counted while there is a limit, suspended tasks hold their slot
+    server.SetMaxInFlight(TASK_CLIENTS * TASK_REQUESTS + 1);
+
+    AnTcpCallbackOptions pooledOptions{};
+    pooledOptions.Dispatch = AnTcpDispatchMode::Pooled;
+
+    server.AddTaskCallback(PARK_MESSAGE_TYPE, ParkTask);
+    server.AddTaskCallback(POOLED_PARK_MESSAGE_TYPE, ParkTask, pooledOptions);
+    server.AddCallback(ECHO_MESSAGE_TYPE, [](ClientHandler* handler, AnTcpMessageType type, const void* data, int size)
+    {
+        handler->SendData(type, data, static_cast<size_t>(size));
+    }, pooledOptions);
+
+    TestServerThread serverThread(server);
+
+    // completes whatever is still suspended when a check fails, the server can't stop while tasks keep their clients
+    struct ParkedGuard
+    {
+        ~ParkedGuard()
+        {
+            std::lock_guard lock(ParkedMutex);
+
+            for (ParkedTask& task : Parked)
+            {
+                task.Completion.Complete(0);
+            }
+        }
+    } parkedGuard;
+
+    AnTcpClient clients[TASK_CLIENTS];
+    AnTcpClient other;
+
+    for (AnTcpClient& client : clients)
+    {
+        TEST_CHECK(ConnectClient(client, port));
+    }
+
+    TEST_CHECK(ConnectClient(other, port));
+
+    // every thread of the server is running by now
+    const size_t threads = GetThreadCount();
+    std::vector<AnTcpClientFuture> futures[TASK_CLIENTS];
+
+    for (unsigned int i = 0; i < TASK_CLIENTS; ++i)
+    {
+        for (uint32_t request = 0; request < TASK_REQUESTS; ++request)
+        {
+            const uint32_t value = i * TASK_REQUESTS + request;
+            futures[i].push_back(clients[i].SendAsync(request % 2 == 0 ? PARK_MESSAGE_TYPE : POOLED_PARK_MESSAGE_TYPE, value));
+        }
+    }
+
+    TEST_CHECK(WaitUntil([]()
+    {
+        std::lock_guard lock(ParkedMutex);
+        return Parked.size() == TASK_CLIENTS * TASK_REQUESTS;
+    }));
+
+    // the suspended tasks hold no thread, the I/O threads and the workers still serve other requests
+    const uint32_t echo = 7;
+    AnTcpClientFuture otherEcho = other.SendAsync(ECHO_MESSAGE_TYPE, echo);
+    TEST_CHECK(otherEcho.WaitFor(std::chrono::duration_cast<std::chrono::milliseconds>(TEST_TIMEOUT)));
+    TEST_CHECK(otherEcho.Get().As<uint32_t>() == echo);
+
+    TEST_CHECK(GetThreadCount() == threads);
+    TEST_CHECK(AnTcpTestAccess::GetInFlight(server) == TASK_CLIENTS * TASK_REQUESTS);
+
+    std::vector<ParkedTask> parked;
+
+    {
+        std::lock_guard lock(ParkedMutex);
+        parked = std::move(Parked);
+        Parked.clear();
+    }
+
+    // the tasks resume and send their responses on the threads that complete them
+    std::vector<std::thread> completers;
+
+    for (unsigned int i = 0; i < TASK_COMPLETERS; ++i)
+    {
+        completers.emplace_back([&parked, i]()
+        {
+            for (size_t task = i; task < parked.size(); task += TASK_COMPLETERS)
+            {
+                parked[task].Completion.Complete(GetResult(parked[task].Value));
+            }
+        });
+    }
+
+    for (std::thread& completer : completers)
+    {
+        completer.join();
+    }
+
+    for (unsigned int i = 0; i < TASK_CLIENTS; ++i)
+    {
+        for (uint32_t request = 0; request < TASK_REQUESTS; ++request)
+        {
+            AnTcpClientFuture& future = futures[i][request];
+            TEST_CHECK(future.WaitFor(std::chrono::duration_cast<std::chrono::milliseconds>(TEST_TIMEOUT)));
+
+            const AnTcpClientResponse response = future.Get();
+            TEST_CHECK(response.IsValid());
+            TEST_CHECK(response.GetType() == (request % 2 == 0 ? PARK_MESSAGE_TYPE : POOLED_PARK_MESSAGE_TYPE));
+            TEST_CHECK(response.As<uint32_t>() == GetResult(i * TASK_REQUESTS + request));
+        }
+    }
+
+    // nothing is left suspended or blocked
+    TEST_CHECK(WaitUntil([&server]() { return AnTcpTestAccess::GetInFlight(server) == 0; }));
+    TEST_CHECK(GetThreadCount() == threads);
+    return true;
+}
@@ -0,0 +1,43 @@
+#include "AnTcpAdmission.hpp"
+
+void AnTcpAdmission::SetConnectionLimit(const AnTcpRateLimit& limit) noexcept
+{
+    ConnectionLimit = limit;
+    Enabled = true;
+}
+
+void AnTcpAdmission::SetMessageLimit(AnTcpMessageType type, const AnTcpRateLimit& limit) noexcept
+{
+    std::unique_ptr<MessageLimit>& messageLimit = MessageLimits[AnTcpCallbackIndex(type)];
+
+    if (!limit.IsEnabled())
+    {
+        messageLimit.reset();
+        return;
+    }
+
+    messageLimit = std::make_unique<MessageLimit>();
+    messageLimit->Limit = limit;
+    Enabled = true;
+}
+
+void AnTcpAdmission::SetMaxInFlight(size_t maxInFlight) noexcept
+{
+    MaxInFlight = maxInFlight;
+    Enabled = true;
+}
+
+AnTcpBusyReason AnTcpAdmission::CheckMessageRate(AnTcpMessageType type, std::chrono::steady_clock::time_point now) noexcept
+{
+    if (MessageLimit* messageLimit = MessageLimits[AnTcpCallbackIndex(type)].get())
+    {
+        std::lock_guard lock(messageLimit->Mutex);
+
+        if (!messageLimit->Bucket.TryTake(messageLimit->Limit, now))
+        {
+            return AnTcpBusyReason::MessageRate;
+        }
+    }
+
+    return AnTcpBusyReason::None;
+}
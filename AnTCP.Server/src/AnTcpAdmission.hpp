@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "AnTcpCallbackTable.hpp"
+
+/// <summary>
+/// Why a request was answered with ANTCP_MESSAGE_BUSY instead of running its callback.
+/// </summary>
+enum class AnTcpBusyReason : unsigned char
+{
+    None,
+    // the client sent more requests than its connection rate limit allows
+    ConnectionRate,
+    // all clients together sent more requests of the message type than its rate limit allows
+    MessageRate,
+    // the server is already running as many requests as it may
+    InFlight
+};
+
+/// <summary>
+/// Payload of an ANTCP_MESSAGE_BUSY response.
+/// </summary>
+struct AnTcpBusyResponse
+{
+    AnTcpMessageType Type;
+    AnTcpBusyReason Reason;
+};
+
+/// <summary>
+/// Rate of a token bucket, a disabled limit admits everything.
+/// </summary>
+struct AnTcpRateLimit
+{
+    // requests per second, 0 means unlimited
+    double Rate = 0.0;
+
+    // requests that may arrive at once after a quiet period, 0 allows one second worth of requests
+    double Burst = 0.0;
+
+    inline bool IsEnabled() const noexcept { return Rate > 0.0; }
+    inline double GetBurst() const noexcept { return Burst > 0.0 ? Burst : std::max(1.0, Rate); }
+};
+
+/// <summary>
+/// Token bucket that refills continuously, not thread safe.
+/// </summary>
+class AnTcpTokenBucket
+{
+private:
+    double Tokens;
+
+    // the bucket is full when it is used the first time
+    std::chrono::steady_clock::time_point Refilled;
+
+public:
+    AnTcpTokenBucket()
+        : Tokens(0.0),
+        Refilled()
+    {}
+
+    /// <summary>
+    /// Take tokens if there is at least one. Taking more than there are overdraws the bucket,
+    /// the next requests are rejected until the tokens that accrue paid it off.
+    /// </summary>
+    /// <param name="now">Current time, the tokens that accrued since the last call are added.</param>
+    /// <param name="count">Tokens to take, the requests of a batch are charged at once.</param>
+    /// <returns>True if the tokens were taken, false if the bucket is empty.</returns>
+    inline bool TryTake(const AnTcpRateLimit& limit, std::chrono::steady_clock::time_point now, double count = 1.0) noexcept
+    {
+        if (Refilled == std::chrono::steady_clock::time_point{})
+        {
+            Tokens = limit.GetBurst();
+            Refilled = now;
+        }
+        else if (now > Refilled)
+        {
+            Tokens = std::min(limit.GetBurst(), Tokens + std::chrono::duration<double>(now - Refilled).count() * limit.Rate);
+            Refilled = now;
+        }
+
+        if (Tokens < 1.0)
+        {
+            return false;
+        }
+
+        Tokens -= count;
+        return true;
+    }
+};
+
+/// <summary>
+/// Admission control of the server: a rate limit per connection, rate limits per message type
+/// that are shared by all clients and a limit for the requests that run at the same time.
+/// Requests over a limit are answered with ANTCP_MESSAGE_BUSY right away instead of queueing up.
+/// Limits need to be set before Run().
+/// </summary>
+class AnTcpAdmission
+{
+private:
+    /// <summary>
+    /// Rate limit of a message type and its bucket.
+    /// </summary>
+    struct MessageLimit
+    {
+        AnTcpRateLimit Limit;
+        std::mutex Mutex;
+        AnTcpTokenBucket Bucket;
+    };
+
+    AnTcpRateLimit ConnectionLimit;
+    std::array<std::unique_ptr<MessageLimit>, 256> MessageLimits;
+
+    // 0 means unlimited
+    size_t MaxInFlight;
+    std::atomic<size_t> InFlight;
+
+    // whether any limit is set, requests skip admission entirely when none is
+    bool Enabled;
+
+    std::atomic<uint64_t> Rejected;
+    std::atomic<uint64_t> TimedOut;
+
+public:
+    AnTcpAdmission()
+        : ConnectionLimit(),
+        MessageLimits(),
+        MaxInFlight(0),
+        InFlight(0),
+        Enabled(false),
+        Rejected(0),
+        TimedOut(0)
+    {}
+
+    AnTcpAdmission(const AnTcpAdmission&) = delete;
+    AnTcpAdmission& operator=(const AnTcpAdmission&) = delete;
+
+    inline bool IsEnabled() const noexcept { return Enabled; }
+
+    inline const AnTcpRateLimit& GetConnectionLimit() const noexcept { return ConnectionLimit; }
+
+    inline uint64_t GetRejectedCount() const noexcept { return Rejected.load(std::memory_order_relaxed); }
+
+    inline uint64_t GetTimedOutCount() const noexcept { return TimedOut.load(std::memory_order_relaxed); }
+
+    inline size_t GetInFlight() const noexcept { return InFlight.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Limit the requests every connection may send.
+    /// </summary>
+    void SetConnectionLimit(const AnTcpRateLimit& limit) noexcept;
+
+    /// <summary>
+    /// Limit the requests of a message type all connections together may send.
+    /// </summary>
+    void SetMessageLimit(AnTcpMessageType type, const AnTcpRateLimit& limit) noexcept;
+
+    /// <summary>
+    /// Limit the requests that run at the same time, 0 means unlimited.
+    /// </summary>
+    void SetMaxInFlight(size_t maxInFlight) noexcept;
+
+    /// <summary>
+    /// Check the rate limits of a request, every limit it passes takes a token.
+    /// </summary>
+    /// <param name="connectionBucket">Bucket of the connection that sent the request, only used by the thread that receives.</param>
+    /// <returns>None if the request may run, the limit it exceeded if not.</returns>
+    inline AnTcpBusyReason CheckRate(AnTcpTokenBucket& connectionBucket, AnTcpMessageType type, std::chrono::steady_clock::time_point now) noexcept
+    {
+        return CheckConnectionRate(connectionBucket, now) ? CheckMessageRate(type, now) : AnTcpBusyReason::ConnectionRate;
+    }
+
+    /// <summary>
+    /// Check the rate limit of a connection, the bucket is not thread safe.
+    /// </summary>
+    /// <param name="connectionBucket">Bucket of the connection that sent the requests, only used by the thread that receives.</param>
+    /// <param name="count">Requests to charge at once, the sub messages of a batch.</param>
+    /// <returns>True if the requests may run, false if the connection exceeded its limit.</returns>
+    inline bool CheckConnectionRate(AnTcpTokenBucket& connectionBucket, std::chrono::steady_clock::time_point now, size_t count = 1) noexcept
+    {
+        return !ConnectionLimit.IsEnabled() || connectionBucket.TryTake(ConnectionLimit, now, static_cast<double>(count));
+    }
+
+    /// <summary>
+    /// Check the rate limit of a message type that all clients share, safe to call from any thread.
+    /// </summary>
+    /// <returns>None if the request may run, MessageRate if its message type exceeded its limit.</returns>
+    AnTcpBusyReason CheckMessageRate(AnTcpMessageType type, std::chrono::steady_clock::time_point now) noexcept;
+
+    /// <summary>
+    /// Take an in flight slot, give it back with Leave() once the request finished.
+    /// </summary>
+    /// <returns>True if the slot was taken, false if the limit is reached.</returns>
+    inline bool Enter() noexcept
+    {
+        if (MaxInFlight == 0)
+        {
+            return true;
+        }
+
+        if (InFlight.fetch_add(1, std::memory_order_relaxed) >= MaxInFlight)
+        {
+            InFlight.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        return true;
+    }
+
+    /// <summary>
+    /// Take an in flight slot even when the limit is reached, for work a request hands off that outlives it.
+    /// </summary>
+    inline void Hold() noexcept
+    {
+        if (MaxInFlight != 0)
+        {
+            InFlight.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /// <summary>
+    /// Give back the in flight slot of a request.
+    /// </summary>
+    inline void Leave() noexcept
+    {
+        if (MaxInFlight != 0)
+        {
+            InFlight.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    /// <summary>
+    /// Count a request that was answered with ANTCP_MESSAGE_BUSY.
+    /// </summary>
+    inline void RecordRejected() noexcept
+    {
+        Rejected.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// <summary>
+    /// Count a request that was answered with ANTCP_MESSAGE_TIMEOUT, it waited longer than its deadline.
+    /// </summary>
+    inline void RecordTimedOut() noexcept
+    {
+        TimedOut.fetch_add(1, std::memory_order_relaxed);
+    }
+};
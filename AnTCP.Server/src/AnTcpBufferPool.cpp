@@ -0,0 +1,66 @@
+#include "AnTcpBufferPool.hpp"
+
+#include <algorithm>
+#include <new>
+
+AnTcpBufferPool::~AnTcpBufferPool()
+{
+    for (SizeClass& sizeClass : SizeClasses)
+    {
+        for (char* buffer : sizeClass.FreeBuffers)
+        {
+            delete[] buffer;
+        }
+    }
+}
+
+AnTcpPooledBuffer AnTcpBufferPool::Acquire(size_t size) noexcept
+{
+    const size_t sizeClassIndex = GetSizeClass(size);
+
+    if (sizeClassIndex >= ANTCP_BUFFER_POOL_CLASS_COUNT)
+    {
+        return AnTcpPooledBuffer{};
+    }
+
+    const size_t capacity = ANTCP_BUFFER_POOL_MIN_SIZE << sizeClassIndex;
+    SizeClass& sizeClass = SizeClasses[sizeClassIndex];
+
+    {
+        std::lock_guard lock(sizeClass.Mutex);
+
+        if (!sizeClass.FreeBuffers.empty())
+        {
+            char* buffer = sizeClass.FreeBuffers.back();
+            sizeClass.FreeBuffers.pop_back();
+            return AnTcpPooledBuffer{ buffer, capacity };
+        }
+    }
+
+    return AnTcpPooledBuffer{ new (std::nothrow) char[capacity], capacity };
+}
+
+void AnTcpBufferPool::Release(AnTcpPooledBuffer& buffer) noexcept
+{
+    if (!buffer.Data)
+    {
+        return;
+    }
+
+    SizeClass& sizeClass = SizeClasses[GetSizeClass(buffer.Capacity)];
+
+    {
+        std::lock_guard lock(sizeClass.Mutex);
+
+        // keep at least one buffer of every size class, big ones are not worth hoarding
+        if (sizeClass.FreeBuffers.size() < std::max<size_t>(1, ANTCP_BUFFER_POOL_MAX_CACHED_BYTES / buffer.Capacity))
+        {
+            sizeClass.FreeBuffers.push_back(buffer.Data);
+            buffer = AnTcpPooledBuffer{};
+            return;
+        }
+    }
+
+    delete[] buffer.Data;
+    buffer = AnTcpPooledBuffer{};
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <vector>
+
+// smallest size class of the pool, everything below is served by the inline receive buffers
+constexpr size_t ANTCP_BUFFER_POOL_MIN_SIZE = 16384;
+
+// number of power of two size classes, the biggest one is 16 KB << 17 = 2 GB
+constexpr size_t ANTCP_BUFFER_POOL_CLASS_COUNT = 18;
+
+// how many bytes each size class keeps at most in its free list
+constexpr size_t ANTCP_BUFFER_POOL_MAX_CACHED_BYTES = 64 * 1024 * 1024;
+
+/// <summary>
+/// Buffer handed out by the AnTcpBufferPool.
+/// </summary>
+struct AnTcpPooledBuffer
+{
+    char* Data = nullptr;
+    size_t Capacity = 0;
+};
+
+/// <summary>
+/// Thread safe pool of power of two sized buffers, used for packets that do not
+/// fit into the inline receive buffer. Released buffers are reused by the next
+/// packet of a similar size, no matter which client receives it.
+/// </summary>
+class AnTcpBufferPool
+{
+private:
+    struct SizeClass
+    {
+        std::mutex Mutex;
+        std::vector<char*> FreeBuffers;
+    };
+
+    std::array<SizeClass, ANTCP_BUFFER_POOL_CLASS_COUNT> SizeClasses;
+
+public:
+    AnTcpBufferPool()
+        : SizeClasses()
+    {}
+
+    ~AnTcpBufferPool();
+
+    AnTcpBufferPool(const AnTcpBufferPool&) = delete;
+    AnTcpBufferPool& operator=(const AnTcpBufferPool&) = delete;
+
+    /// <summary>
+    /// Get a buffer that can hold at least size bytes.
+    /// </summary>
+    /// <param name="size">Minimum size of the buffer.</param>
+    /// <returns>The buffer, Data is null if the size is not supported or allocation failed.</returns>
+    AnTcpPooledBuffer Acquire(size_t size) noexcept;
+
+    /// <summary>
+    /// Return a buffer to the pool, it will be freed if its size class is full.
+    /// </summary>
+    /// <param name="buffer">Buffer returned by Acquire().</param>
+    void Release(AnTcpPooledBuffer& buffer) noexcept;
+
+private:
+    /// <summary>
+    /// Get the index of the smallest size class that fits size bytes.
+    /// </summary>
+    static constexpr size_t GetSizeClass(size_t size) noexcept
+    {
+        size_t sizeClass = 0;
+
+        while (sizeClass < ANTCP_BUFFER_POOL_CLASS_COUNT && (ANTCP_BUFFER_POOL_MIN_SIZE << sizeClass) < size)
+        {
+            ++sizeClass;
+        }
+
+        return sizeClass;
+    }
+};
@@ -0,0 +1,104 @@
+#include "AnTcpCallbackRegistry.hpp"
+
+#include <algorithm>
+
+AnTcpCallbackRegistry::~AnTcpCallbackRegistry()
+{
+    for (const auto& [epoch, table] : Retired)
+    {
+        delete table;
+    }
+
+    delete Current.load(std::memory_order_relaxed);
+}
+
+uint64_t AnTcpCallbackRegistry::GetVersionCount() noexcept
+{
+    std::lock_guard lock(WriteMutex);
+    return Versions;
+}
+
+size_t AnTcpCallbackRegistry::GetRetiredCount() noexcept
+{
+    std::lock_guard lock(WriteMutex);
+    return Retired.size();
+}
+
+void AnTcpCallbackRegistry::Publish(const AnTcpCallbackTable* table) noexcept
+{
+    const AnTcpCallbackTable* replaced = Current.exchange(table, std::memory_order_seq_cst);
+
+    // readers that announce a later epoch load the version after the exchange
+    Retired.emplace_back(GlobalEpoch.fetch_add(1, std::memory_order_seq_cst), replaced);
+    Versions++;
+
+    // makes the plain stores of the readers visible, or orders their loads after the exchange
+    if (ProcessBarrier)
+    {
+        AnTcpProcessBarrier();
+    }
+
+    if (OverflowReaders.load(std::memory_order_seq_cst) > 0)
+    {
+        return;
+    }
+
+    uint64_t oldestEpoch = UINT64_MAX;
+
+    for (const AnTcpCallbackReaderSlot& slot : Slots)
+    {
+        const uint64_t epoch = slot.Epoch.load(std::memory_order_seq_cst);
+
+        if (epoch != 0)
+        {
+            oldestEpoch = std::min(oldestEpoch, epoch);
+        }
+    }
+
+    // a version replaced in an epoch before the oldest announced one is invisible to every reader
+    const auto end = std::partition(Retired.begin(), Retired.end(), [oldestEpoch](const auto& retired)
+    {
+        return retired.first >= oldestEpoch;
+    });
+
+    for (auto retired = end; retired != Retired.end(); ++retired)
+    {
+        delete retired->second;
+    }
+
+    Retired.erase(end, Retired.end());
+}
+
+bool AnTcpCallbackRegistry::HasProcessBarrier() noexcept
+{
+    static const bool available = AnTcpRegisterProcessBarrier();
+    return available;
+}
+
+void AnTcpCallbackRegistry::ClaimSlot(AnTcpCallbackThreadReader& reader) noexcept
+{
+    // gives the slot back when the thread exits, only threads that got one construct it
+    struct SlotRelease
+    {
+        AnTcpCallbackReaderSlot* Slot;
+
+        ~SlotRelease()
+        {
+            Slot->Claimed.store(false, std::memory_order_release);
+        }
+    };
+
+    reader.Claimed = true;
+
+    for (AnTcpCallbackReaderSlot& slot : Slots)
+    {
+        bool expected = false;
+
+        if (!slot.Claimed.load(std::memory_order_relaxed) && slot.Claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+        {
+            static thread_local SlotRelease release{ &slot };
+            reader.Slot = &slot;
+            return;
+        }
+    }
+}
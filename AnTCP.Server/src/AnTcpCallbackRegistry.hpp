@@ -0,0 +1,230 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "AnTcpCallbackTable.hpp"
+#include "AnTcpPlatform.hpp"
+
+// threads that can read callback tables at the same time with a slot of their own, the others share one counter
+constexpr size_t ANTCP_CALLBACK_READER_SLOTS = 1024;
+
+/// <summary>
+/// Epoch a reader of callback tables announced, 0 while it is not pinned.
+/// </summary>
+struct alignas(64) AnTcpCallbackReaderSlot
+{
+    std::atomic<uint64_t> Epoch{ 0 };
+    std::atomic<bool> Claimed{ false };
+};
+
+/// <summary>
+/// Reader state of a thread, trivial so the hot path reads it without a tls wrapper call.
+/// </summary>
+struct AnTcpCallbackThreadReader
+{
+    AnTcpCallbackReaderSlot* Slot = nullptr;
+    bool Claimed = false;
+    unsigned int Depth = 0;
+};
+
+/// <summary>
+/// Versioned callback table that can be changed while clients send requests. Versions are immutable,
+/// readers pin the current one wait free and writers publish a changed copy with a single store.
+/// Replaced versions are deleted once no reader that could have seen them is pinned anymore (epoch
+/// based reclamation), so a callback may keep running after it was replaced or removed. Where the
+/// platform offers a process wide barrier, readers announce themselves with plain stores and the
+/// writers pay for the fence instead.
+/// </summary>
+class AnTcpCallbackRegistry
+{
+public:
+    /// <summary>
+    /// Keeps the version that was current when it was created alive, look up callbacks through it.
+    /// Readers can be nested, only the outermost one of a thread pins and unpins.
+    /// </summary>
+    class Reader
+    {
+    private:
+        const AnTcpCallbackTable* Table;
+
+    public:
+        Reader(const AnTcpCallbackRegistry& registry) noexcept
+            : Table(registry.Pin())
+        {}
+
+        ~Reader()
+        {
+            Unpin();
+        }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        inline const AnTcpCallbackEntry& operator[](AnTcpMessageType type) const noexcept
+        {
+            return (*Table)[AnTcpCallbackIndex(type)];
+        }
+
+        inline const AnTcpCallbackTable& operator*() const noexcept
+        {
+            return *Table;
+        }
+    };
+
+private:
+    // the epochs and slots are shared by all registries, a thread only needs one slot
+    static inline std::atomic<uint64_t> GlobalEpoch{ 1 };
+    static inline std::array<AnTcpCallbackReaderSlot, ANTCP_CALLBACK_READER_SLOTS> Slots{};
+
+    // pinned readers that did not get a slot, versions can't be deleted while there is one
+    static inline std::atomic<size_t> OverflowReaders{ 0 };
+
+    static inline thread_local AnTcpCallbackThreadReader CurrentReader{};
+
+    std::atomic<const AnTcpCallbackTable*> Current;
+
+    // whether writers run AnTcpProcessBarrier() before they look at the readers, the same for all registries
+    const bool ProcessBarrier;
+
+    // writers are serialized, readers never take this mutex
+    std::mutex WriteMutex;
+
+    // replaced versions and the epoch they were replaced in
+    std::vector<std::pair<uint64_t, const AnTcpCallbackTable*>> Retired;
+    uint64_t Versions;
+
+public:
+    AnTcpCallbackRegistry()
+        : Current(new AnTcpCallbackTable()),
+        ProcessBarrier(HasProcessBarrier()),
+        WriteMutex(),
+        Retired(),
+        Versions(1)
+    {}
+
+    /// <summary>
+    /// Deletes all versions, no reader may be pinned anymore.
+    /// </summary>
+    ~AnTcpCallbackRegistry();
+
+    AnTcpCallbackRegistry(const AnTcpCallbackRegistry&) = delete;
+    AnTcpCallbackRegistry& operator=(const AnTcpCallbackRegistry&) = delete;
+
+    /// <summary>
+    /// Pin the current version, see Reader.
+    /// </summary>
+    inline Reader Read() const noexcept
+    {
+        return Reader(*this);
+    }
+
+    /// <summary>
+    /// Change a copy of the current version and publish it, readers see either the old or the new
+    /// version as a whole. Writers are serialized, calling Update() from inside the update deadlocks.
+    /// </summary>
+    /// <param name="update">Called with the copy, returns false to discard it.</param>
+    /// <returns>True if a new version was published, false if the update discarded it.</returns>
+    template<typename Function>
+    inline bool Update(Function&& update) noexcept
+    {
+        std::lock_guard lock(WriteMutex);
+        AnTcpCallbackTable* table = new AnTcpCallbackTable(*Current.load(std::memory_order_relaxed));
+
+        if (!update(*table))
+        {
+            delete table;
+            return false;
+        }
+
+        Publish(table);
+        return true;
+    }
+
+    /// <summary>
+    /// Get the number of versions that were published, the initial one included.
+    /// </summary>
+    uint64_t GetVersionCount() noexcept;
+
+    /// <summary>
+    /// Get the number of replaced versions that can't be deleted yet, because readers might still use them.
+    /// </summary>
+    size_t GetRetiredCount() noexcept;
+
+private:
+    /// <summary>
+    /// Announce the epoch of the thread and load the current version.
+    /// </summary>
+    inline const AnTcpCallbackTable* Pin() const noexcept
+    {
+        AnTcpCallbackThreadReader& reader = CurrentReader;
+
+        if (reader.Depth++ == 0)
+        {
+            if (!reader.Claimed)
+            {
+                ClaimSlot(reader);
+            }
+
+            // the announcement is ordered before the load of the version, a writer that doesn't see it
+            // replaced the version before we load it, so we get the new one. An epoch that is newer
+            // than a replacement is only seen together with the replacement
+            if (!reader.Slot)
+            {
+                OverflowReaders.fetch_add(1, std::memory_order_seq_cst);
+            }
+            else if (ProcessBarrier)
+            {
+                // the barrier of the writer orders the store, the compiler must not move the load above it
+                reader.Slot->Epoch.store(GlobalEpoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            }
+            else
+            {
+                reader.Slot->Epoch.store(GlobalEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            }
+        }
+
+        return Current.load(std::memory_order_seq_cst);
+    }
+
+    /// <summary>
+    /// Leave the epoch, replaced versions the thread might have seen can be deleted afterwards.
+    /// </summary>
+    static inline void Unpin() noexcept
+    {
+        AnTcpCallbackThreadReader& reader = CurrentReader;
+
+        if (--reader.Depth == 0)
+        {
+            if (reader.Slot)
+            {
+                reader.Slot->Epoch.store(0, std::memory_order_release);
+            }
+            else
+            {
+                OverflowReaders.fetch_sub(1, std::memory_order_release);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Replace the current version and delete the replaced ones no reader can see anymore, WriteMutex is held.
+    /// </summary>
+    void Publish(const AnTcpCallbackTable* table) noexcept;
+
+    /// <summary>
+    /// Whether the process wide barrier is available, registers the process the first time.
+    /// </summary>
+    static bool HasProcessBarrier() noexcept;
+
+    /// <summary>
+    /// Take a free reader slot for the current thread, it is given back when the thread exits.
+    /// Threads that find none share OverflowReaders.
+    /// </summary>
+    static void ClaimSlot(AnTcpCallbackThreadReader& reader) noexcept;
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <type_traits>
+
+class AnTcpTask;
+class ClientHandler;
+
+// type used to identy the the type of a message
+typedef char AnTcpMessageType;
+
+// type used to match responses to their requests when frame version 2 was negotiated
+typedef unsigned int AnTcpRequestId;
+
+// message types from here up to 0xFF are reserved for the protocol, callbacks can not be added for them
+constexpr unsigned char ANTCP_RESERVED_MESSAGE_TYPES_START = 0xF0;
+
+// negotiates the frame version of a connection, request and response payload is the version as int
+constexpr AnTcpMessageType ANTCP_MESSAGE_NEGOTIATE = static_cast<AnTcpMessageType>(0xFF);
+
+// returns the servers metrics as binary snapshot, see AnTcpMetricsSnapshot::Serialize(), the request has no payload
+constexpr AnTcpMessageType ANTCP_MESSAGE_METRICS = static_cast<AnTcpMessageType>(0xFE);
+
+// runs many sub messages with one packet, the payload is a list of frames (size | type | payload, the size counts type
+// and payload). The response lists the responses of all sub messages in the same framing, in the order of the requests
+constexpr AnTcpMessageType ANTCP_MESSAGE_BATCH = static_cast<AnTcpMessageType>(0xFD);
+
+// moves a connection from the socket to a pair of shared memory rings, the request has no payload. The response
+// payload is the name of the segment to map, or empty if the server offers no shared memory and the socket is kept
+constexpr AnTcpMessageType ANTCP_MESSAGE_SHARED_MEMORY = static_cast<AnTcpMessageType>(0xFC);
+
+// sent instead of the responses of a request that exceeded a limit of the server, its callback did not run. The
+// payload is the message type of the request followed by the reason as byte, see AnTcpBusyReason
+constexpr AnTcpMessageType ANTCP_MESSAGE_BUSY = static_cast<AnTcpMessageType>(0xFB);
+
+// sent instead of the responses of a request that waited longer than the deadline of its message type, its
+// callback did not run. The payload is the message type of the request
+constexpr AnTcpMessageType ANTCP_MESSAGE_TIMEOUT = static_cast<AnTcpMessageType>(0xFA);
+
+// subscribes the connection to a topic, the payload is the topic as unsigned int. The response payload is
+// a byte, 1 if the connection is subscribed now, 0 if it already was or has too many subscriptions
+constexpr AnTcpMessageType ANTCP_MESSAGE_SUBSCRIBE = static_cast<AnTcpMessageType>(0xF9);
+
+// unsubscribes the connection from a topic, same payloads as ANTCP_MESSAGE_SUBSCRIBE
+constexpr AnTcpMessageType ANTCP_MESSAGE_UNSUBSCRIBE = static_cast<AnTcpMessageType>(0xF8);
+
+// pushed by the server to the subscribers of a topic, never a response. The payload is the topic as unsigned
+// int followed by the published data, frame version 2 clients get a request id of 0
+constexpr AnTcpMessageType ANTCP_MESSAGE_PUBLISH = static_cast<AnTcpMessageType>(0xF7);
+
+// callback fired when a message of its type was received
+typedef std::function<void(ClientHandler*, AnTcpMessageType, const void*, int)> AnTcpCallback;
+
+// plain function callback, called directly without the std::function overhead
+typedef void(*AnTcpCallbackFunction)(ClientHandler*, AnTcpMessageType, const void*, int);
+
+// coroutine callback, see AnTcpTask. Only plain functions, the captures of a lambda would be gone when the task resumes
+typedef AnTcpTask(*AnTcpTaskFunction)(ClientHandler*, AnTcpMessageType, const void*, int);
+
+/// <summary>
+/// Where the callback of a message type gets executed.
+/// </summary>
+enum class AnTcpDispatchMode
+{
+    // on the I/O thread that received the packet, best for cheap callbacks
+    Inline,
+    // on the worker pool, keeps slow callbacks from stalling the other clients of the I/O thread
+    Pooled
+};
+
+/// <summary>
+/// Lane of the worker pool the pooled callbacks of a message type are queued in, workers take
+/// jobs of a lane only when the lanes above it are empty. Jobs that already run are not preempted.
+/// </summary>
+enum class AnTcpPriority : unsigned char
+{
+    // cheap queries that should not wait behind anything
+    High,
+    Normal,
+    // expensive work that may wait until nothing else is left
+    Bulk
+};
+
+// number of lanes of the worker pool, one per AnTcpPriority
+constexpr size_t ANTCP_PRIORITY_COUNT = 3;
+
+/// <summary>
+/// Per message type options passed to AddCallback.
+/// </summary>
+struct AnTcpCallbackOptions
+{
+    AnTcpDispatchMode Dispatch = AnTcpDispatchMode::Inline;
+
+    // memoize the responses the callback sends, keyed by message type and payload. Only for
+    // callbacks whose responses depend on nothing but the payload, responses sent after the
+    // callback returned are not cached
+    bool Cacheable = false;
+
+    // how long cached responses stay valid in milliseconds, 0 keeps them until they are evicted or invalidated
+    unsigned int CacheTtl = 0;
+
+    // run the callback only once for identical requests that arrive while it is running, the others
+    // get copies of its responses sent by it. Nothing blocks, the later requests of frame version 1
+    // clients queue up until their responses were sent. Sub messages of a batch run the callback themselves
+    bool SingleFlight = false;
+
+    // lane of pooled callbacks, frame version 1 clients get their responses in order, so their
+    // requests still wait for the earlier ones of the same connection
+    AnTcpPriority Priority = AnTcpPriority::Normal;
+
+    // milliseconds a request may wait after it was received, requests that are older when their turn
+    // comes are answered with ANTCP_MESSAGE_TIMEOUT instead of running the callback. 0 means no deadline
+    unsigned int Deadline = 0;
+};
+
+/// <summary>
+/// Callback slot of a message type, either a plain function, a std::function or a task.
+/// </summary>
+struct AnTcpCallbackEntry
+{
+    AnTcpCallbackFunction Function = nullptr;
+    AnTcpCallback Callback = nullptr;
+
+    // started by the client handler, see ClientHandler::StartTask()
+    AnTcpTaskFunction Task = nullptr;
+
+    AnTcpCallbackOptions Options{};
+
+    /// <summary>
+    /// Whether there is a callback for the message type.
+    /// </summary>
+    inline explicit operator bool() const noexcept
+    {
+        return Function || Callback || Task;
+    }
+
+    /// <summary>
+    /// Fire the callback, plain functions are preferred as they skip the type erasure. Not for tasks.
+    /// </summary>
+    inline void operator()(ClientHandler* handler, AnTcpMessageType type, const void* data, int size) const
+    {
+        if (Function)
+        {
+            Function(handler, type, data, size);
+        }
+        else
+        {
+            Callback(handler, type, data, size);
+        }
+    }
+};
+
+/// <summary>
+/// Callback table indexed directly by the message type, a lookup is a single array access.
+/// </summary>
+typedef std::array<AnTcpCallbackEntry, 256> AnTcpCallbackTable;
+
+/// <summary>
+/// Get the table index of a message type, AnTcpMessageType may be signed.
+/// </summary>
+constexpr size_t AnTcpCallbackIndex(AnTcpMessageType type) noexcept
+{
+    return static_cast<unsigned char>(type);
+}
+
+/// <summary>
+/// Whether a message type is reserved for the protocol.
+/// </summary>
+constexpr bool AnTcpIsReservedMessageType(AnTcpMessageType type) noexcept
+{
+    return static_cast<unsigned char>(type) >= ANTCP_RESERVED_MESSAGE_TYPES_START;
+}
+
+/// <summary>
+/// Thunk for a callback known at compile time, the callback itself is inlined into it.
+/// Callback can be a function pointer or a captureless lambda.
+/// </summary>
+template<auto Callback>
+void AnTcpCallbackThunk(ClientHandler* handler, AnTcpMessageType type, const void* data, int size)
+{
+    Callback(handler, type, data, size);
+}
+
+/// <summary>
+/// Message type and callback pair for compile time handler lists.
+/// Usage: server.AddCallbacks&lt;AnTcpHandler&lt;0, AddCallback&gt;, AnTcpHandler&lt;1, SubtractCallback&gt;&gt;();
+/// </summary>
+template<AnTcpMessageType Type, auto Callback, AnTcpCallbackOptions CallbackOptions = AnTcpCallbackOptions{}>
+struct AnTcpHandler
+{
+    static constexpr AnTcpMessageType MessageType = Type;
+    static constexpr AnTcpCallbackFunction Function = &AnTcpCallbackThunk<Callback>;
+    static constexpr AnTcpCallbackOptions Options = CallbackOptions;
+};
@@ -0,0 +1,211 @@
+#include "AnTcpServer.hpp"
+
+#include <chrono>
+#include <new>
+#include <thread>
+
+// how often WaitForSlot() looks for a free slot when there were no descriptors left for its wakeup
+constexpr std::chrono::milliseconds ANTCP_CONNECTION_SLOT_POLL_INTERVAL{ 10 };
+
+struct AnTcpConnectionTable::Slot
+{
+    alignas(ClientHandler) unsigned char Storage[sizeof(ClientHandler)];
+    uint32_t Generation = 1;
+    bool Used = false;
+
+    inline ClientHandler* GetHandler() noexcept
+    {
+        return std::launder(reinterpret_cast<ClientHandler*>(Storage));
+    }
+};
+
+AnTcpConnectionTable::AnTcpConnectionTable()
+    : Mutex(),
+    SlotReleased(),
+    Slabs(),
+    SlotWakeup{ INVALID_SOCKET, INVALID_SOCKET },
+    SlotWaiters(0),
+    FreeSlots(),
+    Count(0),
+    MaxConnections(0),
+    RejectedConnections(0)
+{
+    AnTcpCreateWakeup(SlotWakeup);
+}
+
+// handlers are destroyed by their last reference, only the slabs are left here
+AnTcpConnectionTable::~AnTcpConnectionTable()
+{
+    AnTcpCloseWakeup(SlotWakeup);
+}
+
+AnTcpConnectionTable::Slot& AnTcpConnectionTable::GetSlot(uint32_t index) noexcept
+{
+    return Slabs[index / ANTCP_CONNECTION_SLAB_SIZE][index % ANTCP_CONNECTION_SLAB_SIZE];
+}
+
+ClientHandler* AnTcpConnectionTable::Add(AnTcpServer* server, SOCKET socket, const sockaddr_storage& socketInfo, AnTcpEventLoop* eventLoop, AnTcpIoUring* ioUring) noexcept
+{
+    std::lock_guard lock(Mutex);
+
+    if (IsFull())
+    {
+        return nullptr;
+    }
+
+    if (FreeSlots.empty())
+    {
+        std::unique_ptr<Slot[]> slab(new (std::nothrow) Slot[ANTCP_CONNECTION_SLAB_SIZE]);
+
+        if (!slab)
+        {
+            return nullptr;
+        }
+
+        const uint32_t firstIndex = static_cast<uint32_t>(Slabs.size() * ANTCP_CONNECTION_SLAB_SIZE);
+        Slabs.push_back(std::move(slab));
+
+        // pushed in reverse, so the lowest index is used first
+        for (uint32_t i = ANTCP_CONNECTION_SLAB_SIZE; i > 0; --i)
+        {
+            FreeSlots.push_back(firstIndex + i - 1);
+        }
+    }
+
+    const uint32_t index = FreeSlots.back();
+    FreeSlots.pop_back();
+
+    Slot& slot = GetSlot(index);
+    const AnTcpConnectionId id = (static_cast<AnTcpConnectionId>(slot.Generation) << 32) | index;
+
+    // constructed under the lock, a thread per client handler may drop its reference before we return
+    ClientHandler* handler = new (slot.Storage) ClientHandler(server, id, socket, socketInfo, eventLoop, ioUring);
+    slot.Used = true;
+    ++Count;
+
+    return handler;
+}
+
+void AnTcpConnectionTable::Remove(ClientHandler* handler) noexcept
+{
+    const uint32_t index = static_cast<uint32_t>(handler->GetId());
+
+    // the slot stays used while the handler is destroyed, Acquire() sees it has no references left
+    handler->~ClientHandler();
+
+    {
+        std::lock_guard lock(Mutex);
+        Slot& slot = GetSlot(index);
+        slot.Used = false;
+
+        // invalidate the id of the old connection, 0 is skipped to keep ANTCP_INVALID_CONNECTION_ID unused
+        if (++slot.Generation == 0)
+        {
+            slot.Generation = 1;
+        }
+
+        FreeSlots.push_back(index);
+        --Count;
+
+        if (SlotWaiters > 0)
+        {
+            AnTcpWake(SlotWakeup[1]);
+        }
+
+        // notified under the lock, WaitUntilEmpty() may return and the server be deleted right after we unlock
+        SlotReleased.notify_all();
+    }
+}
+
+ClientHandler* AnTcpConnectionTable::Acquire(AnTcpConnectionId id) noexcept
+{
+    const uint32_t index = static_cast<uint32_t>(id);
+    const uint32_t generation = static_cast<uint32_t>(id >> 32);
+
+    std::lock_guard lock(Mutex);
+
+    if (index >= Slabs.size() * ANTCP_CONNECTION_SLAB_SIZE)
+    {
+        return nullptr;
+    }
+
+    Slot& slot = GetSlot(index);
+
+    if (!slot.Used || slot.Generation != generation)
+    {
+        return nullptr;
+    }
+
+    ClientHandler* handler = slot.GetHandler();
+    return handler->TryAddReference() ? handler : nullptr;
+}
+
+void AnTcpConnectionTable::DisconnectAll() noexcept
+{
+    std::vector<ClientHandler*> handlers;
+
+    {
+        std::lock_guard lock(Mutex);
+
+        for (std::unique_ptr<Slot[]>& slab : Slabs)
+        {
+            for (size_t i = 0; i < ANTCP_CONNECTION_SLAB_SIZE; ++i)
+            {
+                if (slab[i].Used && slab[i].GetHandler()->TryAddReference())
+                {
+                    handlers.push_back(slab[i].GetHandler());
+                }
+            }
+        }
+    }
+
+    // outside of the lock, the disconnect event and the last release may need it
+    for (ClientHandler* handler : handlers)
+    {
+        handler->Disconnect();
+        handler->Release();
+    }
+}
+
+void AnTcpConnectionTable::WaitForSlot(const std::atomic<bool>& shouldExit) noexcept
+{
+    std::unique_lock lock(Mutex);
+
+    while (IsFull() && !shouldExit)
+    {
+        // counted under the lock, so a slot released after the check wakes us up
+        ++SlotWaiters;
+        lock.unlock();
+
+        if (SlotWakeup[0] != INVALID_SOCKET)
+        {
+            AnTcpPollFd pollFd{ SlotWakeup[0], POLLIN, 0 };
+            AnTcpPoll(&pollFd, 1, -1);
+        }
+        else
+        {
+            std::this_thread::sleep_for(ANTCP_CONNECTION_SLOT_POLL_INTERVAL);
+        }
+
+        lock.lock();
+        --SlotWaiters;
+
+        // a released slot wakes a single waiter, the wake of the shutdown is left for all of them
+        if (!shouldExit)
+        {
+            AnTcpConsumeWake(SlotWakeup[0]);
+        }
+    }
+}
+
+void AnTcpConnectionTable::WaitUntilEmpty() noexcept
+{
+    std::unique_lock lock(Mutex);
+    SlotReleased.wait(lock, [this]() { return Count == 0; });
+}
+
+void AnTcpConnectionTable::Wakeup() noexcept
+{
+    // no lock, the waiters check the state after every wake
+    AnTcpWake(SlotWakeup[1]);
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "AnTcpPlatform.hpp"
+
+class AnTcpEventLoop;
+class AnTcpIoUring;
+class AnTcpServer;
+class ClientHandler;
+
+// id of a connection: slot index in the low 32 bits and the generation of the slot in the high ones,
+// ids of closed connections never match the new connection in their slot
+typedef uint64_t AnTcpConnectionId;
+
+// generations start at 1, so this id is never handed out
+constexpr AnTcpConnectionId ANTCP_INVALID_CONNECTION_ID = 0;
+
+// number of handler slots allocated at once, slabs are kept until the server is deleted
+constexpr size_t ANTCP_CONNECTION_SLAB_SIZE = 32;
+
+/// <summary>
+/// What the server does with new connections when the connection limit is reached.
+/// </summary>
+enum class AnTcpConnectionLimitMode
+{
+    // accept and close them right away
+    Reject,
+    // stop accepting until a connection closes, new ones wait in the listen backlog of the kernel
+    Queue
+};
+
+/// <summary>
+/// Registry of all client handlers of a server. Handlers are constructed in
+/// preallocated slots, closed connections return their slot to a free list,
+/// so adding and removing a connection is O(1) and memory stays flat when
+/// clients come and go.
+/// </summary>
+class AnTcpConnectionTable
+{
+private:
+    struct Slot;
+
+    std::mutex Mutex;
+    std::condition_variable SlotReleased;
+    std::vector<std::unique_ptr<Slot[]>> Slabs;
+
+    // WaitForSlot() polls this instead of waiting for the condition variable, Wakeup() may run in a signal handler
+    SOCKET SlotWakeup[2];
+    size_t SlotWaiters;
+
+    // most recently released slots are reused first, their memory is likely still cached
+    std::vector<uint32_t> FreeSlots;
+
+    size_t Count;
+    size_t MaxConnections;
+    std::atomic<uint64_t> RejectedConnections;
+
+public:
+    AnTcpConnectionTable();
+    ~AnTcpConnectionTable();
+
+    AnTcpConnectionTable(const AnTcpConnectionTable&) = delete;
+    AnTcpConnectionTable& operator=(const AnTcpConnectionTable&) = delete;
+
+    /// <summary>
+    /// Set the maximum number of open connections, 0 means unlimited.
+    /// </summary>
+    inline void SetMaxConnections(size_t maxConnections) noexcept
+    {
+        std::lock_guard lock(Mutex);
+        MaxConnections = maxConnections;
+    }
+
+    /// <summary>
+    /// Get the number of open connections.
+    /// </summary>
+    inline size_t GetCount() noexcept
+    {
+        std::lock_guard lock(Mutex);
+        return Count;
+    }
+
+    /// <summary>
+    /// Get the number of connections that were closed because the limit was reached.
+    /// </summary>
+    inline uint64_t GetRejectedCount() const noexcept
+    {
+        return RejectedConnections.load(std::memory_order_relaxed);
+    }
+
+    /// <summary>
+    /// Count a connection that was closed because the limit was reached.
+    /// </summary>
+    inline void RecordRejected() noexcept
+    {
+        RejectedConnections.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// <summary>
+    /// Construct a handler for an accepted client in a free slot.
+    /// </summary>
+    /// <returns>The handler holding one reference, null if the connection limit is reached.</returns>
+    ClientHandler* Add(AnTcpServer* server, SOCKET socket, const sockaddr_storage& socketInfo, AnTcpEventLoop* eventLoop, AnTcpIoUring* ioUring = nullptr) noexcept;
+
+    /// <summary>
+    /// Destroy a handler whose last reference was dropped and free its slot.
+    /// </summary>
+    void Remove(ClientHandler* handler) noexcept;
+
+    /// <summary>
+    /// Get the handler of a connection and take a reference to it.
+    /// </summary>
+    /// <returns>The handler, null if the connection is closed. Release() it when done.</returns>
+    ClientHandler* Acquire(AnTcpConnectionId id) noexcept;
+
+    /// <summary>
+    /// Disconnect every open connection.
+    /// </summary>
+    void DisconnectAll() noexcept;
+
+    /// <summary>
+    /// Block until a connection can be added or the server is stopping.
+    /// </summary>
+    void WaitForSlot(const std::atomic<bool>& shouldExit) noexcept;
+
+    /// <summary>
+    /// Block until every handler is destroyed.
+    /// </summary>
+    void WaitUntilEmpty() noexcept;
+
+    /// <summary>
+    /// Wake up WaitForSlot(), used to notice the server shutdown. Only writes to a pipe, so it is async signal safe.
+    /// </summary>
+    void Wakeup() noexcept;
+
+private:
+    inline bool IsFull() const noexcept
+    {
+        return MaxConnections > 0 && Count >= MaxConnections;
+    }
+
+    Slot& GetSlot(uint32_t index) noexcept;
+};
@@ -0,0 +1,225 @@
+#include "AnTcpServer.hpp"
+
+#if ANTCP_HAS_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+// how many events are fetched at most per wait
+constexpr auto ANTCP_EVENT_LOOP_MAX_EVENTS = 64;
+
+AnTcpEventLoop::~AnTcpEventLoop()
+{
+    Wakeup();
+
+    if (Thread)
+    {
+        Thread->join();
+        delete Thread;
+    }
+
+    for (ClientHandler* handler : Handlers)
+    {
+        handler->Disconnect();
+        handler->Release();
+    }
+
+#if ANTCP_HAS_EPOLL
+    if (WakeFd != -1)
+    {
+        close(WakeFd);
+    }
+
+    if (PollFd != -1)
+    {
+        close(PollFd);
+    }
+#endif
+}
+
+bool AnTcpEventLoop::Start() noexcept
+{
+#if ANTCP_HAS_EPOLL
+    PollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (PollFd == -1)
+    {
+        DEBUG_ONLY(std::cout << ">> epoll_create1() failed: " << errno << std::endl);
+        return false;
+    }
+
+    WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (WakeFd == -1)
+    {
+        DEBUG_ONLY(std::cout << ">> eventfd() failed: " << errno << std::endl);
+        return false;
+    }
+
+    // the wake fd is registered without a handler
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+
+    if (epoll_ctl(PollFd, EPOLL_CTL_ADD, WakeFd, &event) == -1)
+    {
+        DEBUG_ONLY(std::cout << ">> epoll_ctl() failed: " << errno << std::endl);
+        return false;
+    }
+
+    Thread = new std::thread(&AnTcpEventLoop::Run, this);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool AnTcpEventLoop::AddClient(ClientHandler* handler) noexcept
+{
+#if ANTCP_HAS_EPOLL
+    if (!AnTcpSetNonBlocking(handler->Socket))
+    {
+        DEBUG_ONLY(std::cout << "[" << handler->GetId() << "] " << "Failed to make socket non-blocking" << std::endl);
+        handler->Release();
+        return false;
+    }
+
+    {
+        std::lock_guard lock(HandlersMutex);
+        Handlers.insert(handler);
+    }
+
+    // fire the connect event before the loop can process any data of the client
+    handler->NotifyConnected();
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = handler;
+
+    if (epoll_ctl(PollFd, EPOLL_CTL_ADD, handler->Socket, &event) == -1)
+    {
+        DEBUG_ONLY(std::cout << "[" << handler->GetId() << "] " << "epoll_ctl() failed: " << errno << std::endl);
+        RemoveClient(handler);
+        return false;
+    }
+
+    return true;
+#else
+    handler->Release();
+    return false;
+#endif
+}
+
+void AnTcpEventLoop::Wakeup() noexcept
+{
+#if ANTCP_HAS_EPOLL
+    if (WakeFd != -1)
+    {
+        const unsigned long long value = 1;
+        [[maybe_unused]] const auto written = write(WakeFd, &value, sizeof(value));
+    }
+#endif
+}
+
+void AnTcpEventLoop::WatchWritable([[maybe_unused]] ClientHandler* handler, [[maybe_unused]] bool writable) noexcept
+{
+#if ANTCP_HAS_EPOLL
+    epoll_event event{};
+    event.events = writable ? EPOLLOUT : EPOLLIN;
+    event.data.ptr = handler;
+
+    // fails when the client was removed meanwhile, there is nothing left to wait for then
+    epoll_ctl(PollFd, EPOLL_CTL_MOD, handler->Socket, &event);
+#endif
+}
+
+void AnTcpEventLoop::Run() noexcept
+{
+#if ANTCP_HAS_EPOLL
+    epoll_event events[ANTCP_EVENT_LOOP_MAX_EVENTS];
+    AnTcpReceiveStats receiveStats{};
+
+    if (Counters)
+    {
+        Counters->AddThread(Core);
+    }
+
+    while (!ShouldExit)
+    {
+        int eventCount = 0;
+        std::chrono::steady_clock::time_point workStart{};
+
+        if (Counters)
+        {
+            // an epoll_wait() without timeout returns right away, spinning on it saves the wakeup of the thread
+            workStart = Counters->Wait(SpinTime,
+                [this, &events, &eventCount, &receiveStats]()
+                {
+                    ++receiveStats.Waits;
+                    return (eventCount = epoll_wait(PollFd, events, ANTCP_EVENT_LOOP_MAX_EVENTS, 0)) != 0 || ShouldExit;
+                },
+                [this, &events, &eventCount, &receiveStats]()
+                {
+                    ++receiveStats.Waits;
+                    eventCount = epoll_wait(PollFd, events, ANTCP_EVENT_LOOP_MAX_EVENTS, -1);
+                });
+        }
+        else
+        {
+            ++receiveStats.Waits;
+            eventCount = epoll_wait(PollFd, events, ANTCP_EVENT_LOOP_MAX_EVENTS, -1);
+        }
+
+        for (int i = 0; i < eventCount; ++i)
+        {
+            ClientHandler* handler = static_cast<ClientHandler*>(events[i].data.ptr);
+
+            if (!handler)
+            {
+                // reset the wake fd, the while condition checks whether we need to exit
+                unsigned long long value = 0;
+                [[maybe_unused]] const auto read = ::read(WakeFd, &value, sizeof(value));
+                continue;
+            }
+
+            // errors and hangups are reported by recv() too
+            if ((events[i].events & EPOLLOUT) && handler->ContinueSend() == AnTcpSendResult::Failed)
+            {
+                RemoveClient(handler);
+            }
+            else if (events[i].events & ~EPOLLOUT)
+            {
+                ++receiveStats.Receives;
+
+                if (!handler->Receive())
+                {
+                    RemoveClient(handler);
+                }
+            }
+        }
+
+        if (Counters)
+        {
+            Counters->AddWork(workStart);
+        }
+    }
+
+    ReceiveCounters.Add(receiveStats);
+#endif
+}
+
+void AnTcpEventLoop::RemoveClient(ClientHandler* handler) noexcept
+{
+#if ANTCP_HAS_EPOLL
+    epoll_ctl(PollFd, EPOLL_CTL_DEL, handler->Socket, nullptr);
+#endif
+
+    {
+        std::lock_guard lock(HandlersMutex);
+        Handlers.erase(handler);
+    }
+
+    // queued jobs may still use the handler, the last reference closes the socket
+    handler->Disconnect();
+    handler->Release();
+}
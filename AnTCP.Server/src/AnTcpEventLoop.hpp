@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include "AnTcpLowLatency.hpp"
+#include "AnTcpPlatform.hpp"
+
+class ClientHandler;
+
+/// <summary>
+/// I/O thread that multiplexes many non-blocking client sockets, used by the
+/// event loop backend instead of one thread per client.
+/// </summary>
+class AnTcpEventLoop
+{
+private:
+    std::atomic<bool>& ShouldExit;
+    AnTcpReceiveCounters& ReceiveCounters;
+    int PollFd;
+    int WakeFd;
+    std::thread* Thread;
+
+    // set in the low latency mode, the loop polls for SpinTime before it blocks
+    AnTcpIoThreadCounters* Counters;
+    std::chrono::nanoseconds SpinTime;
+    int Core;
+
+    std::mutex HandlersMutex;
+    std::unordered_set<ClientHandler*> Handlers;
+
+public:
+    /// <summary>
+    /// Create a new event loop, call Start() to spawn its thread.
+    /// </summary>
+    /// <param name="shouldExit">Atomic bool to notify the loop that the server is going to shutdown.</param>
+    /// <param name="receiveCounters">Receive syscalls of the server, the loop adds its own when it exits.</param>
+    AnTcpEventLoop(std::atomic<bool>& shouldExit, AnTcpReceiveCounters& receiveCounters)
+        : ShouldExit(shouldExit),
+        ReceiveCounters(receiveCounters),
+        PollFd(-1),
+        WakeFd(-1),
+        Thread(nullptr),
+        Counters(nullptr),
+        SpinTime(0),
+        Core(-1),
+        HandlersMutex(),
+        Handlers()
+    {}
+
+    /// <summary>
+    /// Stops the loop thread and deletes all clients that are still handled by it.
+    /// </summary>
+    ~AnTcpEventLoop();
+
+    AnTcpEventLoop(const AnTcpEventLoop&) = delete;
+    AnTcpEventLoop& operator=(const AnTcpEventLoop&) = delete;
+
+    /// <summary>
+    /// Let the loop poll for events before it blocks and pin its thread, needs to be called before Start().
+    /// </summary>
+    /// <param name="counters">Counters of the thread, owned by the server.</param>
+    /// <param name="spinTime">How long to poll before blocking.</param>
+    /// <param name="core">Core to pin the thread to, -1 leaves it to the scheduler.</param>
+    inline void SetLowLatency(AnTcpIoThreadCounters* counters, std::chrono::nanoseconds spinTime, int core) noexcept
+    {
+        Counters = counters;
+        SpinTime = spinTime;
+        Core = core;
+    }
+
+    /// <summary>
+    /// Create the poll instance and start the loop thread.
+    /// </summary>
+    /// <returns>True if the loop is running, false if the platform does not support it.</returns>
+    bool Start() noexcept;
+
+    /// <summary>
+    /// Hand a new client over to the loop, the loop owns the handler afterwards.
+    /// </summary>
+    /// <param name="handler">Handler of the accepted client.</param>
+    /// <returns>True if the client was added, false if it was deleted.</returns>
+    bool AddClient(ClientHandler* handler) noexcept;
+
+    /// <summary>
+    /// Wake the loop thread up, used to notice the server shutdown.
+    /// </summary>
+    void Wakeup() noexcept;
+
+    /// <summary>
+    /// Switch a client between waiting for requests and waiting for its socket to take the pending
+    /// data, it doesn't read while it can't send. Called with the send mutex of the client locked.
+    /// </summary>
+    /// <param name="handler">Handler of the client.</param>
+    /// <param name="writable">True to wait until the socket is writable, false to wait for requests again.</param>
+    void WatchWritable(ClientHandler* handler, bool writable) noexcept;
+
+    /// <summary>
+    /// Get the number of clients handled by this loop.
+    /// </summary>
+    inline size_t GetClientCount() noexcept
+    {
+        std::lock_guard lock(HandlersMutex);
+        return Handlers.size();
+    }
+
+private:
+    /// <summary>
+    /// Routine of the loop thread, waits for readable sockets and lets their handlers process the data,
+    /// and for writable ones to send what their handlers could not send before.
+    /// </summary>
+    void Run() noexcept;
+
+    /// <summary>
+    /// Unregister a client that disconnected and drop the loops reference to it.
+    /// </summary>
+    void RemoveClient(ClientHandler* handler) noexcept;
+};
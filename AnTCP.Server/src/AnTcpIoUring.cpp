@@ -0,0 +1,796 @@
+#include "AnTcpServer.hpp"
+
+#include <utility>
+
+#if ANTCP_HAS_IO_URING
+#include <csignal>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// what a completion belongs to is stored in the low bits of its user data, the rest is the handler or listener index
+constexpr uint64_t ANTCP_IO_URING_ACCEPT = 0;
+constexpr uint64_t ANTCP_IO_URING_RECEIVE = 1;
+constexpr uint64_t ANTCP_IO_URING_SEND = 2;
+constexpr uint64_t ANTCP_IO_URING_CANCEL = 3;
+constexpr uint64_t ANTCP_IO_URING_TAG_MASK = 3;
+
+// the wake read shares the tag of the cancel, it has no handler either
+constexpr uint64_t ANTCP_IO_URING_WAKE = (1 << 2) | ANTCP_IO_URING_CANCEL;
+
+static_assert(alignof(ClientHandler) > ANTCP_IO_URING_TAG_MASK, "handler pointers need free low bits for the tag");
+static_assert((ANTCP_IO_URING_BUFFER_COUNT & (ANTCP_IO_URING_BUFFER_COUNT - 1)) == 0, "the buffer count needs to be a power of two");
+
+// every client receives into the buffers of this group
+constexpr uint16_t ANTCP_IO_URING_BUFFER_GROUP = 0;
+#endif
+
+AnTcpIoUring::~AnTcpIoUring()
+{
+    Wait();
+
+#if ANTCP_HAS_IO_URING
+    // the kernel keeps its own references to the mapped pages until the ring is gone
+    if (RingFd != -1)
+    {
+        close(RingFd);
+    }
+
+    if (WakeFd != -1)
+    {
+        close(WakeFd);
+    }
+
+    if (Buffers)
+    {
+        munmap(Buffers, static_cast<size_t>(ANTCP_IO_URING_BUFFER_COUNT) * ANTCP_RECEIVE_BUFFER_SIZE);
+    }
+
+    if (BufferRing)
+    {
+        munmap(BufferRing, ANTCP_IO_URING_BUFFER_COUNT * sizeof(io_uring_buf));
+    }
+
+    if (Submissions)
+    {
+        munmap(Submissions, SubmissionsSize);
+    }
+
+    if (CompletionMapping && CompletionMapping != QueueMapping)
+    {
+        munmap(CompletionMapping, CompletionMappingSize);
+    }
+
+    if (QueueMapping)
+    {
+        munmap(QueueMapping, QueueMappingSize);
+    }
+#endif
+}
+
+bool AnTcpIoUring::Create(const std::vector<SOCKET>& listenSockets) noexcept
+{
+    ListenSockets = listenSockets;
+    return SetupRing() && SetupBuffers() && SetupWake();
+}
+
+void AnTcpIoUring::Start() noexcept
+{
+    Thread = new std::thread(&AnTcpIoUring::Run, this);
+}
+
+void AnTcpIoUring::Wait() noexcept
+{
+    if (Thread)
+    {
+        Thread->join();
+        delete Thread;
+        Thread = nullptr;
+    }
+}
+
+bool AnTcpIoUring::SetupRing() noexcept
+{
+#if ANTCP_HAS_IO_URING
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = ANTCP_IO_URING_ENTRIES * 4;
+    RingFd = static_cast<int>(syscall(__NR_io_uring_setup, ANTCP_IO_URING_ENTRIES, &params));
+
+    if (RingFd == -1 && errno == EINVAL)
+    {
+        // kernels before 5.19 don't know the flags, they are optimizations only
+        params = io_uring_params{};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = ANTCP_IO_URING_ENTRIES * 4;
+        RingFd = static_cast<int>(syscall(__NR_io_uring_setup, ANTCP_IO_URING_ENTRIES, &params));
+    }
+
+    if (RingFd == -1)
+    {
+        // ENOSYS on old kernels, EPERM when io_uring is disabled by the admin or a seccomp filter
+        DEBUG_ONLY(std::cout << ">> io_uring_setup() failed: " << errno << std::endl);
+        return false;
+    }
+
+    QueueMappingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    CompletionMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        QueueMappingSize = std::max(QueueMappingSize, CompletionMappingSize);
+        CompletionMappingSize = QueueMappingSize;
+    }
+
+    QueueMapping = mmap(nullptr, QueueMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_SQ_RING);
+
+    if (QueueMapping == MAP_FAILED)
+    {
+        QueueMapping = nullptr;
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        CompletionMapping = QueueMapping;
+    }
+    else
+    {
+        CompletionMapping = mmap(nullptr, CompletionMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_CQ_RING);
+
+        if (CompletionMapping == MAP_FAILED)
+        {
+            CompletionMapping = nullptr;
+            return false;
+        }
+    }
+
+    SubmissionsSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* submissions = mmap(nullptr, SubmissionsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_SQES);
+
+    if (submissions == MAP_FAILED)
+    {
+        return false;
+    }
+
+    Submissions = static_cast<io_uring_sqe*>(submissions);
+
+    char* queue = static_cast<char*>(QueueMapping);
+    SubmissionHead = reinterpret_cast<unsigned int*>(queue + params.sq_off.head);
+    SubmissionTail = reinterpret_cast<unsigned int*>(queue + params.sq_off.tail);
+    SubmissionMask = *reinterpret_cast<unsigned int*>(queue + params.sq_off.ring_mask);
+    SubmissionEntries = params.sq_entries;
+    LocalTail = *SubmissionTail;
+
+    // entries are used in order, so every slot of the index array points to its own entry
+    unsigned int* indices = reinterpret_cast<unsigned int*>(queue + params.sq_off.array);
+
+    for (unsigned int i = 0; i < SubmissionEntries; ++i)
+    {
+        indices[i] = i;
+    }
+
+    char* completion = static_cast<char*>(CompletionMapping);
+    CompletionHead = reinterpret_cast<unsigned int*>(completion + params.cq_off.head);
+    CompletionTail = reinterpret_cast<unsigned int*>(completion + params.cq_off.tail);
+    CompletionMask = *reinterpret_cast<unsigned int*>(completion + params.cq_off.ring_mask);
+    Completions = reinterpret_cast<io_uring_cqe*>(completion + params.cq_off.cqes);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool AnTcpIoUring::SetupBuffers() noexcept
+{
+#if ANTCP_HAS_IO_URING
+    BufferRing = mmap(nullptr, ANTCP_IO_URING_BUFFER_COUNT * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (BufferRing == MAP_FAILED)
+    {
+        BufferRing = nullptr;
+        return false;
+    }
+
+    void* buffers = mmap(nullptr, static_cast<size_t>(ANTCP_IO_URING_BUFFER_COUNT) * ANTCP_RECEIVE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (buffers == MAP_FAILED)
+    {
+        return false;
+    }
+
+    Buffers = static_cast<char*>(buffers);
+
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(BufferRing);
+    registration.ring_entries = ANTCP_IO_URING_BUFFER_COUNT;
+    registration.bgid = ANTCP_IO_URING_BUFFER_GROUP;
+
+    if (syscall(__NR_io_uring_register, RingFd, IORING_REGISTER_PBUF_RING, &registration, 1) == -1)
+    {
+        // provided buffer rings need linux 5.19, multishot receives 6.0
+        DEBUG_ONLY(std::cout << ">> IORING_REGISTER_PBUF_RING failed: " << errno << std::endl);
+        return false;
+    }
+
+    for (uint16_t i = 0; i < ANTCP_IO_URING_BUFFER_COUNT; ++i)
+    {
+        RecycleBuffer(i);
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool AnTcpIoUring::SetupWake() noexcept
+{
+#if ANTCP_HAS_IO_URING
+    WakeFd = eventfd(0, EFD_CLOEXEC);
+
+    if (WakeFd == -1)
+    {
+        DEBUG_ONLY(std::cout << ">> eventfd() failed: " << errno << std::endl);
+        return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AnTcpIoUring::Run() noexcept
+{
+#if ANTCP_HAS_IO_URING
+    for (size_t i = 0; i < ListenSockets.size(); ++i)
+    {
+        ArmAccept(i);
+    }
+
+    ArmWake();
+
+    // Stop() shuts the listen sockets down, which completes the accepts and wakes us up
+    if (Counters)
+    {
+        Counters->AddThread(Core);
+    }
+
+    while (!ShouldExit)
+    {
+        const long long timeout = QueuedClients.empty() ? -1 : ANTCP_IO_URING_QUEUE_RETRY;
+        std::chrono::steady_clock::time_point workStart{};
+
+        if (Counters)
+        {
+            // with COOP_TASKRUN the kernel only posts receives when we enter, so polling has to enter too
+            workStart = Counters->Wait(SpinTime,
+                [this]() { Enter(0, 0); return HasCompletions() || ShouldExit; },
+                [this, timeout]() { Enter(1, timeout); });
+        }
+        else
+        {
+            // the sends of the last batch go out with the same syscall that waits for the next one
+            Enter(1, timeout);
+        }
+
+        ProcessCompletions();
+
+        for (ClientHandler* handler : SendQueue)
+        {
+            SubmitSend(handler);
+        }
+
+        SendQueue.clear();
+        AddQueuedClients();
+
+        if (Counters)
+        {
+            Counters->AddWork(workStart);
+        }
+    }
+
+    Shutdown();
+
+    // the receives complete in the ring, entering it is the only syscall they cost
+    Server->ReceiveCounters.Add(AnTcpReceiveStats{ 0, Enters });
+#endif
+}
+
+void AnTcpIoUring::Shutdown() noexcept
+{
+#if ANTCP_HAS_IO_URING
+    // shutting the sockets down ends their receives, the cancel catches everything else
+    const std::vector<ClientHandler*> handlers(Handlers.begin(), Handlers.end());
+
+    for (ClientHandler* handler : handlers)
+    {
+        RemoveClient(handler);
+    }
+
+    io_uring_sqe* submission = GetSubmission();
+    submission->opcode = IORING_OP_ASYNC_CANCEL;
+    submission->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    submission->user_data = ANTCP_IO_URING_CANCEL;
+    ++Operations;
+
+    // buffers and handlers may only go away once the kernel is done with them
+    while (Operations > 0)
+    {
+        Enter(1, -1);
+        ProcessCompletions();
+    }
+
+    for (const QueuedClient& client : QueuedClients)
+    {
+        closesocket(client.Socket);
+    }
+
+    QueuedClients.clear();
+    SendQueue.clear();
+
+    // nobody sends to the disconnected clients anymore, their sockets fail before they fill up
+    std::lock_guard lock(ResumedSendsMutex);
+
+    for (ClientHandler* handler : ResumedSends)
+    {
+        handler->Release();
+    }
+
+    ResumedSends.clear();
+#endif
+}
+
+void AnTcpIoUring::Enter([[maybe_unused]] unsigned int waitCount, [[maybe_unused]] long long timeout) noexcept
+{
+#if ANTCP_HAS_IO_URING
+    std::atomic_ref<unsigned int>(*SubmissionTail).store(LocalTail, std::memory_order_release);
+    const unsigned int submitCount = LocalTail - std::atomic_ref<unsigned int>(*SubmissionHead).load(std::memory_order_acquire);
+
+    unsigned int flags = waitCount > 0 || timeout == 0 ? IORING_ENTER_GETEVENTS : 0;
+    __kernel_timespec time{};
+    io_uring_getevents_arg argument{};
+
+    if (waitCount > 0 && timeout >= 0)
+    {
+        time.tv_sec = timeout / 1000;
+        time.tv_nsec = (timeout % 1000) * 1000000;
+        argument.sigmask_sz = _NSIG / 8;
+        argument.ts = reinterpret_cast<uint64_t>(&time);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    // EINTR and ETIME only mean that we return earlier, completions are checked by the caller anyway
+    ++Enters;
+    syscall(__NR_io_uring_enter, RingFd, submitCount, waitCount, flags, (flags & IORING_ENTER_EXT_ARG) ? &argument : nullptr, (flags & IORING_ENTER_EXT_ARG) ? sizeof(argument) : 0);
+#endif
+}
+
+bool AnTcpIoUring::HasCompletions() noexcept
+{
+#if ANTCP_HAS_IO_URING
+    return std::atomic_ref<unsigned int>(*CompletionHead).load(std::memory_order_relaxed) != std::atomic_ref<unsigned int>(*CompletionTail).load(std::memory_order_acquire);
+#else
+    return false;
+#endif
+}
+
+io_uring_sqe* AnTcpIoUring::GetSubmission() noexcept
+{
+#if ANTCP_HAS_IO_URING
+    if (LocalTail - std::atomic_ref<unsigned int>(*SubmissionHead).load(std::memory_order_acquire) >= SubmissionEntries)
+    {
+        // the kernel takes the entries right away, so there is room again afterwards
+        Enter(0, -1);
+    }
+
+    io_uring_sqe* submission = &Submissions[LocalTail & SubmissionMask];
+    memset(submission, 0, sizeof(io_uring_sqe));
+    ++LocalTail;
+    return submission;
+#else
+    return nullptr;
+#endif
+}
+
+void AnTcpIoUring::ProcessCompletions() noexcept
+{
+#if ANTCP_HAS_IO_URING
+    unsigned int head = std::atomic_ref<unsigned int>(*CompletionHead).load(std::memory_order_relaxed);
+    const unsigned int tail = std::atomic_ref<unsigned int>(*CompletionTail).load(std::memory_order_acquire);
+
+    while (head != tail)
+    {
+        const io_uring_cqe& completion = Completions[head & CompletionMask];
+        const uint64_t data = completion.user_data;
+        const int result = completion.res;
+        const unsigned int flags = completion.flags;
+
+        // free the slot before processing, which may submit and get more completions posted
+        std::atomic_ref<unsigned int>(*CompletionHead).store(++head, std::memory_order_release);
+
+        ClientHandler* handler = reinterpret_cast<ClientHandler*>(data & ~ANTCP_IO_URING_TAG_MASK);
+
+        switch (data & ANTCP_IO_URING_TAG_MASK)
+        {
+            case ANTCP_IO_URING_ACCEPT:
+                OnAccept(static_cast<size_t>(data >> 2), result, flags);
+                break;
+
+            case ANTCP_IO_URING_RECEIVE:
+                OnReceive(handler, result, flags);
+                break;
+
+            case ANTCP_IO_URING_SEND:
+                OnSend(handler, result);
+                break;
+
+            default:
+                if (data == ANTCP_IO_URING_WAKE)
+                {
+                    OnWake(result);
+                    break;
+                }
+
+                --Operations;
+                break;
+        }
+    }
+#endif
+}
+
+void AnTcpIoUring::ArmAccept([[maybe_unused]] size_t listener) noexcept
+{
+#if ANTCP_HAS_IO_URING
+    io_uring_sqe* submission = GetSubmission();
+    submission->opcode = IORING_OP_ACCEPT;
+    submission->fd = ListenSockets[listener];
+    submission->ioprio = IORING_ACCEPT_MULTISHOT;
+    submission->accept_flags = SOCK_CLOEXEC;
+    submission->user_data = (static_cast<uint64_t>(listener) << 2) | ANTCP_IO_URING_ACCEPT;
+    ++Operations;
+#endif
+}
+
+void AnTcpIoUring::ArmReceive([[maybe_unused]] ClientHandler* handler) noexcept
+{
+#if ANTCP_HAS_IO_URING
+    io_uring_sqe* submission = GetSubmission();
+    submission->opcode = IORING_OP_RECV;
+    submission->fd = handler->Socket;
+    submission->flags = IOSQE_BUFFER_SELECT;
+    submission->buf_group = ANTCP_IO_URING_BUFFER_GROUP;
+    submission->ioprio = MultishotReceive ? IORING_RECV_MULTISHOT : 0;
+    submission->user_data = reinterpret_cast<uint64_t>(handler) | ANTCP_IO_URING_RECEIVE;
+
+    // released when the kernel ends the receive
+    handler->AddReference();
+    ++Operations;
+#endif
+}
+
+void AnTcpIoUring::ArmWake() noexcept
+{
+#if ANTCP_HAS_IO_URING
+    io_uring_sqe* submission = GetSubmission();
+    submission->opcode = IORING_OP_READ;
+    submission->fd = WakeFd;
+    submission->addr = reinterpret_cast<uint64_t>(&WakeValue);
+    submission->len = sizeof(WakeValue);
+    submission->user_data = ANTCP_IO_URING_WAKE;
+    ++Operations;
+#endif
+}
+
+void AnTcpIoUring::ResumeSend(ClientHandler* handler) noexcept
+{
+#if ANTCP_HAS_IO_URING
+    // released when the send completed
+    handler->AddReference();
+
+    {
+        std::lock_guard lock(ResumedSendsMutex);
+        ResumedSends.push_back(handler);
+    }
+
+    const uint64_t value = 1;
+    [[maybe_unused]] const auto written = write(WakeFd, &value, sizeof(value));
+#endif
+}
+
+void AnTcpIoUring::SubmitSend(ClientHandler* handler) noexcept
+{
+    {
+        std::lock_guard lock(handler->SendMutex);
+
+        // a pending send picks the buffer up when it completed, corked clients are flushed by the user
+        // and clients that moved to shared memory buffer responses for the rings
+        if (handler->SendPending || handler->OutputBuffer.empty() || handler->Corked || handler->SharedMemory.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        // the output buffer collects the next responses while the kernel sends these
+        std::swap(handler->SendBuffer, handler->OutputBuffer);
+        handler->HeldPushFrames = 0;
+        handler->SendOffset = 0;
+        handler->SendPending = true;
+    }
+
+    // released when the send completed
+    handler->AddReference();
+    ArmSend(handler);
+}
+
+void AnTcpIoUring::ArmSend([[maybe_unused]] ClientHandler* handler) noexcept
+{
+#if ANTCP_HAS_IO_URING
+    // only this thread touches the send buffer while a send is pending
+    io_uring_sqe* submission = GetSubmission();
+    submission->opcode = IORING_OP_SEND;
+    submission->fd = handler->Socket;
+    submission->addr = reinterpret_cast<uint64_t>(handler->SendBuffer.data() + handler->SendOffset);
+    submission->len = static_cast<unsigned int>(handler->SendBuffer.size() - handler->SendOffset);
+    submission->msg_flags = ANTCP_SEND_FLAGS;
+    submission->user_data = reinterpret_cast<uint64_t>(handler) | ANTCP_IO_URING_SEND;
+    ++Operations;
+#endif
+}
+
+bool AnTcpIoUring::AddClient(SOCKET socket, const sockaddr_storage& socketInfo) noexcept
+{
+    ClientHandler* handler = Server->Connections.Add(Server, socket, socketInfo, nullptr, this);
+
+    if (!handler)
+    {
+        if (Server->ConnectionLimitMode == AnTcpConnectionLimitMode::Queue)
+        {
+            // the accept is multishot, so the client can't stay in the listen backlog
+            return false;
+        }
+
+        DEBUG_ONLY(std::cout << ">> Connection limit reached, rejecting client" << std::endl);
+        Server->Connections.RecordRejected();
+        closesocket(socket);
+        return true;
+    }
+
+    {
+        std::lock_guard lock(HandlersMutex);
+        Handlers.insert(handler);
+    }
+
+    // fire the connect event before any data of the client is processed
+    handler->NotifyConnected();
+    ArmReceive(handler);
+    return true;
+}
+
+void AnTcpIoUring::AddQueuedClients() noexcept
+{
+    while (!QueuedClients.empty() && AddClient(QueuedClients.front().Socket, QueuedClients.front().SocketInfo))
+    {
+        QueuedClients.pop_front();
+    }
+}
+
+void AnTcpIoUring::OnAccept([[maybe_unused]] size_t listener, [[maybe_unused]] int result, [[maybe_unused]] unsigned int flags) noexcept
+{
+#if ANTCP_HAS_IO_URING
+    if (!(flags & IORING_CQE_F_MORE))
+    {
+        // the kernel ended the multishot accept, on shutdown the listener is gone for good
+        --Operations;
+
+        if (!ShouldExit && result != -EINVAL)
+        {
+            ArmAccept(listener);
+        }
+    }
+
+    if (result < 0)
+    {
+        DEBUG_ONLY(std::cout << ">> accept failed: " << -result << std::endl);
+        return;
+    }
+
+    const SOCKET clientSocket = result;
+
+    if (ShouldExit)
+    {
+        closesocket(clientSocket);
+        return;
+    }
+
+    sockaddr_storage clientInfo{};
+    socklen_t sockAddrSize = static_cast<socklen_t>(sizeof(sockaddr_storage));
+    getpeername(clientSocket, reinterpret_cast<sockaddr*>(&clientInfo), &sockAddrSize);
+
+    Server->SetupClientSocket(clientSocket, clientInfo);
+
+    // clients that wait for a slot are served in the order they came in
+    if (!QueuedClients.empty() || !AddClient(clientSocket, clientInfo))
+    {
+        QueuedClients.push_back(QueuedClient{ clientSocket, clientInfo });
+    }
+#endif
+}
+
+void AnTcpIoUring::OnReceive([[maybe_unused]] ClientHandler* handler, [[maybe_unused]] int result, [[maybe_unused]] unsigned int flags) noexcept
+{
+#if ANTCP_HAS_IO_URING
+    // removed clients only wait for the receive to end
+    bool active = Handlers.contains(handler);
+
+    if (flags & IORING_CQE_F_BUFFER)
+    {
+        const uint16_t bufferId = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+
+        if (active && result > 0)
+        {
+            if (handler->ProcessReceived(Buffers + static_cast<size_t>(bufferId) * ANTCP_RECEIVE_BUFFER_SIZE, static_cast<size_t>(result)))
+            {
+                SendQueue.push_back(handler);
+            }
+            else
+            {
+                RemoveClient(handler);
+                active = false;
+            }
+        }
+
+        RecycleBuffer(bufferId);
+    }
+
+    if (flags & IORING_CQE_F_MORE)
+    {
+        return;
+    }
+
+    --Operations;
+
+    // the kernel ends a multishot receive when it ran out of buffers, single shot ones end every time
+    bool rearm = active && !ShouldExit && (result > 0 || result == -ENOBUFS);
+
+    if (active && result == -EINVAL && MultishotReceive)
+    {
+        DEBUG_ONLY(std::cout << ">> Multishot receives not supported, rearming every receive" << std::endl);
+        MultishotReceive = false;
+        rearm = !ShouldExit;
+    }
+
+    if (rearm)
+    {
+        ArmReceive(handler);
+    }
+    else if (active)
+    {
+        // zero is a disconnect, everything else an error
+        RemoveClient(handler);
+    }
+
+    handler->Release();
+#endif
+}
+
+void AnTcpIoUring::OnSend(ClientHandler* handler, int result) noexcept
+{
+    --Operations;
+
+    if (result > 0)
+    {
+        handler->SendOffset += static_cast<size_t>(result);
+
+        if (handler->SendOffset < handler->SendBuffer.size())
+        {
+            // the socket buffer was full, continue with the rest
+            ArmSend(handler);
+            return;
+        }
+    }
+
+    AnTcpSharedMemory* sharedMemory = nullptr;
+
+    {
+        std::lock_guard lock(handler->SendMutex);
+        handler->SendBuffer.clear();
+
+        if (result > 0 && !handler->OutputBuffer.empty() && !handler->Corked && handler->IsActive)
+        {
+            // responses that were buffered while the kernel was sending
+            std::swap(handler->SendBuffer, handler->OutputBuffer);
+            handler->HeldPushFrames = 0;
+            handler->SendOffset = 0;
+        }
+        else
+        {
+            handler->SendPending = false;
+
+            if (result > 0)
+            {
+                sharedMemory = std::exchange(handler->PendingSharedMemory, nullptr);
+            }
+        }
+    }
+
+    if (!handler->SendBuffer.empty())
+    {
+        ArmSend(handler);
+        return;
+    }
+
+    if (result <= 0 && Handlers.contains(handler))
+    {
+        RemoveClient(handler);
+    }
+
+    if (sharedMemory)
+    {
+        // the segment name is out, the rings take over
+        handler->StartSharedMemory(sharedMemory);
+    }
+
+    if (result > 0)
+    {
+        // published frames that waited for the send
+        handler->ResumePushQueue();
+    }
+
+    handler->Release();
+}
+
+void AnTcpIoUring::OnWake(int result) noexcept
+{
+    --Operations;
+
+    std::vector<ClientHandler*> handlers;
+
+    {
+        std::lock_guard lock(ResumedSendsMutex);
+        std::swap(handlers, ResumedSends);
+    }
+
+    // the send buffers were filled by the threads that found the sockets full, we own them until the sends completed
+    for (ClientHandler* handler : handlers)
+    {
+        ArmSend(handler);
+    }
+
+    // canceled on shutdown
+    if (result != -ECANCELED && !ShouldExit)
+    {
+        ArmWake();
+    }
+}
+
+void AnTcpIoUring::RecycleBuffer([[maybe_unused]] uint16_t bufferId) noexcept
+{
+#if ANTCP_HAS_IO_URING
+    io_uring_buf_ring* ring = static_cast<io_uring_buf_ring*>(BufferRing);
+
+    // not ring->bufs, the flexible array of the uapi header is misplaced in c++. The
+    // first entry overlays the tail, so the fields are set one by one
+    io_uring_buf& buffer = static_cast<io_uring_buf*>(BufferRing)[BufferTail & (ANTCP_IO_URING_BUFFER_COUNT - 1)];
+    buffer.addr = reinterpret_cast<uint64_t>(Buffers + static_cast<size_t>(bufferId) * ANTCP_RECEIVE_BUFFER_SIZE);
+    buffer.len = ANTCP_RECEIVE_BUFFER_SIZE;
+    buffer.bid = bufferId;
+
+    std::atomic_ref<uint16_t>(ring->tail).store(++BufferTail, std::memory_order_release);
+#endif
+}
+
+void AnTcpIoUring::RemoveClient(ClientHandler* handler) noexcept
+{
+    {
+        std::lock_guard lock(HandlersMutex);
+        Handlers.erase(handler);
+    }
+
+    SendQueue.erase(std::remove(SendQueue.begin(), SendQueue.end(), handler), SendQueue.end());
+
+    // the shutdown ends the receive, which drops its reference, the last one closes the socket
+    handler->Disconnect();
+    handler->Release();
+}
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "AnTcpLowLatency.hpp"
+#include "AnTcpPlatform.hpp"
+
+class AnTcpServer;
+class ClientHandler;
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// size of the submission queue, the completion queue is four times as big
+constexpr unsigned int ANTCP_IO_URING_ENTRIES = 256;
+
+// number of receive buffers the kernel picks from, needs to be a power of two
+constexpr unsigned int ANTCP_IO_URING_BUFFER_COUNT = 256;
+
+// how often clients waiting for a free connection slot are retried in milliseconds
+constexpr long long ANTCP_IO_URING_QUEUE_RETRY = 10;
+
+/// <summary>
+/// I/O thread of the io_uring backend. It accepts with a multishot accept on every listen
+/// socket, receives with multishot receives into a ring of buffers it provided to the kernel
+/// and sends the responses of a batch of completions with the submission that waits for the next one.
+/// </summary>
+class AnTcpIoUring
+{
+private:
+    /// <summary>
+    /// Client waiting for a free connection slot.
+    /// </summary>
+    struct QueuedClient
+    {
+        SOCKET Socket;
+        sockaddr_storage SocketInfo;
+    };
+
+    AnTcpServer* Server;
+    std::atomic<bool>& ShouldExit;
+    int RingFd;
+    std::thread* Thread;
+    std::vector<SOCKET> ListenSockets;
+
+    // mappings of the rings, both queues share the first one when the kernel supports it
+    void* QueueMapping;
+    size_t QueueMappingSize;
+    void* CompletionMapping;
+    size_t CompletionMappingSize;
+    io_uring_sqe* Submissions;
+    size_t SubmissionsSize;
+
+    unsigned int* SubmissionHead;
+    unsigned int* SubmissionTail;
+    unsigned int SubmissionMask;
+    unsigned int SubmissionEntries;
+    unsigned int* CompletionHead;
+    unsigned int* CompletionTail;
+    unsigned int CompletionMask;
+    io_uring_cqe* Completions;
+
+    // tail of the entries we prepared, the kernel sees it when we enter
+    unsigned int LocalTail;
+
+    // provided buffer ring and the buffers it hands out
+    void* BufferRing;
+    char* Buffers;
+    uint16_t BufferTail;
+
+    // cleared when the kernel rejects multishot receives, every receive is rearmed then
+    bool MultishotReceive;
+
+    // accepts, receives, sends and cancels the kernel still owns
+    size_t Operations;
+
+    // io_uring_enter() calls, added to the receive counters of the server when the thread exits
+    uint64_t Enters;
+
+    std::mutex HandlersMutex;
+    std::unordered_set<ClientHandler*> Handlers;
+
+    // clients with buffered responses and no send in flight, sent after the current batch of completions
+    std::vector<ClientHandler*> SendQueue;
+
+    // eventfd whose read completes when other threads left pending sends for us, and the value it reads
+    int WakeFd;
+    uint64_t WakeValue;
+
+    // clients whose socket was full when another thread sent to them, each one holds a reference
+    std::mutex ResumedSendsMutex;
+    std::vector<ClientHandler*> ResumedSends;
+
+    std::deque<QueuedClient> QueuedClients;
+
+    // set in the low latency mode, the thread polls for SpinTime before it blocks
+    AnTcpIoThreadCounters* Counters;
+    std::chrono::nanoseconds SpinTime;
+    int Core;
+
+public:
+    /// <summary>
+    /// Create a new io_uring thread, call Create() to set up the ring and Start() to spawn it.
+    /// </summary>
+    /// <param name="server">Server the accepted clients belong to.</param>
+    /// <param name="shouldExit">Atomic bool to notify the thread that the server is going to shutdown.</param>
+    AnTcpIoUring(AnTcpServer* server, std::atomic<bool>& shouldExit)
+        : Server(server),
+        ShouldExit(shouldExit),
+        RingFd(-1),
+        Thread(nullptr),
+        ListenSockets(),
+        QueueMapping(nullptr),
+        QueueMappingSize(0),
+        CompletionMapping(nullptr),
+        CompletionMappingSize(0),
+        Submissions(nullptr),
+        SubmissionsSize(0),
+        SubmissionHead(nullptr),
+        SubmissionTail(nullptr),
+        SubmissionMask(0),
+        SubmissionEntries(0),
+        CompletionHead(nullptr),
+        CompletionTail(nullptr),
+        CompletionMask(0),
+        Completions(nullptr),
+        LocalTail(0),
+        BufferRing(nullptr),
+        Buffers(nullptr),
+        BufferTail(0),
+        MultishotReceive(true),
+        Operations(0),
+        Enters(0),
+        HandlersMutex(),
+        Handlers(),
+        SendQueue(),
+        WakeFd(-1),
+        WakeValue(0),
+        ResumedSendsMutex(),
+        ResumedSends(),
+        QueuedClients(),
+        Counters(nullptr),
+        SpinTime(0),
+        Core(-1)
+    {}
+
+    /// <summary>
+    /// Waits for the thread and unmaps the rings, the thread disconnected its clients before it exited.
+    /// </summary>
+    ~AnTcpIoUring();
+
+    AnTcpIoUring(const AnTcpIoUring&) = delete;
+    AnTcpIoUring& operator=(const AnTcpIoUring&) = delete;
+
+    /// <summary>
+    /// Set up the ring and its receive buffers.
+    /// </summary>
+    /// <param name="listenSockets">Sockets to accept clients on, every thread accepts on all of them.</param>
+    /// <returns>True if the ring is ready, false if the kernel or platform does not support it.</returns>
+    bool Create(const std::vector<SOCKET>& listenSockets) noexcept;
+
+    /// <summary>
+    /// Let the thread poll for completions before it blocks and pin it, needs to be called before Start().
+    /// </summary>
+    /// <param name="counters">Counters of the thread, owned by the server.</param>
+    /// <param name="spinTime">How long to poll before blocking.</param>
+    /// <param name="core">Core to pin the thread to, -1 leaves it to the scheduler.</param>
+    inline void SetLowLatency(AnTcpIoThreadCounters* counters, std::chrono::nanoseconds spinTime, int core) noexcept
+    {
+        Counters = counters;
+        SpinTime = spinTime;
+        Core = core;
+    }
+
+    /// <summary>
+    /// Start the thread, it accepts right away.
+    /// </summary>
+    void Start() noexcept;
+
+    /// <summary>
+    /// Block until the thread exited, it does so when the server stops.
+    /// </summary>
+    void Wait() noexcept;
+
+    /// <summary>
+    /// Hand the pending send of a client to the kernel, used when another thread found its socket full.
+    /// Safe to call from any thread, the send mutex of the client must be locked.
+    /// </summary>
+    void ResumeSend(ClientHandler* handler) noexcept;
+
+    /// <summary>
+    /// Get the number of clients handled by this thread.
+    /// </summary>
+    inline size_t GetClientCount() noexcept
+    {
+        std::lock_guard lock(HandlersMutex);
+        return Handlers.size();
+    }
+
+private:
+    /// <summary>
+    /// Create the ring and map its queues.
+    /// </summary>
+    bool SetupRing() noexcept;
+
+    /// <summary>
+    /// Map the receive buffers and register them as provided buffer ring.
+    /// </summary>
+    bool SetupBuffers() noexcept;
+
+    /// <summary>
+    /// Create the eventfd other threads wake the thread with.
+    /// </summary>
+    bool SetupWake() noexcept;
+
+    /// <summary>
+    /// Routine of the thread, processes completions until the server stops.
+    /// </summary>
+    void Run() noexcept;
+
+    /// <summary>
+    /// Disconnect all clients, cancel everything in flight and wait until the kernel gave it back.
+    /// </summary>
+    void Shutdown() noexcept;
+
+    /// <summary>
+    /// Submit the prepared entries and wait for completions.
+    /// </summary>
+    /// <param name="waitCount">Number of completions to wait for, 0 only submits.</param>
+    /// <param name="timeout">How long to wait at most in milliseconds, -1 waits forever. With a waitCount
+    /// of 0 a timeout of 0 posts the completions that are ready without waiting for any.</param>
+    void Enter(unsigned int waitCount, long long timeout) noexcept;
+
+    /// <summary>
+    /// Check whether the kernel posted completions that were not processed yet.
+    /// </summary>
+    bool HasCompletions() noexcept;
+
+    /// <summary>
+    /// Get the next free submission entry, cleared. A full queue is submitted first.
+    /// </summary>
+    io_uring_sqe* GetSubmission() noexcept;
+
+    /// <summary>
+    /// Process every completion the kernel posted.
+    /// </summary>
+    void ProcessCompletions() noexcept;
+
+    /// <summary>
+    /// Post a multishot accept on a listen socket.
+    /// </summary>
+    void ArmAccept(size_t listener) noexcept;
+
+    /// <summary>
+    /// Post a receive into the provided buffers, it holds a reference to the handler.
+    /// </summary>
+    void ArmReceive(ClientHandler* handler) noexcept;
+
+    /// <summary>
+    /// Post the read of the wake eventfd.
+    /// </summary>
+    void ArmWake() noexcept;
+
+    /// <summary>
+    /// Hand the buffered responses of a client to the kernel unless a send is in flight already.
+    /// </summary>
+    void SubmitSend(ClientHandler* handler) noexcept;
+
+    /// <summary>
+    /// Post the send of the unsent part of a clients send buffer.
+    /// </summary>
+    void ArmSend(ClientHandler* handler) noexcept;
+
+    /// <summary>
+    /// Set up a handler for an accepted socket.
+    /// </summary>
+    /// <returns>True if the socket was handled, false if it waits for a free slot.</returns>
+    bool AddClient(SOCKET socket, const sockaddr_storage& socketInfo) noexcept;
+
+    /// <summary>
+    /// Retry the clients waiting for a free connection slot.
+    /// </summary>
+    void AddQueuedClients() noexcept;
+
+    /// <summary>
+    /// Completion of an accept, rearms it when the kernel ended the multishot.
+    /// </summary>
+    void OnAccept(size_t listener, int result, unsigned int flags) noexcept;
+
+    /// <summary>
+    /// Completion of a receive, processes the data and rearms the receive when it ended.
+    /// </summary>
+    void OnReceive(ClientHandler* handler, int result, unsigned int flags) noexcept;
+
+    /// <summary>
+    /// Completion of a send, continues partial sends and sends what was buffered meanwhile.
+    /// </summary>
+    void OnSend(ClientHandler* handler, int result) noexcept;
+
+    /// <summary>
+    /// Completion of the wake read, posts the sends other threads left for us.
+    /// </summary>
+    void OnWake(int result) noexcept;
+
+    /// <summary>
+    /// Give a receive buffer back to the kernel.
+    /// </summary>
+    void RecycleBuffer(uint16_t bufferId) noexcept;
+
+    /// <summary>
+    /// Forget a disconnected client and drop the threads reference to it.
+    /// </summary>
+    void RemoveClient(ClientHandler* handler) noexcept;
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "AnTcpPlatform.hpp"
+
+// how long I/O threads of the low latency mode poll their sockets before they block, in microseconds
+constexpr unsigned int ANTCP_LOW_LATENCY_SPIN_TIME = 50;
+
+// SO_BUSY_POLL of accepted sockets in the low latency mode, in microseconds
+constexpr unsigned int ANTCP_LOW_LATENCY_BUSY_POLL = 50;
+
+/// <summary>
+/// Settings of the low latency mode, see AnTcpServer::SetLowLatency().
+/// </summary>
+struct AnTcpLowLatencyOptions
+{
+    bool Enabled = false;
+
+    // cores the I/O threads are pinned to in turn, empty leaves them to the scheduler
+    std::vector<unsigned int> Cores;
+
+    // how long an I/O thread polls its sockets without blocking before it sleeps, in microseconds
+    unsigned int SpinTime = ANTCP_LOW_LATENCY_SPIN_TIME;
+
+    // busy polling of accepted tcp sockets in microseconds, 0 leaves the system default
+    unsigned int BusyPoll = ANTCP_LOW_LATENCY_BUSY_POLL;
+};
+
+/// <summary>
+/// Parse a list of cores like "0,2,4-7", invalid parts are skipped.
+/// </summary>
+inline std::vector<unsigned int> AnTcpParseCores(const std::string& list)
+{
+    std::vector<unsigned int> cores;
+    size_t start = 0;
+
+    while (start < list.size())
+    {
+        const size_t end = std::min(list.find(',', start), list.size());
+        const std::string part = list.substr(start, end - start);
+        const size_t dash = part.find('-');
+        char* first = nullptr;
+        const unsigned long from = std::strtoul(part.c_str(), &first, 10);
+
+        if (first != part.c_str())
+        {
+            const unsigned long to = dash != std::string::npos ? std::strtoul(part.c_str() + dash + 1, nullptr, 10) : from;
+
+            for (unsigned long core = from; core <= to && core < 4096; ++core)
+            {
+                cores.push_back(static_cast<unsigned int>(core));
+            }
+        }
+
+        start = end + 1;
+    }
+
+    return cores;
+}
+
+enum class AnTcpIoThreadType : uint8_t
+{
+    EventLoop,
+    IoUring,
+    // the threads of the thread per client backend share one entry
+    Client
+};
+
+/// <summary>
+/// Where the time of an I/O thread went while the low latency mode was enabled.
+/// </summary>
+struct AnTcpIoThreadStats
+{
+    AnTcpIoThreadType Type = AnTcpIoThreadType::EventLoop;
+    unsigned int Index = 0;
+
+    // core the thread is pinned to, the last one pinned for the thread per client backend, -1 if none was
+    int Core = -1;
+
+    // threads that were counted, more than one for the thread per client backend
+    uint64_t Threads = 0;
+
+    // nanoseconds spent polling without finding data, processing data and sleeping in the kernel
+    uint64_t SpinTime = 0;
+    uint64_t WorkTime = 0;
+    uint64_t BlockedTime = 0;
+
+    // waits that found data while polling and waits that ran out of their budget and blocked
+    uint64_t SpinHits = 0;
+    uint64_t Blocks = 0;
+};
+
+/// <summary>
+/// Counters of an I/O thread in the low latency mode, and the spin then block wait that feeds them.
+/// The server keeps them after the thread stopped, so they can be read after Run() returned.
+/// </summary>
+class AnTcpIoThreadCounters
+{
+private:
+    AnTcpIoThreadType Type;
+    unsigned int Index;
+    std::atomic<int> Core;
+    std::atomic<uint64_t> Threads;
+    std::atomic<uint64_t> SpinTime;
+    std::atomic<uint64_t> WorkTime;
+    std::atomic<uint64_t> BlockedTime;
+    std::atomic<uint64_t> SpinHits;
+    std::atomic<uint64_t> Blocks;
+
+public:
+    AnTcpIoThreadCounters(AnTcpIoThreadType type, unsigned int index) noexcept
+        : Type(type),
+        Index(index),
+        Core(-1),
+        Threads(0),
+        SpinTime(0),
+        WorkTime(0),
+        BlockedTime(0),
+        SpinHits(0),
+        Blocks(0)
+    {}
+
+    AnTcpIoThreadCounters(const AnTcpIoThreadCounters&) = delete;
+    AnTcpIoThreadCounters& operator=(const AnTcpIoThreadCounters&) = delete;
+
+    /// <summary>
+    /// Count a thread that started and pin it.
+    /// </summary>
+    /// <param name="core">Core to pin the calling thread to, -1 leaves it to the scheduler.</param>
+    inline void AddThread(int core) noexcept
+    {
+        Threads.fetch_add(1, std::memory_order_relaxed);
+
+        if (core >= 0 && AnTcpPinThread(static_cast<unsigned int>(core)))
+        {
+            Core.store(core, std::memory_order_relaxed);
+        }
+    }
+
+    /// <summary>
+    /// Poll for work until the budget ran out, then block until there is some. Polls at least once.
+    /// </summary>
+    /// <param name="budget">How long to poll.</param>
+    /// <param name="poll">Looks for work without blocking, returns true when it found some.</param>
+    /// <param name="block">Sleeps until there is work.</param>
+    /// <returns>When the wait ended, pass it to AddWork() once the work is done.</returns>
+    template<typename Poll, typename Block>
+    inline std::chrono::steady_clock::time_point Wait(std::chrono::nanoseconds budget, Poll&& poll, Block&& block) noexcept
+    {
+        const auto start = std::chrono::steady_clock::now();
+        auto now = start;
+
+        do
+        {
+            if (poll())
+            {
+                now = std::chrono::steady_clock::now();
+                Add(SpinTime, now - start);
+                SpinHits.fetch_add(1, std::memory_order_relaxed);
+                return now;
+            }
+
+            now = std::chrono::steady_clock::now();
+        } while (now - start < budget);
+
+        Add(SpinTime, now - start);
+        block();
+
+        const auto end = std::chrono::steady_clock::now();
+        Add(BlockedTime, end - now);
+        Blocks.fetch_add(1, std::memory_order_relaxed);
+        return end;
+    }
+
+    inline void AddWork(std::chrono::steady_clock::time_point start) noexcept
+    {
+        Add(WorkTime, std::chrono::steady_clock::now() - start);
+    }
+
+    inline AnTcpIoThreadStats GetStats() const noexcept
+    {
+        return AnTcpIoThreadStats
+        {
+            Type,
+            Index,
+            Core.load(std::memory_order_relaxed),
+            Threads.load(std::memory_order_relaxed),
+            SpinTime.load(std::memory_order_relaxed),
+            WorkTime.load(std::memory_order_relaxed),
+            BlockedTime.load(std::memory_order_relaxed),
+            SpinHits.load(std::memory_order_relaxed),
+            Blocks.load(std::memory_order_relaxed)
+        };
+    }
+
+private:
+    static inline void Add(std::atomic<uint64_t>& counter, std::chrono::steady_clock::duration duration) noexcept
+    {
+        counter.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()), std::memory_order_relaxed);
+    }
+};
+
+/// <summary>
+/// Syscalls of the receive path of the I/O threads, counted whether the low latency mode is enabled or not.
+/// </summary>
+struct AnTcpReceiveStats
+{
+    // recv() calls, the receives of the io_uring backend complete without one
+    uint64_t Receives = 0;
+
+    // poll(), epoll_wait() and io_uring_enter() calls, the ones of the low latency mode that spin included
+    uint64_t Waits = 0;
+};
+
+/// <summary>
+/// Receive syscalls of all I/O threads of the server. Every thread counts its own and adds them when it
+/// exits, so they don't bounce between the cores and are complete once the clients and Run() are done.
+/// </summary>
+class AnTcpReceiveCounters
+{
+private:
+    std::atomic<uint64_t> Receives;
+    std::atomic<uint64_t> Waits;
+
+public:
+    AnTcpReceiveCounters() noexcept
+        : Receives(0),
+        Waits(0)
+    {}
+
+    AnTcpReceiveCounters(const AnTcpReceiveCounters&) = delete;
+    AnTcpReceiveCounters& operator=(const AnTcpReceiveCounters&) = delete;
+
+    inline void Add(const AnTcpReceiveStats& stats) noexcept
+    {
+        Receives.fetch_add(stats.Receives, std::memory_order_relaxed);
+        Waits.fetch_add(stats.Waits, std::memory_order_relaxed);
+    }
+
+    inline void Reset() noexcept
+    {
+        Receives.store(0, std::memory_order_relaxed);
+        Waits.store(0, std::memory_order_relaxed);
+    }
+
+    inline AnTcpReceiveStats GetStats() const noexcept
+    {
+        return AnTcpReceiveStats{ Receives.load(std::memory_order_relaxed), Waits.load(std::memory_order_relaxed) };
+    }
+};
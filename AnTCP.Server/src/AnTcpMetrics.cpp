@@ -0,0 +1,207 @@
+#include "AnTcpMetrics.hpp"
+
+#include <cstring>
+
+void AnTcpHistogram::Merge(const AnTcpHistogram& other) noexcept
+{
+    for (size_t i = 0; i < Buckets.size(); ++i)
+    {
+        Buckets[i] += other.Buckets[i];
+    }
+
+    Count += other.Count;
+    Sum += other.Sum;
+    Max = std::max(Max, other.Max);
+}
+
+uint64_t AnTcpHistogram::GetPercentile(double percentile) const noexcept
+{
+    if (Count == 0)
+    {
+        return 0;
+    }
+
+    // rank of the value we are looking for, at least the first one
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::clamp(percentile, 0.0, 100.0) / 100.0 * Count + 0.5));
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < Buckets.size(); ++i)
+    {
+        seen += Buckets[i];
+
+        if (seen >= rank)
+        {
+            return std::min(GetBucketValue(i), Max);
+        }
+    }
+
+    return Max;
+}
+
+void AnTcpHistogramShard::MergeInto(AnTcpHistogram& histogram) const noexcept
+{
+    // there is no separate count, the writer may be in the middle of a record and they would not match
+    for (size_t i = 0; i < Buckets.size(); ++i)
+    {
+        const uint64_t count = Buckets[i].load(std::memory_order_relaxed);
+        histogram.Buckets[i] += count;
+        histogram.Count += count;
+    }
+
+    histogram.Sum += Sum.load(std::memory_order_relaxed);
+    histogram.Max = std::max(histogram.Max, Max.load(std::memory_order_relaxed));
+}
+
+const AnTcpMessageMetrics* AnTcpMetricsSnapshot::Get(AnTcpMessageType type) const noexcept
+{
+    for (const AnTcpMessageMetrics& metrics : MessageTypes)
+    {
+        if (metrics.Type == type)
+        {
+            return &metrics;
+        }
+    }
+
+    return nullptr;
+}
+
+template<typename T>
+inline void AnTcpAppend(std::vector<char>& buffer, T value) noexcept
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+inline void AnTcpAppendHistogram(std::vector<char>& buffer, const AnTcpHistogram& histogram) noexcept
+{
+    AnTcpAppend<uint64_t>(buffer, histogram.GetCount());
+    AnTcpAppend<uint64_t>(buffer, histogram.GetSum());
+    AnTcpAppend<uint64_t>(buffer, histogram.GetMax());
+    AnTcpAppend<uint64_t>(buffer, histogram.GetPercentile(50.0));
+    AnTcpAppend<uint64_t>(buffer, histogram.GetPercentile(90.0));
+    AnTcpAppend<uint64_t>(buffer, histogram.GetPercentile(99.0));
+    AnTcpAppend<uint64_t>(buffer, histogram.GetPercentile(99.9));
+}
+
+void AnTcpMetricsSnapshot::Serialize(std::vector<char>& buffer) const noexcept
+{
+    AnTcpAppend<unsigned short>(buffer, ANTCP_METRICS_FORMAT_VERSION);
+    AnTcpAppend<unsigned short>(buffer, static_cast<unsigned short>(MessageTypes.size()));
+    AnTcpAppend<uint64_t>(buffer, ProtocolErrors);
+
+    for (const AnTcpMessageMetrics& metrics : MessageTypes)
+    {
+        AnTcpAppend<AnTcpMessageType>(buffer, metrics.Type);
+        AnTcpAppend<uint64_t>(buffer, metrics.Requests);
+        AnTcpAppend<uint64_t>(buffer, metrics.BytesIn);
+        AnTcpAppend<uint64_t>(buffer, metrics.BytesOut);
+        AnTcpAppend<uint64_t>(buffer, metrics.Errors);
+        AnTcpAppend<uint64_t>(buffer, metrics.UnknownType);
+        AnTcpAppendHistogram(buffer, metrics.QueueWait);
+        AnTcpAppendHistogram(buffer, metrics.HandlerTime);
+    }
+}
+
+AnTcpMetrics::Shard::~Shard()
+{
+    for (std::atomic<MessageShard*>& messageShard : MessageTypes)
+    {
+        delete messageShard.load();
+    }
+}
+
+AnTcpMetrics::MessageShard& AnTcpMetrics::Shard::Get(AnTcpMessageType type) noexcept
+{
+    std::atomic<MessageShard*>& slot = MessageTypes[AnTcpCallbackIndex(type)];
+    MessageShard* messageShard = slot.load(std::memory_order_relaxed);
+
+    if (!messageShard)
+    {
+        // only the owning thread writes the slot, readers need to see the initialized shard
+        messageShard = new MessageShard();
+        slot.store(messageShard, std::memory_order_release);
+    }
+
+    return *messageShard;
+}
+
+AnTcpMetrics::ThreadShards::~ThreadShards()
+{
+    // keep the shards and their values, the next new thread continues with them
+    for (ShardHandle& handle : Handles)
+    {
+        std::lock_guard lock(handle.Owner->Mutex);
+        handle.Owner->FreeShards.push_back(handle.Instance);
+    }
+}
+
+AnTcpMetrics::Shard& AnTcpMetrics::AddShard() noexcept
+{
+    Shard* shard = nullptr;
+
+    {
+        std::lock_guard lock(Shards->Mutex);
+
+        if (!Shards->FreeShards.empty())
+        {
+            shard = Shards->FreeShards.back();
+            Shards->FreeShards.pop_back();
+        }
+        else
+        {
+            Shards->Shards.push_back(std::make_unique<Shard>());
+            shard = Shards->Shards.back().get();
+        }
+    }
+
+    CurrentShards.Handles.push_back(ShardHandle{ Shards, shard });
+    return *shard;
+}
+
+AnTcpMetricsSnapshot AnTcpMetrics::GetSnapshot() const noexcept
+{
+    AnTcpMetricsSnapshot snapshot{};
+    std::array<std::unique_ptr<AnTcpMessageMetrics>, 256> messageTypes{};
+
+    std::lock_guard lock(Shards->Mutex);
+
+    for (const std::unique_ptr<Shard>& shard : Shards->Shards)
+    {
+        snapshot.ProtocolErrors += shard->ProtocolErrors.Get();
+
+        for (size_t i = 0; i < shard->MessageTypes.size(); ++i)
+        {
+            const MessageShard* messageShard = shard->MessageTypes[i].load(std::memory_order_acquire);
+
+            if (!messageShard)
+            {
+                continue;
+            }
+
+            if (!messageTypes[i])
+            {
+                messageTypes[i] = std::make_unique<AnTcpMessageMetrics>();
+                messageTypes[i]->Type = static_cast<AnTcpMessageType>(i);
+            }
+
+            AnTcpMessageMetrics& messageMetrics = *messageTypes[i];
+            messageMetrics.Requests += messageShard->Requests.Get();
+            messageMetrics.BytesIn += messageShard->BytesIn.Get();
+            messageMetrics.BytesOut += messageShard->BytesOut.Get();
+            messageMetrics.Errors += messageShard->Errors.Get();
+            messageMetrics.UnknownType += messageShard->UnknownType.Get();
+            messageShard->QueueWait.MergeInto(messageMetrics.QueueWait);
+            messageShard->HandlerTime.MergeInto(messageMetrics.HandlerTime);
+        }
+    }
+
+    for (std::unique_ptr<AnTcpMessageMetrics>& messageMetrics : messageTypes)
+    {
+        if (messageMetrics)
+        {
+            snapshot.MessageTypes.push_back(std::move(*messageMetrics));
+        }
+    }
+
+    return snapshot;
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "AnTcpCallbackTable.hpp"
+
+// every power of two is split into 2^4 sub buckets, recorded values are off by at most 6.25%
+constexpr size_t ANTCP_HISTOGRAM_SUB_BUCKET_BITS = 4;
+constexpr size_t ANTCP_HISTOGRAM_SUB_BUCKETS = size_t(1) << ANTCP_HISTOGRAM_SUB_BUCKET_BITS;
+
+// values are clamped to 2^36 - 1, which is about 68 seconds in nanoseconds
+constexpr size_t ANTCP_HISTOGRAM_MAX_EXPONENT = 36;
+constexpr size_t ANTCP_HISTOGRAM_BUCKET_COUNT = (ANTCP_HISTOGRAM_MAX_EXPONENT - ANTCP_HISTOGRAM_SUB_BUCKET_BITS + 1) * ANTCP_HISTOGRAM_SUB_BUCKETS;
+
+// version of the binary snapshot sent as response to ANTCP_MESSAGE_METRICS
+constexpr unsigned short ANTCP_METRICS_FORMAT_VERSION = 1;
+
+/// <summary>
+/// Log-linear histogram in the style of HdrHistogram, values below 16 are
+/// exact, bigger ones keep 4 significant bits.
+/// </summary>
+class AnTcpHistogram
+{
+private:
+    std::array<uint64_t, ANTCP_HISTOGRAM_BUCKET_COUNT> Buckets;
+    uint64_t Count;
+    uint64_t Sum;
+    uint64_t Max;
+
+    friend class AnTcpHistogramShard;
+
+public:
+    AnTcpHistogram()
+        : Buckets{ 0 },
+        Count(0),
+        Sum(0),
+        Max(0)
+    {}
+
+    /// <summary>
+    /// Get the bucket a value is counted in.
+    /// </summary>
+    static constexpr size_t GetBucket(uint64_t value) noexcept
+    {
+        value = std::min<uint64_t>(value, (uint64_t(1) << ANTCP_HISTOGRAM_MAX_EXPONENT) - 1);
+
+        if (value < ANTCP_HISTOGRAM_SUB_BUCKETS)
+        {
+            return static_cast<size_t>(value);
+        }
+
+        const size_t shift = std::bit_width(value) - 1 - ANTCP_HISTOGRAM_SUB_BUCKET_BITS;
+        return (shift + 1) * ANTCP_HISTOGRAM_SUB_BUCKETS + static_cast<size_t>((value >> shift) & (ANTCP_HISTOGRAM_SUB_BUCKETS - 1));
+    }
+
+    /// <summary>
+    /// Get the highest value that is counted in a bucket.
+    /// </summary>
+    static constexpr uint64_t GetBucketValue(size_t bucket) noexcept
+    {
+        if (bucket < ANTCP_HISTOGRAM_SUB_BUCKETS)
+        {
+            return bucket;
+        }
+
+        const size_t shift = bucket / ANTCP_HISTOGRAM_SUB_BUCKETS - 1;
+        const uint64_t lowest = (ANTCP_HISTOGRAM_SUB_BUCKETS + bucket % ANTCP_HISTOGRAM_SUB_BUCKETS) << shift;
+        return lowest + (uint64_t(1) << shift) - 1;
+    }
+
+    /// <summary>
+    /// Count a value.
+    /// </summary>
+    inline void Record(uint64_t value) noexcept
+    {
+        Buckets[GetBucket(value)]++;
+        Count++;
+        Sum += value;
+        Max = std::max(Max, value);
+    }
+
+    /// <summary>
+    /// Add all values of another histogram.
+    /// </summary>
+    void Merge(const AnTcpHistogram& other) noexcept;
+
+    /// <summary>
+    /// Get the value below which the given percentage of all values are.
+    /// </summary>
+    /// <param name="percentile">Percentile from 0.0 to 100.0.</param>
+    /// <returns>Highest value of the bucket the percentile falls into, 0 if empty.</returns>
+    uint64_t GetPercentile(double percentile) const noexcept;
+
+    inline uint64_t GetCount() const noexcept { return Count; }
+    inline uint64_t GetSum() const noexcept { return Sum; }
+    inline uint64_t GetMax() const noexcept { return Max; }
+    inline double GetMean() const noexcept { return Count > 0 ? static_cast<double>(Sum) / Count : 0.0; }
+};
+
+/// <summary>
+/// Histogram that is written by a single thread and read by any thread.
+/// </summary>
+class AnTcpHistogramShard
+{
+private:
+    std::array<std::atomic<uint64_t>, ANTCP_HISTOGRAM_BUCKET_COUNT> Buckets;
+    std::atomic<uint64_t> Sum;
+    std::atomic<uint64_t> Max;
+
+public:
+    AnTcpHistogramShard()
+        : Buckets{},
+        Sum(0),
+        Max(0)
+    {}
+
+    /// <summary>
+    /// Count a value, must only be called by the owning thread.
+    /// </summary>
+    inline void Record(uint64_t value) noexcept
+    {
+        // single writer, so plain loads and stores are enough and cheaper than read-modify-write
+        std::atomic<uint64_t>& bucket = Buckets[AnTcpHistogram::GetBucket(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        Sum.store(Sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+
+        if (value > Max.load(std::memory_order_relaxed))
+        {
+            Max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    /// <summary>
+    /// Add the current values to a histogram.
+    /// </summary>
+    void MergeInto(AnTcpHistogram& histogram) const noexcept;
+};
+
+/// <summary>
+/// Counter that is written by a single thread and read by any thread.
+/// </summary>
+struct AnTcpCounterShard
+{
+    std::atomic<uint64_t> Value{ 0 };
+
+    inline void Add(uint64_t amount) noexcept
+    {
+        Value.store(Value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    inline uint64_t Get() const noexcept
+    {
+        return Value.load(std::memory_order_relaxed);
+    }
+};
+
+/// <summary>
+/// Metrics of one message type.
+/// </summary>
+struct AnTcpMessageMetrics
+{
+    AnTcpMessageType Type = 0;
+
+    // received packets, including unknown ones
+    uint64_t Requests = 0;
+
+    // received and sent bytes, including the frame headers
+    uint64_t BytesIn = 0;
+    uint64_t BytesOut = 0;
+
+    // responses that could not be sent
+    uint64_t Errors = 0;
+
+    // packets without a callback
+    uint64_t UnknownType = 0;
+
+    // nanoseconds from receiving the packet until its callback started
+    AnTcpHistogram QueueWait;
+
+    // nanoseconds the callback took
+    AnTcpHistogram HandlerTime;
+};
+
+/// <summary>
+/// Aggregated metrics of a server at one point in time.
+/// </summary>
+struct AnTcpMetricsSnapshot
+{
+    // packets with an invalid size, their clients got disconnected
+    uint64_t ProtocolErrors = 0;
+
+    // every message type that was received or sent at least once, sorted by type
+    std::vector<AnTcpMessageMetrics> MessageTypes;
+
+    /// <summary>
+    /// Get the metrics of a message type.
+    /// </summary>
+    /// <returns>The metrics, null if the type was never received or sent.</returns>
+    const AnTcpMessageMetrics* Get(AnTcpMessageType type) const noexcept;
+
+    /// <summary>
+    /// Write the compact binary format sent as response to ANTCP_MESSAGE_METRICS:
+    /// u16 version | u16 type count | u64 protocol errors | per type: u8 type |
+    /// u64 requests, bytes in, bytes out, errors, unknown | queue wait and
+    /// handler time as u64 count, sum, max, p50, p90, p99, p99.9 in nanoseconds.
+    /// </summary>
+    /// <param name="buffer">Buffer the snapshot is appended to.</param>
+    void Serialize(std::vector<char>& buffer) const noexcept;
+};
+
+/// <summary>
+/// Always on server metrics. Every thread records into its own shard, so
+/// recording needs no locks and no shared cache lines, shards are only
+/// summed up when a snapshot is requested.
+/// </summary>
+class AnTcpMetrics
+{
+private:
+    struct MessageShard
+    {
+        AnTcpCounterShard Requests;
+        AnTcpCounterShard BytesIn;
+        AnTcpCounterShard BytesOut;
+        AnTcpCounterShard Errors;
+        AnTcpCounterShard UnknownType;
+        AnTcpHistogramShard QueueWait;
+        AnTcpHistogramShard HandlerTime;
+    };
+
+    struct Shard
+    {
+        // allocated on first use by the owning thread, histograms are too big to keep 256 of them around
+        std::array<std::atomic<MessageShard*>, 256> MessageTypes{};
+        AnTcpCounterShard ProtocolErrors;
+
+        ~Shard();
+
+        MessageShard& Get(AnTcpMessageType type) noexcept;
+    };
+
+    // shared with the thread local handles, so exiting threads can return their shard after the server is gone
+    struct Registry
+    {
+        std::mutex Mutex;
+        std::vector<std::unique_ptr<Shard>> Shards;
+        std::vector<Shard*> FreeShards;
+    };
+
+    struct ShardHandle
+    {
+        std::shared_ptr<Registry> Owner;
+        Shard* Instance;
+    };
+
+    struct ThreadShards
+    {
+        std::vector<ShardHandle> Handles;
+
+        ~ThreadShards();
+    };
+
+    std::shared_ptr<Registry> Shards;
+    std::atomic<bool> Enabled;
+
+    // shards of the current thread, one per server the thread recorded for
+    static inline thread_local ThreadShards CurrentShards{};
+
+public:
+    AnTcpMetrics()
+        : Shards(std::make_shared<Registry>()),
+        Enabled(true)
+    {}
+
+    AnTcpMetrics(const AnTcpMetrics&) = delete;
+    AnTcpMetrics& operator=(const AnTcpMetrics&) = delete;
+
+    /// <summary>
+    /// Turn recording on or off, it is on by default.
+    /// </summary>
+    inline void SetEnabled(bool enabled) noexcept { Enabled = enabled; }
+
+    inline bool IsEnabled() const noexcept { return Enabled.load(std::memory_order_relaxed); }
+
+    inline void RecordRequest(AnTcpMessageType type, size_t bytes) noexcept
+    {
+        MessageShard& shard = GetShard().Get(type);
+        shard.Requests.Add(1);
+        shard.BytesIn.Add(bytes);
+    }
+
+    inline void RecordUnknownType(AnTcpMessageType type) noexcept
+    {
+        GetShard().Get(type).UnknownType.Add(1);
+    }
+
+    inline void RecordExecution(AnTcpMessageType type, uint64_t queueWait, uint64_t handlerTime) noexcept
+    {
+        MessageShard& shard = GetShard().Get(type);
+        shard.QueueWait.Record(queueWait);
+        shard.HandlerTime.Record(handlerTime);
+    }
+
+    inline void RecordResponse(AnTcpMessageType type, size_t bytes, bool sent) noexcept
+    {
+        MessageShard& shard = GetShard().Get(type);
+        shard.BytesOut.Add(bytes);
+        shard.Errors.Add(sent ? 0 : 1);
+    }
+
+    inline void RecordProtocolError() noexcept
+    {
+        GetShard().ProtocolErrors.Add(1);
+    }
+
+    /// <summary>
+    /// Sum up the shards of all threads.
+    /// </summary>
+    AnTcpMetricsSnapshot GetSnapshot() const noexcept;
+
+private:
+    /// <summary>
+    /// Get the shard of the current thread, creates one on first use.
+    /// </summary>
+    inline Shard& GetShard() noexcept
+    {
+        for (const ShardHandle& handle : CurrentShards.Handles)
+        {
+            if (handle.Owner == Shards)
+            {
+                return *handle.Instance;
+            }
+        }
+
+        return AddShard();
+    }
+
+    Shard& AddShard() noexcept;
+};
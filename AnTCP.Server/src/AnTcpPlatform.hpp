@@ -0,0 +1,532 @@
+#pragma once
+
+#ifdef _WIN32
+
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <iphlpapi.h>
+
+// flags passed to every send() call
+constexpr int ANTCP_SEND_FLAGS = 0;
+
+// buffer descriptor for vectored sends
+typedef WSABUF AnTcpIoVec;
+
+// descriptor for AnTcpPoll()
+typedef WSAPOLLFD AnTcpPollFd;
+
+#else
+
+#include <cerrno>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// map the winsock names used throughout the server to their posix counterparts
+typedef int SOCKET;
+typedef sockaddr_in SOCKADDR_IN;
+
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+constexpr int SD_BOTH = SHUT_RDWR;
+
+// flags passed to every send() call, we never want a SIGPIPE for a dead client
+constexpr int ANTCP_SEND_FLAGS = MSG_NOSIGNAL;
+
+// buffer descriptor for vectored sends
+typedef iovec AnTcpIoVec;
+
+// descriptor for AnTcpPoll()
+typedef pollfd AnTcpPollFd;
+
+inline int closesocket(SOCKET socket) noexcept { return close(socket); }
+inline int WSAGetLastError() noexcept { return errno; }
+
+#endif
+
+#if defined(__linux__)
+// epoll is used for the event loop backend
+#define ANTCP_HAS_EPOLL 1
+#else
+#define ANTCP_HAS_EPOLL 0
+#endif
+
+#ifndef _WIN32
+// unix domain stream sockets can be used as listeners
+#define ANTCP_HAS_UNIX_SOCKETS 1
+#else
+#define ANTCP_HAS_UNIX_SOCKETS 0
+#endif
+
+#if defined(SO_REUSEPORT)
+// multiple sockets can be bound to the same port, the kernel spreads the connections over them
+#define ANTCP_HAS_REUSE_PORT 1
+#else
+#define ANTCP_HAS_REUSE_PORT 0
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+#if defined(IORING_RECV_MULTISHOT)
+// io_uring is used for the io_uring backend, whether the kernel supports it is checked at runtime
+#define ANTCP_HAS_IO_URING 1
+#else
+#define ANTCP_HAS_IO_URING 0
+#endif
+
+#if defined(__linux__) && __has_include(<linux/membarrier.h>)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__)
+// shm_open() and futexes are used for the shared memory transport
+#define ANTCP_HAS_SHARED_MEMORY 1
+#else
+#define ANTCP_HAS_SHARED_MEMORY 0
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(SO_BUSY_POLL)
+// reads can poll the device queue of the nic instead of sleeping until its interrupt arrives
+#define ANTCP_HAS_BUSY_POLL 1
+#else
+#define ANTCP_HAS_BUSY_POLL 0
+#endif
+
+/// <summary>
+/// Prepare the process for AnTcpProcessBarrier(), it may only be used when this succeeded.
+/// </summary>
+/// <returns>True if the barrier is available, false if not.</returns>
+inline bool AnTcpRegisterProcessBarrier() noexcept
+{
+#ifdef _WIN32
+    return true;
+#elif defined(MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+    return syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+    return false;
+#endif
+}
+
+/// <summary>
+/// Run a full memory barrier on every thread of the process. Threads whose stores only need to be
+/// ordered against a rare caller of this get away with a compiler barrier instead of a fence.
+/// </summary>
+inline void AnTcpProcessBarrier() noexcept
+{
+#ifdef _WIN32
+    FlushProcessWriteBuffers();
+#elif defined(MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+    syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+#endif
+}
+
+/// <summary>
+/// Switch a socket to non-blocking mode.
+/// </summary>
+/// <param name="socket">Socket to modify.</param>
+/// <returns>True if the mode was changed, false if not.</returns>
+inline bool AnTcpSetNonBlocking(SOCKET socket) noexcept
+{
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+    const int flags = fcntl(socket, F_GETFL, 0);
+    return flags != -1 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+}
+
+/// <summary>
+/// Whether the last socket error means that the operation would have blocked.
+/// </summary>
+inline bool AnTcpWouldBlock() noexcept
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/// <summary>
+/// Build a buffer descriptor for AnTcpSendVector().
+/// </summary>
+inline AnTcpIoVec AnTcpMakeIoVec(const void* data, size_t size) noexcept
+{
+#ifdef _WIN32
+    return AnTcpIoVec{ static_cast<ULONG>(size), static_cast<CHAR*>(const_cast<void*>(data)) };
+#else
+    return AnTcpIoVec{ const_cast<void*>(data), size };
+#endif
+}
+
+/// <summary>
+/// Wait for events on multiple sockets.
+/// </summary>
+/// <param name="pollFds">Sockets and the events to wait for.</param>
+/// <param name="count">Socket count.</param>
+/// <param name="timeout">Timeout in milliseconds, -1 waits forever.</param>
+/// <returns>Number of sockets with events, 0 on timeout, SOCKET_ERROR on failure.</returns>
+inline int AnTcpPoll(AnTcpPollFd* pollFds, size_t count, int timeout) noexcept
+{
+#ifdef _WIN32
+    return WSAPoll(pollFds, static_cast<ULONG>(count), timeout);
+#else
+    return poll(pollFds, static_cast<nfds_t>(count), timeout);
+#endif
+}
+
+/// <summary>
+/// Wait until a socket is writable, used when the kernel buffer of a non-blocking socket is full.
+/// </summary>
+inline void AnTcpWaitWritable(SOCKET socket) noexcept
+{
+    AnTcpPollFd pollFd{ socket, POLLOUT, 0 };
+    AnTcpPoll(&pollFd, 1, -1);
+}
+
+/// <summary>
+/// Create a wakeup, a thread that polls the first socket of it for POLLIN is woken up by AnTcpWake() on the second one.
+/// On posix it is a pipe, windows can only poll sockets and gets a loopback udp socket that sends to itself.
+/// </summary>
+/// <param name="wakeup">Receives the end to poll and the end to wake, closed with AnTcpCloseWakeup().</param>
+/// <returns>True if the wakeup was created, false if not.</returns>
+inline bool AnTcpCreateWakeup(SOCKET(&wakeup)[2]) noexcept
+{
+    wakeup[0] = INVALID_SOCKET;
+    wakeup[1] = INVALID_SOCKET;
+
+#ifdef _WIN32
+    const SOCKET socket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (socket == INVALID_SOCKET)
+    {
+        return false;
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int addressSize = sizeof(address);
+
+    if (bind(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR
+        || getsockname(socket, reinterpret_cast<sockaddr*>(&address), &addressSize) == SOCKET_ERROR
+        || connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR
+        || !AnTcpSetNonBlocking(socket))
+    {
+        closesocket(socket);
+        return false;
+    }
+
+    wakeup[0] = socket;
+    wakeup[1] = socket;
+    return true;
+#else
+    int fds[2];
+
+    if (pipe(fds) != 0)
+    {
+        return false;
+    }
+
+    for (const int fd : fds)
+    {
+        if (!AnTcpSetNonBlocking(fd) || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+        {
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+    }
+
+    wakeup[0] = fds[0];
+    wakeup[1] = fds[1];
+    return true;
+#endif
+}
+
+/// <summary>
+/// Close both ends of a wakeup, does nothing if it was never created.
+/// </summary>
+inline void AnTcpCloseWakeup(SOCKET(&wakeup)[2]) noexcept
+{
+    if (wakeup[0] != INVALID_SOCKET)
+    {
+        closesocket(wakeup[0]);
+    }
+
+    if (wakeup[1] != INVALID_SOCKET && wakeup[1] != wakeup[0])
+    {
+        closesocket(wakeup[1]);
+    }
+
+    wakeup[0] = INVALID_SOCKET;
+    wakeup[1] = INVALID_SOCKET;
+}
+
+/// <summary>
+/// Wake up the threads that poll a wakeup, until one of them consumes the wake. On posix this is a
+/// single write(), so it is async signal safe. A full pipe already wakes everyone, so it is not retried.
+/// </summary>
+/// <param name="socket">Second socket of the wakeup.</param>
+inline void AnTcpWake(SOCKET socket) noexcept
+{
+    const char wake = 1;
+
+#ifdef _WIN32
+    send(socket, &wake, 1, 0);
+#else
+    [[maybe_unused]] const auto written = write(socket, &wake, 1);
+#endif
+}
+
+/// <summary>
+/// Consume a single wake of a wakeup without waiting for one.
+/// </summary>
+/// <param name="socket">First socket of the wakeup.</param>
+/// <returns>True if there was a wake, false if not.</returns>
+inline bool AnTcpConsumeWake(SOCKET socket) noexcept
+{
+    char wake = 0;
+
+#ifdef _WIN32
+    return recv(socket, &wake, 1, 0) > 0;
+#else
+    return read(socket, &wake, 1) > 0;
+#endif
+}
+
+/// <summary>
+/// Skip the buffers that were sent completely and advance into the partially sent one.
+/// </summary>
+/// <param name="sentBytes">Bytes the last send took.</param>
+inline void AnTcpAdvanceIoVec(AnTcpIoVec*& buffers, size_t& count, size_t sentBytes) noexcept
+{
+#ifdef _WIN32
+    while (count > 0 && sentBytes >= buffers->len)
+    {
+        sentBytes -= buffers->len;
+        ++buffers;
+        --count;
+    }
+
+    if (count > 0)
+    {
+        buffers->buf += sentBytes;
+        buffers->len -= static_cast<ULONG>(sentBytes);
+    }
+#else
+    while (count > 0 && sentBytes >= buffers->iov_len)
+    {
+        sentBytes -= buffers->iov_len;
+        ++buffers;
+        --count;
+    }
+
+    if (count > 0)
+    {
+        buffers->iov_base = static_cast<char*>(buffers->iov_base) + sentBytes;
+        buffers->iov_len -= sentBytes;
+    }
+#endif
+}
+
+/// <summary>
+/// Send multiple buffers with a single vectored write, partial writes are continued
+/// until everything is sent. The buffer descriptors are modified while sending.
+/// </summary>
+/// <param name="socket">Socket to send the data on.</param>
+/// <param name="buffers">Buffers to send.</param>
+/// <param name="count">Buffer count.</param>
+/// <returns>True if all data was sent, false if not.</returns>
+inline bool AnTcpSendVector(SOCKET socket, AnTcpIoVec* buffers, size_t count) noexcept
+{
+    while (count > 0)
+    {
+#ifdef _WIN32
+        DWORD sentBytes = 0;
+
+        if (WSASend(socket, buffers, static_cast<DWORD>(count), &sentBytes, 0, nullptr, nullptr) == SOCKET_ERROR)
+#else
+        msghdr message{};
+        message.msg_iov = buffers;
+        message.msg_iovlen = count;
+
+        const auto sentBytes = sendmsg(socket, &message, ANTCP_SEND_FLAGS);
+
+        if (sentBytes == SOCKET_ERROR)
+#endif
+        {
+            if (!AnTcpWouldBlock())
+            {
+                return false;
+            }
+
+            AnTcpWaitWritable(socket);
+            continue;
+        }
+
+        AnTcpAdvanceIoVec(buffers, count, static_cast<size_t>(sentBytes));
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Result of AnTcpTrySendVector().
+/// </summary>
+enum class AnTcpSendResult
+{
+    Sent,
+    // the kernel buffer of the socket is full, the rest was not sent
+    WouldBlock,
+    Failed
+};
+
+/// <summary>
+/// Send multiple buffers as far as the kernel buffer of the socket takes them, blocking sockets don't
+/// block either. On windows the socket is only checked for space up front, the send itself may block.
+/// </summary>
+/// <param name="socket">Socket to send the data on.</param>
+/// <param name="buffers">Buffers to send, afterwards the ones that were not sent completely.</param>
+/// <param name="count">Buffer count, afterwards the count of the buffers that were not sent completely.</param>
+/// <param name="sentBytes">Bytes the kernel took, less than the buffers hold when it would block.</param>
+inline AnTcpSendResult AnTcpTrySendVector(SOCKET socket, AnTcpIoVec*& buffers, size_t& count, size_t& sentBytes) noexcept
+{
+    sentBytes = 0;
+
+#ifdef _WIN32
+    // winsock has no per call non-blocking flag, check if the socket takes data first
+    AnTcpPollFd pollFd{ socket, POLLWRNORM, 0 };
+
+    if (AnTcpPoll(&pollFd, 1, 0) == 0)
+    {
+        return AnTcpSendResult::WouldBlock;
+    }
+#endif
+
+    while (count > 0)
+    {
+#ifdef _WIN32
+        DWORD sent = 0;
+
+        if (WSASend(socket, buffers, static_cast<DWORD>(count), &sent, 0, nullptr, nullptr) == SOCKET_ERROR)
+#else
+        msghdr message{};
+        message.msg_iov = buffers;
+        message.msg_iovlen = count;
+
+        const auto sent = sendmsg(socket, &message, ANTCP_SEND_FLAGS | MSG_DONTWAIT);
+
+        if (sent == SOCKET_ERROR)
+#endif
+        {
+            return AnTcpWouldBlock() ? AnTcpSendResult::WouldBlock : AnTcpSendResult::Failed;
+        }
+
+        sentBytes += static_cast<size_t>(sent);
+        AnTcpAdvanceIoVec(buffers, count, static_cast<size_t>(sent));
+    }
+
+    return AnTcpSendResult::Sent;
+}
+
+/// <summary>
+/// Send the whole buffer, blocking and non-blocking sockets are supported. When
+/// the kernel buffer of a non-blocking socket is full, we wait until it is writable.
+/// </summary>
+/// <param name="socket">Socket to send the data on.</param>
+/// <param name="data">Data to send.</param>
+/// <param name="size">Size of the data.</param>
+/// <returns>True if all data was sent, false if not.</returns>
+inline bool AnTcpSendAll(SOCKET socket, const char* data, size_t size) noexcept
+{
+    AnTcpIoVec buffer = AnTcpMakeIoVec(data, size);
+    return AnTcpSendVector(socket, &buffer, 1);
+}
+
+/// <summary>
+/// Enable or disable nagle's algorithm on a socket.
+/// </summary>
+/// <param name="socket">Socket to modify.</param>
+/// <param name="noDelay">True to send small segments immediately.</param>
+/// <returns>True if the option was set, false if not.</returns>
+inline bool AnTcpSetNoDelay(SOCKET socket, bool noDelay) noexcept
+{
+    const int value = noDelay ? 1 : 0;
+    return setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&value), sizeof(value)) != SOCKET_ERROR;
+}
+
+/// <summary>
+/// Enable busy polling on a socket, blocking reads and polls of it spin on the device queue
+/// of the nic for a while before they sleep. Loopback traffic has no device queue to poll.
+/// </summary>
+/// <param name="socket">Socket to modify.</param>
+/// <param name="busyPoll">How long to spin in microseconds, more than net.core.busy_read needs CAP_NET_ADMIN.</param>
+/// <returns>True if the option was set, false if not or the platform does not support it.</returns>
+inline bool AnTcpSetBusyPoll([[maybe_unused]] SOCKET socket, [[maybe_unused]] unsigned int busyPoll) noexcept
+{
+#if ANTCP_HAS_BUSY_POLL
+    const int value = static_cast<int>(busyPoll);
+
+    if (setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) == SOCKET_ERROR)
+    {
+        return false;
+    }
+
+#if defined(SO_PREFER_BUSY_POLL)
+    // keep polling under load instead of falling back to interrupts, older kernels ignore it
+    const int prefer = 1;
+    setsockopt(socket, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+#endif
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// <summary>
+/// Pin the calling thread to a single core.
+/// </summary>
+/// <param name="core">Index of the core.</param>
+/// <returns>True if the thread was pinned, false if the core does not exist or the platform does not support it.</returns>
+inline bool AnTcpPinThread([[maybe_unused]] unsigned int core) noexcept
+{
+#ifdef _WIN32
+    return core < sizeof(DWORD_PTR) * 8 && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#elif defined(__linux__)
+    if (core >= CPU_SETSIZE)
+    {
+        return false;
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,98 @@
+#include "AnTcpPubSub.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+bool AnTcpPubSub::Subscribe(AnTcpTopic topic, AnTcpConnectionId id) noexcept
+{
+    std::lock_guard lock(Mutex);
+    AnTcpSubscriberList& subscribers = Topics[topic];
+
+    if (subscribers && std::find(subscribers->begin(), subscribers->end(), id) != subscribers->end())
+    {
+        return false;
+    }
+
+    // publishers may still send to the old list, it is deleted by the last one
+    auto newSubscribers = subscribers ? std::make_shared<std::vector<AnTcpConnectionId>>(*subscribers) : std::make_shared<std::vector<AnTcpConnectionId>>();
+    newSubscribers->push_back(id);
+    subscribers = std::move(newSubscribers);
+    ++Subscriptions;
+    return true;
+}
+
+bool AnTcpPubSub::Unsubscribe(AnTcpTopic topic, AnTcpConnectionId id) noexcept
+{
+    std::lock_guard lock(Mutex);
+    const auto entry = Topics.find(topic);
+
+    if (entry == Topics.end() || std::find(entry->second->begin(), entry->second->end(), id) == entry->second->end())
+    {
+        return false;
+    }
+
+    if (entry->second->size() == 1)
+    {
+        Topics.erase(entry);
+    }
+    else
+    {
+        auto newSubscribers = std::make_shared<std::vector<AnTcpConnectionId>>();
+        newSubscribers->reserve(entry->second->size() - 1);
+        std::copy_if(entry->second->begin(), entry->second->end(), std::back_inserter(*newSubscribers), [id](AnTcpConnectionId subscriber)
+        {
+            return subscriber != id;
+        });
+
+        entry->second = std::move(newSubscribers);
+    }
+
+    --Subscriptions;
+    return true;
+}
+
+void AnTcpPubSub::RemoveSubscriber(AnTcpConnectionId id, const std::vector<AnTcpTopic>& topics) noexcept
+{
+    for (AnTcpTopic topic : topics)
+    {
+        Unsubscribe(topic, id);
+    }
+}
+
+AnTcpSubscriberList AnTcpPubSub::GetSubscribers(AnTcpTopic topic) noexcept
+{
+    std::lock_guard lock(Mutex);
+    const auto entry = Topics.find(topic);
+    return entry != Topics.end() ? entry->second : nullptr;
+}
+
+AnTcpSharedFrame AnTcpPubSub::Encode(AnTcpTopic topic, const void* data, size_t size) noexcept
+{
+    auto frame = std::make_shared<AnTcpPublishedFrame>();
+    frame->Topic = topic;
+    frame->Payload.resize(sizeof(AnTcpTopic) + size);
+    memcpy(frame->Payload.data(), &topic, sizeof(AnTcpTopic));
+
+    if (size > 0)
+    {
+        memcpy(frame->Payload.data() + sizeof(AnTcpTopic), data, size);
+    }
+
+    return frame;
+}
+
+AnTcpPubSubStats AnTcpPubSub::GetStats() noexcept
+{
+    AnTcpPubSubStats stats{};
+    stats.Published = Published.load(std::memory_order_relaxed);
+    stats.Sent = Sent.load(std::memory_order_relaxed);
+    stats.Dropped = Dropped.load(std::memory_order_relaxed);
+    stats.Coalesced = Coalesced.load(std::memory_order_relaxed);
+    stats.Disconnected = Disconnected.load(std::memory_order_relaxed);
+
+    std::lock_guard lock(Mutex);
+    stats.Topics = Topics.size();
+    stats.Subscriptions = Subscriptions;
+    return stats;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "AnTcpCallbackTable.hpp"
+#include "AnTcpConnectionTable.hpp"
+
+// topic frames are published to, clients subscribe with ANTCP_MESSAGE_SUBSCRIBE
+typedef unsigned int AnTcpTopic;
+
+// frames that may wait for a client before the slow subscriber policy kicks in
+constexpr size_t ANTCP_PUSH_QUEUE_DEFAULT_LIMIT = 256;
+
+// topics a single client may subscribe to
+constexpr size_t ANTCP_MAX_CLIENT_TOPICS = 1024;
+
+/// <summary>
+/// What happens when a published frame finds the push queue of a client full, because it
+/// doesn't read as fast as frames are published.
+/// </summary>
+enum class AnTcpSlowSubscriberPolicy : unsigned char
+{
+    // the oldest queued frame is dropped
+    DropOldest,
+    // the queued frames of the same topic are dropped, the client only gets the latest one.
+    // If there are none, the oldest frame is dropped
+    CoalesceLatest,
+    // the client is disconnected
+    Disconnect
+};
+
+/// <summary>
+/// Frame published to a topic, encoded once and shared by the push queues of all subscribers.
+/// </summary>
+struct AnTcpPublishedFrame
+{
+    AnTcpTopic Topic = 0;
+
+    // payload of the ANTCP_MESSAGE_PUBLISH frame: the topic followed by the published data,
+    // every subscriber only builds the few bytes of the header itself
+    std::vector<char> Payload;
+};
+
+typedef std::shared_ptr<const AnTcpPublishedFrame> AnTcpSharedFrame;
+
+// subscribers of a topic, replaced as a whole when one joins or leaves, so publishers don't hold the lock while they send
+typedef std::shared_ptr<const std::vector<AnTcpConnectionId>> AnTcpSubscriberList;
+
+/// <summary>
+/// Counters of the publish subscribe messages.
+/// </summary>
+struct AnTcpPubSubStats
+{
+    // publishes that had at least one subscriber
+    uint64_t Published = 0;
+
+    // frames sent to a subscriber
+    uint64_t Sent = 0;
+
+    // frames a slow subscriber never got, dropped because its queue was full
+    uint64_t Dropped = 0;
+
+    // frames replaced by a later frame of their topic
+    uint64_t Coalesced = 0;
+
+    // subscribers disconnected because their queue was full
+    uint64_t Disconnected = 0;
+
+    size_t Topics = 0;
+    size_t Subscriptions = 0;
+};
+
+/// <summary>
+/// Topics and their subscribers. The push queues live in the client handlers, this only
+/// knows which connections get a published frame and how slow ones are treated.
+/// </summary>
+class AnTcpPubSub
+{
+private:
+    std::mutex Mutex;
+    std::unordered_map<AnTcpTopic, AnTcpSubscriberList> Topics;
+    size_t Subscriptions;
+
+    AnTcpSlowSubscriberPolicy Policy;
+    size_t QueueLimit;
+
+    std::atomic<uint64_t> Published;
+    std::atomic<uint64_t> Sent;
+    std::atomic<uint64_t> Dropped;
+    std::atomic<uint64_t> Coalesced;
+    std::atomic<uint64_t> Disconnected;
+
+public:
+    AnTcpPubSub()
+        : Mutex(),
+        Topics(),
+        Subscriptions(0),
+        Policy(AnTcpSlowSubscriberPolicy::DropOldest),
+        QueueLimit(ANTCP_PUSH_QUEUE_DEFAULT_LIMIT),
+        Published(0),
+        Sent(0),
+        Dropped(0),
+        Coalesced(0),
+        Disconnected(0)
+    {}
+
+    AnTcpPubSub(const AnTcpPubSub&) = delete;
+    AnTcpPubSub& operator=(const AnTcpPubSub&) = delete;
+
+    inline AnTcpSlowSubscriberPolicy GetPolicy() const noexcept { return Policy; }
+
+    inline size_t GetQueueLimit() const noexcept { return QueueLimit; }
+
+    /// <summary>
+    /// Set how slow subscribers are treated, see AnTcpSlowSubscriberPolicy.
+    /// </summary>
+    /// <param name="queueLimit">Frames that may wait for a subscriber, at least 1.</param>
+    inline void SetPolicy(AnTcpSlowSubscriberPolicy policy, size_t queueLimit) noexcept
+    {
+        Policy = policy;
+        QueueLimit = std::max<size_t>(1, queueLimit);
+    }
+
+    /// <summary>
+    /// Add a connection to the subscribers of a topic.
+    /// </summary>
+    /// <returns>True if it was added, false if it already was subscribed.</returns>
+    bool Subscribe(AnTcpTopic topic, AnTcpConnectionId id) noexcept;
+
+    /// <summary>
+    /// Remove a connection from the subscribers of a topic.
+    /// </summary>
+    /// <returns>True if it was removed, false if it was not subscribed.</returns>
+    bool Unsubscribe(AnTcpTopic topic, AnTcpConnectionId id) noexcept;
+
+    /// <summary>
+    /// Remove a closed connection from all of its topics.
+    /// </summary>
+    void RemoveSubscriber(AnTcpConnectionId id, const std::vector<AnTcpTopic>& topics) noexcept;
+
+    /// <summary>
+    /// Get the subscribers of a topic, the list stays valid while it is used.
+    /// </summary>
+    /// <returns>The subscribers, null if the topic has none.</returns>
+    AnTcpSubscriberList GetSubscribers(AnTcpTopic topic) noexcept;
+
+    /// <summary>
+    /// Encode a frame for a topic, the data is copied once.
+    /// </summary>
+    static AnTcpSharedFrame Encode(AnTcpTopic topic, const void* data, size_t size) noexcept;
+
+    /// <summary>
+    /// Get the counters and the number of topics and subscriptions.
+    /// </summary>
+    AnTcpPubSubStats GetStats() noexcept;
+
+    inline void RecordPublished() noexcept { Published.fetch_add(1, std::memory_order_relaxed); }
+
+    inline void RecordSent() noexcept { Sent.fetch_add(1, std::memory_order_relaxed); }
+
+    inline void RecordDropped(uint64_t frames) noexcept { Dropped.fetch_add(frames, std::memory_order_relaxed); }
+
+    inline void RecordCoalesced(uint64_t frames) noexcept { Coalesced.fetch_add(frames, std::memory_order_relaxed); }
+
+    inline void RecordDisconnected() noexcept { Disconnected.fetch_add(1, std::memory_order_relaxed); }
+};
@@ -0,0 +1,169 @@
+#include "AnTcpResponseCache.hpp"
+
+std::shared_ptr<const AnTcpCachedResponses> AnTcpResponseCache::Find(AnTcpMessageType type, const void* data, size_t size) noexcept
+{
+    const std::string_view key = BuildKey(type, data, size);
+    Shard& shard = GetShard(key);
+
+    std::lock_guard lock(shard.Mutex);
+    const auto entry = shard.Index.find(key);
+
+    if (entry == shard.Index.end())
+    {
+        shard.Stats.Misses++;
+        return nullptr;
+    }
+
+    if (entry->second->Expiry != std::chrono::steady_clock::time_point::max() && entry->second->Expiry <= std::chrono::steady_clock::now())
+    {
+        Erase(shard, entry->second);
+        shard.Stats.Expirations++;
+        shard.Stats.Misses++;
+        return nullptr;
+    }
+
+    shard.Entries.splice(shard.Entries.begin(), shard.Entries, entry->second);
+    shard.Stats.Hits++;
+    return entry->second->Responses;
+}
+
+void AnTcpResponseCache::Insert(AnTcpMessageType type, const void* data, size_t size, std::shared_ptr<const AnTcpCachedResponses> responses, std::chrono::milliseconds ttl) noexcept
+{
+    const size_t shardCapacity = GetCapacity() / ANTCP_RESPONSE_CACHE_SHARD_COUNT;
+    size_t entrySize = ANTCP_RESPONSE_CACHE_ENTRY_OVERHEAD + sizeof(AnTcpMessageType) + size;
+
+    for (const AnTcpCachedResponse& response : *responses)
+    {
+        entrySize += sizeof(AnTcpCachedResponse) + response.Data.size();
+    }
+
+    // an entry that would evict a whole shard is not worth it
+    if (entrySize > shardCapacity)
+    {
+        return;
+    }
+
+    const std::string_view key = BuildKey(type, data, size);
+    Shard& shard = GetShard(key);
+
+    Entry entry
+    {
+        std::string(key),
+        std::move(responses),
+        ttl.count() > 0 ? std::chrono::steady_clock::now() + ttl : std::chrono::steady_clock::time_point::max(),
+        entrySize
+    };
+
+    std::lock_guard lock(shard.Mutex);
+    const auto existingEntry = shard.Index.find(key);
+
+    if (existingEntry != shard.Index.end())
+    {
+        // another thread missed at the same time and was faster
+        Erase(shard, existingEntry->second);
+    }
+
+    shard.Entries.push_front(std::move(entry));
+    shard.Index.emplace(shard.Entries.front().Key, shard.Entries.begin());
+    shard.Bytes += entrySize;
+    shard.Stats.Insertions++;
+
+    while (shard.Bytes > shardCapacity)
+    {
+        Erase(shard, std::prev(shard.Entries.end()));
+        shard.Stats.Evictions++;
+    }
+}
+
+bool AnTcpResponseCache::Invalidate(AnTcpMessageType type, const void* data, size_t size) noexcept
+{
+    const std::string_view key = BuildKey(type, data, size);
+    Shard& shard = GetShard(key);
+
+    std::lock_guard lock(shard.Mutex);
+    const auto entry = shard.Index.find(key);
+
+    if (entry == shard.Index.end())
+    {
+        return false;
+    }
+
+    Erase(shard, entry->second);
+    shard.Stats.Invalidations++;
+    return true;
+}
+
+size_t AnTcpResponseCache::InvalidateType(AnTcpMessageType type) noexcept
+{
+    size_t count = 0;
+
+    for (Shard& shard : Shards)
+    {
+        std::lock_guard lock(shard.Mutex);
+
+        for (auto entry = shard.Entries.begin(); entry != shard.Entries.end();)
+        {
+            const auto next = std::next(entry);
+
+            if (entry->Key[0] == type)
+            {
+                Erase(shard, entry);
+                shard.Stats.Invalidations++;
+                ++count;
+            }
+
+            entry = next;
+        }
+    }
+
+    return count;
+}
+
+void AnTcpResponseCache::Clear() noexcept
+{
+    for (Shard& shard : Shards)
+    {
+        std::lock_guard lock(shard.Mutex);
+        shard.Stats.Invalidations += shard.Entries.size();
+        shard.Index.clear();
+        shard.Entries.clear();
+        shard.Bytes = 0;
+    }
+}
+
+AnTcpResponseCacheStats AnTcpResponseCache::GetStats() noexcept
+{
+    AnTcpResponseCacheStats stats{};
+
+    for (Shard& shard : Shards)
+    {
+        std::lock_guard lock(shard.Mutex);
+        stats.Hits += shard.Stats.Hits;
+        stats.Misses += shard.Stats.Misses;
+        stats.Insertions += shard.Stats.Insertions;
+        stats.Evictions += shard.Stats.Evictions;
+        stats.Expirations += shard.Stats.Expirations;
+        stats.Invalidations += shard.Stats.Invalidations;
+        stats.Entries += shard.Entries.size();
+        stats.Bytes += shard.Bytes;
+    }
+
+    return stats;
+}
+
+std::string_view AnTcpResponseCache::BuildKey(AnTcpMessageType type, const void* data, size_t size) noexcept
+{
+    // keeps its capacity, so only the first lookups of a thread allocate
+    static thread_local std::string key;
+
+    key.assign(1, type);
+    key.append(static_cast<const char*>(data), size);
+    return key;
+}
+
+void AnTcpResponseCache::Erase(Shard& shard, std::list<Entry>::iterator entry) noexcept
+{
+    shard.Bytes -= entry->Size;
+    shard.Index.erase(entry->Key);
+    shard.Entries.erase(entry);
+}
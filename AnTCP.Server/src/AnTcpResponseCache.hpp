@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "AnTcpCallbackTable.hpp"
+
+// the cache is split into shards with their own lock and LRU list, so lookups of different keys rarely contend
+constexpr size_t ANTCP_RESPONSE_CACHE_SHARD_COUNT = 16;
+
+// default capacity of the cache in bytes, keys and responses are counted
+constexpr size_t ANTCP_RESPONSE_CACHE_DEFAULT_SIZE = 64 * 1024 * 1024;
+
+// bytes counted per entry on top of its key and responses, roughly the list node and index entry
+constexpr size_t ANTCP_RESPONSE_CACHE_ENTRY_OVERHEAD = 128;
+
+/// <summary>
+/// Response that was sent by a cacheable callback.
+/// </summary>
+struct AnTcpCachedResponse
+{
+    AnTcpMessageType Type = 0;
+    std::vector<char> Data;
+};
+
+// every response a callback sent for one request, in the order they were sent
+typedef std::vector<AnTcpCachedResponse> AnTcpCachedResponses;
+
+/// <summary>
+/// Counters of the response cache.
+/// </summary>
+struct AnTcpResponseCacheStats
+{
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Insertions = 0;
+
+    // entries removed to make room for new ones
+    uint64_t Evictions = 0;
+
+    // entries found after their ttl ran out
+    uint64_t Expirations = 0;
+
+    // entries removed by the invalidation functions
+    uint64_t Invalidations = 0;
+
+    size_t Entries = 0;
+    size_t Bytes = 0;
+};
+
+/// <summary>
+/// Sharded, size bounded LRU cache for the responses of idempotent message
+/// types, keyed by message type and payload bytes.
+/// </summary>
+class AnTcpResponseCache
+{
+private:
+    struct Entry
+    {
+        // message type followed by the payload
+        std::string Key;
+        std::shared_ptr<const AnTcpCachedResponses> Responses;
+        std::chrono::steady_clock::time_point Expiry;
+        size_t Size;
+    };
+
+    struct Shard
+    {
+        std::mutex Mutex;
+
+        // most recently used entry first
+        std::list<Entry> Entries;
+
+        // keys point into the entries, list nodes never move
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> Index;
+
+        size_t Bytes = 0;
+        AnTcpResponseCacheStats Stats;
+    };
+
+    std::array<Shard, ANTCP_RESPONSE_CACHE_SHARD_COUNT> Shards;
+    std::atomic<size_t> Capacity;
+
+public:
+    AnTcpResponseCache()
+        : Shards(),
+        Capacity(ANTCP_RESPONSE_CACHE_DEFAULT_SIZE)
+    {}
+
+    AnTcpResponseCache(const AnTcpResponseCache&) = delete;
+    AnTcpResponseCache& operator=(const AnTcpResponseCache&) = delete;
+
+    /// <summary>
+    /// Set the maximum size of the cache, 0 disables it. Shrinking it evicts
+    /// entries on the next insertion.
+    /// </summary>
+    inline void SetCapacity(size_t bytes) noexcept { Capacity = bytes; }
+
+    inline size_t GetCapacity() const noexcept { return Capacity.load(std::memory_order_relaxed); }
+
+    inline bool IsEnabled() const noexcept { return GetCapacity() > 0; }
+
+    /// <summary>
+    /// Look up the responses for a request and mark them as recently used.
+    /// </summary>
+    /// <returns>The responses, null on a miss.</returns>
+    std::shared_ptr<const AnTcpCachedResponses> Find(AnTcpMessageType type, const void* data, size_t size) noexcept;
+
+    /// <summary>
+    /// Store the responses for a request, evicting the least recently used entries of its shard if needed.
+    /// </summary>
+    /// <param name="ttl">How long the entry stays valid, 0 keeps it until it is evicted or invalidated.</param>
+    void Insert(AnTcpMessageType type, const void* data, size_t size, std::shared_ptr<const AnTcpCachedResponses> responses, std::chrono::milliseconds ttl) noexcept;
+
+    /// <summary>
+    /// Remove the responses for a request.
+    /// </summary>
+    /// <returns>True if there was an entry, false if not.</returns>
+    bool Invalidate(AnTcpMessageType type, const void* data, size_t size) noexcept;
+
+    /// <summary>
+    /// Remove all responses of a message type, this has to look at every entry.
+    /// </summary>
+    /// <returns>Number of removed entries.</returns>
+    size_t InvalidateType(AnTcpMessageType type) noexcept;
+
+    /// <summary>
+    /// Remove all entries.
+    /// </summary>
+    void Clear() noexcept;
+
+    /// <summary>
+    /// Sum up the counters of all shards.
+    /// </summary>
+    AnTcpResponseCacheStats GetStats() noexcept;
+
+    /// <summary>
+    /// Build the key of a request into a thread local buffer, so lookups don't allocate.
+    /// The view is valid until the next call on the same thread.
+    /// </summary>
+    static std::string_view BuildKey(AnTcpMessageType type, const void* data, size_t size) noexcept;
+
+private:
+    inline Shard& GetShard(std::string_view key) noexcept
+    {
+        return Shards[std::hash<std::string_view>{}(key) % ANTCP_RESPONSE_CACHE_SHARD_COUNT];
+    }
+
+    /// <summary>
+    /// Remove an entry, the shard must be locked.
+    /// </summary>
+    static void Erase(Shard& shard, std::list<Entry>::iterator entry) noexcept;
+};
@@ -1,69 +1,303 @@
 #include "AnTcpServer.hpp"
 
+#ifndef _WIN32
+// winsock needs to be initialized and cleaned up, posix sockets do not
+inline int WSACleanup() noexcept { return 0; }
+#endif
+
 AnTcpError AnTcpServer::Run() noexcept
 {
+#ifdef _WIN32
     WSADATA wsaData{};
-    int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    const int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
 
     if (result != 0)
     {
         DEBUG_ONLY(std::cout << ">> WSAStartup() failed: " << result << std::endl);
         return AnTcpError::Win32WsaStartupFailed;
     }
+#endif
+
+    const AnTcpError listenError = OpenListeners();
+
+    if (listenError != AnTcpError::Success)
+    {
+        SocketCleanup();
+        WSACleanup();
+        return listenError;
+    }
+
+    StartWorkerPool();
+
+    {
+        std::lock_guard lock(IoThreadCountersMutex);
+        IoThreadCounters.clear();
+        ClientThreadCounters = nullptr;
+    }
+
+    ReceiveCounters.Reset();
+
+    // threads of the thread per client backend share their counters, unused ones are not reported
+    if (LowLatency.Enabled)
+    {
+        ClientThreadCounters = AddIoThreadCounters(AnTcpIoThreadType::Client, 0);
+    }
+
+    std::vector<SOCKET> listenSockets;
+
+    for (size_t i = 0; i < ListenSocketCount; ++i)
+    {
+        listenSockets.push_back(ListenSockets[i]);
+    }
+
+    const bool ioUring = IoBackend == AnTcpIoBackend::IoUring && StartIoUrings(listenSockets);
+
+    if (IoBackend == AnTcpIoBackend::IoUring && !ioUring)
+    {
+        DEBUG_ONLY(std::cout << ">> io_uring backend not available, using the event loop" << std::endl);
+    }
+
+    if ((IoBackend == AnTcpIoBackend::EventLoop || (IoBackend == AnTcpIoBackend::IoUring && !ioUring)) && !StartEventLoops())
+    {
+        DEBUG_ONLY(std::cout << ">> Event loop backend not available, using one thread per client" << std::endl);
+    }
+
+    if (ioUring)
+    {
+        // the io_uring threads accept by themselves and exit once Stop() shut the listen sockets down
+        for (AnTcpIoUring* ring : IoUrings)
+        {
+            ring->Wait();
+        }
+    }
+    else
+    {
+        // every listen socket but the first gets an accept thread, the first one is served here
+        std::vector<std::thread> acceptThreads;
+
+        for (size_t i = 1; i < listenSockets.size(); ++i)
+        {
+            acceptThreads.emplace_back(&AnTcpServer::AcceptClients, this, listenSockets[i]);
+        }
+
+        AcceptClients(listenSockets.front());
+
+        for (std::thread& acceptThread : acceptThreads)
+        {
+            acceptThread.join();
+        }
+    }
+
+    // nobody accepts anymore, free the ports and remove the unix socket files
+    SocketCleanup();
+    StopIoUrings();
+    StopEventLoops();
+
+    // wake up the client threads, they release their handlers when they exit
+    Connections.DisconnectAll();
+
+    // pooled jobs hold references too, so the worker pool keeps running until every handler is gone
+    Connections.WaitUntilEmpty();
+    WorkerPool.Stop();
+
+    WSACleanup();
+    return AnTcpError::Success;
+}
+
+AnTcpError AnTcpServer::OpenListeners() noexcept
+{
+    if (Listeners.empty())
+    {
+        DEBUG_ONLY(std::cout << ">> No listeners configured" << std::endl);
+        return AnTcpError::NoListeners;
+    }
+
+    for (const AnTcpListener& listener : Listeners)
+    {
+        const AnTcpError result = OpenListener(listener);
+
+        if (result != AnTcpError::Success)
+        {
+            return result;
+        }
+    }
+
+    return AnTcpError::Success;
+}
+
+AnTcpError AnTcpServer::OpenListener(const AnTcpListener& listener) noexcept
+{
+    if (listener.Type == AnTcpListenerType::Unix)
+    {
+#if ANTCP_HAS_UNIX_SOCKETS
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+
+        if (listener.Address.empty() || listener.Address.size() >= sizeof(address.sun_path))
+        {
+            DEBUG_ONLY(std::cout << ">> Invalid unix socket path: " << listener.Address << std::endl);
+            return AnTcpError::SocketBindingFailed;
+        }
+
+        memcpy(address.sun_path, listener.Address.c_str(), listener.Address.size());
+
+        // a crashed server leaves its socket file behind, which would make bind() fail. Only a file that
+        // refuses connections is stale, a server that still listens on it must keep it
+        const SOCKET probeSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (probeSocket == INVALID_SOCKET)
+        {
+            DEBUG_ONLY(std::cout << ">> socket() failed: " << WSAGetLastError() << std::endl);
+            return AnTcpError::SocketCreationFailed;
+        }
+
+        // non-blocking, a server with a full backlog would block the connect() otherwise
+        const bool probed = AnTcpSetNonBlocking(probeSocket)
+            && connect(probeSocket, reinterpret_cast<const sockaddr*>(&address), static_cast<socklen_t>(sizeof(address))) == SOCKET_ERROR;
+        const int probeError = errno;
+        closesocket(probeSocket);
+
+        struct stat info{};
+
+        if (!probed || (probeError != ECONNREFUSED && probeError != ENOENT))
+        {
+            DEBUG_ONLY(std::cout << ">> Unix socket is in use: " << listener.Address << std::endl);
+            errno = EADDRINUSE;
+            return AnTcpError::SocketBindingFailed;
+        }
+
+        if (probeError == ECONNREFUSED && stat(address.sun_path, &info) == 0 && S_ISSOCK(info.st_mode))
+        {
+            unlink(address.sun_path);
+        }
+
+        const SOCKET listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (listenSocket == INVALID_SOCKET)
+        {
+            DEBUG_ONLY(std::cout << ">> socket() failed: " << WSAGetLastError() << std::endl);
+            return AnTcpError::SocketCreationFailed;
+        }
+
+        if (!AddListenSocket(listenSocket))
+        {
+            DEBUG_ONLY(std::cout << ">> Too many listen sockets, the limit is " << ANTCP_MAX_LISTEN_SOCKETS << std::endl);
+            closesocket(listenSocket);
+            return AnTcpError::SocketCreationFailed;
+        }
+
+        if (bind(listenSocket, reinterpret_cast<const sockaddr*>(&address), static_cast<socklen_t>(sizeof(address))) == SOCKET_ERROR)
+        {
+            DEBUG_ONLY(std::cout << ">> bind() failed: " << WSAGetLastError() << std::endl);
+            return AnTcpError::SocketBindingFailed;
+        }
+
+        UnixSocketPaths.push_back(listener.Address);
+
+        if (listen(listenSocket, SOMAXCONN) == SOCKET_ERROR)
+        {
+            DEBUG_ONLY(std::cout << ">> listen() failed: " << WSAGetLastError() << std::endl);
+            return AnTcpError::SocketListeningFailed;
+        }
+
+        return AnTcpError::Success;
+#else
+        DEBUG_ONLY(std::cout << ">> Unix sockets are not available on this platform" << std::endl);
+        return AnTcpError::SocketCreationFailed;
+#endif
+    }
 
-    addrinfo hints{ 0 };
-    hints.ai_family = AF_INET;
+    // the family follows the address, so the same listener type works for ipv4 and ipv6
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_protocol = IPPROTO_TCP;
     hints.ai_flags = AI_PASSIVE;
 
     addrinfo* addrResult{ nullptr };
-    result = getaddrinfo(Ip.c_str(), Port.c_str(), &hints, &addrResult);
+    const int result = getaddrinfo(listener.Address.c_str(), listener.Port.c_str(), &hints, &addrResult);
 
     if (result != 0)
     {
         DEBUG_ONLY(std::cout << ">> getaddrinfo() failed: " << result << std::endl);
-        WSACleanup();
         return AnTcpError::GetAddrInfoFailed;
     }
 
-    ListenSocket = socket(addrResult->ai_family, addrResult->ai_socktype, addrResult->ai_protocol);
+    const unsigned int shards = ANTCP_HAS_REUSE_PORT ? ListenerShards : 1;
+    AnTcpError error = AnTcpError::Success;
 
-    if (ListenSocket == INVALID_SOCKET)
+    for (unsigned int i = 0; i < shards && error == AnTcpError::Success; ++i)
     {
-        DEBUG_ONLY(std::cout << ">> socket() failed: " << WSAGetLastError() << std::endl);
-        freeaddrinfo(addrResult);
-        WSACleanup();
-        return AnTcpError::SocketCreationFailed;
-    }
+        const SOCKET listenSocket = socket(addrResult->ai_family, addrResult->ai_socktype, addrResult->ai_protocol);
 
-    result = bind(ListenSocket, addrResult->ai_addr, static_cast<int>(addrResult->ai_addrlen));
-    freeaddrinfo(addrResult);
+        if (listenSocket == INVALID_SOCKET)
+        {
+            DEBUG_ONLY(std::cout << ">> socket() failed: " << WSAGetLastError() << std::endl);
+            error = AnTcpError::SocketCreationFailed;
+            break;
+        }
 
-    if (result == SOCKET_ERROR)
-    {
-        DEBUG_ONLY(std::cout << ">> bind() failed: " << WSAGetLastError() << std::endl);
-        SocketCleanup();
-        WSACleanup();
-        return AnTcpError::SocketBindingFailed;
-    }
+        if (!AddListenSocket(listenSocket))
+        {
+            DEBUG_ONLY(std::cout << ">> Too many listen sockets, the limit is " << ANTCP_MAX_LISTEN_SOCKETS << std::endl);
+            closesocket(listenSocket);
+            error = AnTcpError::SocketCreationFailed;
+            break;
+        }
 
-    if (listen(ListenSocket, SOMAXCONN) == SOCKET_ERROR)
-    {
-        DEBUG_ONLY(std::cout << ">> listen() failed: " << WSAGetLastError() << std::endl);
-        SocketCleanup();
-        WSACleanup();
-        return AnTcpError::SocketListeningFailed;
+        const int enabled = 1;
+
+        // an ipv6 listener would take the ipv4 clients of its port too, which collides with an ipv4 listener
+        if (addrResult->ai_family == AF_INET6)
+        {
+            setsockopt(listenSocket, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char*>(&enabled), sizeof(enabled));
+        }
+
+#if ANTCP_HAS_REUSE_PORT
+        if (shards > 1 && setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char*>(&enabled), sizeof(enabled)) == SOCKET_ERROR)
+        {
+            DEBUG_ONLY(std::cout << ">> setsockopt(SO_REUSEPORT) failed: " << WSAGetLastError() << std::endl);
+            error = AnTcpError::SocketBindingFailed;
+            break;
+        }
+#endif
+
+        if (bind(listenSocket, addrResult->ai_addr, static_cast<int>(addrResult->ai_addrlen)) == SOCKET_ERROR)
+        {
+            DEBUG_ONLY(std::cout << ">> bind() failed: " << WSAGetLastError() << std::endl);
+            error = AnTcpError::SocketBindingFailed;
+        }
+        else if (listen(listenSocket, SOMAXCONN) == SOCKET_ERROR)
+        {
+            DEBUG_ONLY(std::cout << ">> listen() failed: " << WSAGetLastError() << std::endl);
+            error = AnTcpError::SocketListeningFailed;
+        }
     }
 
+    freeaddrinfo(addrResult);
+    return error;
+}
 
+void AnTcpServer::AcceptClients(SOCKET listenSocket) noexcept
+{
     while (!ShouldExit)
     {
+        if (ConnectionLimitMode == AnTcpConnectionLimitMode::Queue)
+        {
+            // leave new clients in the listen backlog until a connection closes
+            Connections.WaitForSlot(ShouldExit);
+
+            if (ShouldExit)
+            {
+                break;
+            }
+        }
+
         // accept client and get socket info from it, the socket info contains the ip address
         // and port used to connect o the server
-        SOCKADDR_IN clientInfo{ 0 };
-        int sockAddrSize = static_cast<int>(sizeof(SOCKADDR_IN));
-        SOCKET clientSocket = accept(ListenSocket, reinterpret_cast<sockaddr*>(&clientInfo), &sockAddrSize);
+        sockaddr_storage clientInfo{};
+        socklen_t sockAddrSize = static_cast<socklen_t>(sizeof(sockaddr_storage));
+        SOCKET clientSocket = accept(listenSocket, reinterpret_cast<sockaddr*>(&clientInfo), &sockAddrSize);
 
         if (clientSocket == INVALID_SOCKET)
         {
@@ -71,96 +305,1961 @@ AnTcpError AnTcpServer::Run() noexcept
             continue;
         }
 
-        // cleanup old disconnected clients and add the new
-        ClientCleanup();
-        Clients.push_back(new ClientHandler(clientSocket, clientInfo, ShouldExit, &Callbacks, &OnClientConnected, &OnClientDisconnected));
+        SetupClientSocket(clientSocket, clientInfo);
+
+        // spread the clients over the loops, without loops the handler spawns its own thread
+        AnTcpEventLoop* eventLoop = !EventLoops.empty() ? EventLoops[NextEventLoop.fetch_add(1, std::memory_order_relaxed) % EventLoops.size()] : nullptr;
+        ClientHandler* clientHandler = Connections.Add(this, clientSocket, clientInfo, eventLoop);
+
+        // another accept thread may have taken the slot we waited for, queued clients keep waiting for the next one
+        while (!clientHandler && ConnectionLimitMode == AnTcpConnectionLimitMode::Queue && !ShouldExit)
+        {
+            Connections.WaitForSlot(ShouldExit);
+            clientHandler = Connections.Add(this, clientSocket, clientInfo, eventLoop);
+        }
+
+        if (!clientHandler)
+        {
+            DEBUG_ONLY(std::cout << ">> Connection limit reached, rejecting client" << std::endl);
+            Connections.RecordRejected();
+            closesocket(clientSocket);
+            continue;
+        }
+
+        if (eventLoop)
+        {
+            // the loop owns the handler from now on
+            eventLoop->AddClient(clientHandler);
+        }
+    }
+}
+
+void AnTcpServer::SetupClientSocket(SOCKET clientSocket, const sockaddr_storage& clientInfo) noexcept
+{
+    // unix sockets have no nagle's algorithm to disable and no device queue to busy poll
+    if (clientInfo.ss_family == AF_UNIX)
+    {
+        return;
+    }
+
+    if ((ClientOptions.NoDelay || LowLatency.Enabled) && !AnTcpSetNoDelay(clientSocket, true))
+    {
+        DEBUG_ONLY(std::cout << ">> setsockopt(TCP_NODELAY) failed: " << WSAGetLastError() << std::endl);
+    }
+
+    // raising it over net.core.busy_read needs CAP_NET_ADMIN, the mode works without it
+    if (LowLatency.Enabled && LowLatency.BusyPoll > 0 && !AnTcpSetBusyPoll(clientSocket, LowLatency.BusyPoll))
+    {
+        DEBUG_ONLY(std::cout << ">> setsockopt(SO_BUSY_POLL) failed: " << WSAGetLastError() << std::endl);
+    }
+}
+
+AnTcpIoThreadCounters* AnTcpServer::AddIoThreadCounters(AnTcpIoThreadType type, unsigned int index) noexcept
+{
+    std::lock_guard lock(IoThreadCountersMutex);
+    IoThreadCounters.push_back(std::make_unique<AnTcpIoThreadCounters>(type, index));
+    return IoThreadCounters.back().get();
+}
+
+std::vector<AnTcpIoThreadStats> AnTcpServer::GetIoThreadStats() noexcept
+{
+    std::vector<AnTcpIoThreadStats> stats;
+    std::lock_guard lock(IoThreadCountersMutex);
+
+    for (const std::unique_ptr<AnTcpIoThreadCounters>& counters : IoThreadCounters)
+    {
+        const AnTcpIoThreadStats threadStats = counters->GetStats();
+
+        // loops that never started and a thread per client entry of another backend
+        if (threadStats.Threads > 0)
+        {
+            stats.push_back(threadStats);
+        }
     }
 
-    for (ClientHandler* clientHandler : Clients)
+    return stats;
+}
+
+bool AnTcpServer::StartEventLoops() noexcept
+{
+    const unsigned int loopCount = IoThreadCount > 0 ? IoThreadCount : std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < loopCount; ++i)
     {
-        if (clientHandler)
+        EventLoops.push_back(new AnTcpEventLoop(ShouldExit, ReceiveCounters));
+
+        if (LowLatency.Enabled)
+        {
+            EventLoops.back()->SetLowLatency(AddIoThreadCounters(AnTcpIoThreadType::EventLoop, i), std::chrono::microseconds(LowLatency.SpinTime), GetIoThreadCore(i));
+        }
+
+        if (!EventLoops.back()->Start())
         {
-            delete clientHandler;
+            StopEventLoops();
+            return false;
         }
     }
 
-    SocketCleanup();
-    WSACleanup();
-    return AnTcpError::Success;
+    return true;
 }
 
-void ClientHandler::Listen() noexcept
+void AnTcpServer::StopEventLoops() noexcept
 {
-    if (OnClientConnected)
+    for (AnTcpEventLoop* eventLoop : EventLoops)
     {
-        (*OnClientConnected)(this);
+        delete eventLoop;
     }
 
-    // the total packet size and data ptr offset
-    AnTcpSizeType packetSize = 0;
-    AnTcpSizeType packetOffset = 0;
+    EventLoops.clear();
+    NextEventLoop = 0;
+}
 
-    // buffer for the packet
-    char packet[sizeof(AnTcpSizeType) + ANTCP_MAX_PACKET_SIZE]{ 0 };
+bool AnTcpServer::StartIoUrings(const std::vector<SOCKET>& listenSockets) noexcept
+{
+    const unsigned int ringCount = IoThreadCount > 0 ? IoThreadCount : std::max(1u, std::thread::hardware_concurrency());
 
-    while (!ShouldExit)
+    for (unsigned int i = 0; i < ringCount; ++i)
     {
-        auto packetBytesMissing = packetSize - packetOffset;
-        // how many bytes to receive at most, if packet is beeing built it's the remaining packets size 
-        // otherwise the size of the AnTcpSizeType which tells us how big the packet will be
-        auto maxReceiveSize = packetBytesMissing > 0 ? packetBytesMissing : sizeof(AnTcpSizeType);
+        IoUrings.push_back(new AnTcpIoUring(this, ShouldExit));
 
-        auto receivedPacketBytes = recv(Socket, packet + packetOffset, maxReceiveSize, 0);
-        packetOffset += receivedPacketBytes;
+        if (!IoUrings.back()->Create(listenSockets))
+        {
+            StopIoUrings();
+            return false;
+        }
+    }
 
-        // if we received 0 or -1 bytes, we're going to disconnect the client
-        if (receivedPacketBytes <= 0)
+    // only start accepting when every ring is ready, running threads could not be stopped without the listeners
+    for (size_t i = 0; i < IoUrings.size(); ++i)
+    {
+        if (LowLatency.Enabled)
         {
-            break;
+            IoUrings[i]->SetLowLatency(AddIoThreadCounters(AnTcpIoThreadType::IoUring, static_cast<unsigned int>(i)), std::chrono::microseconds(LowLatency.SpinTime), GetIoThreadCore(i));
         }
 
-        DEBUG_ONLY(std::cout << "[" << Id << "] " << "Received " << std::to_string(receivedPacketBytes) + " bytes" << std::endl);
+        IoUrings[i]->Start();
+    }
 
-        if (packetSize == 0)
-        {
-            // wait until the transmission of the AnTcpSizeType is completed to determine packet size
-            if (packetOffset >= sizeof(AnTcpSizeType))
-            {
-                packetSize = *reinterpret_cast<AnTcpSizeType*>(packet);
+    return true;
+}
 
-                if (packetSize > ANTCP_MAX_PACKET_SIZE)
-                {
-                    // packet is too big, this may be a wrong/malicious payload
-                    DEBUG_ONLY(std::cout << "[" << Id << "] " << "Packet too big (" << std::to_string(packetSize)
-                        << "/" << ANTCP_MAX_PACKET_SIZE << "), disconnecting client..." << std::endl);
-                    break;
-                }
+void AnTcpServer::StopIoUrings() noexcept
+{
+    for (AnTcpIoUring* ring : IoUrings)
+    {
+        delete ring;
+    }
 
-                DEBUG_ONLY(std::cout << "[" << Id << "] " << "New Packet: " << std::to_string(packetSize) + " bytes" << std::endl);
-            }
-        }
-        else
+    IoUrings.clear();
+}
+
+void AnTcpServer::StartWorkerPool() noexcept
+{
+    const AnTcpCallbackRegistry::Reader callbacks = Callbacks.Read();
+    const bool hasPooledCallbacks = std::any_of((*callbacks).begin(), (*callbacks).end(), [](const AnTcpCallbackEntry& entry)
+    {
+        return entry && entry.Options.Dispatch == AnTcpDispatchMode::Pooled;
+    });
+
+    if (hasPooledCallbacks)
+    {
+        WorkerPool.Start(WorkerCount);
+    }
+}
+
+bool AnTcpServer::SendData(AnTcpConnectionId id, AnTcpMessageType type, const void* data, size_t size) noexcept
+{
+    ClientHandler* handler = Connections.Acquire(id);
+
+    if (!handler)
+    {
+        return false;
+    }
+
+    const bool sent = handler->IsConnected() && handler->SendResponse(0, type, data, size);
+    handler->Release();
+    return sent;
+}
+
+size_t AnTcpServer::Publish(AnTcpTopic topic, const void* data, size_t size) noexcept
+{
+    const AnTcpSubscriberList subscribers = PubSub.GetSubscribers(topic);
+
+    if (!subscribers)
+    {
+        return 0;
+    }
+
+    const AnTcpSharedFrame frame = AnTcpPubSub::Encode(topic, data, size);
+    PubSub.RecordPublished();
+    size_t queued = 0;
+
+    for (AnTcpConnectionId id : *subscribers)
+    {
+        // closed connections leave their topics when their handler is destroyed
+        ClientHandler* handler = Connections.Acquire(id);
+
+        if (!handler)
         {
-            // we know the packet's size, wait for it to be complete
-            if (packetBytesMissing == 0)
-            {
-                if (!ProcessPacket(packet + sizeof(AnTcpSizeType), packetSize))
-                {
-                    // processing the packet failed, disconnect client
-                    break;
-                }
+            continue;
+        }
 
-                // reset packet buffer
-                packetSize = 0;
-                packetOffset = 0;
-            }
-            else
-            {
-                DEBUG_ONLY(std::cout << "[" << Id << "] " << "Packet Chunk: " << std::to_string(receivedPacketBytes) << " bytes ("
-                    << std::to_string(packetOffset) << "/" << std::to_string(packetSize) << ")" << std::endl);
-            }
+        if (handler->IsConnected() && handler->PushFrame(frame))
+        {
+            ++queued;
         }
+
+        handler->Release();
     }
 
-    Disconnect();
-}
\ No newline at end of file
+    return queued;
+}
+
+bool AnTcpServer::Subscribe(AnTcpConnectionId id, AnTcpTopic topic) noexcept
+{
+    ClientHandler* handler = Connections.Acquire(id);
+
+    if (!handler)
+    {
+        return false;
+    }
+
+    const bool subscribed = handler->IsConnected() && handler->Subscribe(topic);
+    handler->Release();
+    return subscribed;
+}
+
+bool AnTcpServer::Unsubscribe(AnTcpConnectionId id, AnTcpTopic topic) noexcept
+{
+    ClientHandler* handler = Connections.Acquire(id);
+
+    if (!handler)
+    {
+        return false;
+    }
+
+    const bool unsubscribed = handler->Unsubscribe(topic);
+    handler->Release();
+    return unsubscribed;
+}
+
+void AnTcpServer::MetricsCallback(ClientHandler* handler, AnTcpMessageType, const void*, int) noexcept
+{
+    handler->SendMetrics();
+}
+
+void AnTcpServer::BatchCallback(ClientHandler* handler, AnTcpMessageType, const void* data, int size) noexcept
+{
+    if (!handler->ProcessBatch(static_cast<const char*>(data), size))
+    {
+        // same as an invalid packet, but we may be on a worker thread and can't return an error
+        handler->Server->Metrics.RecordProtocolError();
+        handler->Disconnect();
+    }
+}
+
+void AnTcpServer::SubscribeCallback(ClientHandler* handler, AnTcpMessageType type, const void* data, int size) noexcept
+{
+    if (size != sizeof(AnTcpTopic))
+    {
+        handler->Server->Metrics.RecordProtocolError();
+        handler->Disconnect();
+        return;
+    }
+
+    AnTcpTopic topic = 0;
+    memcpy(&topic, data, sizeof(AnTcpTopic));
+    handler->SendDataVar(type, static_cast<unsigned char>(handler->Subscribe(topic)));
+}
+
+void AnTcpServer::UnsubscribeCallback(ClientHandler* handler, AnTcpMessageType type, const void* data, int size) noexcept
+{
+    if (size != sizeof(AnTcpTopic))
+    {
+        handler->Server->Metrics.RecordProtocolError();
+        handler->Disconnect();
+        return;
+    }
+
+    AnTcpTopic topic = 0;
+    memcpy(&topic, data, sizeof(AnTcpTopic));
+    handler->SendDataVar(type, static_cast<unsigned char>(handler->Unsubscribe(topic)));
+}
+
+ClientHandler::~ClientHandler()
+{
+    DEBUG_ONLY(std::cout << "[" << Id << "] " << "Deleting Handler: " << Id << std::endl);
+
+    Disconnect();
+
+    // publishers that still have the id find the slot free or reused
+    if (!Topics.empty())
+    {
+        Server->PubSub.RemoveSubscriber(Id, Topics);
+    }
+
+    Server->BufferPool.Release(LargePacket);
+    closesocket(Socket);
+    AnTcpCloseWakeup(Wakeup);
+
+    // the thread serving the rings held a reference, so it is gone
+    delete SharedMemory.load();
+    delete PendingSharedMemory;
+    delete OfferedSharedMemory;
+}
+
+void ClientHandler::Disconnect() noexcept
+{
+    if (IsActive.exchange(false))
+    {
+        if (Server->TrafficLog.IsEnabled())
+        {
+            Server->TrafficLog.RecordClose(Id);
+        }
+
+        if (Server->OnClientDisconnected)
+        {
+            Server->OnClientDisconnected(this);
+        }
+
+        shutdown(Socket, SD_BOTH);
+
+        // wakes up the thread serving the rings and tells the client we are gone
+        if (AnTcpSharedMemory* sharedMemory = SharedMemory.load())
+        {
+            sharedMemory->Close();
+        }
+    }
+}
+
+void ClientHandler::Release() noexcept
+{
+    if (References.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        Server->Connections.Remove(this);
+    }
+}
+
+void ClientHandler::FinishTask() noexcept
+{
+    Server->Admission.Leave();
+    FinishJob();
+    Release();
+}
+
+void ClientHandler::BeginFollow() noexcept
+{
+    Server->Admission.Hold();
+    PendingJobs++;
+    AddReference();
+}
+
+void ClientHandler::FinishFollow(AnTcpRequestId requestId, bool ordered, const AnTcpCachedResponses& responses) noexcept
+{
+    for (const AnTcpCachedResponse& response : responses)
+    {
+        SendResponse(requestId, response.Type, response.Data.data(), response.Data.size());
+    }
+
+    if (ordered)
+    {
+        bool resume = false;
+
+        {
+            std::lock_guard lock(StrandMutex);
+
+            if (StrandFollowing)
+            {
+                StrandFollowing = false;
+                resume = !Strand.empty();
+                StrandActive = resume;
+            }
+            else
+            {
+                // the strand did not stop yet, it goes on by itself
+                FollowerLanded = true;
+            }
+        }
+
+        if (resume)
+        {
+            ResumeStrand();
+        }
+    }
+
+    FinishTask();
+}
+
+bool ClientHandler::HoldStrand() noexcept
+{
+    std::lock_guard lock(StrandMutex);
+
+    if (FollowerLanded)
+    {
+        FollowerLanded = false;
+        return false;
+    }
+
+    StrandFollowing = true;
+    StrandActive = true;
+    return true;
+}
+
+void ClientHandler::FinishJob() noexcept
+{
+    if (PendingJobs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock(StrandMutex);
+
+        if (!StrandWaiting)
+        {
+            return;
+        }
+
+        StrandWaiting = false;
+    }
+
+    // the switch at the front of the strand waited for this job
+    ResumeStrand();
+}
+
+void ClientHandler::NotifyConnected() noexcept
+{
+    if (Server->OnClientConnected)
+    {
+        Server->OnClientConnected(this);
+    }
+}
+
+void ClientHandler::RecordResponse(AnTcpMessageType type, size_t bytes, bool sent) noexcept
+{
+    if (Server->Metrics.IsEnabled())
+    {
+        Server->Metrics.RecordResponse(type, bytes, sent);
+    }
+}
+
+void ClientHandler::LogResponse(AnTcpMessageType type, AnTcpRequestId requestId, const void* data, size_t size) noexcept
+{
+    if (Server->TrafficLog.IsLoggingResponses())
+    {
+        Server->TrafficLog.RecordResponse(Id, static_cast<uint8_t>(FrameVersion), type, FrameVersion >= ANTCP_FRAME_VERSION_2 ? requestId : 0, data, size);
+    }
+}
+
+AnTcpResponseWriter::AnTcpResponseWriter(ClientHandler* handler, AnTcpRequestId requestId, AnTcpMessageType type) noexcept
+    : Handler(handler),
+    Buffer(&handler->OutputBuffer),
+    Lock(handler->SendMutex, std::defer_lock),
+    Type(type),
+    RequestId(requestId),
+    Open(true),
+    Start(0),
+    HeaderSize(0)
+{
+    AnTcpBatch* batch = ClientHandler::CurrentBatch;
+
+    if (batch && batch->Handler == Handler && batch->RequestId == RequestId)
+    {
+        // responses of sub messages are framed without request id
+        Buffer = &batch->Responses;
+        Start = Buffer->size();
+        HeaderSize = sizeof(AnTcpSizeType) + sizeof(AnTcpMessageType);
+        Reserve(HeaderSize);
+        return;
+    }
+
+    Lock.lock();
+    Start = Buffer->size();
+
+    // the size is not known yet, the header gets patched on commit. The frame
+    // version can't change meanwhile, negotiating needs the send mutex too
+    char header[sizeof(AnTcpSizeType) + sizeof(AnTcpMessageType) + sizeof(AnTcpRequestId)];
+    HeaderSize = Handler->BuildHeader(header, Type, RequestId, 0);
+    Append(header, HeaderSize);
+}
+
+bool AnTcpResponseWriter::Commit() noexcept
+{
+    if (!Open)
+    {
+        return false;
+    }
+
+    std::vector<char>& buffer = *Buffer;
+    const size_t size = GetSize();
+    Open = false;
+
+    if (ClientHandler::CurrentCapture && ClientHandler::CurrentCapture->Handler == Handler && ClientHandler::CurrentCapture->RequestId == RequestId)
+    {
+        const char* payload = buffer.data() + Start + HeaderSize;
+        ClientHandler::CurrentCapture->Responses.push_back(AnTcpCachedResponse{ Type, std::vector<char>(payload, payload + size) });
+    }
+
+    if (!Lock.owns_lock())
+    {
+        // part of a batch, it is sent with the batch response
+        const AnTcpSizeType packetSize = static_cast<AnTcpSizeType>(size + sizeof(AnTcpMessageType));
+        memcpy(buffer.data() + Start, &packetSize, sizeof(AnTcpSizeType));
+        buffer[Start + sizeof(AnTcpSizeType)] = Type;
+        return true;
+    }
+
+    Handler->BuildHeader(buffer.data() + Start, Type, RequestId, size);
+    Handler->LogResponse(Type, RequestId, buffer.data() + Start + HeaderSize, size);
+    bool sent = true;
+
+    // same rules as SendResponse(), only the thread that processes the receive batch buffers
+    if (!Handler->Corked && ClientHandler::BatchingClient != Handler)
+    {
+        // responses a batch buffered in front of ours were sent earlier, so they go out with it
+        sent = Handler->FlushOutput();
+    }
+
+    Handler->RecordResponse(Type, HeaderSize + size, sent);
+    Lock.unlock();
+    return sent;
+}
+
+void AnTcpResponseWriter::Discard() noexcept
+{
+    if (Open)
+    {
+        Buffer->resize(Start);
+        Open = false;
+
+        if (Lock.owns_lock())
+        {
+            Lock.unlock();
+        }
+    }
+}
+
+bool ClientHandler::SendMetrics() noexcept
+{
+    std::vector<char> snapshot;
+    Server->Metrics.GetSnapshot().Serialize(snapshot);
+    return SendData(ANTCP_MESSAGE_METRICS, snapshot.data(), snapshot.size());
+}
+
+size_t ClientHandler::CountBatchMessages(const char* data, int size) noexcept
+{
+    size_t count = 0;
+    int offset = 0;
+
+    while (size - offset >= static_cast<int>(sizeof(AnTcpSizeType)))
+    {
+        AnTcpSizeType packetSize = 0;
+        memcpy(&packetSize, data + offset, sizeof(AnTcpSizeType));
+
+        if (packetSize < static_cast<AnTcpSizeType>(sizeof(AnTcpMessageType)) || packetSize > size - offset - static_cast<int>(sizeof(AnTcpSizeType)))
+        {
+            break;
+        }
+
+        offset += static_cast<int>(sizeof(AnTcpSizeType)) + packetSize;
+        count++;
+    }
+
+    return count;
+}
+
+bool ClientHandler::ProcessBatch(const char* data, int size) noexcept
+{
+    const AnTcpRequestId requestId = GetRequestId();
+    const bool recordMetrics = Server->Metrics.IsEnabled();
+
+    // the batch may run on a worker, where the receive time of the client is not ours to read
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // keeps its capacity, batches of a connection tend to have a similar size
+    static thread_local std::vector<char> responses;
+
+    AnTcpBatch batch{ this, requestId, std::move(responses) };
+    batch.Responses.clear();
+
+    AnTcpBatch* previousBatch = CurrentBatch;
+    CurrentBatch = &batch;
+
+    // all sub messages run with the same callbacks
+    const AnTcpCallbackRegistry::Reader callbacks = Server->Callbacks.Read();
+
+    bool valid = true;
+    int offset = 0;
+
+    while (offset < size)
+    {
+        AnTcpSizeType packetSize = 0;
+
+        if (size - offset < static_cast<int>(sizeof(AnTcpSizeType) + sizeof(AnTcpMessageType)))
+        {
+            valid = false;
+            break;
+        }
+
+        memcpy(&packetSize, data + offset, sizeof(AnTcpSizeType));
+
+        if (packetSize < static_cast<AnTcpSizeType>(sizeof(AnTcpMessageType)) || packetSize > size - offset - static_cast<int>(sizeof(AnTcpSizeType)))
+        {
+            valid = false;
+            break;
+        }
+
+        const AnTcpMessageType type = data[offset + sizeof(AnTcpSizeType)];
+        const char* payload = data + offset + sizeof(AnTcpSizeType) + sizeof(AnTcpMessageType);
+        const int payloadSize = packetSize - static_cast<int>(sizeof(AnTcpMessageType));
+        const AnTcpCallbackEntry& callback = callbacks[type];
+
+        // nested batches, other protocol messages and tasks, which may answer after the batch was sent, are not allowed
+        if (!callback || callback.Task || AnTcpIsReservedMessageType(type))
+        {
+            if (recordMetrics)
+            {
+                Server->Metrics.RecordUnknownType(type);
+            }
+
+            valid = false;
+            break;
+        }
+
+        if (recordMetrics)
+        {
+            Server->Metrics.RecordRequest(type, sizeof(AnTcpSizeType) + packetSize);
+        }
+
+        // the connection paid for the whole batch when it was received, the bucket belongs to the receiving thread
+        const AnTcpBusyReason busy = Server->Admission.IsEnabled() ? Server->Admission.CheckMessageRate(type, startTime) : AnTcpBusyReason::None;
+
+        // a rejected sub message gets its busy response in place of its responses
+        if (busy != AnTcpBusyReason::None)
+        {
+            SendBusy(requestId, type, busy);
+        }
+        else if (!callback.Options.Cacheable || !SendCachedResponses(type, requestId, payload, payloadSize))
+        {
+            ExecutePacket(callback, type, requestId, startTime, payload, payloadSize);
+        }
+
+        offset += static_cast<int>(sizeof(AnTcpSizeType)) + packetSize;
+    }
+
+    CurrentBatch = previousBatch;
+
+    // responses of the sub messages that ran before an invalid one are dropped with the connection
+    const bool sent = valid && SendResponse(requestId, ANTCP_MESSAGE_BATCH, batch.Responses.data(), batch.Responses.size());
+    responses = std::move(batch.Responses);
+    return valid && sent;
+}
+
+AnTcpSharedMemory* ClientHandler::CreateSharedMemory() noexcept
+{
+    if (!Server->ClientOptions.SharedMemory)
+    {
+        return nullptr;
+    }
+
+    AnTcpSharedMemory* sharedMemory = new AnTcpSharedMemory();
+
+    if (!sharedMemory->Create(Server->ClientOptions.SharedMemoryRingSize, std::chrono::microseconds(Server->ClientOptions.SharedMemorySpinTime)))
+    {
+        DEBUG_ONLY(std::cout << "[" << Id << "] " << "Failed to create shared memory, keeping the socket" << std::endl);
+        delete sharedMemory;
+        return nullptr;
+    }
+
+    return sharedMemory;
+}
+
+bool ClientHandler::OpenSharedMemory(AnTcpRequestId requestId) noexcept
+{
+    AnTcpSharedMemory* sharedMemory = std::exchange(OfferedSharedMemory, nullptr);
+
+    // the name goes out on the socket, together with everything that was buffered before it
+    const std::string name = sharedMemory ? sharedMemory->GetName() : std::string();
+    const bool sent = SendResponse(requestId, ANTCP_MESSAGE_SHARED_MEMORY, name.data(), name.size()) && Flush();
+
+    if (!sharedMemory || !sent)
+    {
+        delete sharedMemory;
+        return sent;
+    }
+
+    DEBUG_ONLY(std::cout << "[" << Id << "] " << "Moved to shared memory " << name << std::endl);
+
+    {
+        std::lock_guard lock(SendMutex);
+
+        if (SendPending)
+        {
+            // the socket still sends the name, responses written to the rings before would overtake it
+            PendingSharedMemory = sharedMemory;
+            return true;
+        }
+    }
+
+    StartSharedMemory(sharedMemory);
+    return true;
+}
+
+void ClientHandler::StartSharedMemory(AnTcpSharedMemory* sharedMemory) noexcept
+{
+    {
+        std::lock_guard lock(SendMutex);
+        SharedMemory = sharedMemory;
+    }
+
+    // the thread holds a reference like a pooled job, a disconnect closes the rings and wakes it up
+    AddReference();
+    std::thread(&ClientHandler::ServeSharedMemory, this).detach();
+}
+
+void ClientHandler::ServeSharedMemory() noexcept
+{
+    while (IsActive && ReceiveSharedMemory())
+    {
+    }
+
+    Disconnect();
+    Release();
+}
+
+bool ClientHandler::ReceiveSharedMemory() noexcept
+{
+    AnTcpSharedRing& requests = SharedMemory.load()->GetRequests();
+
+    if (!requests.WaitForReadable(1))
+    {
+        // closed by the client or by Disconnect()
+        return false;
+    }
+
+    ReceiveTime = std::chrono::steady_clock::now();
+    const BatchingScope batching(Server->ClientOptions.BatchResponses ? this : nullptr);
+
+    while (requests.GetReadable() > 0)
+    {
+        AnTcpSizeType packetSize = 0;
+        const char* frame = nullptr;
+
+        if (requests.GetReadable() >= sizeof(AnTcpSizeType))
+        {
+            requests.Copy(&packetSize, sizeof(AnTcpSizeType));
+            frame = requests.Peek(sizeof(AnTcpSizeType) + std::max<AnTcpSizeType>(packetSize, 0));
+        }
+
+        if (!frame)
+        {
+            // the frame wraps around the end of the ring or is still being written
+            if (!requests.Read(&packetSize, sizeof(AnTcpSizeType)))
+            {
+                return false;
+            }
+        }
+
+        if (packetSize < GetFrameHeaderSize(ReceiveFrameVersion) || packetSize > Server->ClientOptions.MaxPacketSize)
+        {
+            Server->Metrics.RecordProtocolError();
+            DEBUG_ONLY(std::cout << "[" << Id << "] " << "Invalid packet size (" << std::to_string(packetSize)
+                << "/" << Server->ClientOptions.MaxPacketSize << "), disconnecting client..." << std::endl);
+            return false;
+        }
+
+        if (frame)
+        {
+            // the client does not touch the frame before we consumed it, so it is processed in place
+            const bool processed = ProcessPacket(frame + sizeof(AnTcpSizeType), packetSize);
+            requests.Consume(sizeof(AnTcpSizeType) + packetSize);
+
+            if (!processed)
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        AnTcpPooledBuffer packet = Server->BufferPool.Acquire(packetSize);
+        const bool processed = packet.Data && requests.Read(packet.Data, packetSize) && ProcessPacket(packet.Data, packetSize);
+        Server->BufferPool.Release(packet);
+
+        if (!processed)
+        {
+            return false;
+        }
+    }
+
+    return Corked || Flush();
+}
+
+void ClientHandler::Listen() noexcept
+{
+    // without the wakeup a send that another thread left pending would never finish, same as running out of sockets on accept
+    if (Wakeup[0] == INVALID_SOCKET)
+    {
+        DEBUG_ONLY(std::cout << "[" << Id << "] " << "Failed to create wakeup" << std::endl);
+        Disconnect();
+        Release();
+        return;
+    }
+
+    AnTcpIoThreadCounters* counters = Server->ClientThreadCounters;
+
+    if (counters)
+    {
+        counters->AddThread(Server->GetIoThreadCore(static_cast<size_t>(Id)));
+    }
+
+    NotifyConnected();
+
+    // added to the server when the thread exits
+    AnTcpReceiveStats receiveStats{};
+
+    while (!Server->ShouldExit)
+    {
+        std::chrono::steady_clock::time_point workStart{};
+
+        // other threads only leave a send pending while they have work of this client, a finished job
+        // decrements the jobs after its send. Without them the blocking recv() is the only syscall per read
+        const bool otherSenders = HasOtherSenders();
+        bool sendPending = false;
+
+        {
+            std::lock_guard lock(SendMutex);
+            sendPending = SendPending;
+        }
+
+        if (!sendPending && !otherSenders)
+        {
+            if (counters)
+            {
+                // poll() without timeout returns right away, the blocking recv() only runs once there is data or a hangup
+                AnTcpPollFd pollFd{ Socket, POLLIN, 0 };
+                workStart = counters->Wait(std::chrono::microseconds(Server->LowLatency.SpinTime),
+                    [&pollFd, &receiveStats]() { ++receiveStats.Waits; return AnTcpPoll(&pollFd, 1, 0) != 0; },
+                    [&pollFd, &receiveStats]() { ++receiveStats.Waits; AnTcpPoll(&pollFd, 1, -1); });
+            }
+
+            ++receiveStats.Receives;
+
+            if (!Receive())
+            {
+                break;
+            }
+        }
+        else
+        {
+            // the socket is watched for space while a send is pending, the wakeup tells us about
+            // one that a worker or a publisher left pending meanwhile, see AwaitWritable()
+            AnTcpPollFd pollFds[2]{ { Socket, static_cast<short>(sendPending ? POLLIN | POLLOUT : POLLIN), 0 }, { Wakeup[0], POLLIN, 0 } };
+
+            if (counters)
+            {
+                workStart = counters->Wait(std::chrono::microseconds(Server->LowLatency.SpinTime),
+                    [&pollFds, &receiveStats]() { ++receiveStats.Waits; return AnTcpPoll(pollFds, 2, 0) != 0; },
+                    [&pollFds, &receiveStats]() { ++receiveStats.Waits; AnTcpPoll(pollFds, 2, -1); });
+            }
+            else
+            {
+                ++receiveStats.Waits;
+
+                if (AnTcpPoll(pollFds, 2, -1) == SOCKET_ERROR)
+                {
+                    // interrupted by a signal
+                    continue;
+                }
+            }
+
+            while (pollFds[1].revents && AnTcpConsumeWake(Wakeup[0]))
+            {
+            }
+
+            if ((pollFds[0].revents & POLLOUT) && ContinueSend() == AnTcpSendResult::Failed)
+            {
+                break;
+            }
+
+            if (pollFds[0].revents & ~POLLOUT)
+            {
+                ++receiveStats.Receives;
+
+                if (!Receive())
+                {
+                    break;
+                }
+            }
+        }
+
+        if (counters)
+        {
+            counters->AddWork(workStart);
+        }
+    }
+
+    Server->ReceiveCounters.Add(receiveStats);
+    Disconnect();
+
+    // the thread owns the handler, nothing may touch it after this
+    Release();
+}
+
+bool ClientHandler::HasOtherSenders() noexcept
+{
+    if (PendingJobs.load(std::memory_order_acquire) > 0)
+    {
+        return true;
+    }
+
+    std::lock_guard lock(PushMutex);
+    return !Topics.empty() || PushDraining || !PushQueue.empty();
+}
+
+bool ClientHandler::Receive() noexcept
+{
+    if (LargePacket.Data)
+    {
+        return ReceiveLargePacket();
+    }
+
+    const auto receivedBytes = recv(Socket, ReceiveBuffer + ReceiveEnd, static_cast<int>(sizeof(ReceiveBuffer) - ReceiveEnd), 0);
+
+    // if we received 0 or -1 bytes, we're going to disconnect the client, unless
+    // the non-blocking socket just has no data for us right now
+    if (receivedBytes <= 0)
+    {
+        return receivedBytes < 0 && AnTcpWouldBlock();
+    }
+
+    ReceiveEnd += static_cast<size_t>(receivedBytes);
+    ReceiveTime = std::chrono::steady_clock::now();
+
+    DEBUG_ONLY(std::cout << "[" << Id << "] " << "Received " << std::to_string(receivedBytes) + " bytes" << std::endl);
+
+    // responses of all packets in this batch are sent together
+    const BatchingScope batching(Server->ClientOptions.BatchResponses ? this : nullptr);
+
+    size_t processedBytes = 0;
+
+    if (!ProcessPackets(ReceiveBuffer, ReceiveEnd, processedBytes))
+    {
+        return false;
+    }
+
+    // move the incomplete packet to the front, it is smaller than a packet so this is cheap
+    ReceiveEnd -= processedBytes;
+    memmove(ReceiveBuffer, ReceiveBuffer + processedBytes, ReceiveEnd);
+    return Corked || Flush();
+}
+
+bool ClientHandler::ReceiveLargePacket() noexcept
+{
+    // only receive the missing bytes, the next packet goes into the receive buffer again
+    const auto receivedBytes = recv(Socket, LargePacket.Data + LargePacketOffset, LargePacketSize - LargePacketOffset, 0);
+
+    if (receivedBytes <= 0)
+    {
+        return receivedBytes < 0 && AnTcpWouldBlock();
+    }
+
+    LargePacketOffset += static_cast<AnTcpSizeType>(receivedBytes);
+    ReceiveTime = std::chrono::steady_clock::now();
+
+    DEBUG_ONLY(std::cout << "[" << Id << "] " << "Large Packet Chunk: " << std::to_string(receivedBytes) << " bytes ("
+        << std::to_string(LargePacketOffset) << "/" << std::to_string(LargePacketSize) << ")" << std::endl);
+
+    if (LargePacketOffset < LargePacketSize)
+    {
+        return true;
+    }
+
+    const BatchingScope batching(Server->ClientOptions.BatchResponses ? this : nullptr);
+    return ProcessLargePacket() && (Corked || Flush());
+}
+
+bool ClientHandler::WriteSocket(AnTcpIoVec* buffers, size_t count) noexcept
+{
+    size_t sentBytes = 0;
+    const AnTcpSendResult result = AnTcpTrySendVector(Socket, buffers, count, sentBytes);
+
+    if (result != AnTcpSendResult::WouldBlock)
+    {
+        return result == AnTcpSendResult::Sent;
+    }
+
+    // the buffers only live during the call, so the rest is copied
+    for (size_t i = 0; i < count; ++i)
+    {
+#ifdef _WIN32
+        SendBuffer.insert(SendBuffer.end(), buffers[i].buf, buffers[i].buf + buffers[i].len);
+#else
+        SendBuffer.insert(SendBuffer.end(), static_cast<const char*>(buffers[i].iov_base), static_cast<const char*>(buffers[i].iov_base) + buffers[i].iov_len);
+#endif
+    }
+
+    SendOffset = 0;
+    SendPending = true;
+    AwaitWritable();
+    return true;
+}
+
+void ClientHandler::AwaitWritable() noexcept
+{
+    if (EventLoop)
+    {
+        EventLoop->WatchWritable(this, true);
+    }
+    else if (IoUring)
+    {
+        IoUring->ResumeSend(this);
+    }
+    else
+    {
+        AnTcpWake(Wakeup[1]);
+    }
+}
+
+AnTcpSendResult ClientHandler::ContinueSend() noexcept
+{
+    AnTcpSharedMemory* sharedMemory = nullptr;
+
+    {
+        std::lock_guard lock(SendMutex);
+
+        while (SendPending)
+        {
+            AnTcpIoVec buffer = AnTcpMakeIoVec(SendBuffer.data() + SendOffset, SendBuffer.size() - SendOffset);
+            AnTcpIoVec* buffers = &buffer;
+            size_t count = SendOffset < SendBuffer.size() ? 1 : 0;
+            size_t sentBytes = 0;
+
+            const AnTcpSendResult result = AnTcpTrySendVector(Socket, buffers, count, sentBytes);
+            SendOffset += sentBytes;
+
+            if (result != AnTcpSendResult::Sent)
+            {
+                return result;
+            }
+
+            SendBuffer.clear();
+            SendOffset = 0;
+
+            if (!OutputBuffer.empty() && !Corked)
+            {
+                // responses that were buffered while the socket was full
+                std::swap(SendBuffer, OutputBuffer);
+                HeldPushFrames = 0;
+                continue;
+            }
+
+            SendPending = false;
+            sharedMemory = std::exchange(PendingSharedMemory, nullptr);
+
+            // under the send mutex, so a send that gets pending meanwhile can't be overtaken by this
+            if (EventLoop)
+            {
+                EventLoop->WatchWritable(this, false);
+            }
+        }
+    }
+
+    if (sharedMemory)
+    {
+        // the segment name is out, the rings take over
+        StartSharedMemory(sharedMemory);
+    }
+
+    ResumePushQueue();
+    return AnTcpSendResult::Sent;
+}
+
+bool ClientHandler::ProcessReceived(const char* data, size_t size) noexcept
+{
+    ReceiveTime = std::chrono::steady_clock::now();
+
+    // the io_uring backend sends the responses of a receive batch with its next submission
+    const BatchingScope batching(this);
+
+    while (size > 0)
+    {
+        size_t processedBytes = 0;
+
+        if (LargePacket.Data)
+        {
+            processedBytes = std::min(size, static_cast<size_t>(LargePacketSize - LargePacketOffset));
+            memcpy(LargePacket.Data + LargePacketOffset, data, processedBytes);
+            LargePacketOffset += static_cast<AnTcpSizeType>(processedBytes);
+
+            if (LargePacketOffset == LargePacketSize && !ProcessLargePacket())
+            {
+                return false;
+            }
+        }
+        else if (ReceiveEnd == 0)
+        {
+            // nothing is buffered, so the packets are processed right in the buffer of the kernel
+            if (!ProcessPackets(data, size, processedBytes))
+            {
+                return false;
+            }
+
+            if (!LargePacket.Data && processedBytes < size)
+            {
+                // keep the incomplete packet, it is smaller than the receive buffer
+                memcpy(ReceiveBuffer, data + processedBytes, size - processedBytes);
+                ReceiveEnd = size - processedBytes;
+                processedBytes = size;
+            }
+        }
+        else
+        {
+            // complete the buffered packet, then continue in the buffer of the kernel
+            processedBytes = std::min(size, sizeof(ReceiveBuffer) - ReceiveEnd);
+            memcpy(ReceiveBuffer + ReceiveEnd, data, processedBytes);
+            ReceiveEnd += processedBytes;
+
+            size_t bufferedBytes = 0;
+
+            if (!ProcessPackets(ReceiveBuffer, ReceiveEnd, bufferedBytes))
+            {
+                return false;
+            }
+
+            ReceiveEnd -= bufferedBytes;
+            memmove(ReceiveBuffer, ReceiveBuffer + bufferedBytes, ReceiveEnd);
+        }
+
+        data += processedBytes;
+        size -= processedBytes;
+    }
+
+    return true;
+}
+
+bool ClientHandler::ProcessPackets(const char* data, size_t size, size_t& processedBytes) noexcept
+{
+    processedBytes = 0;
+
+    // process every complete packet in the buffer
+    while (size - processedBytes >= sizeof(AnTcpSizeType))
+    {
+        if (MovingToSharedMemory)
+        {
+            // the client moved to shared memory, requests on the socket would be answered in the ring
+            Server->Metrics.RecordProtocolError();
+            return false;
+        }
+
+        const char* packet = data + processedBytes;
+        const size_t available = size - processedBytes - sizeof(AnTcpSizeType);
+
+        AnTcpSizeType packetSize = 0;
+        memcpy(&packetSize, packet, sizeof(AnTcpSizeType));
+
+        if (packetSize < GetFrameHeaderSize(ReceiveFrameVersion) || packetSize > Server->ClientOptions.MaxPacketSize)
+        {
+            // packet is too big or too small, this may be a wrong/malicious payload
+            Server->Metrics.RecordProtocolError();
+            DEBUG_ONLY(std::cout << "[" << Id << "] " << "Invalid packet size (" << std::to_string(packetSize)
+                << "/" << Server->ClientOptions.MaxPacketSize << "), disconnecting client..." << std::endl);
+            return false;
+        }
+
+        if (sizeof(AnTcpSizeType) + packetSize > sizeof(ReceiveBuffer))
+        {
+            // packet does not fit into the receive buffer, everything after its size belongs to it
+            LargePacket = Server->BufferPool.Acquire(packetSize);
+
+            if (!LargePacket.Data)
+            {
+                DEBUG_ONLY(std::cout << "[" << Id << "] " << "Failed to get a buffer for " << std::to_string(packetSize)
+                    << " bytes, disconnecting client..." << std::endl);
+                return false;
+            }
+
+            LargePacketSize = packetSize;
+            LargePacketOffset = static_cast<AnTcpSizeType>(std::min(available, static_cast<size_t>(packetSize)));
+            memcpy(LargePacket.Data, packet + sizeof(AnTcpSizeType), LargePacketOffset);
+            processedBytes += sizeof(AnTcpSizeType) + LargePacketOffset;
+
+            // only a buffer bigger than the receive buffer can hold all of it
+            if (LargePacketOffset < LargePacketSize)
+            {
+                break;
+            }
+
+            if (!ProcessLargePacket())
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        if (available < static_cast<size_t>(packetSize))
+        {
+            DEBUG_ONLY(std::cout << "[" << Id << "] " << "Packet Chunk: " << std::to_string(available + sizeof(AnTcpSizeType)) << " bytes ("
+                << std::to_string(sizeof(AnTcpSizeType) + packetSize) << " total)" << std::endl);
+            break;
+        }
+
+        if (!ProcessPacket(packet + sizeof(AnTcpSizeType), packetSize))
+        {
+            // processing the packet failed, disconnect client
+            return false;
+        }
+
+        processedBytes += sizeof(AnTcpSizeType) + packetSize;
+    }
+
+    return true;
+}
+
+bool ClientHandler::ProcessLargePacket() noexcept
+{
+    const bool processed = ProcessPacket(LargePacket.Data, LargePacketSize);
+
+    Server->BufferPool.Release(LargePacket);
+    LargePacketSize = 0;
+    LargePacketOffset = 0;
+
+    return processed;
+}
+
+bool ClientHandler::Negotiate(AnTcpRequestId requestId, int version) noexcept
+{
+    DEBUG_ONLY(std::cout << "[" << Id << "] " << "Negotiated frame version " << std::to_string(version) << std::endl);
+
+    const bool sent = SendResponse(requestId, ANTCP_MESSAGE_NEGOTIATE, &version, sizeof(int));
+
+    {
+        std::lock_guard lock(SendMutex);
+        FrameVersion = version;
+    }
+
+    return sent;
+}
+
+bool ClientHandler::ProcessSwitch(AnTcpMessageType type, AnTcpRequestId requestId, const char* data, int size) noexcept
+{
+    if (type == ANTCP_MESSAGE_NEGOTIATE)
+    {
+        if (size != sizeof(int))
+        {
+            return false;
+        }
+
+        int version = 0;
+        memcpy(&version, data, sizeof(int));
+
+        // the packets behind the negotiation are framed in the new version, whenever it gets answered
+        ReceiveFrameVersion = std::clamp(version, ANTCP_FRAME_VERSION_1, ANTCP_FRAME_VERSION_MAX);
+    }
+    else if (type == ANTCP_MESSAGE_SHARED_MEMORY)
+    {
+        // a client that already uses the rings can't move again
+        if (size != 0 || MovingToSharedMemory)
+        {
+            return false;
+        }
+
+        // created right away, the client must not send anything else on the socket once it asked for rings it gets
+        OfferedSharedMemory = CreateSharedMemory();
+        MovingToSharedMemory = OfferedSharedMemory != nullptr;
+    }
+
+    // responses buffered so far belong to earlier requests and have to go out first
+    if (BatchingClient == this && !Corked)
+    {
+        Flush();
+    }
+
+    {
+        std::lock_guard lock(StrandMutex);
+
+        // the responses of the packets in flight are framed in the old version, so the switch waits
+        // for them, and everything the client sends after it waits for the switch
+        if (StrandActive || PendingJobs > 0)
+        {
+            Strand.push_back(AnTcpPacket{ type, requestId, ReceiveTime, std::vector<char>(data, data + size) });
+            DeferredSwitches++;
+
+            if (!StrandActive)
+            {
+                StrandActive = true;
+                StrandWaiting = true;
+            }
+
+            return true;
+        }
+    }
+
+    return ExecuteSwitch(type, requestId, data, size);
+}
+
+bool ClientHandler::ExecuteSwitch(AnTcpMessageType type, AnTcpRequestId requestId, const char* data, int) noexcept
+{
+    if (type == ANTCP_MESSAGE_NEGOTIATE)
+    {
+        int version = 0;
+        memcpy(&version, data, sizeof(int));
+        return Negotiate(requestId, std::clamp(version, ANTCP_FRAME_VERSION_1, ANTCP_FRAME_VERSION_MAX));
+    }
+
+    if (type == ANTCP_MESSAGE_SHARED_MEMORY)
+    {
+        return OpenSharedMemory(requestId);
+    }
+
+    return false;
+}
+
+bool ClientHandler::ProcessPacket(const char* data, AnTcpSizeType size) noexcept
+{
+    const AnTcpMessageType msgType = *reinterpret_cast<const AnTcpMessageType*>(data);
+    const AnTcpSizeType frameHeaderSize = GetFrameHeaderSize(ReceiveFrameVersion);
+    const char* payload = data + frameHeaderSize;
+    const int payloadSize = size - frameHeaderSize;
+
+    AnTcpRequestId requestId = 0;
+
+    if (ReceiveFrameVersion >= ANTCP_FRAME_VERSION_2)
+    {
+        memcpy(&requestId, data + sizeof(AnTcpMessageType), sizeof(AnTcpRequestId));
+    }
+
+    const bool recordMetrics = Server->Metrics.IsEnabled();
+
+    if (recordMetrics)
+    {
+        Server->Metrics.RecordRequest(msgType, sizeof(AnTcpSizeType) + size);
+    }
+
+    if (Server->TrafficLog.IsEnabled())
+    {
+        Server->TrafficLog.RecordRequest(Id, static_cast<uint8_t>(ReceiveFrameVersion), data, static_cast<size_t>(size));
+    }
+
+    if (IsSwitch(msgType))
+    {
+        return ProcessSwitch(msgType, requestId, payload, payloadSize);
+    }
+
+    // the version stays alive until the packet was dispatched, even when the callbacks are changed meanwhile
+    const AnTcpCallbackRegistry::Reader callbacks = Server->Callbacks.Read();
+    const AnTcpCallbackEntry& callback = callbacks[msgType];
+
+    if (!callback)
+    {
+        if (recordMetrics)
+        {
+            Server->Metrics.RecordUnknownType(msgType);
+        }
+
+        DEBUG_ONLY(std::cout << "[" << Id << "] " << "\"" << std::to_string(msgType)
+            << "\" is an unknown message type..." << std::endl);
+
+        return false;
+    }
+
+    // requests over a limit are answered right away instead of queueing up behind the others
+    const AnTcpBusyReason busy = Server->Admission.IsEnabled() ? AdmitPacket(msgType, payload, payloadSize) : AnTcpBusyReason::None;
+
+    if (ReceiveFrameVersion < ANTCP_FRAME_VERSION_2 || DeferredSwitches > 0)
+    {
+        std::lock_guard lock(StrandMutex);
+
+        if (StrandActive)
+        {
+            // the client matches responses by their order, so everything waits for the pooled packets or the switch in front of it
+            Strand.push_back(busy == AnTcpBusyReason::None ? AnTcpPacket{ msgType, requestId, ReceiveTime, std::vector<char>(payload, payload + payloadSize) }
+                : AnTcpPacket{ msgType, requestId, ReceiveTime, {}, busy });
+            return true;
+        }
+    }
+
+    if (busy != AnTcpBusyReason::None)
+    {
+        SendBusy(requestId, msgType, busy);
+        return true;
+    }
+
+    // hits are answered right here, even for pooled callbacks
+    if (callback.Options.Cacheable && SendCachedResponses(msgType, requestId, payload, payloadSize))
+    {
+        Server->Admission.Leave();
+        return true;
+    }
+
+    if (callback.Options.Dispatch == AnTcpDispatchMode::Pooled && Server->WorkerPool.IsRunning())
+    {
+        SubmitPacket(msgType, requestId, payload, payloadSize);
+        return true;
+    }
+
+    const bool done = ExecutePacket(callback, msgType, requestId, ReceiveTime, payload, payloadSize);
+    Server->Admission.Leave();
+
+    if (!done)
+    {
+        HoldStrand();
+    }
+
+    return true;
+}
+
+AnTcpBusyReason ClientHandler::AdmitPacket(AnTcpMessageType type, const char* data, int size) noexcept
+{
+    // protocol messages don't count against the rate limits, the sub messages of a batch do
+    if (type == ANTCP_MESSAGE_BATCH)
+    {
+        if (!Server->Admission.CheckConnectionRate(RateBucket, ReceiveTime, CountBatchMessages(data, size)))
+        {
+            return AnTcpBusyReason::ConnectionRate;
+        }
+    }
+    else if (!AnTcpIsReservedMessageType(type))
+    {
+        const AnTcpBusyReason reason = Server->Admission.CheckRate(RateBucket, type, ReceiveTime);
+
+        if (reason != AnTcpBusyReason::None)
+        {
+            return reason;
+        }
+    }
+
+    return Server->Admission.Enter() ? AnTcpBusyReason::None : AnTcpBusyReason::InFlight;
+}
+
+bool ClientHandler::SendBusy(AnTcpRequestId requestId, AnTcpMessageType type, AnTcpBusyReason reason) noexcept
+{
+    Server->Admission.RecordRejected();
+
+    const AnTcpBusyResponse response{ type, reason };
+    return SendResponse(requestId, ANTCP_MESSAGE_BUSY, &response, sizeof(response));
+}
+
+bool ClientHandler::SendTimeout(AnTcpRequestId requestId, AnTcpMessageType type) noexcept
+{
+    Server->Admission.RecordTimedOut();
+    return SendResponse(requestId, ANTCP_MESSAGE_TIMEOUT, &type, sizeof(type));
+}
+
+bool ClientHandler::SendCachedResponses(AnTcpMessageType type, AnTcpRequestId requestId, const char* data, int size) noexcept
+{
+    if (!Server->ResponseCache.IsEnabled())
+    {
+        return false;
+    }
+
+    const std::shared_ptr<const AnTcpCachedResponses> responses = Server->ResponseCache.Find(type, data, size);
+
+    if (!responses)
+    {
+        return false;
+    }
+
+    for (const AnTcpCachedResponse& response : *responses)
+    {
+        SendResponse(requestId, response.Type, response.Data.data(), response.Data.size());
+    }
+
+    return true;
+}
+
+bool ClientHandler::ExecutePacket(const AnTcpCallbackEntry& callback, AnTcpMessageType type, AnTcpRequestId requestId, std::chrono::steady_clock::time_point receiveTime, const char* data, int size) noexcept
+{
+    const bool recordMetrics = Server->Metrics.IsEnabled();
+    const auto start = recordMetrics || callback.Options.Deadline != 0 ? std::chrono::steady_clock::now() : receiveTime;
+
+    // the client gave up on requests that waited this long, their turn is better spent on fresh ones
+    if (callback.Options.Deadline != 0 && start - receiveTime > std::chrono::milliseconds(callback.Options.Deadline))
+    {
+        SendTimeout(requestId, type);
+        return true;
+    }
+
+    std::shared_ptr<AnTcpFlight> flight;
+
+    // sub messages of a batch run the callback themselves, their responses are sent together with the batch
+    const bool singleFlight = callback.Options.SingleFlight && !(CurrentBatch && CurrentBatch->Handler == this);
+
+    // clients without request ids match responses by their order, later requests must not overtake this one
+    const bool ordered = FrameVersion < ANTCP_FRAME_VERSION_2;
+
+    if (singleFlight && ordered && BatchingClient == this && !Corked)
+    {
+        // the leader may send our responses right away, the ones buffered so far have to go out first
+        Flush();
+    }
+
+    bool following = false;
+
+    if (singleFlight && !Server->SingleFlight.Join(type, data, size, this, requestId, ordered, flight))
+    {
+        // an identical request is running, its leader sends us the responses and finishes the request
+        following = true;
+    }
+    else
+    {
+        // remember the request, responses sent by the callback carry its id
+        const AnTcpRequest previousRequest = CurrentRequest;
+        CurrentRequest = AnTcpRequest{ this, requestId };
+
+        // record the responses of cacheable callbacks, so the next request with this payload skips the callback
+        const bool cacheResponses = callback.Options.Cacheable && Server->ResponseCache.IsEnabled();
+        AnTcpResponseCapture capture{ this, requestId, {} };
+        AnTcpResponseCapture* previousCapture = CurrentCapture;
+        CurrentCapture = cacheResponses || flight ? &capture : nullptr;
+
+        // fire the callback with the raw data, tasks only run until they suspend the first time
+        if (callback.Task)
+        {
+            StartTask(callback.Task, type, requestId, data, size);
+        }
+        else
+        {
+            callback(this, type, data, size);
+        }
+
+        CurrentRequest = previousRequest;
+        CurrentCapture = previousCapture;
+
+        if (cacheResponses || flight)
+        {
+            std::shared_ptr<const AnTcpCachedResponses> responses = std::make_shared<const AnTcpCachedResponses>(std::move(capture.Responses));
+
+            // cached before landing, so requests arriving after the flight hit the cache
+            if (cacheResponses)
+            {
+                Server->ResponseCache.Insert(type, data, size, responses, std::chrono::milliseconds(callback.Options.CacheTtl));
+            }
+
+            if (flight)
+            {
+                for (const AnTcpFlightWaiter& flightWaiter : Server->SingleFlight.Land(flight))
+                {
+                    flightWaiter.Handler->FinishFollow(flightWaiter.RequestId, flightWaiter.Ordered, *responses);
+                }
+            }
+        }
+    }
+
+    if (recordMetrics)
+    {
+        const auto end = std::chrono::steady_clock::now();
+        const auto queueWait = std::chrono::duration_cast<std::chrono::nanoseconds>(start - receiveTime).count();
+        const auto handlerTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        Server->Metrics.RecordExecution(type, static_cast<uint64_t>(std::max<long long>(0, queueWait)), static_cast<uint64_t>(handlerTime));
+    }
+
+    return !following || !ordered;
+}
+
+void ClientHandler::StartTask(AnTcpTaskFunction task, AnTcpMessageType type, AnTcpRequestId requestId, const char* data, int size) noexcept
+{
+    // the receive buffer gets reused, so the task gets its own copy of the payload. Tasks are
+    // created suspended, the pointer stays valid when the copy is moved into the task
+    std::vector<char> payload(data, data + size);
+    AnTcpTask coroutine = task(this, type, payload.data(), size);
+
+    // the request is in flight until the task finished, not only until it suspended, and a switch waits for it
+    Server->Admission.Hold();
+    PendingJobs++;
+    coroutine.Start(this, requestId, std::move(payload));
+}
+
+void ClientHandler::SubmitPacket(AnTcpMessageType type, AnTcpRequestId requestId, const char* data, int size) noexcept
+{
+    // the receive buffer gets reused, so the job needs its own copy of the payload
+    AnTcpPacket packet{ type, requestId, ReceiveTime, std::vector<char>(data, data + size) };
+    const AnTcpPriority priority = Server->Callbacks.Read()[type].Options.Priority;
+
+    if (ReceiveFrameVersion < ANTCP_FRAME_VERSION_2)
+    {
+        // responses buffered so far belong to earlier requests and have to go out first
+        if (BatchingClient == this && !Corked)
+        {
+            Flush();
+        }
+
+        {
+            std::lock_guard lock(StrandMutex);
+            Strand.push_back(std::move(packet));
+            StrandActive = true;
+        }
+
+        SubmitStrand(priority);
+        return;
+    }
+
+    // the job keeps the handler alive, even when the client disconnects meanwhile
+    AddReference();
+    PendingJobs++;
+
+    // requests carry ids, so the responses may go out in any order
+    Server->WorkerPool.Submit([this, packet = std::move(packet)]()
+    {
+        // the callback may have been replaced or removed while the packet was queued
+        const AnTcpCallbackRegistry::Reader callbacks = Server->Callbacks.Read();
+        const AnTcpCallbackEntry& callback = callbacks[packet.Type];
+
+        if (callback)
+        {
+            ExecutePacket(callback, packet.Type, packet.RequestId, packet.ReceiveTime, packet.Payload.data(), static_cast<int>(packet.Payload.size()));
+        }
+
+        Server->Admission.Leave();
+        FinishJob();
+        Release();
+    }, priority);
+}
+
+void ClientHandler::SubmitStrand(AnTcpPriority priority) noexcept
+{
+    // the job keeps the handler alive, even when the client disconnects meanwhile
+    AddReference();
+    PendingJobs++;
+
+    // the strand runs in the lane of its first packet, the packets queued behind it have to wait anyway
+    Server->WorkerPool.Submit([this]()
+    {
+        RunStrand();
+        FinishJob();
+        Release();
+    }, priority);
+}
+
+void ClientHandler::ResumeStrand() noexcept
+{
+    // the strand already waited for a switch, which is a protocol message, or for a flight, it should not wait behind anything
+    if (Server->WorkerPool.IsRunning())
+    {
+        SubmitStrand(AnTcpPriority::High);
+        return;
+    }
+
+    AddReference();
+    PendingJobs++;
+    RunStrand();
+    FinishJob();
+    Release();
+}
+
+void ClientHandler::RunStrand() noexcept
+{
+    AnTcpPacket packet;
+    bool first = true;
+
+    while (true)
+    {
+        // every packet runs with the callbacks of the moment it reached the front of the strand
+        const AnTcpCallbackRegistry::Reader callbacks = Server->Callbacks.Read();
+
+        {
+            std::lock_guard lock(StrandMutex);
+
+            if (Strand.empty())
+            {
+                // the next pooled packet starts a new job
+                StrandActive = false;
+                return;
+            }
+
+            if (IsSwitch(Strand.front().Type))
+            {
+                // the responses of the other jobs and tasks in flight have to go out before, the last one resumes us
+                if (PendingJobs > 1)
+                {
+                    StrandWaiting = true;
+                    return;
+                }
+            }
+            else
+            {
+                // a strand of bulk requests steps aside between its packets when more urgent jobs are waiting,
+                // it stays active, so new packets still queue up behind the ones it left
+                const AnTcpPriority priority = callbacks[Strand.front().Type].Options.Priority;
+
+                if (!first && Server->WorkerPool.HasJobsAbove(priority))
+                {
+                    SubmitStrand(priority);
+                    return;
+                }
+            }
+
+            packet = std::move(Strand.front());
+            Strand.pop_front();
+            first = false;
+        }
+
+        if (IsSwitch(packet.Type))
+        {
+            if (!ExecuteSwitch(packet.Type, packet.RequestId, packet.Payload.data(), static_cast<int>(packet.Payload.size())))
+            {
+                Disconnect();
+            }
+
+            DeferredSwitches--;
+            continue;
+        }
+
+        if (packet.Busy != AnTcpBusyReason::None)
+        {
+            SendBusy(packet.RequestId, packet.Type, packet.Busy);
+            continue;
+        }
+
+        const AnTcpCallbackEntry& callback = callbacks[packet.Type];
+        const bool done = !callback || ExecutePacket(callback, packet.Type, packet.RequestId, packet.ReceiveTime, packet.Payload.data(), static_cast<int>(packet.Payload.size()));
+
+        Server->Admission.Leave();
+
+        if (!done && HoldStrand())
+        {
+            // stays active, the leader of the flight resumes us after it sent the responses
+            return;
+        }
+    }
+}
+
+bool ClientHandler::Subscribe(AnTcpTopic topic) noexcept
+{
+    std::lock_guard lock(PushMutex);
+
+    if (Topics.size() >= ANTCP_MAX_CLIENT_TOPICS || !Server->PubSub.Subscribe(topic, Id))
+    {
+        return false;
+    }
+
+    Topics.push_back(topic);
+    return true;
+}
+
+bool ClientHandler::Unsubscribe(AnTcpTopic topic) noexcept
+{
+    std::lock_guard lock(PushMutex);
+    const auto entry = std::find(Topics.begin(), Topics.end(), topic);
+
+    if (entry == Topics.end())
+    {
+        return false;
+    }
+
+    Topics.erase(entry);
+    Server->PubSub.Unsubscribe(topic, Id);
+    return true;
+}
+
+bool ClientHandler::PushFrame(const AnTcpSharedFrame& frame) noexcept
+{
+    bool disconnect = false;
+
+    {
+        std::lock_guard lock(PushMutex);
+
+        if (PushQueue.size() >= Server->PubSub.GetQueueLimit())
+        {
+            switch (Server->PubSub.GetPolicy())
+            {
+                case AnTcpSlowSubscriberPolicy::DropOldest:
+                    PushQueue.pop_front();
+                    Server->PubSub.RecordDropped(1);
+                    break;
+
+                case AnTcpSlowSubscriberPolicy::CoalesceLatest:
+                {
+                    // the new frame supersedes the queued ones of its topic
+                    const size_t coalesced = std::erase_if(PushQueue, [&frame](const AnTcpSharedFrame& queued)
+                    {
+                        return queued->Topic == frame->Topic;
+                    });
+
+                    if (coalesced > 0)
+                    {
+                        Server->PubSub.RecordCoalesced(coalesced);
+                    }
+                    else
+                    {
+                        PushQueue.pop_front();
+                        Server->PubSub.RecordDropped(1);
+                    }
+
+                    break;
+                }
+
+                case AnTcpSlowSubscriberPolicy::Disconnect:
+                    PushQueue.clear();
+                    disconnect = true;
+                    break;
+            }
+        }
+
+        if (!disconnect)
+        {
+            PushQueue.push_back(frame);
+
+            if (PushDraining)
+            {
+                return true;
+            }
+
+            PushDraining = true;
+        }
+    }
+
+    // not under the push mutex, the disconnect event may unsubscribe the client
+    if (disconnect)
+    {
+        Server->PubSub.RecordDisconnected();
+        Disconnect();
+        return false;
+    }
+
+    DrainPushQueue();
+    return true;
+}
+
+void ClientHandler::DrainPushQueue() noexcept
+{
+    while (true)
+    {
+        AnTcpSharedFrame frame;
+
+        {
+            std::lock_guard lock(PushMutex);
+
+            if (PushQueue.empty() || !IsActive)
+            {
+                PushQueue.clear();
+                PushDraining = false;
+                return;
+            }
+
+            // taken out while it is sent, a full queue may drop frames meanwhile
+            frame = std::move(PushQueue.front());
+            PushQueue.pop_front();
+            PushRetry = false;
+        }
+
+        const AnTcpSendResult result = SendPushFrame(*frame);
+
+        if (result == AnTcpSendResult::WouldBlock)
+        {
+            std::lock_guard lock(PushMutex);
+            PushQueue.push_front(std::move(frame));
+
+            // the pending send completed while we were at it, otherwise its completion resumes the queue
+            if (std::exchange(PushRetry, false))
+            {
+                continue;
+            }
+
+            PushDraining = false;
+            return;
+        }
+
+        if (result == AnTcpSendResult::Failed)
+        {
+            // the connection is gone, its receive side notices that too
+            std::lock_guard lock(PushMutex);
+            PushQueue.clear();
+            PushDraining = false;
+            return;
+        }
+
+        Server->PubSub.RecordSent();
+    }
+}
+
+void ClientHandler::ResumePushQueue() noexcept
+{
+    // nothing was held back, the common case
+    if (!PushBlocked.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock(SendMutex);
+
+        // still blocked, whatever blocks the frames calls us again. Buffered responses go out
+        // before, the io_uring backend resumes us when it sent them
+        if ((SendPending && !SharedMemory.load(std::memory_order_relaxed)) || Corked || BatchingClient == this || !OutputBuffer.empty())
+        {
+            return;
+        }
+
+        PushBlocked = false;
+    }
+
+    {
+        std::lock_guard lock(PushMutex);
+
+        if (PushDraining)
+        {
+            // the publisher that sends the queue tries its frame again
+            PushRetry = true;
+            return;
+        }
+
+        if (PushQueue.empty())
+        {
+            return;
+        }
+
+        PushDraining = true;
+    }
+
+    DrainPushQueue();
+}
+
+AnTcpSendResult ClientHandler::SendPushFrame(const AnTcpPublishedFrame& frame) noexcept
+{
+    std::lock_guard lock(SendMutex);
+
+    char header[sizeof(AnTcpSizeType) + sizeof(AnTcpMessageType) + sizeof(AnTcpRequestId)];
+    const size_t headerSize = BuildHeader(header, ANTCP_MESSAGE_PUBLISH, 0, frame.Payload.size());
+    const size_t frameSize = headerSize + frame.Payload.size();
+    AnTcpSharedMemory* sharedMemory = SharedMemory.load(std::memory_order_relaxed);
+
+    // while a send is pending, the frame stays in the push queue where the slow subscriber policy sees it
+    if (SendPending && !sharedMemory)
+    {
+        PushBlocked = true;
+        return AnTcpSendResult::WouldBlock;
+    }
+
+    // same as responses, frames must not overtake the ones that are held back
+    if (Corked || BatchingClient == this)
+    {
+        // held back frames are limited like queued ones, the others wait in the queue for the flush
+        if (HeldPushFrames >= Server->PubSub.GetQueueLimit())
+        {
+            PushBlocked = true;
+            return AnTcpSendResult::WouldBlock;
+        }
+
+        OutputBuffer.insert(OutputBuffer.end(), header, header + headerSize);
+        OutputBuffer.insert(OutputBuffer.end(), frame.Payload.begin(), frame.Payload.end());
+        RecordResponse(ANTCP_MESSAGE_PUBLISH, frameSize, true);
+        HeldPushFrames++;
+        return AnTcpSendResult::Sent;
+    }
+
+    AnTcpIoVec buffers[]{ AnTcpMakeIoVec(header, headerSize), AnTcpMakeIoVec(frame.Payload.data(), frame.Payload.size()) };
+
+    if (sharedMemory)
+    {
+        const bool written = sharedMemory->GetResponses().Write(buffers, 2);
+        RecordResponse(ANTCP_MESSAGE_PUBLISH, frameSize, written);
+        return written ? AnTcpSendResult::Sent : AnTcpSendResult::Failed;
+    }
+
+    // the socket of a thread per client blocks too, the publisher must not wait for the client
+    const bool sent = WriteSocket(buffers, 2);
+    RecordResponse(ANTCP_MESSAGE_PUBLISH, frameSize, sent);
+    return sent ? AnTcpSendResult::Sent : AnTcpSendResult::Failed;
+}
@@ -3,36 +3,67 @@
 // toggle debug output here
 #if 0
 #define DEBUG_ONLY(x) x
-#define BENCHMARK(x) x
 #else
 #define DEBUG_ONLY(x)
-#define BENCHMARK(x)
 #endif
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
-#include <unordered_map>
 #include <vector>
 
-#define NOMINMAX
-#define WIN32_LEAN_AND_MEAN
-
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <iphlpapi.h>
+#include "AnTcpPlatform.hpp"
+#include "AnTcpAdmission.hpp"
+#include "AnTcpBufferPool.hpp"
+#include "AnTcpCallbackRegistry.hpp"
+#include "AnTcpCallbackTable.hpp"
+#include "AnTcpConnectionTable.hpp"
+#include "AnTcpEventLoop.hpp"
+#include "AnTcpIoUring.hpp"
+#include "AnTcpLowLatency.hpp"
+#include "AnTcpMetrics.hpp"
+#include "AnTcpPubSub.hpp"
+#include "AnTcpResponseCache.hpp"
+#include "AnTcpSharedMemory.hpp"
+#include "AnTcpSingleFlight.hpp"
+#include "AnTcpTask.hpp"
+#include "AnTcpTrafficLog.hpp"
+#include "AnTcpWorkerPool.hpp"
 
 constexpr auto ANTCP_SERVER_VERSION = "1.2.1.0";
+// default maximum packet size, can be changed per server using SetMaxPacketSize()
 constexpr auto ANTCP_MAX_PACKET_SIZE = 256;
 
+// size of the per client receive buffer, every recv() call reads as much as fits in here,
+// bigger packets are received into a buffer of the servers AnTcpBufferPool
+constexpr auto ANTCP_RECEIVE_BUFFER_SIZE = 8192;
+
 // type used in the payload to specify the size of a packet
 typedef int AnTcpSizeType;
 
-// type used to identy the the type of a message
-typedef char AnTcpMessageType;
+// default framing: size | type | payload
+constexpr int ANTCP_FRAME_VERSION_1 = 1;
+
+// framing with request ids: size | type | request id | payload, responses carry the id of their request
+constexpr int ANTCP_FRAME_VERSION_2 = 2;
+
+// biggest frame version this server supports
+constexpr int ANTCP_FRAME_VERSION_MAX = ANTCP_FRAME_VERSION_2;
+
+// most sockets the listeners of a server may open, every shard of a tcp listener takes one
+constexpr size_t ANTCP_MAX_LISTEN_SOCKETS = 64;
+
+static_assert(ANTCP_RECEIVE_BUFFER_SIZE <= ANTCP_BUFFER_POOL_MIN_SIZE, "packets bigger than the receive buffer need to fit into the pool");
 
 enum class AnTcpError
 {
@@ -41,75 +72,439 @@ enum class AnTcpError
     GetAddrInfoFailed,
     SocketCreationFailed,
     SocketBindingFailed,
-    SocketListeningFailed
+    SocketListeningFailed,
+    NoListeners
+};
+
+enum class AnTcpIoBackend
+{
+    // every client gets its own thread with blocking reads
+    ThreadPerClient,
+    // a small fixed number of threads multiplex all clients with non-blocking reads
+    EventLoop,
+    // a small fixed number of threads with multishot accepts and receives into kernel provided buffers,
+    // the responses of a batch are sent with the next submission (linux 6.0 and newer)
+    IoUring
+};
+
+enum class AnTcpListenerType
+{
+    // tcp over ipv4 or ipv6, depending on the address
+    Tcp,
+    // unix domain stream socket bound to a path, local clients skip the tcp stack
+    Unix
+};
+
+/// <summary>
+/// Endpoint the server accepts clients on.
+/// </summary>
+struct AnTcpListener
+{
+    AnTcpListenerType Type = AnTcpListenerType::Tcp;
+
+    // ip address and port, or the path of a unix socket
+    std::string Address;
+    std::string Port;
+};
+
+/// <summary>
+/// Settings of the server that apply to every client.
+/// </summary>
+struct AnTcpClientOptions
+{
+    // disable nagle's algorithm on accepted sockets
+    bool NoDelay = false;
+
+    // collect all responses sent while processing one receive batch and send them together
+    bool BatchResponses = false;
+
+    // biggest packet a client may send, bigger ones get the client disconnected
+    AnTcpSizeType MaxPacketSize = ANTCP_MAX_PACKET_SIZE;
+
+    // let clients on the same host move to shared memory rings, see ANTCP_MESSAGE_SHARED_MEMORY
+    bool SharedMemory = false;
+    size_t SharedMemoryRingSize = ANTCP_SHARED_MEMORY_RING_SIZE;
+
+    // how long the thread of a shared memory client polls for requests before it sleeps, in microseconds
+    unsigned int SharedMemorySpinTime = 0;
+};
+
+/// <summary>
+/// Request that is processed by a callback on the current thread.
+/// </summary>
+struct AnTcpRequest
+{
+    const ClientHandler* Handler = nullptr;
+    AnTcpRequestId Id = 0;
+};
+
+/// <summary>
+/// Responses sent by a cacheable callback on the current thread.
+/// </summary>
+struct AnTcpResponseCapture
+{
+    const ClientHandler* Handler = nullptr;
+    AnTcpRequestId RequestId = 0;
+    AnTcpCachedResponses Responses;
+};
+
+/// <summary>
+/// Responses of the sub messages of an ANTCP_MESSAGE_BATCH packet, they are sent together.
+/// </summary>
+struct AnTcpBatch
+{
+    const ClientHandler* Handler = nullptr;
+    AnTcpRequestId RequestId = 0;
+
+    // frames of the responses: size | type | payload
+    std::vector<char> Responses;
+};
+
+/// <summary>
+/// Copy of a packet whose callback runs on the worker pool.
+/// </summary>
+struct AnTcpPacket
+{
+    AnTcpMessageType Type = 0;
+    AnTcpRequestId RequestId = 0;
+    std::chrono::steady_clock::time_point ReceiveTime{};
+    std::vector<char> Payload;
+
+    // packets that were rejected only wait in the strand for their busy response to be sent in order
+    AnTcpBusyReason Busy = AnTcpBusyReason::None;
+};
+
+class AnTcpServer;
+
+/// <summary>
+/// Serializes a response straight into the output buffer of a client, get one
+/// with ClientHandler::BeginResponse(). Sending of the client is locked until
+/// the response is committed or discarded, so don't send anything else to the
+/// client meanwhile. Responses that are neither committed nor discarded are
+/// discarded when the writer is destroyed.
+/// </summary>
+class AnTcpResponseWriter
+{
+private:
+    ClientHandler* Handler;
+
+    // output buffer of the client, or the responses of the batch the response belongs to
+    std::vector<char>* Buffer;
+
+    // only held when writing into the output buffer
+    std::unique_lock<std::mutex> Lock;
+    AnTcpMessageType Type;
+    AnTcpRequestId RequestId;
+    bool Open;
+
+    // where the header of the response starts in the buffer
+    size_t Start;
+    size_t HeaderSize;
+
+public:
+    AnTcpResponseWriter(ClientHandler* handler, AnTcpRequestId requestId, AnTcpMessageType type) noexcept;
+
+    ~AnTcpResponseWriter()
+    {
+        Discard();
+    }
+
+    AnTcpResponseWriter(const AnTcpResponseWriter&) = delete;
+    AnTcpResponseWriter& operator=(const AnTcpResponseWriter&) = delete;
+
+    /// <summary>
+    /// Extend the response and get the new bytes to write them. The pointer is
+    /// valid until the next Reserve() or Append(), it may not be aligned.
+    /// </summary>
+    /// <param name="size">Number of bytes to add.</param>
+    /// <returns>Pointer to the added bytes.</returns>
+    inline char* Reserve(size_t size) noexcept;
+
+    /// <summary>
+    /// Copy data to the end of the response.
+    /// </summary>
+    inline void Append(const void* data, size_t size) noexcept
+    {
+        memcpy(Reserve(size), data, size);
+    }
+
+    /// <summary>
+    /// Copy a single primitive or struct to the end of the response.
+    /// </summary>
+    template<typename T>
+    inline void AppendVar(const T& value) noexcept
+    {
+        Append(&value, sizeof(T));
+    }
+
+    /// <summary>
+    /// Get the size of the payload written so far.
+    /// </summary>
+    inline size_t GetSize() const noexcept;
+
+    /// <summary>
+    /// Patch the size into the header and send the response, or leave it in
+    /// the output buffer when the client is corked or a receive batch is processed.
+    /// </summary>
+    /// <returns>True if the response was sent or buffered, false if not.</returns>
+    bool Commit() noexcept;
+
+    /// <summary>
+    /// Drop the response, nothing is sent.
+    /// </summary>
+    void Discard() noexcept;
 };
 
 class ClientHandler
 {
 private:
-    size_t Id;
+    AnTcpConnectionId Id;
     SOCKET Socket;
-    SOCKADDR_IN SocketInfo;
-    std::atomic<bool>& ShouldExit;
-    std::unordered_map <AnTcpMessageType, std::function<void(ClientHandler*, AnTcpMessageType, const void*, int)>>* Callbacks;
+    sockaddr_storage SocketInfo;
+    AnTcpServer* Server;
+
+    std::atomic<bool> IsActive;
+    AnTcpEventLoop* EventLoop;
+    AnTcpIoUring* IoUring;
+
+    // the owner (event loop, io_uring or client thread) and every queued job hold a reference,
+    // the last one destroys the handler and frees its slot in the connection table
+    std::atomic<unsigned int> References;
+
+    // end of the received data, it starts with the first unprocessed byte
+    size_t ReceiveEnd;
+
+    // buffer for the received data, may contain many packets
+    char ReceiveBuffer[ANTCP_RECEIVE_BUFFER_SIZE];
+
+    // pooled buffer for a packet that is too big for the receive buffer
+    AnTcpPooledBuffer LargePacket;
+    AnTcpSizeType LargePacketSize;
+    AnTcpSizeType LargePacketOffset;
+
+    // framing of the responses negotiated by the client, see ANTCP_FRAME_VERSION_1. Changed with the send
+    // mutex held, once everything the client sent before the negotiation was answered
+    std::atomic<int> FrameVersion;
+
+    // framing of the received packets, only used by the thread that receives. It changes right with the
+    // negotiation, the packets after it are framed in the new version already
+    int ReceiveFrameVersion;
+
+    // when the last recv() returned, the queue wait of its packets is measured from here
+    std::chrono::steady_clock::time_point ReceiveTime;
+
+    // request whose callback is running on this thread, its id is sent with the responses
+    static inline thread_local AnTcpRequest CurrentRequest{};
+
+    // client whose receive batch is processed on this thread, its responses are buffered
+    static inline thread_local const ClientHandler* BatchingClient = nullptr;
+
+    /// <summary>
+    /// Sets the batching client of this thread until the end of the scope, so it is reset on
+    /// every way out of a receive path, a packet that disconnects the client included.
+    /// </summary>
+    class BatchingScope
+    {
+    private:
+        ClientHandler* Client;
+        const ClientHandler* Previous;
+
+    public:
+        explicit BatchingScope(ClientHandler* client) noexcept
+            : Client(client),
+            Previous(BatchingClient)
+        {
+            BatchingClient = client;
+        }
+
+        ~BatchingScope()
+        {
+            BatchingClient = Previous;
+
+            // published frames that had to wait for the batch
+            if (Client && Client != Previous)
+            {
+                Client->ResumePushQueue();
+            }
+        }
+
+        BatchingScope(const BatchingScope&) = delete;
+        BatchingScope& operator=(const BatchingScope&) = delete;
+    };
+
+    // responses of the cacheable callback running on this thread are recorded here
+    static inline thread_local AnTcpResponseCapture* CurrentCapture = nullptr;
+
+    // batch whose sub messages are processed on this thread, their responses are collected here
+    static inline thread_local AnTcpBatch* CurrentBatch = nullptr;
+
+    // responses that are held back until the next flush, guarded by the send mutex
+    // as workers and the I/O thread may send at the same time
+    std::mutex SendMutex;
+    std::vector<char> OutputBuffer;
+    std::atomic<bool> Corked;
+
+    // published frames among the held back responses, they count against the push queue limit
+    size_t HeldPushFrames;
+
+    // data the kernel did not take yet, from the send offset on. The io_uring backend hands it to the kernel,
+    // the other ones keep what a full socket left and send it once the socket is writable again. Meanwhile
+    // new responses are appended to the output buffer and sent afterwards
+    std::vector<char> SendBuffer;
+    size_t SendOffset;
+    bool SendPending;
+
+    // wakes the thread of a thread per client handler from its poll(), so it sends what another thread left pending.
+    // It only polls while a send is pending or another thread may send, it blocks in recv() otherwise
+    SOCKET Wakeup[2];
+
+    // frame version 1 has no request ids, so pooled packets of such clients are executed
+    // one after another and every packet that arrives meanwhile queues up behind them.
+    // Switches of clients of any version wait in here too
+    std::mutex StrandMutex;
+    std::deque<AnTcpPacket> Strand;
+    bool StrandActive;
+
+    // the switch at the front of the strand waits for the jobs in flight, the last one resumes the strand, see IsSwitch()
+    bool StrandWaiting;
+
+    // the strand stopped behind a request that joined the flight of an identical one, the leader resumes it
+    // after it sent the responses. Landed is set when the leader was done before the strand could stop
+    bool StrandFollowing;
+    bool FollowerLanded;
+
+    // switches in the strand, every packet of the client queues up behind them until they ran
+    std::atomic<unsigned int> DeferredSwitches;
+
+    // jobs of this client that are queued or running on the worker pool, and its tasks that did not finish yet
+    std::atomic<unsigned int> PendingJobs;
+
+    // rate limit of the connection, only used by the thread that receives. Batches are charged for all of their sub messages there
+    AnTcpTokenBucket RateBucket;
+
+    // rings that replace the socket once the client asked for them, the socket is only
+    // watched for the disconnect then. Set and used for sending with the send mutex held
+    std::atomic<AnTcpSharedMemory*> SharedMemory;
 
-    bool IsActive;
-    std::thread* Thread;
+    // rings of an io_uring client that are used once the responses in front of the segment name are sent
+    AnTcpSharedMemory* PendingSharedMemory;
 
-    std::function<void(ClientHandler*)>* OnClientConnected;
-    std::function<void(ClientHandler*)>* OnClientDisconnected;
+    // rings created when the client asked for them, their name is sent once the switch runs
+    AnTcpSharedMemory* OfferedSharedMemory;
+
+    // the client asked for rings and got some, requests on the socket are protocol errors from now
+    // on even while the switch waits in the strand. Only used by the thread that receives
+    bool MovingToSharedMemory;
+
+    // frames published to the topics of the client that wait to be sent, guarded by the push mutex
+    std::mutex PushMutex;
+    std::deque<AnTcpSharedFrame> PushQueue;
+    std::vector<AnTcpTopic> Topics;
+
+    // whether a publisher is sending the push queue, the others only add their frame then.
+    // Retry tells it that the socket got writable while it was sending, so a frame it could not send goes out anyway
+    bool PushDraining;
+    bool PushRetry;
+
+    // a frame could not be sent, the push queue is resumed once the pending send completed or the responses are flushed
+    std::atomic<bool> PushBlocked;
+
+    friend class AnTcpConnectionTable;
+    friend class AnTcpEventLoop;
+    friend class AnTcpIoUring;
+    friend class AnTcpResponseWriter;
+    friend class AnTcpServer;
+    friend class AnTcpSingleFlight;
+    friend class AnTcpTask;
+
+    // lets the tests feed data into the receive path of a handler without an I/O backend
+    friend class AnTcpTestAccess;
 
 public:
     /// <summary>
     /// Create a new client handler, which processes incoming data and fires callbacks.
+    /// Handlers are created by the AnTcpConnectionTable of the server.
     /// </summary>
-    /// <param name="id">Id of the handler, used for logging.</param>
+    /// <param name="server">Server that accepted the client, provides the callbacks and options.</param>
+    /// <param name="id">Id of the connection, see AnTcpConnectionId.</param>
     /// <param name="socket">Socket where the client was accepted on.</param>
     /// <param name="socketInfo">Information about the socket, used for logging.</param>
-    /// <param name="shouldExit">Atomic bool to notify the handler that the server is going to shutdown.</param>
-    /// <param name="callbacks">Pointer to the server callback map.</param>
-    ClientHandler
-    (
-        SOCKET socket,
-        const SOCKADDR_IN& socketInfo,
-        std::atomic<bool>& shouldExit,
-        std::unordered_map <AnTcpMessageType, std::function<void(ClientHandler*, AnTcpMessageType, const void*, int)>>* callbacks,
-        std::function<void(ClientHandler*)>* onClientConnected = nullptr,
-        std::function<void(ClientHandler*)>* onClientDisconnected = nullptr
-    )
-        : Id(static_cast<unsigned int>(socketInfo.sin_addr.S_un.S_addr + socketInfo.sin_port)),
+    /// <param name="eventLoop">Event loop that drives the client, if null the handler spawns its own thread.</param>
+    /// <param name="ioUring">io_uring thread that drives the client instead of an event loop.</param>
+    ClientHandler(AnTcpServer* server, AnTcpConnectionId id, SOCKET socket, const sockaddr_storage& socketInfo, AnTcpEventLoop* eventLoop = nullptr, AnTcpIoUring* ioUring = nullptr)
+        : Id(id),
         Socket(socket),
         SocketInfo(socketInfo),
-        ShouldExit(shouldExit),
-        Callbacks(callbacks),
+        Server(server),
         IsActive(true),
-        Thread(new std::thread(&ClientHandler::Listen, this)),
-        OnClientConnected(onClientConnected),
-        OnClientDisconnected(onClientDisconnected)
-    {}
-
-    ~ClientHandler()
+        EventLoop(eventLoop),
+        IoUring(ioUring),
+        References(1),
+        ReceiveEnd(0),
+        ReceiveBuffer{ 0 },
+        LargePacket(),
+        LargePacketSize(0),
+        LargePacketOffset(0),
+        FrameVersion(ANTCP_FRAME_VERSION_1),
+        ReceiveFrameVersion(ANTCP_FRAME_VERSION_1),
+        ReceiveTime(),
+        SendMutex(),
+        OutputBuffer(),
+        Corked(false),
+        HeldPushFrames(0),
+        SendBuffer(),
+        SendOffset(0),
+        SendPending(false),
+        Wakeup{ INVALID_SOCKET, INVALID_SOCKET },
+        StrandMutex(),
+        Strand(),
+        StrandActive(false),
+        StrandWaiting(false),
+        StrandFollowing(false),
+        FollowerLanded(false),
+        DeferredSwitches(0),
+        PendingJobs(0),
+        RateBucket(),
+        SharedMemory(nullptr),
+        PendingSharedMemory(nullptr),
+        OfferedSharedMemory(nullptr),
+        MovingToSharedMemory(false),
+        PushMutex(),
+        PushQueue(),
+        Topics(),
+        PushDraining(false),
+        PushRetry(false),
+        PushBlocked(false)
     {
-        DEBUG_ONLY(std::cout << "[" << Id << "] " << "Deleting Handler: " << Id << std::endl);
-
-        Disconnect();
-
-        Thread->join();
-        delete Thread;
+        // start the thread after all members are initialized, it fires the callbacks and
+        // owns the handler, so nobody needs to join it
+        if (!EventLoop && !IoUring)
+        {
+            AnTcpCreateWakeup(Wakeup);
+            std::thread(&ClientHandler::Listen, this).detach();
+        }
     }
 
+    ~ClientHandler();
+
     ClientHandler(const ClientHandler&) = delete;
     ClientHandler& operator=(const ClientHandler&) = delete;
 
     /// <summary>
-    /// Get the AnTCP handler id.
+    /// Get the id of the connection, ids of closed connections are never valid again.
+    /// Keep it instead of the handler to send data later with AnTcpServer::SendData().
     /// </summary>
     constexpr auto GetId() const noexcept { return Id; }
 
     /// <summary>
-    /// Used to delete old disconnected clients.
+    /// Whether the client is still connected.
     /// </summary>
-    constexpr bool IsConnected() const noexcept { return !IsActive; }
+    inline bool IsConnected() const noexcept { return IsActive; }
+
+    /// <summary>
+    /// Whether the client moved from the socket to shared memory rings.
+    /// </summary>
+    inline bool IsSharedMemory() const noexcept { return SharedMemory != nullptr; }
 
     /// <summary>
     /// Send data to the client. Size will be sizeof(T).
@@ -121,7 +516,7 @@ public:
     /// <param name="data">Data to send.</param>
     /// <returns>True if data was sent, false if not.</returns>
     template<typename T>
-    constexpr bool SendDataVar(AnTcpMessageType type, const T data) const noexcept
+    constexpr bool SendDataVar(AnTcpMessageType type, const T data) noexcept
     {
         return SendData(type, &data, sizeof(T));
     }
@@ -137,250 +532,1588 @@ public:
     /// <param name="data">Data to send.</param>
     /// <returns>True if data was sent, false if not.</returns>
     template<typename T>
-    constexpr bool SendDataPtr(AnTcpMessageType type, const T* data) const noexcept
+    constexpr bool SendDataPtr(AnTcpMessageType type, const T* data) noexcept
     {
         return SendData(type, data, sizeof(T));
     }
 
     /// <summary>
-    /// Send data to the client.
+    /// Send data to the client. Header and data are sent with a single
+    /// vectored write, or appended to the output buffer while the client
+    /// is corked or a receive batch is processed. When called from a
+    /// callback, the response carries the id of the request.
     /// </summary>
     /// <param name="type">Message type (1 byte)</param>
     /// <param name="data">Data to send.</param>
     /// <param name="size">Size of the data to send.</param>
-    /// <returns>True if data was sent, false if not.</returns>
-    inline bool SendData(AnTcpMessageType type, const void* data, size_t size) const noexcept
+    /// <returns>True if data was sent or buffered, false if not.</returns>
+    inline bool SendData(AnTcpMessageType type, const void* data, size_t size) noexcept
     {
-        const int packetSize = size + static_cast<int>(sizeof(AnTcpMessageType));
-        return send(Socket, reinterpret_cast<const char*>(&packetSize), sizeof(decltype(packetSize)), 0) != SOCKET_ERROR
-            && send(Socket, &type, sizeof(AnTcpMessageType), 0) != SOCKET_ERROR
-            && send(Socket, static_cast<const char*>(data), size, 0) != SOCKET_ERROR;
+        return SendResponse(GetRequestId(), type, data, size);
     }
 
     /// <summary>
-    /// Disconnect the client.
+    /// Send data to the client as response to a specific request, use this
+    /// to reply to a request after its callback returned. The id is only
+    /// sent when the client negotiated frame version 2. Safe to call from
+    /// worker threads.
     /// </summary>
-    inline void Disconnect() noexcept
+    /// <param name="requestId">Id of the request, see GetRequestId().</param>
+    /// <param name="type">Message type (1 byte)</param>
+    /// <param name="data">Data to send.</param>
+    /// <param name="size">Size of the data to send.</param>
+    /// <returns>True if data was sent or buffered, false if not.</returns>
+    inline bool SendResponse(AnTcpRequestId requestId, AnTcpMessageType type, const void* data, size_t size) noexcept
     {
-        if (OnClientDisconnected)
+        if (CurrentCapture && CurrentCapture->Handler == this && CurrentCapture->RequestId == requestId)
+        {
+            CurrentCapture->Responses.push_back(AnTcpCachedResponse{ type, std::vector<char>(static_cast<const char*>(data), static_cast<const char*>(data) + size) });
+        }
+
+        if (CurrentBatch && CurrentBatch->Handler == this && CurrentBatch->RequestId == requestId)
+        {
+            // sent with the response of the batch
+            const AnTcpSizeType packetSize = static_cast<AnTcpSizeType>(size + sizeof(AnTcpMessageType));
+            std::vector<char>& responses = CurrentBatch->Responses;
+            responses.insert(responses.end(), reinterpret_cast<const char*>(&packetSize), reinterpret_cast<const char*>(&packetSize) + sizeof(AnTcpSizeType));
+            responses.push_back(type);
+            responses.insert(responses.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+            return true;
+        }
+
+        std::lock_guard lock(SendMutex);
+
+        char header[sizeof(AnTcpSizeType) + sizeof(AnTcpMessageType) + sizeof(AnTcpRequestId)];
+        const size_t headerSize = BuildHeader(header, type, requestId, size);
+        LogResponse(type, requestId, data, size);
+
+        // only the thread that processes the receive batch buffers, workers send right away. While the
+        // io_uring backend sends, responses queue up behind it so they can't overtake the pending ones
+        if (Corked || BatchingClient == this || (SendPending && !SharedMemory.load(std::memory_order_relaxed)))
         {
-            (*OnClientDisconnected)(this);
+            OutputBuffer.insert(OutputBuffer.end(), header, header + headerSize);
+            OutputBuffer.insert(OutputBuffer.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+            RecordResponse(type, headerSize + size, true);
+            return true;
         }
 
-        closesocket(Socket);
-        Socket = INVALID_SOCKET;
-        IsActive = false;
+        AnTcpIoVec buffers[]{ AnTcpMakeIoVec(header, headerSize), AnTcpMakeIoVec(data, size) };
+        const bool sent = Write(buffers, size > 0 ? 2 : 1);
+        RecordResponse(type, headerSize + size, sent);
+        return sent;
     }
 
     /// <summary>
-    /// Get the clients ip address.
+    /// Start a response that is serialized straight into the output buffer,
+    /// which saves the temporary buffer and the copy of big responses sent
+    /// with SendData(). When called from a callback, the response carries the
+    /// id of the request.
+    /// Usage: auto writer = handler->BeginResponse(type); writer.AppendVar(x); writer.Commit();
     /// </summary>
-    /// <returns>IP address as string.</returns>
-    inline std::string GetIpAddress() const noexcept
+    /// <param name="type">Message type (1 byte)</param>
+    /// <returns>Writer for the response, it locks sending until it is committed.</returns>
+    inline AnTcpResponseWriter BeginResponse(AnTcpMessageType type) noexcept
     {
-        char ipAddressBuffer[128]{ 0 };
-        inet_ntop(AF_INET, &SocketInfo.sin_addr, ipAddressBuffer, 128);
-        return std::string(ipAddressBuffer);
+        return AnTcpResponseWriter(this, GetRequestId(), type);
     }
 
     /// <summary>
-    /// Get the client connection port.
+    /// Start a response to a specific request, see BeginResponse() and SendResponse().
     /// </summary>
-    constexpr unsigned short GetPort() const noexcept
+    inline AnTcpResponseWriter BeginResponse(AnTcpRequestId requestId, AnTcpMessageType type) noexcept
     {
-        return SocketInfo.sin_port;
+        return AnTcpResponseWriter(this, requestId, type);
     }
 
-    constexpr unsigned short GetAddressFamily() const noexcept
+    /// <summary>
+    /// Get the id of the request that is currently processed by a callback
+    /// of this client, 0 if there is none.
+    /// </summary>
+    inline AnTcpRequestId GetRequestId() const noexcept
     {
-        return SocketInfo.sin_family;
+        return CurrentRequest.Handler == this ? CurrentRequest.Id : 0;
     }
 
-private:
     /// <summary>
-    /// Routine for new clients, packets will be reassembled
-    /// and processed in here.
+    /// Get the frame version negotiated by the client.
     /// </summary>
-    void Listen() noexcept;
+    inline int GetFrameVersion() const noexcept { return FrameVersion; }
 
     /// <summary>
-    /// Search whether there is a callback or not, 
-    /// if there is one, fire it with the data.
+    /// Hold back all responses until Uncork() or Flush() is called.
     /// </summary>
-    /// <param name="type">Message type.</param>
-    /// <param name="data">Data received.</param>
-    /// <returns>True if callback was fired, false if not.</returns>
-    inline bool ProcessPacket(const char* data, AnTcpMessageType size) noexcept
+    inline void Cork() noexcept
     {
-        auto msgType = *reinterpret_cast<const AnTcpMessageType*>(data);
-
-        if ((*Callbacks).contains(msgType))
-        {
-            // measure packet processing time in debug mode
-            BENCHMARK(const auto packetStart = std::chrono::high_resolution_clock::now());
-
-            // fire the callback with the raw data
-            (*Callbacks)[msgType](this, msgType, data + sizeof(AnTcpMessageType), size - sizeof(AnTcpMessageType));
-
-            BENCHMARK(std::cout << "[" << Id << "] " << "Processing packet of type \""
-                << std::to_string(msgType) << "\" took: "
-                << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - packetStart) << std::endl);
-
-            return true;
-        }
-
-        DEBUG_ONLY(std::cout << "[" << Id << "] " << "\"" << std::to_string(msgType)
-            << "\" is an unknown message type..." << std::endl);
-
-        return false;
+        Corked = true;
     }
-};
-
-class AnTcpServer
-{
-private:
-    std::string Ip;
-    std::string Port;
-    std::atomic<bool> ShouldExit;
-    SOCKET ListenSocket;
-    std::vector<ClientHandler*> Clients;
-    std::unordered_map <AnTcpMessageType, std::function<void(ClientHandler*, AnTcpMessageType, const void*, int)>> Callbacks;
-
-    std::function<void(ClientHandler*)> OnClientConnected;
-    std::function<void(ClientHandler*)> OnClientDisconnected;
-
-public:
-    /// <summary>
-    /// Create anew instace of the AnTcpServer to start a new server.
-    /// </summary>
-    /// <param name="ip">Ip address to bind the server to.</param>
-    /// <param name="port">Port to listen on.</param>
-    AnTcpServer(const std::string& ip, unsigned short port)
-        : Ip(ip),
-        Port(std::to_string(port)),
-        ShouldExit(false),
-        ListenSocket(INVALID_SOCKET),
-        Clients(),
-        Callbacks(),
-        OnClientConnected(nullptr),
-        OnClientDisconnected(nullptr)
-    {}
 
     /// <summary>
-    /// Create anew instace of the AnTcpServer to start a new server.
+    /// Stop holding back responses and send the buffered ones.
     /// </summary>
-    /// <param name="ip">Ip address to bind the server to.</param>
-    /// <param name="port">Port to listen on.</param>
-    AnTcpServer(const std::string& ip, const std::string& port)
-        : Ip(ip),
-        Port(port),
-        ShouldExit(false),
-        ListenSocket(INVALID_SOCKET),
-        Clients(),
-        Callbacks(),
-        OnClientConnected(nullptr),
-        OnClientDisconnected(nullptr)
-    {}
+    /// <returns>True if the buffered data was sent, false if not.</returns>
+    inline bool Uncork() noexcept
+    {
+        Corked = false;
+        const bool flushed = Flush();
 
-    AnTcpServer(const AnTcpServer&) = delete;
-    AnTcpServer& operator=(const AnTcpServer&) = delete;
+        // published frames over the limit waited in the push queue
+        ResumePushQueue();
+        return flushed;
+    }
 
     /// <summary>
-    /// Set the event handler for the OnClientConnected event.
+    /// Send all buffered responses with a single write.
     /// </summary>
-    /// <param name="handlerFunction">Handler function, can be nulltpr</param>
-    inline void SetOnClientConnected(std::function<void(ClientHandler*)> handlerFunction)
+    /// <returns>True if the buffered data was sent, false if not.</returns>
+    inline bool Flush() noexcept
     {
-        OnClientConnected = handlerFunction;
+        std::lock_guard lock(SendMutex);
+        return FlushOutput();
     }
 
     /// <summary>
-    /// Set the event handler for the OnClientDisconnected event.
+    /// Disconnect the client. The socket is shut down here and closed
+    /// when the handler gets deleted.
     /// </summary>
-    /// <param name="handlerFunction">Handler function, can be nulltpr</param>
-    inline void SetOnClientDisconnected(std::function<void(ClientHandler*)> handlerFunction)
-    {
-        OnClientDisconnected = handlerFunction;
-    }
+    void Disconnect() noexcept;
 
     /// <summary>
-    /// Add a new callback for a message type, will be fired when the server received a message of that type.
+    /// Get the clients ip address.
     /// </summary>
-    /// <param name="type">Message type.</param>
-    /// <param name="callback">Function to handle the message.</param>
-    /// <returns>True if callback was added, false if there is already a callback for this message type.</returns>
-    inline bool AddCallback(AnTcpMessageType type, std::function<void(ClientHandler*, AnTcpMessageType, const void*, int)> callback) noexcept
+    /// <returns>IP address as string, empty for clients of a unix socket.</returns>
+    inline std::string GetIpAddress() const noexcept
     {
-        if (!Callbacks.contains(type))
+        char ipAddressBuffer[128]{ 0 };
+
+        if (SocketInfo.ss_family == AF_INET)
         {
-            Callbacks[type] = callback;
-            return true;
+            inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&SocketInfo)->sin_addr, ipAddressBuffer, 128);
+        }
+        else if (SocketInfo.ss_family == AF_INET6)
+        {
+            inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(&SocketInfo)->sin6_addr, ipAddressBuffer, 128);
         }
 
-        return false;
+        return std::string(ipAddressBuffer);
     }
 
     /// <summary>
-    /// Remove a callback for the given message type.
+    /// Get the client connection port, 0 for clients of a unix socket.
     /// </summary>
-    /// <param name="type">Message type.</param>
-    /// <returns>True if callback was removed, false if there was no callback for this message type.</returns>
-    inline bool RemoveCallback(AnTcpMessageType type) noexcept
+    inline unsigned short GetPort() const noexcept
     {
-        if (Callbacks.contains(type))
+        switch (SocketInfo.ss_family)
         {
-            Callbacks.erase(type);
-            return true;
+            case AF_INET: return reinterpret_cast<const sockaddr_in*>(&SocketInfo)->sin_port;
+            case AF_INET6: return reinterpret_cast<const sockaddr_in6*>(&SocketInfo)->sin6_port;
+            default: return 0;
         }
+    }
 
-        return false;
+    constexpr unsigned short GetAddressFamily() const noexcept
+    {
+        return SocketInfo.ss_family;
     }
 
+private:
     /// <summary>
-    /// Stops the server.
+    /// Take a reference, the handler stays alive until it is released.
     /// </summary>
-    inline void Stop() noexcept
+    inline void AddReference() noexcept
     {
-        ShouldExit = true;
-        SocketCleanup();
-        Clients.clear();
-        WSACleanup();
+        References.fetch_add(1, std::memory_order_relaxed);
     }
 
     /// <summary>
-    /// Starts the server, blocking. You may want to start it on a thread.
+    /// Take a reference unless the handler is already being destroyed.
     /// </summary>
-    /// <returns>Status of the server, 1 if an error occured, 0 if not</returns>
-    AnTcpError Run() noexcept;
-
-private:
-    constexpr void SocketCleanup() noexcept
+    /// <returns>True if a reference was taken, false if not.</returns>
+    inline bool TryAddReference() noexcept
     {
-        if (ListenSocket != INVALID_SOCKET)
+        unsigned int references = References.load(std::memory_order_relaxed);
+
+        while (references > 0 && !References.compare_exchange_weak(references, references + 1, std::memory_order_relaxed))
         {
-            closesocket(ListenSocket);
-            ListenSocket = INVALID_SOCKET;
         }
+
+        return references > 0;
     }
 
     /// <summary>
-    /// Delete old clients that are not running.
+    /// Drop a reference, the last one destroys the handler.
     /// </summary>
-    constexpr void ClientCleanup() noexcept
-    {
-        for (size_t i = 0; i < Clients.size(); ++i)
-        {
-            if (Clients[i] && Clients[i]->IsConnected())
-            {
-                if (OnClientDisconnected)
-                {
-                    OnClientDisconnected(Clients[i]);
-                }
+    void Release() noexcept;
 
-                delete Clients[i];
-            }
+    /// <summary>
+    /// Called when a task started by the handler or a request that followed an identical one
+    /// finished, drops its in flight slot and reference.
+    /// </summary>
+    void FinishTask() noexcept;
 
-            Clients.erase(Clients.begin() + i);
-        }
-    }
+    /// <summary>
+    /// Called when a request joined the flight of an identical one, it stays in flight and keeps the
+    /// handler alive until the leader finished it with FinishFollow(), like a task.
+    /// </summary>
+    void BeginFollow() noexcept;
+
+    /// <summary>
+    /// Called by the leader of a flight, sends the responses to a request that joined it and finishes it.
+    /// </summary>
+    /// <param name="ordered">Whether the strand stopped behind the request, it is resumed afterwards.</param>
+    void FinishFollow(AnTcpRequestId requestId, bool ordered, const AnTcpCachedResponses& responses) noexcept;
+
+    /// <summary>
+    /// Stop the strand behind a request of a frame version 1 client that joined the flight of an
+    /// identical one, later packets of the client queue up until the leader resumes it.
+    /// </summary>
+    /// <returns>True if the strand stopped, false if the leader already sent the responses.</returns>
+    bool HoldStrand() noexcept;
+
+    /// <summary>
+    /// Called when a job or a task of the client finished, the last one resumes a strand that waits for it.
+    /// </summary>
+    void FinishJob() noexcept;
+
+    /// <summary>
+    /// Fire the OnClientConnected event of the server.
+    /// </summary>
+    void NotifyConnected() noexcept;
+
+    /// <summary>
+    /// Count a response in the server metrics.
+    /// </summary>
+    void RecordResponse(AnTcpMessageType type, size_t bytes, bool sent) noexcept;
+
+    /// <summary>
+    /// Write a response into the traffic log, if it records responses. The send mutex must be locked.
+    /// </summary>
+    void LogResponse(AnTcpMessageType type, AnTcpRequestId requestId, const void* data, size_t size) noexcept;
+
+    /// <summary>
+    /// Answer an ANTCP_MESSAGE_METRICS request with a snapshot of the server metrics.
+    /// </summary>
+    bool SendMetrics() noexcept;
+
+    /// <summary>
+    /// Fire the callbacks of the sub messages of an ANTCP_MESSAGE_BATCH packet one after
+    /// another and send their responses with a single frame. Pooled callbacks run here too,
+    /// the batch needs their responses.
+    /// </summary>
+    /// <param name="data">Sub message frames.</param>
+    /// <param name="size">Size of the data.</param>
+    /// <returns>True if the batch was valid, false if not.</returns>
+    bool ProcessBatch(const char* data, int size) noexcept;
+
+    /// <summary>
+    /// Count the sub messages of an ANTCP_MESSAGE_BATCH packet without checking them, ProcessBatch() does.
+    /// </summary>
+    /// <returns>The number of complete sub message frames.</returns>
+    static size_t CountBatchMessages(const char* data, int size) noexcept;
+
+    /// <summary>
+    /// Send buffers on the transport of the client, the socket or the response ring. The send mutex must be locked
+    /// and no send may be pending. Sockets of the event loop and io_uring backends are never waited for, see WriteSocket().
+    /// </summary>
+    /// <returns>True if all data was sent or kept for sending, false if not.</returns>
+    inline bool Write(AnTcpIoVec* buffers, size_t count) noexcept
+    {
+        AnTcpSharedMemory* sharedMemory = SharedMemory.load(std::memory_order_relaxed);
+
+        if (sharedMemory)
+        {
+            return sharedMemory->GetResponses().Write(buffers, count);
+        }
+
+        // the socket of a thread per client blocks, it stops reading requests while the client doesn't read its responses
+        if (!EventLoop && !IoUring)
+        {
+            return AnTcpSendVector(Socket, buffers, count);
+        }
+
+        return WriteSocket(buffers, count);
+    }
+
+    /// <summary>
+    /// Send buffers on the socket without waiting for it. What a full socket does not take is kept in
+    /// the send buffer and sent by the I/O side of the client once the socket is writable again, see
+    /// AwaitWritable(). The send mutex must be locked and no send may be pending.
+    /// </summary>
+    /// <returns>True if all data was sent or kept for sending, false if not.</returns>
+    bool WriteSocket(AnTcpIoVec* buffers, size_t count) noexcept;
+
+    /// <summary>
+    /// Let the I/O side of the client send the pending data once the socket is writable: the event loop
+    /// watches the socket, the io_uring thread hands it to the kernel and the thread of a thread per client
+    /// handler is woken up to poll it. The send mutex must be locked.
+    /// </summary>
+    void AwaitWritable() noexcept;
+
+    /// <summary>
+    /// Send the pending data and the responses that were buffered meanwhile, as far as the socket takes them.
+    /// </summary>
+    /// <returns>Sent when nothing is pending anymore, WouldBlock when the socket is full again.</returns>
+    AnTcpSendResult ContinueSend() noexcept;
+
+    /// <summary>
+    /// Send the output buffer, the send mutex must be locked.
+    /// </summary>
+    /// <returns>True if the buffered data was sent, false if not.</returns>
+    inline bool FlushOutput() noexcept
+    {
+        // a pending send of the io_uring backend picks the output buffer up when it completed,
+        // only responses for the rings of a client that moved to shared memory are written now
+        if (OutputBuffer.empty() || (SendPending && !SharedMemory.load(std::memory_order_relaxed)))
+        {
+            return true;
+        }
+
+        AnTcpIoVec buffer = AnTcpMakeIoVec(OutputBuffer.data(), OutputBuffer.size());
+        const bool sent = Write(&buffer, 1);
+
+        // keep the capacity, the next batch will likely be of similar size
+        OutputBuffer.clear();
+        HeldPushFrames = 0;
+        return sent;
+    }
+
+    /// <summary>
+    /// Create the rings for a client that sent ANTCP_MESSAGE_SHARED_MEMORY, when the server offers them.
+    /// </summary>
+    /// <returns>The segment, null if the server doesn't offer shared memory or it could not be created.</returns>
+    AnTcpSharedMemory* CreateSharedMemory() noexcept;
+
+    /// <summary>
+    /// Answer an ANTCP_MESSAGE_SHARED_MEMORY request once its switch runs. The name of the segment
+    /// offered by ProcessSwitch() is sent over the socket, empty if there is none, and everything
+    /// after the request goes through its rings, served by a thread of its own.
+    /// </summary>
+    /// <param name="requestId">Id of the request.</param>
+    /// <returns>True if the answer was sent, false if not.</returns>
+    bool OpenSharedMemory(AnTcpRequestId requestId) noexcept;
+
+    /// <summary>
+    /// Routine of the thread of a shared memory client, processes requests until the client is
+    /// gone and releases the threads reference afterwards.
+    /// </summary>
+    void ServeSharedMemory() noexcept;
+
+    /// <summary>
+    /// Switch the client to the rings and start the thread that serves them.
+    /// </summary>
+    void StartSharedMemory(AnTcpSharedMemory* sharedMemory) noexcept;
+
+    /// <summary>
+    /// Wait for requests in the request ring and process every one of them. Complete packets are
+    /// processed right in the ring, the rest is collected into a pooled buffer first.
+    /// </summary>
+    /// <returns>True if the client is still alive, false if it needs to be disconnected.</returns>
+    bool ReceiveSharedMemory() noexcept;
+
+    /// <summary>
+    /// Routine for new clients when running the thread per client
+    /// backend, receives until the client is gone and releases
+    /// the threads reference afterwards.
+    /// </summary>
+    void Listen() noexcept;
+
+    /// <summary>
+    /// Whether another thread may send to the client and leave the send
+    /// pending, a pooled job or task of it runs or it has subscriptions.
+    /// </summary>
+    bool HasOtherSenders() noexcept;
+
+    /// <summary>
+    /// Receive once from the socket, reading as much as the buffer can
+    /// hold. Every complete packet will be processed in here, incomplete
+    /// ones are kept until the rest of them arrives.
+    /// </summary>
+    /// <returns>True if the client is still alive, false if it needs to be disconnected.</returns>
+    bool Receive() noexcept;
+
+    /// <summary>
+    /// Receive the rest of a packet that did not fit into the receive buffer
+    /// directly into its pooled buffer and process it once it is complete.
+    /// </summary>
+    /// <returns>True if the client is still alive, false if it needs to be disconnected.</returns>
+    bool ReceiveLargePacket() noexcept;
+
+    /// <summary>
+    /// Process data the io_uring backend received into one of its buffers. Complete packets are
+    /// processed right in there, the rest is copied behind the data that is already buffered. The
+    /// responses are buffered, the io_uring thread sends them with its next submission.
+    /// </summary>
+    /// <param name="data">Received data, only valid during the call.</param>
+    /// <param name="size">Size of the data.</param>
+    /// <returns>True if the client is still alive, false if it needs to be disconnected.</returns>
+    bool ProcessReceived(const char* data, size_t size) noexcept;
+
+    /// <summary>
+    /// Process every complete packet of the data, the first bytes of a packet too big for the receive
+    /// buffer are copied into a pooled buffer.
+    /// </summary>
+    /// <param name="data">Data starting with a packet.</param>
+    /// <param name="size">Size of the data.</param>
+    /// <param name="processedBytes">Number of bytes that were consumed.</param>
+    /// <returns>True if the client is still alive, false if it needs to be disconnected.</returns>
+    bool ProcessPackets(const char* data, size_t size, size_t& processedBytes) noexcept;
+
+    /// <summary>
+    /// Process the completely received large packet and give its buffer back to the pool.
+    /// </summary>
+    /// <returns>True if the client is still alive, false if it needs to be disconnected.</returns>
+    bool ProcessLargePacket() noexcept;
+
+    /// <summary>
+    /// Get the size of everything in front of the payload in a frame, the size excluded.
+    /// </summary>
+    static constexpr AnTcpSizeType GetFrameHeaderSize(int frameVersion) noexcept
+    {
+        return static_cast<AnTcpSizeType>(sizeof(AnTcpMessageType) + (frameVersion >= ANTCP_FRAME_VERSION_2 ? sizeof(AnTcpRequestId) : 0));
+    }
+
+    /// <summary>
+    /// Write the frame header for the negotiated frame version.
+    /// </summary>
+    /// <returns>Size of the header.</returns>
+    inline size_t BuildHeader(char* header, AnTcpMessageType type, AnTcpRequestId requestId, size_t payloadSize) const noexcept
+    {
+        const int frameVersion = FrameVersion.load(std::memory_order_relaxed);
+        const AnTcpSizeType frameHeaderSize = GetFrameHeaderSize(frameVersion);
+        const AnTcpSizeType packetSize = static_cast<AnTcpSizeType>(payloadSize + frameHeaderSize);
+        memcpy(header, &packetSize, sizeof(AnTcpSizeType));
+        header[sizeof(AnTcpSizeType)] = type;
+
+        if (frameVersion >= ANTCP_FRAME_VERSION_2)
+        {
+            memcpy(header + sizeof(AnTcpSizeType) + sizeof(AnTcpMessageType), &requestId, sizeof(AnTcpRequestId));
+        }
+
+        return sizeof(AnTcpSizeType) + frameHeaderSize;
+    }
+
+    /// <summary>
+    /// Answer a frame version negotiation, the response is sent in the old
+    /// framing and everything after it uses the new one.
+    /// </summary>
+    /// <param name="requestId">Id of the negotiation request.</param>
+    /// <param name="version">Negotiated version, already clamped to the supported ones.</param>
+    /// <returns>True if the response was sent, false if not.</returns>
+    bool Negotiate(AnTcpRequestId requestId, int version) noexcept;
+
+    /// <summary>
+    /// Whether a packet switches how the responses of the client are framed or where they are sent. The responses
+    /// of the packets in flight have to go out before, so a switch waits for them in the strand, see ProcessSwitch().
+    /// </summary>
+    static constexpr bool IsSwitch(AnTcpMessageType type) noexcept
+    {
+        return type == ANTCP_MESSAGE_NEGOTIATE || type == ANTCP_MESSAGE_SHARED_MEMORY;
+    }
+
+    /// <summary>
+    /// Run a switch right away when nothing of the client is in flight, or queue it in the strand. The thread
+    /// that receives never waits for the jobs and tasks in flight, the last of them resumes the strand.
+    /// </summary>
+    /// <param name="data">Payload of the switch.</param>
+    /// <param name="size">Size of the payload.</param>
+    /// <returns>True if the switch was valid, false if not.</returns>
+    bool ProcessSwitch(AnTcpMessageType type, AnTcpRequestId requestId, const char* data, int size) noexcept;
+
+    /// <summary>
+    /// Run a switch that was validated by ProcessSwitch(), nothing of the client may be in flight.
+    /// </summary>
+    /// <returns>True if the switch was answered, false if not.</returns>
+    bool ExecuteSwitch(AnTcpMessageType type, AnTcpRequestId requestId, const char* data, int size) noexcept;
+
+    /// <summary>
+    /// Parse a packet and fire its callback, either right here or on the
+    /// worker pool when the callback is pooled.
+    /// </summary>
+    /// <param name="data">Packet without its size.</param>
+    /// <param name="size">Size of the packet.</param>
+    /// <returns>True if the packet was valid, false if not.</returns>
+    bool ProcessPacket(const char* data, AnTcpSizeType size) noexcept;
+
+    /// <summary>
+    /// Check the limits of the server for a packet, see AnTcpAdmission. An admitted packet holds
+    /// an in flight slot until its callback returned. A batch is charged against the rate limit of
+    /// the connection for all of its sub messages here, their message type limits are checked when it runs.
+    /// </summary>
+    /// <returns>None if the packet may run, the limit it exceeded if not.</returns>
+    AnTcpBusyReason AdmitPacket(AnTcpMessageType type, const char* data, int size) noexcept;
+
+    /// <summary>
+    /// Answer a request that exceeded a limit with ANTCP_MESSAGE_BUSY.
+    /// </summary>
+    bool SendBusy(AnTcpRequestId requestId, AnTcpMessageType type, AnTcpBusyReason reason) noexcept;
+
+    /// <summary>
+    /// Answer a request that waited longer than its deadline with ANTCP_MESSAGE_TIMEOUT.
+    /// </summary>
+    bool SendTimeout(AnTcpRequestId requestId, AnTcpMessageType type) noexcept;
+
+    /// <summary>
+    /// Answer a packet of a cacheable message type from the response cache.
+    /// </summary>
+    /// <returns>True if the responses were cached and sent, false if the callback needs to run.</returns>
+    bool SendCachedResponses(AnTcpMessageType type, AnTcpRequestId requestId, const char* data, int size) noexcept;
+
+    /// <summary>
+    /// Fire the callback of a packet on the current thread, or answer it with a timeout when it is past its deadline.
+    /// </summary>
+    /// <param name="receiveTime">When the packet was received, used to measure the queue wait and for the deadline.</param>
+    /// <returns>True if the packet is done, false if a frame version 1 request joined the flight of an identical one, see HoldStrand().</returns>
+    bool ExecutePacket(const AnTcpCallbackEntry& callback, AnTcpMessageType type, AnTcpRequestId requestId, std::chrono::steady_clock::time_point receiveTime, const char* data, int size) noexcept;
+
+    /// <summary>
+    /// Run the task of a packet until it suspends, it resumes wherever the work it awaits completes.
+    /// </summary>
+    void StartTask(AnTcpTaskFunction task, AnTcpMessageType type, AnTcpRequestId requestId, const char* data, int size) noexcept;
+
+    /// <summary>
+    /// Queue a copy of the packet on the worker pool, in the lane of its message type.
+    /// </summary>
+    void SubmitPacket(AnTcpMessageType type, AnTcpRequestId requestId, const char* data, int size) noexcept;
+
+    /// <summary>
+    /// Queue a job on the worker pool that runs the strand, it holds a reference to the handler.
+    /// </summary>
+    void SubmitStrand(AnTcpPriority priority) noexcept;
+
+    /// <summary>
+    /// Continue a strand that waited for the jobs in flight. Without workers it only waited for tasks
+    /// and runs on the thread that finished the last one.
+    /// </summary>
+    void ResumeStrand() noexcept;
+
+    /// <summary>
+    /// Worker pool job that executes the strand of a frame version 1 client until it is empty,
+    /// or until jobs of a higher lane are waiting, then the rest of the strand is queued again.
+    /// A switch at its front stops it while other jobs of the client are in flight.
+    /// </summary>
+    void RunStrand() noexcept;
+
+    /// <summary>
+    /// Subscribe the client to a topic.
+    /// </summary>
+    /// <returns>True if it was subscribed, false if it already was or has ANTCP_MAX_CLIENT_TOPICS topics.</returns>
+    bool Subscribe(AnTcpTopic topic) noexcept;
+
+    /// <summary>
+    /// Unsubscribe the client from a topic.
+    /// </summary>
+    /// <returns>True if it was unsubscribed, false if it was not subscribed.</returns>
+    bool Unsubscribe(AnTcpTopic topic) noexcept;
+
+    /// <summary>
+    /// Queue a published frame, the slow subscriber policy of the server is applied when the
+    /// push queue is full. Unless another publisher is at it, the queue is sent right away.
+    /// </summary>
+    /// <returns>True if the frame was queued, false if the client was disconnected.</returns>
+    bool PushFrame(const AnTcpSharedFrame& frame) noexcept;
+
+    /// <summary>
+    /// Send the push queue until it is empty or the socket takes no more data. Frames the
+    /// client is too slow for stay queued until the pending send completed, see ResumePushQueue().
+    /// </summary>
+    void DrainPushQueue() noexcept;
+
+    /// <summary>
+    /// Send the push queue again after a frame could not be sent, unless the responses are still
+    /// held back or a send is still pending. Called when a pending send completed, after a flush
+    /// of the held back responses and at the end of a receive batch, the send mutex must not be locked.
+    /// </summary>
+    void ResumePushQueue() noexcept;
+
+    /// <summary>
+    /// Send a published frame without waiting for a full socket, or buffer it behind the
+    /// responses when they are held back. When the kernel only takes a part of it, the
+    /// rest is kept like that of a response and the frame counts as sent.
+    /// </summary>
+    /// <returns>WouldBlock if a send is pending or the push queue limit of frames is held back, the frame stays queued then.</returns>
+    AnTcpSendResult SendPushFrame(const AnTcpPublishedFrame& frame) noexcept;
+};
+
+inline char* AnTcpResponseWriter::Reserve(size_t size) noexcept
+{
+    const size_t end = Buffer->size();
+    Buffer->resize(end + size);
+    return Buffer->data() + end;
+}
+
+inline size_t AnTcpResponseWriter::GetSize() const noexcept
+{
+    return Open ? Buffer->size() - Start - HeaderSize : 0;
+}
+
+class AnTcpServer
+{
+private:
+    std::vector<AnTcpListener> Listeners;
+    unsigned int ListenerShards;
+    std::atomic<bool> ShouldExit;
+
+    // sockets of the listeners, Stop() shuts them down from any thread or a signal handler, so they live in a fixed
+    // array of atomics instead of behind a mutex. Shutdowns counts the Stop() calls that are looking at them
+    std::array<std::atomic<SOCKET>, ANTCP_MAX_LISTEN_SOCKETS> ListenSockets;
+    std::atomic<size_t> ListenSocketCount;
+    std::atomic<unsigned int> ListenShutdowns;
+
+    // unix socket files to remove, only used by Run()
+    std::vector<std::string> UnixSocketPaths;
+
+    AnTcpIoBackend IoBackend;
+    unsigned int IoThreadCount;
+    std::vector<AnTcpEventLoop*> EventLoops;
+    std::atomic<size_t> NextEventLoop;
+    std::vector<AnTcpIoUring*> IoUrings;
+    AnTcpLowLatencyOptions LowLatency;
+
+    // counters of the I/O threads in the low latency mode, kept until the next Run() so they can be read afterwards
+    std::mutex IoThreadCountersMutex;
+    std::vector<std::unique_ptr<AnTcpIoThreadCounters>> IoThreadCounters;
+    AnTcpIoThreadCounters* ClientThreadCounters;
+
+    // recv() and wait syscalls of the I/O threads of the last Run()
+    AnTcpReceiveCounters ReceiveCounters;
+    AnTcpConnectionTable Connections;
+    AnTcpConnectionLimitMode ConnectionLimitMode;
+    AnTcpCallbackRegistry Callbacks;
+    AnTcpClientOptions ClientOptions;
+    AnTcpBufferPool BufferPool;
+    AnTcpMetrics Metrics;
+    AnTcpResponseCache ResponseCache;
+    AnTcpSingleFlight SingleFlight;
+    AnTcpAdmission Admission;
+    AnTcpPubSub PubSub;
+    AnTcpTrafficLog TrafficLog;
+    AnTcpWorkerPool WorkerPool;
+    unsigned int WorkerCount;
+
+    std::function<void(ClientHandler*)> OnClientConnected;
+    std::function<void(ClientHandler*)> OnClientDisconnected;
+
+    friend class AnTcpIoUring;
+    friend class ClientHandler;
+
+    // lets the tests look at the admission of the server
+    friend class AnTcpTestAccess;
+
+public:
+    /// <summary>
+    /// Create a server without listeners, add them using AddListener() and AddUnixListener().
+    /// </summary>
+    AnTcpServer()
+        : Listeners(),
+        ListenerShards(1),
+        ShouldExit(false),
+        ListenSockets(),
+        ListenSocketCount(0),
+        ListenShutdowns(0),
+        UnixSocketPaths(),
+        IoBackend(AnTcpIoBackend::ThreadPerClient),
+        IoThreadCount(0),
+        EventLoops(),
+        NextEventLoop(0),
+        IoUrings(),
+        LowLatency(),
+        IoThreadCountersMutex(),
+        IoThreadCounters(),
+        ClientThreadCounters(nullptr),
+        ReceiveCounters(),
+        Connections(),
+        ConnectionLimitMode(AnTcpConnectionLimitMode::Reject),
+        Callbacks(),
+        ClientOptions(),
+        BufferPool(),
+        Metrics(),
+        ResponseCache(),
+        SingleFlight(),
+        Admission(),
+        PubSub(),
+        TrafficLog(),
+        WorkerPool(),
+        WorkerCount(0),
+        OnClientConnected(nullptr),
+        OnClientDisconnected(nullptr)
+    {
+        AddProtocolCallbacks();
+    }
+
+    /// <summary>
+    /// Create anew instace of the AnTcpServer to start a new server.
+    /// </summary>
+    /// <param name="ip">Ip address to bind the server to, ipv4 or ipv6.</param>
+    /// <param name="port">Port to listen on.</param>
+    AnTcpServer(const std::string& ip, unsigned short port)
+        : Listeners{ AnTcpListener{ AnTcpListenerType::Tcp, ip, std::to_string(port) } },
+        ListenerShards(1),
+        ShouldExit(false),
+        ListenSockets(),
+        ListenSocketCount(0),
+        ListenShutdowns(0),
+        UnixSocketPaths(),
+        IoBackend(AnTcpIoBackend::ThreadPerClient),
+        IoThreadCount(0),
+        EventLoops(),
+        NextEventLoop(0),
+        IoUrings(),
+        LowLatency(),
+        IoThreadCountersMutex(),
+        IoThreadCounters(),
+        ClientThreadCounters(nullptr),
+        ReceiveCounters(),
+        Connections(),
+        ConnectionLimitMode(AnTcpConnectionLimitMode::Reject),
+        Callbacks(),
+        ClientOptions(),
+        BufferPool(),
+        Metrics(),
+        ResponseCache(),
+        SingleFlight(),
+        Admission(),
+        PubSub(),
+        TrafficLog(),
+        WorkerPool(),
+        WorkerCount(0),
+        OnClientConnected(nullptr),
+        OnClientDisconnected(nullptr)
+    {
+        AddProtocolCallbacks();
+    }
+
+    /// <summary>
+    /// Create anew instace of the AnTcpServer to start a new server.
+    /// </summary>
+    /// <param name="ip">Ip address to bind the server to, ipv4 or ipv6.</param>
+    /// <param name="port">Port to listen on.</param>
+    AnTcpServer(const std::string& ip, const std::string& port)
+        : Listeners{ AnTcpListener{ AnTcpListenerType::Tcp, ip, port } },
+        ListenerShards(1),
+        ShouldExit(false),
+        ListenSockets(),
+        ListenSocketCount(0),
+        ListenShutdowns(0),
+        UnixSocketPaths(),
+        IoBackend(AnTcpIoBackend::ThreadPerClient),
+        IoThreadCount(0),
+        EventLoops(),
+        NextEventLoop(0),
+        IoUrings(),
+        LowLatency(),
+        IoThreadCountersMutex(),
+        IoThreadCounters(),
+        ClientThreadCounters(nullptr),
+        ReceiveCounters(),
+        Connections(),
+        ConnectionLimitMode(AnTcpConnectionLimitMode::Reject),
+        Callbacks(),
+        ClientOptions(),
+        BufferPool(),
+        Metrics(),
+        ResponseCache(),
+        SingleFlight(),
+        Admission(),
+        PubSub(),
+        TrafficLog(),
+        WorkerPool(),
+        WorkerCount(0),
+        OnClientConnected(nullptr),
+        OnClientDisconnected(nullptr)
+    {
+        AddProtocolCallbacks();
+    }
+
+    AnTcpServer(const AnTcpServer&) = delete;
+    AnTcpServer& operator=(const AnTcpServer&) = delete;
+
+    /// <summary>
+    /// Set the event handler for the OnClientConnected event, it may run on multiple threads at once.
+    /// </summary>
+    /// <param name="handlerFunction">Handler function, can be nulltpr</param>
+    inline void SetOnClientConnected(std::function<void(ClientHandler*)> handlerFunction)
+    {
+        OnClientConnected = handlerFunction;
+    }
+
+    /// <summary>
+    /// Set the event handler for the OnClientDisconnected event.
+    /// </summary>
+    /// <param name="handlerFunction">Handler function, can be nulltpr</param>
+    inline void SetOnClientDisconnected(std::function<void(ClientHandler*)> handlerFunction)
+    {
+        OnClientDisconnected = handlerFunction;
+    }
+
+    /// <summary>
+    /// Accept clients on another tcp endpoint too, needs to be called before Run().
+    /// The ip and port passed to the constructor are the first listener.
+    /// </summary>
+    /// <param name="ip">Ip address to bind to, ipv6 listeners only accept ipv6 clients.</param>
+    /// <param name="port">Port to listen on.</param>
+    inline void AddListener(const std::string& ip, const std::string& port)
+    {
+        Listeners.push_back(AnTcpListener{ AnTcpListenerType::Tcp, ip, port });
+    }
+
+    /// <summary>
+    /// Accept local clients on a unix domain socket, needs to be called before Run().
+    /// A stale socket file left behind at the path is replaced, the file is removed when the server stops.
+    /// Run() fails with EADDRINUSE when another server still accepts on it.
+    /// Not available on windows.
+    /// </summary>
+    /// <param name="path">Path of the socket file.</param>
+    inline void AddUnixListener(const std::string& path)
+    {
+        Listeners.push_back(AnTcpListener{ AnTcpListenerType::Unix, path, "" });
+    }
+
+    /// <summary>
+    /// Bind every tcp listener multiple times with SO_REUSEPORT, needs to be called before Run().
+    /// Each socket accepts on its own thread and the kernel spreads new connections over them,
+    /// so accepting scales over multiple cores when many clients connect at once. Ignored on
+    /// platforms without SO_REUSEPORT.
+    /// </summary>
+    /// <param name="shards">Number of sockets per tcp listener.</param>
+    inline void SetListenerShards(unsigned int shards) noexcept
+    {
+        ListenerShards = std::max(1u, shards);
+    }
+
+    /// <summary>
+    /// Select how client sockets are served, needs to be called before Run().
+    /// The io_uring backend falls back to the event loop when the kernel does not
+    /// support it, the event loop backend to one thread per client on platforms
+    /// where it is not available.
+    /// </summary>
+    /// <param name="backend">Backend to use.</param>
+    /// <param name="ioThreadCount">Number of event loop or io_uring threads, 0 uses one per hardware thread.</param>
+    inline void SetIoBackend(AnTcpIoBackend backend, unsigned int ioThreadCount = 0) noexcept
+    {
+        IoBackend = backend;
+        IoThreadCount = ioThreadCount;
+    }
+
+    /// <summary>
+    /// Trade cpu time for latency, needs to be called before Run(). I/O threads poll their sockets
+    /// for a while before they block, so a request that follows quickly does not have to wait for
+    /// the scheduler to wake the thread up, and get pinned to the given cores in turn. Accepted tcp
+    /// sockets get TCP_NODELAY and busy polling where the kernel supports it. See GetIoThreadStats()
+    /// for what the spinning costs.
+    /// </summary>
+    /// <param name="enabled">True to enable the mode.</param>
+    /// <param name="cores">Cores the I/O threads are pinned to in turn, empty leaves them to the scheduler.</param>
+    /// <param name="spinTime">How long an I/O thread polls before it blocks.</param>
+    /// <param name="busyPoll">SO_BUSY_POLL of accepted sockets, 0 leaves the system default.</param>
+    inline void SetLowLatency(bool enabled, std::vector<unsigned int> cores = {}, std::chrono::microseconds spinTime = std::chrono::microseconds(ANTCP_LOW_LATENCY_SPIN_TIME),
+        std::chrono::microseconds busyPoll = std::chrono::microseconds(ANTCP_LOW_LATENCY_BUSY_POLL)) noexcept
+    {
+        LowLatency.Enabled = enabled;
+        LowLatency.Cores = std::move(cores);
+        LowLatency.SpinTime = static_cast<unsigned int>(spinTime.count());
+        LowLatency.BusyPoll = static_cast<unsigned int>(busyPoll.count());
+    }
+
+    /// <summary>
+    /// Enable or disable nagle's algorithm for new clients, enabling
+    /// this sends small responses immediately.
+    /// </summary>
+    /// <param name="noDelay">True to set TCP_NODELAY on accepted sockets.</param>
+    inline void SetNoDelay(bool noDelay) noexcept
+    {
+        ClientOptions.NoDelay = noDelay;
+    }
+
+    /// <summary>
+    /// Collect all responses generated while processing the packets of one
+    /// receive call and send them together, needs to be called before Run().
+    /// </summary>
+    /// <param name="batchResponses">True to batch responses.</param>
+    inline void SetBatchResponses(bool batchResponses) noexcept
+    {
+        ClientOptions.BatchResponses = batchResponses;
+    }
+
+    /// <summary>
+    /// Set the biggest packet size clients may send, needs to be called before Run().
+    /// Packets bigger than the receive buffer are received into pooled buffers.
+    /// </summary>
+    /// <param name="maxPacketSize">Maximum size of type and payload in bytes.</param>
+    inline void SetMaxPacketSize(AnTcpSizeType maxPacketSize) noexcept
+    {
+        ClientOptions.MaxPacketSize = maxPacketSize;
+    }
+
+    /// <summary>
+    /// Offer shared memory rings to clients on the same host, see ANTCP_MESSAGE_SHARED_MEMORY.
+    /// Every client that moves to shared memory gets a thread of its own, no matter which I/O backend
+    /// is used, its socket is only watched for the disconnect. Only available on linux.
+    /// </summary>
+    /// <param name="enabled">True to create segments for clients that ask for them.</param>
+    /// <param name="ringSize">Size of the request and the response ring of each client.</param>
+    /// <param name="spinTime">How long the thread of a client polls for requests before it sleeps on a futex.</param>
+    inline void SetSharedMemory(bool enabled, size_t ringSize = ANTCP_SHARED_MEMORY_RING_SIZE, std::chrono::microseconds spinTime = std::chrono::microseconds(0)) noexcept
+    {
+        ClientOptions.SharedMemory = enabled;
+        ClientOptions.SharedMemoryRingSize = ringSize;
+        ClientOptions.SharedMemorySpinTime = static_cast<unsigned int>(spinTime.count());
+    }
+
+    /// <summary>
+    /// Set the number of worker threads that execute pooled callbacks, needs to be called before Run().
+    /// The pool is only started when at least one callback uses AnTcpDispatchMode::Pooled.
+    /// </summary>
+    /// <param name="workerCount">Number of workers, 0 uses one per hardware thread.</param>
+    inline void SetWorkerCount(unsigned int workerCount) noexcept
+    {
+        WorkerCount = workerCount;
+    }
+
+    /// <summary>
+    /// Limit the number of open connections, needs to be called before Run().
+    /// </summary>
+    /// <param name="maxConnections">Maximum number of connections, 0 means unlimited.</param>
+    /// <param name="mode">What happens to new connections while the limit is reached.</param>
+    inline void SetMaxConnections(size_t maxConnections, AnTcpConnectionLimitMode mode = AnTcpConnectionLimitMode::Reject) noexcept
+    {
+        Connections.SetMaxConnections(maxConnections);
+        ConnectionLimitMode = mode;
+    }
+
+    /// <summary>
+    /// Limit the requests every client may send, requests over the limit are answered with
+    /// ANTCP_MESSAGE_BUSY instead of running their callback. Needs to be called before Run().
+    /// </summary>
+    /// <param name="rate">Requests per second, 0 means unlimited.</param>
+    /// <param name="burst">Requests a client may send at once after a quiet period, 0 allows one second worth of requests.</param>
+    inline void SetConnectionRateLimit(double rate, double burst = 0.0) noexcept
+    {
+        Admission.SetConnectionLimit(AnTcpRateLimit{ rate, burst });
+    }
+
+    /// <summary>
+    /// Limit the requests of a message type all clients together may send, requests over the limit
+    /// are answered with ANTCP_MESSAGE_BUSY instead of running their callback. Use it to protect
+    /// expensive callbacks. Needs to be called before Run().
+    /// </summary>
+    /// <param name="type">Message type.</param>
+    /// <param name="rate">Requests per second, 0 means unlimited.</param>
+    /// <param name="burst">Requests that may arrive at once after a quiet period, 0 allows one second worth of requests.</param>
+    inline void SetMessageRateLimit(AnTcpMessageType type, double rate, double burst = 0.0) noexcept
+    {
+        Admission.SetMessageLimit(type, AnTcpRateLimit{ rate, burst });
+    }
+
+    /// <summary>
+    /// Limit the requests that are running, queued on the worker pool or suspended in a task at the same
+    /// time. New requests are answered with ANTCP_MESSAGE_BUSY while the limit is reached, so they don't
+    /// queue up when the server is overloaded. Needs to be called before Run().
+    /// </summary>
+    /// <param name="maxInFlight">Maximum number of requests, 0 means unlimited.</param>
+    inline void SetMaxInFlight(size_t maxInFlight) noexcept
+    {
+        Admission.SetMaxInFlight(maxInFlight);
+    }
+
+    /// <summary>
+    /// Get the number of requests that were answered with ANTCP_MESSAGE_BUSY.
+    /// </summary>
+    inline uint64_t GetRejectedRequestCount() const noexcept
+    {
+        return Admission.GetRejectedCount();
+    }
+
+    /// <summary>
+    /// Get the number of requests that were answered with ANTCP_MESSAGE_TIMEOUT, see AnTcpCallbackOptions::Deadline.
+    /// </summary>
+    inline uint64_t GetTimedOutRequestCount() const noexcept
+    {
+        return Admission.GetTimedOutCount();
+    }
+
+    /// <summary>
+    /// Get the number of open connections.
+    /// </summary>
+    inline size_t GetConnectionCount() noexcept
+    {
+        return Connections.GetCount();
+    }
+
+    /// <summary>
+    /// Get the number of connections that were closed because the connection limit was reached.
+    /// </summary>
+    inline uint64_t GetRejectedConnectionCount() const noexcept
+    {
+        return Connections.GetRejectedCount();
+    }
+
+    /// <summary>
+    /// Send data to a client by its connection id, safe to call from any thread
+    /// and after the client disconnected.
+    /// </summary>
+    /// <param name="id">Id of the connection, see ClientHandler::GetId().</param>
+    /// <param name="type">Message type (1 byte)</param>
+    /// <param name="data">Data to send.</param>
+    /// <param name="size">Size of the data to send.</param>
+    /// <returns>True if data was sent, false if the connection is closed or sending failed.</returns>
+    bool SendData(AnTcpConnectionId id, AnTcpMessageType type, const void* data, size_t size) noexcept;
+
+    /// <summary>
+    /// Push data to every subscriber of a topic as ANTCP_MESSAGE_PUBLISH frame, safe to call from any thread.
+    /// The frame is encoded once and shared by the push queues of the subscribers. Subscribers whose socket
+    /// is full or whose responses are corked keep the frame queued until they can take it, see SetSlowSubscriberPolicy().
+    /// </summary>
+    /// <param name="topic">Topic to publish to.</param>
+    /// <param name="data">Data to publish.</param>
+    /// <param name="size">Size of the data.</param>
+    /// <returns>Number of subscribers the frame was queued for.</returns>
+    size_t Publish(AnTcpTopic topic, const void* data, size_t size) noexcept;
+
+    /// <summary>
+    /// Push a single primitive or struct to every subscriber of a topic, see Publish().
+    /// </summary>
+    template<typename T>
+    inline size_t PublishVar(AnTcpTopic topic, const T& data) noexcept
+    {
+        return Publish(topic, &data, sizeof(T));
+    }
+
+    /// <summary>
+    /// Subscribe a client to a topic, clients can do the same with ANTCP_MESSAGE_SUBSCRIBE.
+    /// </summary>
+    /// <param name="id">Id of the connection, see ClientHandler::GetId().</param>
+    /// <returns>True if it was subscribed, false if the connection is closed, already subscribed or has too many topics.</returns>
+    bool Subscribe(AnTcpConnectionId id, AnTcpTopic topic) noexcept;
+
+    /// <summary>
+    /// Unsubscribe a client from a topic.
+    /// </summary>
+    /// <param name="id">Id of the connection, see ClientHandler::GetId().</param>
+    /// <returns>True if it was unsubscribed, false if the connection is closed or was not subscribed.</returns>
+    bool Unsubscribe(AnTcpConnectionId id, AnTcpTopic topic) noexcept;
+
+    /// <summary>
+    /// Set what happens when frames are published faster than a subscriber reads them, needs to be called before Run().
+    /// </summary>
+    /// <param name="policy">What to do when the push queue of a subscriber is full.</param>
+    /// <param name="queueLimit">Frames that may wait for a subscriber.</param>
+    inline void SetSlowSubscriberPolicy(AnTcpSlowSubscriberPolicy policy, size_t queueLimit = ANTCP_PUSH_QUEUE_DEFAULT_LIMIT) noexcept
+    {
+        PubSub.SetPolicy(policy, queueLimit);
+    }
+
+    /// <summary>
+    /// Get the number of subscribers of a topic.
+    /// </summary>
+    inline size_t GetSubscriberCount(AnTcpTopic topic) noexcept
+    {
+        const AnTcpSubscriberList subscribers = PubSub.GetSubscribers(topic);
+        return subscribers ? subscribers->size() : 0;
+    }
+
+    /// <summary>
+    /// Get the counters of the published frames, and how many were dropped for slow subscribers.
+    /// </summary>
+    inline AnTcpPubSubStats GetPubSubStats() noexcept
+    {
+        return PubSub.GetStats();
+    }
+
+    /// <summary>
+    /// Add a new callback for a message type, will be fired when the server received a message of that type.
+    /// Callbacks can be added, replaced and removed while the server runs, see AnTcpCallbackRegistry.
+    /// </summary>
+    /// <param name="type">Message type.</param>
+    /// <param name="callback">Function to handle the message.</param>
+    /// <param name="options">Where the callback is executed, pooled callbacks must be added before Run().</param>
+    /// <returns>True if callback was added, false if there is already a callback for this message type or it is reserved.</returns>
+    template<typename T>
+        requires std::is_invocable_v<T, ClientHandler*, AnTcpMessageType, const void*, int>
+    inline bool AddCallback(AnTcpMessageType type, T&& callback, AnTcpCallbackOptions options = {}) noexcept
+    {
+        return SetCallbackEntry(type, AnTcpCallbackEntry{ .Callback = std::forward<T>(callback), .Options = options }, false);
+    }
+
+    /// <summary>
+    /// Add a new callback for a message type, will be fired when the server received a message of that type.
+    /// Plain functions are called directly, without the overhead of std::function.
+    /// </summary>
+    /// <param name="type">Message type.</param>
+    /// <param name="callback">Function to handle the message.</param>
+    /// <param name="options">Where the callback is executed, pooled callbacks must be added before Run().</param>
+    /// <returns>True if callback was added, false if there is already a callback for this message type or it is reserved.</returns>
+    inline bool AddCallback(AnTcpMessageType type, AnTcpCallbackFunction callback, AnTcpCallbackOptions options = {}) noexcept
+    {
+        return SetCallbackEntry(type, AnTcpCallbackEntry{ .Function = callback, .Options = options }, false);
+    }
+
+    /// <summary>
+    /// Add a new callback known at compile time, it gets inlined into the dispatch thunk.
+    /// Usage: server.AddCallback&lt;MyCallback&gt;(type);
+    /// </summary>
+    /// <typeparam name="Callback">Function pointer or captureless lambda to handle the message.</typeparam>
+    /// <param name="type">Message type.</param>
+    /// <param name="options">Where the callback is executed, pooled callbacks must be added before Run().</param>
+    /// <returns>True if callback was added, false if there is already a callback for this message type.</returns>
+    template<auto Callback>
+    inline bool AddCallback(AnTcpMessageType type, AnTcpCallbackOptions options = {}) noexcept
+    {
+        return AddCallback(type, &AnTcpCallbackThunk<Callback>, options);
+    }
+
+    /// <summary>
+    /// Add a compile time list of callbacks, see AnTcpHandler.
+    /// </summary>
+    /// <typeparam name="Handlers">AnTcpHandler types.</typeparam>
+    /// <returns>True if all callbacks were added, false if there already was a callback for one of the message types.</returns>
+    template<typename... Handlers>
+    inline bool AddCallbacks() noexcept
+    {
+        return (AddCallback(Handlers::MessageType, Handlers::Function, Handlers::Options) & ...);
+    }
+
+    /// <summary>
+    /// Add a coroutine callback for a message type, see AnTcpTask. It starts like any other callback
+    /// and can co_await without blocking the thread, the task keeps its client alive until it finished.
+    /// Responses are sent in the order the tasks finish, so clients should negotiate frame version 2.
+    /// Responses of tasks are neither cached nor shared, Cacheable and SingleFlight are ignored, and
+    /// the message type can't be used inside of an ANTCP_MESSAGE_BATCH.
+    /// </summary>
+    /// <param name="type">Message type.</param>
+    /// <param name="task">Coroutine function to handle the message.</param>
+    /// <param name="options">Where the task is started, pooled tasks must be added before Run().</param>
+    /// <returns>True if the task was added, false if there is already a callback for this message type or it is reserved.</returns>
+    inline bool AddTaskCallback(AnTcpMessageType type, AnTcpTaskFunction task, AnTcpCallbackOptions options = {}) noexcept
+    {
+        return SetCallbackEntry(type, AnTcpCallbackEntry{ .Task = task, .Options = options }, false);
+    }
+
+    /// <summary>
+    /// Add or replace the callback of a message type, requests that arrive afterwards run the new one.
+    /// Requests that already run or wait in a queue may still run the old one.
+    /// </summary>
+    /// <param name="type">Message type.</param>
+    /// <param name="callback">Function to handle the message.</param>
+    /// <param name="options">Where the callback is executed, pooled callbacks run inline when no pooled callback was added before Run().</param>
+    /// <returns>True if callback was set, false if the message type is reserved.</returns>
+    template<typename T>
+        requires std::is_invocable_v<T, ClientHandler*, AnTcpMessageType, const void*, int>
+    inline bool ReplaceCallback(AnTcpMessageType type, T&& callback, AnTcpCallbackOptions options = {}) noexcept
+    {
+        return SetCallbackEntry(type, AnTcpCallbackEntry{ .Callback = std::forward<T>(callback), .Options = options }, true);
+    }
+
+    /// <summary>
+    /// Add or replace the callback of a message type, requests that arrive afterwards run the new one.
+    /// Requests that already run or wait in a queue may still run the old one.
+    /// </summary>
+    /// <param name="type">Message type.</param>
+    /// <param name="callback">Function to handle the message.</param>
+    /// <param name="options">Where the callback is executed, pooled callbacks run inline when no pooled callback was added before Run().</param>
+    /// <returns>True if callback was set, false if the message type is reserved.</returns>
+    inline bool ReplaceCallback(AnTcpMessageType type, AnTcpCallbackFunction callback, AnTcpCallbackOptions options = {}) noexcept
+    {
+        return SetCallbackEntry(type, AnTcpCallbackEntry{ .Function = callback, .Options = options }, true);
+    }
+
+    /// <summary>
+    /// Change many callbacks at once, every request runs with either all or none of the changes.
+    /// Use it to swap a whole handler set while clients are connected. Changes to reserved
+    /// message types are discarded.
+    /// Usage: server.UpdateCallbacks([](AnTcpCallbackTable& table) { table[AnTcpCallbackIndex(1)].Function = PathV2; return true; });
+    /// </summary>
+    /// <param name="update">Called with a copy of the callbacks, returns false to discard the changes.</param>
+    /// <returns>True if the changes were published, false if the update discarded them.</returns>
+    template<typename Update>
+        requires std::is_invocable_r_v<bool, Update, AnTcpCallbackTable&>
+    inline bool UpdateCallbacks(Update&& update) noexcept
+    {
+        return Callbacks.Update([&update](AnTcpCallbackTable& table)
+        {
+            std::array<AnTcpCallbackEntry, 256 - ANTCP_RESERVED_MESSAGE_TYPES_START> reserved;
+            std::move(table.begin() + ANTCP_RESERVED_MESSAGE_TYPES_START, table.end(), reserved.begin());
+
+            if (!update(table))
+            {
+                return false;
+            }
+
+            std::move(reserved.begin(), reserved.end(), table.begin() + ANTCP_RESERVED_MESSAGE_TYPES_START);
+
+            for (AnTcpCallbackEntry& entry : table)
+            {
+                if (entry.Task)
+                {
+                    entry.Options.Cacheable = false;
+                    entry.Options.SingleFlight = false;
+                }
+            }
+
+            return true;
+        });
+    }
+
+    /// <summary>
+    /// Remove a callback for the given message type, requests that already run or wait in a queue may still run it.
+    /// </summary>
+    /// <param name="type">Message type.</param>
+    /// <returns>True if callback was removed, false if there was no callback for this message type or it is reserved.</returns>
+    inline bool RemoveCallback(AnTcpMessageType type) noexcept
+    {
+        return !AnTcpIsReservedMessageType(type) && Callbacks.Update([type](AnTcpCallbackTable& table)
+        {
+            AnTcpCallbackEntry& entry = table[AnTcpCallbackIndex(type)];
+
+            if (!entry)
+            {
+                return false;
+            }
+
+            entry = AnTcpCallbackEntry{};
+            return true;
+        });
+    }
+
+    /// <summary>
+    /// Get the number of callback table versions that were published and how many replaced ones
+    /// are still waiting for their readers, see AnTcpCallbackRegistry.
+    /// </summary>
+    inline std::pair<uint64_t, size_t> GetCallbackVersions() noexcept
+    {
+        return { Callbacks.GetVersionCount(), Callbacks.GetRetiredCount() };
+    }
+
+    /// <summary>
+    /// Turn recording of the server metrics on or off, they are on by default.
+    /// </summary>
+    /// <param name="enabled">True to record metrics.</param>
+    inline void SetMetricsEnabled(bool enabled) noexcept
+    {
+        Metrics.SetEnabled(enabled);
+    }
+
+    /// <summary>
+    /// Get the per message type counters and latency histograms, summed up
+    /// over all threads. Clients can request the same data with an
+    /// ANTCP_MESSAGE_METRICS packet.
+    /// </summary>
+    inline AnTcpMetricsSnapshot GetMetrics() const noexcept
+    {
+        return Metrics.GetSnapshot();
+    }
+
+    /// <summary>
+    /// Start capturing every received frame into a binary log, safe to call while the server runs. Every
+    /// thread records into a buffer of its own and a writer thread moves them into the file, records that
+    /// don't fit into a full buffer are dropped. See AnTcpTrafficLogReader and the replay mode of the benchmark.
+    /// </summary>
+    /// <param name="path">File to create, an existing one is overwritten.</param>
+    /// <param name="responses">Capture the responses too, so a replay can compare them.</param>
+    /// <returns>True if the capture was started, false if it runs already or the file could not be created.</returns>
+    inline bool StartTrafficLog(const std::string& path, bool responses = false) noexcept
+    {
+        return TrafficLog.Start(path, responses);
+    }
+
+    /// <summary>
+    /// Stop the capture, the log is complete when this returns.
+    /// </summary>
+    inline void StopTrafficLog() noexcept
+    {
+        TrafficLog.Stop();
+    }
+
+    /// <summary>
+    /// Get how many records were captured and how many were dropped.
+    /// </summary>
+    inline AnTcpTrafficLogStats GetTrafficLogStats() noexcept
+    {
+        return TrafficLog.GetStats();
+    }
+
+    /// <summary>
+    /// Set the size of the response cache used by cacheable message types, see AnTcpCallbackOptions::Cacheable.
+    /// </summary>
+    /// <param name="bytes">Maximum size of all cached keys and responses, 0 disables the cache.</param>
+    inline void SetResponseCacheSize(size_t bytes) noexcept
+    {
+        ResponseCache.SetCapacity(bytes);
+    }
+
+    /// <summary>
+    /// Remove the cached responses of a request, call this when the data it depends on changed.
+    /// </summary>
+    /// <param name="type">Message type of the request.</param>
+    /// <param name="data">Payload of the request.</param>
+    /// <param name="size">Size of the payload.</param>
+    /// <returns>True if responses were cached, false if not.</returns>
+    inline bool InvalidateResponse(AnTcpMessageType type, const void* data, size_t size) noexcept
+    {
+        return ResponseCache.Invalidate(type, data, size);
+    }
+
+    /// <summary>
+    /// Remove all cached responses of a message type.
+    /// </summary>
+    /// <returns>Number of removed entries.</returns>
+    inline size_t InvalidateResponses(AnTcpMessageType type) noexcept
+    {
+        return ResponseCache.InvalidateType(type);
+    }
+
+    /// <summary>
+    /// Remove all cached responses.
+    /// </summary>
+    inline void ClearResponseCache() noexcept
+    {
+        ResponseCache.Clear();
+    }
+
+    /// <summary>
+    /// Get the hit, miss and eviction counters of the response cache.
+    /// </summary>
+    inline AnTcpResponseCacheStats GetResponseCacheStats() noexcept
+    {
+        return ResponseCache.GetStats();
+    }
+
+    /// <summary>
+    /// Get the number of requests of single flight message types that got the responses of an identical request
+    /// instead of running the callback, see AnTcpCallbackOptions::SingleFlight.
+    /// </summary>
+    inline uint64_t GetCoalescedRequestCount() const noexcept
+    {
+        return SingleFlight.GetFollowerCount();
+    }
+
+    /// <summary>
+    /// Get how the I/O threads spent their time in the low latency mode, one entry per event loop
+    /// or io_uring thread and one for all threads of the thread per client backend. The counters
+    /// of the last Run() stay available after it returned.
+    /// </summary>
+    std::vector<AnTcpIoThreadStats> GetIoThreadStats() noexcept;
+
+    /// <summary>
+    /// Get the recv() and wait syscalls the I/O threads of the last Run() made, divide them by the
+    /// received messages for the syscalls per message. A thread adds its counts when it exits, so
+    /// they are complete once the clients disconnected and Run() returned.
+    /// </summary>
+    inline AnTcpReceiveStats GetReceiveStats() const noexcept
+    {
+        return ReceiveCounters.GetStats();
+    }
+
+    /// <summary>
+    /// Stops the server, async signal safe on posix.
+    /// </summary>
+    inline void Stop() noexcept
+    {
+        // Run() notices the shut down listen sockets and cleans up, a Run() waiting
+        // for a free connection slot is woken up first as it is not blocked in accept()
+        ShouldExit = true;
+        Connections.Wakeup();
+        ShutdownListeners();
+    }
+
+    /// <summary>
+    /// Starts the server, blocking. You may want to start it on a thread.
+    /// </summary>
+    /// <returns>Status of the server, 1 if an error occured, 0 if not</returns>
+    AnTcpError Run() noexcept;
+
+private:
+    inline void ShutdownListeners() noexcept
+    {
+        // only atomics and shutdown(), Stop() may run in a signal handler where we must not lock or free anything
+        ListenShutdowns++;
+
+        const size_t count = ListenSocketCount.load();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const SOCKET listenSocket = ListenSockets[i].load();
+
+            if (listenSocket != INVALID_SOCKET)
+            {
+                // shutdown wakes up a blocking accept() on every platform, close does not on linux
+                shutdown(listenSocket, SD_BOTH);
+            }
+        }
+
+        ListenShutdowns--;
+    }
+
+    /// <summary>
+    /// Remember a socket of a listener, so Stop() can shut it down.
+    /// </summary>
+    /// <returns>True if it was added, false if there are ANTCP_MAX_LISTEN_SOCKETS already.</returns>
+    inline bool AddListenSocket(SOCKET listenSocket) noexcept
+    {
+        const size_t count = ListenSocketCount.load();
+
+        if (count == ANTCP_MAX_LISTEN_SOCKETS)
+        {
+            return false;
+        }
+
+        // stored before it is counted, a Stop() never sees an unset entry
+        ListenSockets[count].store(listenSocket);
+        ListenSocketCount.store(count + 1);
+        return true;
+    }
+
+    inline void SocketCleanup() noexcept
+    {
+        const size_t count = ListenSocketCount.exchange(0);
+        SOCKET listenSockets[ANTCP_MAX_LISTEN_SOCKETS];
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            listenSockets[i] = ListenSockets[i].exchange(INVALID_SOCKET);
+        }
+
+        // a Stop() that still looks at a socket must be done before it is closed, its number may be reused right after
+        while (ListenShutdowns > 0)
+        {
+            std::this_thread::yield();
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            closesocket(listenSockets[i]);
+        }
+
+        for (const std::string& path : UnixSocketPaths)
+        {
+            remove(path.c_str());
+        }
+
+        UnixSocketPaths.clear();
+    }
+
+    /// <summary>
+    /// Create, bind and listen on the sockets of all listeners.
+    /// </summary>
+    AnTcpError OpenListeners() noexcept;
+
+    /// <summary>
+    /// Create the sockets of a listener, a tcp listener gets one socket per shard.
+    /// </summary>
+    AnTcpError OpenListener(const AnTcpListener& listener) noexcept;
+
+    /// <summary>
+    /// Accept clients on a listen socket until the server stops.
+    /// </summary>
+    void AcceptClients(SOCKET listenSocket) noexcept;
+
+    /// <summary>
+    /// Spawn the event loop threads.
+    /// </summary>
+    /// <returns>True if the loops are running, false if the backend is not available.</returns>
+    bool StartEventLoops() noexcept;
+
+    /// <summary>
+    /// Stop and delete the event loop threads and their clients.
+    /// </summary>
+    void StopEventLoops() noexcept;
+
+    /// <summary>
+    /// Set up the io_uring threads and start them, each of them accepts on every listen socket.
+    /// </summary>
+    /// <returns>True if the threads are running, false if the kernel does not support it.</returns>
+    bool StartIoUrings(const std::vector<SOCKET>& listenSockets) noexcept;
+
+    /// <summary>
+    /// Delete the io_uring threads, they exited already.
+    /// </summary>
+    void StopIoUrings() noexcept;
+
+    /// <summary>
+    /// Start the worker pool if any callback needs it.
+    /// </summary>
+    void StartWorkerPool() noexcept;
+
+    /// <summary>
+    /// Create the counters of an I/O thread for the low latency mode.
+    /// </summary>
+    AnTcpIoThreadCounters* AddIoThreadCounters(AnTcpIoThreadType type, unsigned int index) noexcept;
+
+    /// <summary>
+    /// Get the core the nth I/O thread is pinned to, -1 if no cores were configured.
+    /// </summary>
+    inline int GetIoThreadCore(size_t index) const noexcept
+    {
+        return LowLatency.Cores.empty() ? -1 : static_cast<int>(LowLatency.Cores[index % LowLatency.Cores.size()]);
+    }
+
+    /// <summary>
+    /// Apply the client options and the low latency mode to an accepted socket.
+    /// </summary>
+    void SetupClientSocket(SOCKET clientSocket, const sockaddr_storage& clientInfo) noexcept;
+
+    /// <summary>
+    /// Set the callback of a message type in a new version of the callback table.
+    /// </summary>
+    /// <param name="replace">Whether an existing callback is replaced or kept.</param>
+    /// <returns>True if the callback was set, false if the message type is reserved, the entry is empty or there was one and it was kept.</returns>
+    inline bool SetCallbackEntry(AnTcpMessageType type, AnTcpCallbackEntry&& entry, bool replace) noexcept
+    {
+        if (!entry || AnTcpIsReservedMessageType(type))
+        {
+            return false;
+        }
+
+        if (entry.Task)
+        {
+            entry.Options.Cacheable = false;
+            entry.Options.SingleFlight = false;
+        }
+
+        return Callbacks.Update([type, &entry, replace](AnTcpCallbackTable& table)
+        {
+            AnTcpCallbackEntry& current = table[AnTcpCallbackIndex(type)];
+
+            if (current && !replace)
+            {
+                return false;
+            }
+
+            current = std::move(entry);
+            return true;
+        });
+    }
+
+    /// <summary>
+    /// Set the built in callbacks of the protocol messages.
+    /// </summary>
+    inline void AddProtocolCallbacks() noexcept
+    {
+        Callbacks.Update([](AnTcpCallbackTable& table)
+        {
+            table[AnTcpCallbackIndex(ANTCP_MESSAGE_METRICS)].Function = &MetricsCallback;
+            table[AnTcpCallbackIndex(ANTCP_MESSAGE_BATCH)].Function = &BatchCallback;
+            table[AnTcpCallbackIndex(ANTCP_MESSAGE_SUBSCRIBE)].Function = &SubscribeCallback;
+            table[AnTcpCallbackIndex(ANTCP_MESSAGE_UNSUBSCRIBE)].Function = &UnsubscribeCallback;
+            return true;
+        });
+    }
+
+    /// <summary>
+    /// Built in callback of ANTCP_MESSAGE_METRICS.
+    /// </summary>
+    static void MetricsCallback(ClientHandler* handler, AnTcpMessageType type, const void* data, int size) noexcept;
+
+    /// <summary>
+    /// Built in callback of ANTCP_MESSAGE_BATCH, runs the sub messages.
+    /// </summary>
+    static void BatchCallback(ClientHandler* handler, AnTcpMessageType type, const void* data, int size) noexcept;
+
+    /// <summary>
+    /// Built in callback of ANTCP_MESSAGE_SUBSCRIBE.
+    /// </summary>
+    static void SubscribeCallback(ClientHandler* handler, AnTcpMessageType type, const void* data, int size) noexcept;
+
+    /// <summary>
+    /// Built in callback of ANTCP_MESSAGE_UNSUBSCRIBE.
+    /// </summary>
+    static void UnsubscribeCallback(ClientHandler* handler, AnTcpMessageType type, const void* data, int size) noexcept;
 };
\ No newline at end of file
@@ -0,0 +1,379 @@
+#include "AnTcpServer.hpp"
+
+#include <new>
+
+#if ANTCP_HAS_SHARED_MEMORY
+#include <climits>
+#include <cstdio>
+#include <random>
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futexes need plain 32 bit words");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "positions are shared with another process");
+
+/// <summary>
+/// Sleep until the word is woken up or no longer has the expected value, works across processes.
+/// </summary>
+inline void AnTcpFutexWait(std::atomic<uint32_t>* word, uint32_t expected, const timespec* timeout) noexcept
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+/// <summary>
+/// Wake up everyone sleeping on the word.
+/// </summary>
+inline void AnTcpFutexWake(std::atomic<uint32_t>* word) noexcept
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+/// <summary>
+/// Tell the cpu that we are spinning.
+/// </summary>
+inline void AnTcpCpuRelax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+#endif
+
+bool AnTcpSharedRing::Write(const AnTcpIoVec* buffers, size_t count) noexcept
+{
+#if ANTCP_HAS_SHARED_MEMORY
+    size_t remaining = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        remaining += buffers[i].iov_len;
+    }
+
+    size_t buffer = 0;
+    size_t bufferOffset = 0;
+
+    while (remaining > 0)
+    {
+        // wait until everything fits, so the consumer gets whole frames it can process in place
+        if (!WaitForWritable(std::min<size_t>(remaining, Size)))
+        {
+            return false;
+        }
+
+        const uint64_t position = Control->WritePosition.load(std::memory_order_relaxed);
+        const size_t chunkSize = std::min(remaining, GetWritable());
+
+        for (size_t written = 0; written < chunkSize;)
+        {
+            const size_t length = std::min(buffers[buffer].iov_len - bufferOffset, chunkSize - written);
+            const char* source = static_cast<const char*>(buffers[buffer].iov_base) + bufferOffset;
+            const size_t offset = static_cast<size_t>((position + written) & (Size - 1));
+            const size_t firstPart = std::min(length, static_cast<size_t>(Size) - offset);
+
+            memcpy(Data + offset, source, firstPart);
+            memcpy(Data, source + firstPart, length - firstPart);
+
+            written += length;
+            bufferOffset += length;
+
+            if (bufferOffset == buffers[buffer].iov_len)
+            {
+                ++buffer;
+                bufferOffset = 0;
+            }
+        }
+
+        Control->WritePosition.store(position + chunkSize, std::memory_order_release);
+        Notify(Control->Readable);
+        remaining -= chunkSize;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AnTcpSharedRing::Copy(void* destination, size_t size) const noexcept
+{
+    const size_t offset = static_cast<size_t>(Control->ReadPosition.load(std::memory_order_relaxed) & (Size - 1));
+    const size_t firstPart = std::min(size, static_cast<size_t>(Size) - offset);
+
+    memcpy(destination, Data + offset, firstPart);
+    memcpy(static_cast<char*>(destination) + firstPart, Data, size - firstPart);
+}
+
+void AnTcpSharedRing::Consume(size_t size) noexcept
+{
+    Control->ReadPosition.store(Control->ReadPosition.load(std::memory_order_relaxed) + size, std::memory_order_release);
+    Notify(Control->Writable);
+}
+
+bool AnTcpSharedRing::Read(void* destination, size_t size) noexcept
+{
+    char* target = static_cast<char*>(destination);
+
+    while (size > 0)
+    {
+        // consume whatever is there, a producer writing more than the ring holds waits for the room
+        if (!WaitForReadable(1))
+        {
+            return false;
+        }
+
+        const size_t length = std::min(size, GetReadable());
+        Copy(target, length);
+        Consume(length);
+
+        target += length;
+        size -= length;
+    }
+
+    return true;
+}
+
+bool AnTcpSharedRing::WaitForReadable(size_t size, std::chrono::steady_clock::duration timeout) noexcept
+{
+    return Wait(Control->Readable, [this, size]() { return GetReadable() >= size; }, timeout);
+}
+
+bool AnTcpSharedRing::WaitForWritable(size_t size) noexcept
+{
+    return Wait(Control->Writable, [this, size]() { return GetWritable() >= size; }, std::chrono::steady_clock::duration::max());
+}
+
+template<typename Condition>
+bool AnTcpSharedRing::Wait(AnTcpSharedSignal& signal, Condition condition, std::chrono::steady_clock::duration timeout) noexcept
+{
+#if ANTCP_HAS_SHARED_MEMORY
+    if (condition())
+    {
+        return true;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto deadline = timeout < std::chrono::steady_clock::time_point::max() - now ? now + timeout : std::chrono::steady_clock::time_point::max();
+    const auto spinEnd = std::min(deadline, now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(SpinTime));
+
+    // a busy peer answers faster than a futex wakes us up
+    while (std::chrono::steady_clock::now() < spinEnd)
+    {
+        if (condition())
+        {
+            return true;
+        }
+
+        if (Closed->load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        AnTcpCpuRelax();
+    }
+
+    while (true)
+    {
+        const uint32_t sequence = signal.Sequence.load(std::memory_order_acquire);
+
+        // the other side checks the flag after publishing its position, so one of us sees the other
+        signal.Waiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        const bool ready = condition();
+
+        if (ready || Closed->load(std::memory_order_acquire))
+        {
+            signal.Waiting.store(0, std::memory_order_relaxed);
+            return ready;
+        }
+
+        const timespec* timeoutPointer = nullptr;
+        timespec time{};
+
+        if (deadline != std::chrono::steady_clock::time_point::max())
+        {
+            const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+
+            if (nanoseconds <= 0)
+            {
+                signal.Waiting.store(0, std::memory_order_relaxed);
+                return false;
+            }
+
+            time = timespec{ static_cast<time_t>(nanoseconds / 1000000000), static_cast<long>(nanoseconds % 1000000000) };
+            timeoutPointer = &time;
+        }
+
+        AnTcpFutexWait(&signal.Sequence, sequence, timeoutPointer);
+        signal.Waiting.store(0, std::memory_order_relaxed);
+    }
+#else
+    return false;
+#endif
+}
+
+void AnTcpSharedRing::Notify(AnTcpSharedSignal& signal) noexcept
+{
+#if ANTCP_HAS_SHARED_MEMORY
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // the syscall is only needed when the other side gave up spinning
+    if (signal.Waiting.load(std::memory_order_relaxed))
+    {
+        signal.Sequence.fetch_add(1, std::memory_order_release);
+        AnTcpFutexWake(&signal.Sequence);
+    }
+#endif
+}
+
+AnTcpSharedMemory::~AnTcpSharedMemory()
+{
+#if ANTCP_HAS_SHARED_MEMORY
+    if (Mapping)
+    {
+        munmap(Mapping, MappingSize);
+    }
+
+    if (!Name.empty())
+    {
+        // fails when the client already removed it
+        shm_unlink(Name.c_str());
+    }
+#endif
+}
+
+bool AnTcpSharedMemory::Create(size_t ringSize, std::chrono::microseconds spinTime) noexcept
+{
+#if ANTCP_HAS_SHARED_MEMORY
+    size_t size = ANTCP_SHARED_MEMORY_MIN_RING_SIZE;
+
+    while (size < ringSize)
+    {
+        size <<= 1;
+    }
+
+    // only the client that asked for the segment gets to know its name
+    std::random_device random;
+    char name[64]{ 0 };
+    snprintf(name, sizeof(name), "/antcp-%d-%08x%08x", static_cast<int>(getpid()), random(), random());
+
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+    if (fd == -1)
+    {
+        DEBUG_ONLY(std::cout << ">> shm_open() failed: " << errno << std::endl);
+        return false;
+    }
+
+    Name = name;
+    MappingSize = sizeof(AnTcpSharedMemoryHeader) + 2 * size;
+
+    if (ftruncate(fd, static_cast<off_t>(MappingSize)) == -1)
+    {
+        DEBUG_ONLY(std::cout << ">> ftruncate() failed: " << errno << std::endl);
+        close(fd);
+        return false;
+    }
+
+    Mapping = mmap(nullptr, MappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (Mapping == MAP_FAILED)
+    {
+        DEBUG_ONLY(std::cout << ">> mmap() failed: " << errno << std::endl);
+        Mapping = nullptr;
+        return false;
+    }
+
+    Header = new (Mapping) AnTcpSharedMemoryHeader();
+    Header->Magic = ANTCP_SHARED_MEMORY_MAGIC;
+    Header->Version = ANTCP_SHARED_MEMORY_VERSION;
+    Header->RingSize = size;
+
+    AttachRings(spinTime);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool AnTcpSharedMemory::Open(const std::string& name, std::chrono::microseconds spinTime) noexcept
+{
+#if ANTCP_HAS_SHARED_MEMORY
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    // nobody else can open it now, the memory is freed once both sides unmapped it
+    shm_unlink(name.c_str());
+
+    struct stat info{};
+
+    if (fstat(fd, &info) == -1 || static_cast<size_t>(info.st_size) < sizeof(AnTcpSharedMemoryHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    MappingSize = static_cast<size_t>(info.st_size);
+    Mapping = mmap(nullptr, MappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (Mapping == MAP_FAILED)
+    {
+        Mapping = nullptr;
+        return false;
+    }
+
+    Header = static_cast<AnTcpSharedMemoryHeader*>(Mapping);
+
+    if (Header->Magic != ANTCP_SHARED_MEMORY_MAGIC || Header->Version != ANTCP_SHARED_MEMORY_VERSION
+        || Header->RingSize < ANTCP_SHARED_MEMORY_MIN_RING_SIZE || (Header->RingSize & (Header->RingSize - 1)) != 0
+        || sizeof(AnTcpSharedMemoryHeader) + 2 * Header->RingSize != MappingSize)
+    {
+        munmap(Mapping, MappingSize);
+        Mapping = nullptr;
+        Header = nullptr;
+        return false;
+    }
+
+    AttachRings(spinTime);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AnTcpSharedMemory::Close() noexcept
+{
+#if ANTCP_HAS_SHARED_MEMORY
+    if (!Header)
+    {
+        return;
+    }
+
+    Header->Closed.store(1, std::memory_order_release);
+
+    // wake up whoever sleeps, they see the flag afterwards
+    for (AnTcpSharedSignal* signal : { &Header->Requests.Readable, &Header->Requests.Writable, &Header->Responses.Readable, &Header->Responses.Writable })
+    {
+        signal->Sequence.fetch_add(1, std::memory_order_release);
+        AnTcpFutexWake(&signal->Sequence);
+    }
+#endif
+}
+
+void AnTcpSharedMemory::AttachRings(std::chrono::microseconds spinTime) noexcept
+{
+    char* data = static_cast<char*>(Mapping) + sizeof(AnTcpSharedMemoryHeader);
+    Requests = AnTcpSharedRing(&Header->Requests, data, Header->RingSize, &Header->Closed, spinTime);
+    Responses = AnTcpSharedRing(&Header->Responses, data + Header->RingSize, Header->RingSize, &Header->Closed, spinTime);
+}
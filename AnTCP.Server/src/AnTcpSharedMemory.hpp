@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "AnTcpPlatform.hpp"
+
+// default size of each ring of a shared memory connection
+constexpr size_t ANTCP_SHARED_MEMORY_RING_SIZE = 1024 * 1024;
+
+// smallest ring size, sizes are rounded up to a power of two
+constexpr size_t ANTCP_SHARED_MEMORY_MIN_RING_SIZE = 4096;
+
+// first bytes of every segment ("ATCP") and the version of its layout
+constexpr uint32_t ANTCP_SHARED_MEMORY_MAGIC = 0x50435441;
+constexpr uint32_t ANTCP_SHARED_MEMORY_VERSION = 1;
+
+// the fields of the producer and the consumer of a ring are kept on their own cache lines
+constexpr size_t ANTCP_CACHE_LINE_SIZE = 64;
+
+/// <summary>
+/// Wakeup of one side of a ring, the waiting side sleeps on the sequence with a futex.
+/// </summary>
+struct AnTcpSharedSignal
+{
+    std::atomic<uint32_t> Sequence;
+
+    // set while the side is about to sleep, the other side only wakes it up then
+    std::atomic<uint32_t> Waiting;
+};
+
+/// <summary>
+/// Positions of a ring, they only grow and the offset in the ring is the position modulo its size.
+/// </summary>
+struct AnTcpSharedRingControl
+{
+    alignas(ANTCP_CACHE_LINE_SIZE) std::atomic<uint64_t> WritePosition;
+
+    // the consumer waits for data on this
+    AnTcpSharedSignal Readable;
+
+    alignas(ANTCP_CACHE_LINE_SIZE) std::atomic<uint64_t> ReadPosition;
+
+    // the producer waits for free space on this
+    AnTcpSharedSignal Writable;
+};
+
+/// <summary>
+/// Start of a shared memory segment, followed by the data of the request and the response ring.
+/// </summary>
+struct AnTcpSharedMemoryHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t RingSize;
+
+    // set by the side that closes the connection, waiting on the rings fails afterwards
+    std::atomic<uint32_t> Closed;
+
+    AnTcpSharedRingControl Requests;
+    AnTcpSharedRingControl Responses;
+};
+
+/// <summary>
+/// Single producer single consumer byte ring in shared memory. Frames are written just
+/// like on a socket, a write that does not fit waits until the consumer made room.
+/// </summary>
+class AnTcpSharedRing
+{
+private:
+    AnTcpSharedRingControl* Control;
+    char* Data;
+    uint64_t Size;
+    const std::atomic<uint32_t>* Closed;
+
+    // how long to poll before sleeping on a futex, trades cpu time for latency
+    std::chrono::microseconds SpinTime;
+
+public:
+    AnTcpSharedRing()
+        : Control(nullptr),
+        Data(nullptr),
+        Size(0),
+        Closed(nullptr),
+        SpinTime(0)
+    {}
+
+    AnTcpSharedRing(AnTcpSharedRingControl* control, char* data, uint64_t size, const std::atomic<uint32_t>* closed, std::chrono::microseconds spinTime)
+        : Control(control),
+        Data(data),
+        Size(size),
+        Closed(closed),
+        SpinTime(spinTime)
+    {}
+
+    /// <summary>
+    /// Get the number of bytes that can be read.
+    /// </summary>
+    inline size_t GetReadable() const noexcept
+    {
+        // the other process may write anything into the positions, never trust them beyond the ring
+        return static_cast<size_t>(std::min(Control->WritePosition.load(std::memory_order_acquire) - Control->ReadPosition.load(std::memory_order_relaxed), Size));
+    }
+
+    /// <summary>
+    /// Get the number of bytes that can be written.
+    /// </summary>
+    inline size_t GetWritable() const noexcept
+    {
+        const uint64_t used = Control->WritePosition.load(std::memory_order_relaxed) - Control->ReadPosition.load(std::memory_order_acquire);
+        return used < Size ? static_cast<size_t>(Size - used) : 0;
+    }
+
+    /// <summary>
+    /// Get the size of the ring.
+    /// </summary>
+    constexpr size_t GetSize() const noexcept { return static_cast<size_t>(Size); }
+
+    /// <summary>
+    /// Write multiple buffers, they become readable together when they fit into the
+    /// ring. Blocks while the ring is full, must not be called by multiple threads at once.
+    /// </summary>
+    /// <returns>True if everything was written, false if the connection was closed.</returns>
+    bool Write(const AnTcpIoVec* buffers, size_t count) noexcept;
+
+    /// <summary>
+    /// Write a single buffer, see Write().
+    /// </summary>
+    inline bool Write(const void* data, size_t size) noexcept
+    {
+        const AnTcpIoVec buffer = AnTcpMakeIoVec(data, size);
+        return Write(&buffer, 1);
+    }
+
+    /// <summary>
+    /// Get the next bytes without copying them, they stay valid until they are consumed.
+    /// </summary>
+    /// <param name="size">Number of bytes needed.</param>
+    /// <returns>Pointer to the bytes, null if they are not readable yet or wrap around the end of the ring.</returns>
+    inline const char* Peek(size_t size) const noexcept
+    {
+        const size_t offset = static_cast<size_t>(Control->ReadPosition.load(std::memory_order_relaxed) & (Size - 1));
+        return GetReadable() >= size && offset + size <= Size ? Data + offset : nullptr;
+    }
+
+    /// <summary>
+    /// Copy the next bytes without consuming them, they need to be readable.
+    /// </summary>
+    void Copy(void* destination, size_t size) const noexcept;
+
+    /// <summary>
+    /// Drop the next bytes, which makes room for the producer.
+    /// </summary>
+    void Consume(size_t size) noexcept;
+
+    /// <summary>
+    /// Copy and consume the next bytes, waits until all of them were written.
+    /// </summary>
+    /// <returns>True if the bytes were read, false if the connection was closed.</returns>
+    bool Read(void* destination, size_t size) noexcept;
+
+    /// <summary>
+    /// Wait until at least size bytes can be read, spins for the spin time before sleeping.
+    /// </summary>
+    /// <param name="size">Number of bytes, may not be bigger than the ring.</param>
+    /// <param name="timeout">How long to wait at most.</param>
+    /// <returns>True if the bytes can be read, false on timeout or if the connection was closed.</returns>
+    bool WaitForReadable(size_t size, std::chrono::steady_clock::duration timeout = std::chrono::steady_clock::duration::max()) noexcept;
+
+private:
+    /// <summary>
+    /// Wait until at least size bytes can be written.
+    /// </summary>
+    /// <returns>True if the bytes can be written, false if the connection was closed.</returns>
+    bool WaitForWritable(size_t size) noexcept;
+
+    /// <summary>
+    /// Spin and then sleep on a signal until the condition is met.
+    /// </summary>
+    template<typename Condition>
+    bool Wait(AnTcpSharedSignal& signal, Condition condition, std::chrono::steady_clock::duration timeout) noexcept;
+
+    /// <summary>
+    /// Wake up the other side if it sleeps on the signal.
+    /// </summary>
+    static void Notify(AnTcpSharedSignal& signal) noexcept;
+};
+
+/// <summary>
+/// Shared memory segment with a request and a response ring, used as transport for
+/// clients on the same host instead of the socket. The server creates it and the
+/// client maps it by its name, the socket stays open to notice when either side is gone.
+/// </summary>
+class AnTcpSharedMemory
+{
+private:
+    std::string Name;
+    void* Mapping;
+    size_t MappingSize;
+    AnTcpSharedMemoryHeader* Header;
+    AnTcpSharedRing Requests;
+    AnTcpSharedRing Responses;
+
+public:
+    AnTcpSharedMemory()
+        : Name(),
+        Mapping(nullptr),
+        MappingSize(0),
+        Header(nullptr),
+        Requests(),
+        Responses()
+    {}
+
+    /// <summary>
+    /// Unmaps the segment and removes its name if the client did not do so.
+    /// </summary>
+    ~AnTcpSharedMemory();
+
+    AnTcpSharedMemory(const AnTcpSharedMemory&) = delete;
+    AnTcpSharedMemory& operator=(const AnTcpSharedMemory&) = delete;
+
+    /// <summary>
+    /// Create a new segment with a random name, only the user of the process can open it.
+    /// </summary>
+    /// <param name="ringSize">Size of each ring, rounded up to a power of two.</param>
+    /// <param name="spinTime">How long to poll the rings before sleeping.</param>
+    /// <returns>True if the segment was created, false if not or the platform does not support it.</returns>
+    bool Create(size_t ringSize, std::chrono::microseconds spinTime) noexcept;
+
+    /// <summary>
+    /// Map a segment created by the server and remove its name, nobody else can open it afterwards.
+    /// </summary>
+    /// <param name="name">Name sent by the server.</param>
+    /// <param name="spinTime">How long to poll the rings before sleeping.</param>
+    /// <returns>True if the segment was mapped, false if not.</returns>
+    bool Open(const std::string& name, std::chrono::microseconds spinTime) noexcept;
+
+    /// <summary>
+    /// Mark the connection as closed and wake up both sides.
+    /// </summary>
+    void Close() noexcept;
+
+    /// <summary>
+    /// Whether either side closed the connection.
+    /// </summary>
+    inline bool IsClosed() const noexcept
+    {
+        return !Header || Header->Closed.load(std::memory_order_acquire) != 0;
+    }
+
+    /// <summary>
+    /// Get the name of the segment.
+    /// </summary>
+    inline const std::string& GetName() const noexcept { return Name; }
+
+    /// <summary>
+    /// Get the ring the client writes its requests to.
+    /// </summary>
+    inline AnTcpSharedRing& GetRequests() noexcept { return Requests; }
+
+    /// <summary>
+    /// Get the ring the server writes its responses to.
+    /// </summary>
+    inline AnTcpSharedRing& GetResponses() noexcept { return Responses; }
+
+private:
+    /// <summary>
+    /// Set up the rings of the mapped segment.
+    /// </summary>
+    void AttachRings(std::chrono::microseconds spinTime) noexcept;
+};
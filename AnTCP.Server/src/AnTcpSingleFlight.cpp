@@ -0,0 +1,53 @@
+#include "AnTcpServer.hpp"
+
+bool AnTcpSingleFlight::Join(AnTcpMessageType type, const void* data, size_t size, ClientHandler* waiter, AnTcpRequestId requestId, bool ordered, std::shared_ptr<AnTcpFlight>& flight) noexcept
+{
+    const std::string_view key = AnTcpResponseCache::BuildKey(type, data, size);
+
+    {
+        std::lock_guard lock(Mutex);
+        const auto existingFlight = Flights.find(key);
+
+        if (existingFlight != Flights.end())
+        {
+            flight = existingFlight->second;
+            AddWaiter(*flight, waiter, requestId, ordered);
+            return false;
+        }
+    }
+
+    // allocated outside of the lock, another thread may start the same flight meanwhile
+    std::shared_ptr<AnTcpFlight> newFlight = std::make_shared<AnTcpFlight>();
+    newFlight->Key = key;
+
+    std::lock_guard lock(Mutex);
+    const auto [entry, inserted] = Flights.emplace(newFlight->Key, newFlight);
+    flight = entry->second;
+
+    if (!inserted)
+    {
+        AddWaiter(*flight, waiter, requestId, ordered);
+        return false;
+    }
+
+    Leaders++;
+    return true;
+}
+
+std::vector<AnTcpFlightWaiter> AnTcpSingleFlight::Land(const std::shared_ptr<AnTcpFlight>& flight) noexcept
+{
+    std::lock_guard lock(Mutex);
+
+    // requests arriving from now on start a new flight
+    Flights.erase(flight->Key);
+    return std::move(flight->Waiters);
+}
+
+void AnTcpSingleFlight::AddWaiter(AnTcpFlight& flight, ClientHandler* waiter, AnTcpRequestId requestId, bool ordered) noexcept
+{
+    Followers++;
+
+    // taken before the leader can see the waiter, it finishes the request after it sent the responses
+    waiter->BeginFollow();
+    flight.Waiters.push_back(AnTcpFlightWaiter{ waiter, requestId, ordered });
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "AnTcpResponseCache.hpp"
+
+class ClientHandler;
+
+/// <summary>
+/// Request that joined a flight and gets its responses sent by the leader.
+/// </summary>
+struct AnTcpFlightWaiter
+{
+    // holds a reference and an in flight slot until the responses were sent
+    ClientHandler* Handler = nullptr;
+    AnTcpRequestId RequestId = 0;
+
+    // the client has no request ids, its strand waits for the responses
+    bool Ordered = false;
+};
+
+/// <summary>
+/// Request whose callback is running, identical requests wait for its responses.
+/// </summary>
+struct AnTcpFlight
+{
+    // message type followed by the payload
+    std::string Key;
+    std::vector<AnTcpFlightWaiter> Waiters;
+};
+
+/// <summary>
+/// Coalesces identical requests of single flight message types, only the first
+/// one runs the callback and the others get copies of its responses.
+/// </summary>
+class AnTcpSingleFlight
+{
+private:
+    std::mutex Mutex;
+
+    // keys point into the flights
+    std::unordered_map<std::string_view, std::shared_ptr<AnTcpFlight>> Flights;
+
+    std::atomic<uint64_t> Leaders;
+    std::atomic<uint64_t> Followers;
+
+public:
+    AnTcpSingleFlight()
+        : Mutex(),
+        Flights(),
+        Leaders(0),
+        Followers(0)
+    {}
+
+    AnTcpSingleFlight(const AnTcpSingleFlight&) = delete;
+    AnTcpSingleFlight& operator=(const AnTcpSingleFlight&) = delete;
+
+    /// <summary>
+    /// Join the flight of an identical request or start a new one.
+    /// </summary>
+    /// <param name="waiter">Handler that gets the responses sent by the leader, nothing waits for them.</param>
+    /// <param name="requestId">Id of the request of the waiter.</param>
+    /// <param name="ordered">Whether the strand of the waiter stops until the responses were sent.</param>
+    /// <param name="flight">The flight that was joined or started.</param>
+    /// <returns>True if a new flight was started and the callback has to run, false if the flight was joined.</returns>
+    bool Join(AnTcpMessageType type, const void* data, size_t size, ClientHandler* waiter, AnTcpRequestId requestId, bool ordered, std::shared_ptr<AnTcpFlight>& flight) noexcept;
+
+    /// <summary>
+    /// Finish a started flight, requests arriving afterwards start a new one.
+    /// </summary>
+    /// <returns>The waiters that joined the flight, the leader sends them the responses and finishes them.</returns>
+    std::vector<AnTcpFlightWaiter> Land(const std::shared_ptr<AnTcpFlight>& flight) noexcept;
+
+    /// <summary>
+    /// Number of requests that ran their callback.
+    /// </summary>
+    inline uint64_t GetLeaderCount() const noexcept { return Leaders; }
+
+    /// <summary>
+    /// Number of requests that got the responses of an identical request.
+    /// </summary>
+    inline uint64_t GetFollowerCount() const noexcept { return Followers; }
+
+private:
+    /// <summary>
+    /// Count a request that joined a flight and remember it for the leader, the mutex must be locked.
+    /// </summary>
+    void AddWaiter(AnTcpFlight& flight, ClientHandler* waiter, AnTcpRequestId requestId, bool ordered) noexcept;
+};
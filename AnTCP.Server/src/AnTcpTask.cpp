@@ -0,0 +1,72 @@
+#include "AnTcpTask.hpp"
+
+#include "AnTcpServer.hpp"
+
+AnTcpTask::promise_type::~promise_type()
+{
+    if (Detached)
+    {
+        Handler->FinishTask();
+    }
+}
+
+void AnTcpTask::promise_type::Enter() noexcept
+{
+    if (!Entered)
+    {
+        PreviousHandler = ClientHandler::CurrentRequest.Handler;
+        PreviousRequestId = ClientHandler::CurrentRequest.Id;
+        ClientHandler::CurrentRequest = AnTcpRequest{ Handler, RequestId };
+        Entered = true;
+    }
+}
+
+void AnTcpTask::promise_type::Leave() noexcept
+{
+    // awaiters that were ready never suspended, so there can be an enter without a leave
+    if (Entered)
+    {
+        ClientHandler::CurrentRequest = AnTcpRequest{ PreviousHandler, PreviousRequestId };
+        Entered = false;
+    }
+}
+
+std::coroutine_handle<> AnTcpTask::FinalAwaiter::await_suspend(Handle handle) noexcept
+{
+    promise_type& promise = handle.promise();
+    promise.Leave();
+
+    if (promise.Continuation)
+    {
+        // the awaiting task destroys this one together with the AnTcpTask it awaited
+        return promise.Continuation;
+    }
+
+    handle.destroy();
+    return std::noop_coroutine();
+}
+
+AnTcpTask::Handle AnTcpTask::TaskAwaiter::await_suspend(Handle caller) noexcept
+{
+    promise_type& promise = Task.promise();
+    promise.Handler = caller.promise().Handler;
+    promise.RequestId = caller.promise().RequestId;
+    promise.Continuation = caller;
+    return Task;
+}
+
+void AnTcpTask::Start(ClientHandler* handler, AnTcpRequestId requestId, std::vector<char>&& payload) noexcept
+{
+    const Handle coroutine = std::exchange(Coroutine, nullptr);
+    promise_type& promise = coroutine.promise();
+
+    // the task keeps the handler alive, even when the client disconnects meanwhile
+    handler->AddReference();
+
+    promise.Handler = handler;
+    promise.RequestId = requestId;
+    promise.Payload = std::move(payload);
+    promise.Detached = true;
+
+    coroutine.resume();
+}
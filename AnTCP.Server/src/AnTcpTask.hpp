@@ -0,0 +1,323 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "AnTcpCallbackTable.hpp"
+
+class ClientHandler;
+
+/// <summary>
+/// Coroutine returned by a task callback, see AnTcpServer::AddTaskCallback(). The server starts it
+/// on the thread that received the request. Whenever it awaits something that is not ready, the
+/// thread moves on to other work and the task resumes on the thread that completes the awaited work.
+/// Responses it sends carry the id of its request, no matter on which thread it resumed.
+/// Tasks can co_await other tasks, they run inline and share the request of their caller.
+/// Usage: AnTcpTask MyCallback(ClientHandler* handler, AnTcpMessageType type, const void* data, int size)
+///        { int result = co_await Lookup(...); handler->SendData(type, &result, sizeof(int)); }
+/// </summary>
+class AnTcpTask
+{
+public:
+    struct promise_type;
+
+private:
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    /// <summary>
+    /// Wraps everything the task awaits, the request of the task is left before
+    /// it suspends and entered again when it resumes.
+    /// </summary>
+    template<typename Awaiter>
+    struct ContextAwaiter
+    {
+        // awaiters that are the operand of co_await itself live until the end of the full expression
+        std::conditional_t<std::is_reference_v<Awaiter>, std::remove_reference_t<Awaiter>&, Awaiter> Inner;
+        promise_type& Promise;
+
+        inline bool await_ready()
+        {
+            return Inner.await_ready();
+        }
+
+        inline auto await_suspend(Handle handle)
+        {
+            Promise.Leave();
+            return Inner.await_suspend(handle);
+        }
+
+        inline decltype(auto) await_resume()
+        {
+            Promise.Enter();
+            return Inner.await_resume();
+        }
+    };
+
+    /// <summary>
+    /// Starts the body of the task, it runs in the context of its request.
+    /// </summary>
+    struct InitialAwaiter
+    {
+        promise_type& Promise;
+
+        constexpr bool await_ready() const noexcept { return false; }
+        constexpr void await_suspend(std::coroutine_handle<>) const noexcept {}
+        inline void await_resume() noexcept { Promise.Enter(); }
+    };
+
+    /// <summary>
+    /// Continues the task that awaited this one, a task started by the server destroys itself.
+    /// </summary>
+    struct FinalAwaiter
+    {
+        constexpr bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept;
+        constexpr void await_resume() const noexcept {}
+    };
+
+    /// <summary>
+    /// Runs a task that was co_awaited by another one.
+    /// </summary>
+    struct TaskAwaiter
+    {
+        Handle Task;
+
+        constexpr bool await_ready() const noexcept { return false; }
+        Handle await_suspend(Handle caller) noexcept;
+        constexpr void await_resume() const noexcept {}
+    };
+
+    Handle Coroutine;
+
+    friend class ClientHandler;
+
+public:
+    struct promise_type
+    {
+        // client and request the task answers, null until it was started or awaited
+        ClientHandler* Handler = nullptr;
+        AnTcpRequestId RequestId = 0;
+
+        // the receive buffer gets reused, so the task started by the server owns a copy of the payload
+        std::vector<char> Payload;
+
+        // task that awaits this one, resumed when it finished
+        std::coroutine_handle<> Continuation = nullptr;
+
+        // tasks started by the server hold a reference to the handler and destroy themselves
+        bool Detached = false;
+
+        // the request that ran on the thread before the task entered its own
+        bool Entered = false;
+        const ClientHandler* PreviousHandler = nullptr;
+        AnTcpRequestId PreviousRequestId = 0;
+
+        promise_type() = default;
+
+        promise_type(const promise_type&) = delete;
+        promise_type& operator=(const promise_type&) = delete;
+
+        /// <summary>
+        /// Drops the reference a detached task holds.
+        /// </summary>
+        ~promise_type();
+
+        inline AnTcpTask get_return_object() noexcept
+        {
+            return AnTcpTask(Handle::from_promise(*this));
+        }
+
+        inline InitialAwaiter initial_suspend() noexcept
+        {
+            return InitialAwaiter{ *this };
+        }
+
+        inline FinalAwaiter final_suspend() noexcept
+        {
+            return FinalAwaiter{};
+        }
+
+        inline void return_void() noexcept {}
+
+        /// <summary>
+        /// Callbacks run in noexcept code, a task that throws ends the process like any other callback.
+        /// </summary>
+        inline void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+
+        template<typename Awaitable>
+        inline auto await_transform(Awaitable&& awaitable)
+        {
+            if constexpr (requires { std::forward<Awaitable>(awaitable).operator co_await(); })
+            {
+                return ContextAwaiter<decltype(std::forward<Awaitable>(awaitable).operator co_await())>{ std::forward<Awaitable>(awaitable).operator co_await(), *this };
+            }
+            else
+            {
+                return ContextAwaiter<Awaitable&>{ awaitable, *this };
+            }
+        }
+
+        /// <summary>
+        /// Make the request of the task the current request of the thread, see ClientHandler::GetRequestId().
+        /// </summary>
+        void Enter() noexcept;
+
+        /// <summary>
+        /// Give the thread its previous request back.
+        /// </summary>
+        void Leave() noexcept;
+    };
+
+    AnTcpTask(AnTcpTask&& other) noexcept
+        : Coroutine(std::exchange(other.Coroutine, nullptr))
+    {}
+
+    AnTcpTask& operator=(AnTcpTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (Coroutine)
+            {
+                Coroutine.destroy();
+            }
+
+            Coroutine = std::exchange(other.Coroutine, nullptr);
+        }
+
+        return *this;
+    }
+
+    AnTcpTask(const AnTcpTask&) = delete;
+    AnTcpTask& operator=(const AnTcpTask&) = delete;
+
+    /// <summary>
+    /// Destroys a task that was never started or awaited, or one that was awaited and finished.
+    /// </summary>
+    ~AnTcpTask()
+    {
+        if (Coroutine)
+        {
+            Coroutine.destroy();
+        }
+    }
+
+    /// <summary>
+    /// Run the task inside another task, it can only be awaited once.
+    /// </summary>
+    inline TaskAwaiter operator co_await() && noexcept
+    {
+        return TaskAwaiter{ Coroutine };
+    }
+
+private:
+    explicit AnTcpTask(Handle coroutine) noexcept
+        : Coroutine(coroutine)
+    {}
+
+    /// <summary>
+    /// Run the task until it suspends the first time, it owns itself from now on.
+    /// </summary>
+    /// <param name="handler">Client that sent the request, a reference is held until the task finished.</param>
+    /// <param name="requestId">Id of the request.</param>
+    /// <param name="payload">Copy of the payload, the task got a pointer to its data.</param>
+    void Start(ClientHandler* handler, AnTcpRequestId requestId, std::vector<char>&& payload) noexcept;
+};
+
+/// <summary>
+/// Result that a task can co_await and another thread provides with Complete(), the awaiting task
+/// resumes on the thread that calls Complete(). Copies share the same result, it is awaited by one
+/// task. A task waiting for a completion that is never completed keeps its client alive and so
+/// AnTcpServer::Run() from returning.
+/// </summary>
+/// <typeparam name="T">Type of the result, void when there is none.</typeparam>
+template<typename T = void>
+class AnTcpCompletion
+{
+private:
+    typedef std::conditional_t<std::is_void_v<T>, std::monostate, T> ValueType;
+
+    struct State
+    {
+        std::atomic<bool> Completed{ false };
+        std::optional<ValueType> Value;
+
+        // coroutine waiting for the value, the address of the state once the value is there
+        std::atomic<void*> Waiter{ nullptr };
+    };
+
+    std::shared_ptr<State> Shared;
+
+public:
+    AnTcpCompletion()
+        : Shared(std::make_shared<State>())
+    {}
+
+    /// <summary>
+    /// Provide the result, the waiting task resumes on this thread before it returns.
+    /// </summary>
+    /// <returns>True if the result was set, false if the completion was already completed.</returns>
+    inline bool Complete() noexcept requires std::is_void_v<T>
+    {
+        return Finish(std::monostate{});
+    }
+
+    /// <summary>
+    /// Provide the result, the waiting task resumes on this thread before it returns.
+    /// </summary>
+    /// <returns>True if the result was set, false if the completion was already completed.</returns>
+    inline bool Complete(ValueType value) noexcept requires (!std::is_void_v<T>)
+    {
+        return Finish(std::move(value));
+    }
+
+    inline bool await_ready() const noexcept
+    {
+        return Shared->Waiter.load(std::memory_order_acquire) == Shared.get();
+    }
+
+    inline bool await_suspend(std::coroutine_handle<> waiter) noexcept
+    {
+        // fails when the value arrived meanwhile, the task continues right away then
+        void* expected = nullptr;
+        return Shared->Waiter.compare_exchange_strong(expected, waiter.address(), std::memory_order_acq_rel, std::memory_order_acquire);
+    }
+
+    inline T await_resume() noexcept
+    {
+        if constexpr (!std::is_void_v<T>)
+        {
+            return std::move(*Shared->Value);
+        }
+    }
+
+private:
+    inline bool Finish(ValueType&& value) noexcept
+    {
+        if (Shared->Completed.exchange(true, std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        // keep the state alive, the resumed task may drop the last other copy
+        const std::shared_ptr<State> state = Shared;
+        state->Value.emplace(std::move(value));
+        void* waiter = state->Waiter.exchange(state.get(), std::memory_order_acq_rel);
+
+        if (waiter)
+        {
+            std::coroutine_handle<>::from_address(waiter).resume();
+        }
+
+        return true;
+    }
+};
@@ -0,0 +1,330 @@
+#include "AnTcpTrafficLog.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+AnTcpTrafficLog::ThreadRings::~ThreadRings()
+{
+    // the ring may still hold records, the writer empties it while it waits for the next thread
+    for (RingHandle& handle : Handles)
+    {
+        std::lock_guard lock(handle.Owner->Mutex);
+        handle.Owner->FreeRings.push_back(handle.Instance);
+    }
+}
+
+AnTcpTrafficLog::Ring& AnTcpTrafficLog::AddRing() noexcept
+{
+    Ring* ring = nullptr;
+
+    {
+        std::lock_guard lock(Rings->Mutex);
+
+        if (!Rings->FreeRings.empty())
+        {
+            ring = Rings->FreeRings.back();
+            Rings->FreeRings.pop_back();
+        }
+        else
+        {
+            Rings->Rings.push_back(std::make_unique<Ring>());
+            ring = Rings->Rings.back().get();
+        }
+    }
+
+    CurrentRings.Handles.push_back(RingHandle{ Rings, ring });
+    return *ring;
+}
+
+bool AnTcpTrafficLog::Start(const std::string& path, bool responses) noexcept
+{
+    std::lock_guard lock(Mutex);
+
+    if (File.is_open())
+    {
+        return false;
+    }
+
+    File.open(path, std::ios::binary | std::ios::trunc);
+
+    if (!File.is_open())
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard ringLock(Rings->Mutex);
+
+        // records that came in while the last log was stopped belong to no log
+        for (const std::unique_ptr<Ring>& ring : Rings->Rings)
+        {
+            ring->ReadPosition.store(ring->WritePosition.load(std::memory_order_acquire), std::memory_order_release);
+        }
+    }
+
+    const AnTcpTrafficLogHeader header{ ANTCP_TRAFFIC_LOG_MAGIC, ANTCP_TRAFFIC_LOG_VERSION, responses ? ANTCP_TRAFFIC_LOG_RESPONSES : 0,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count() };
+
+    File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    StartTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    Responses = responses;
+    Stopping = false;
+    Writer = std::thread(&AnTcpTrafficLog::RunWriter, this);
+    Enabled = true;
+    return true;
+}
+
+void AnTcpTrafficLog::Stop() noexcept
+{
+    std::lock_guard lock(Mutex);
+
+    if (!File.is_open())
+    {
+        return;
+    }
+
+    Enabled = false;
+
+    {
+        std::lock_guard ringLock(Rings->Mutex);
+        Stopping = true;
+    }
+
+    Wakeup.notify_one();
+    Writer.join();
+    File.close();
+}
+
+void AnTcpTrafficLog::Record(AnTcpTrafficRecordKind kind, AnTcpConnectionId id, uint8_t frameVersion, const char* first, size_t firstSize, const char* second, size_t secondSize) noexcept
+{
+    Ring& ring = GetRing();
+    const size_t size = sizeof(AnTcpTrafficRecordHeader) + firstSize + secondSize;
+    const uint64_t writePosition = ring.WritePosition.load(std::memory_order_relaxed);
+
+    if (writePosition + size - ring.ReadPosition.load(std::memory_order_acquire) > ANTCP_TRAFFIC_LOG_RING_SIZE)
+    {
+        ring.Dropped.store(ring.Dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    const AnTcpTrafficRecordHeader header{ static_cast<uint32_t>(size), kind, frameVersion, 0, id, now - StartTime.load(std::memory_order_relaxed) };
+    const std::pair<const char*, size_t> parts[]{ { reinterpret_cast<const char*>(&header), sizeof(header) }, { first, firstSize }, { second, secondSize } };
+    uint64_t position = writePosition;
+
+    for (const auto& [data, partSize] : parts)
+    {
+        // a part may wrap around the end of the ring
+        const size_t offset = static_cast<size_t>(position % ANTCP_TRAFFIC_LOG_RING_SIZE);
+        const size_t head = std::min(partSize, ANTCP_TRAFFIC_LOG_RING_SIZE - offset);
+
+        if (partSize > 0)
+        {
+            memcpy(ring.Data.get() + offset, data, head);
+            memcpy(ring.Data.get(), data + head, partSize - head);
+        }
+
+        position += partSize;
+    }
+
+    // only this thread writes the counters, so they need no atomic increments
+    ring.Records.store(ring.Records.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    ring.Bytes.store(ring.Bytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+    ring.WritePosition.store(position, std::memory_order_release);
+}
+
+void AnTcpTrafficLog::RunWriter() noexcept
+{
+    while (true)
+    {
+        bool stopping = false;
+
+        {
+            std::unique_lock lock(Rings->Mutex);
+            Wakeup.wait_for(lock, ANTCP_TRAFFIC_LOG_FLUSH_INTERVAL, [this]() { return Stopping; });
+            stopping = Stopping;
+        }
+
+        Drain();
+
+        if (stopping)
+        {
+            File.flush();
+            return;
+        }
+    }
+}
+
+void AnTcpTrafficLog::Drain() noexcept
+{
+    // rings are never deleted while the log exists, only new ones are added
+    std::vector<Ring*> rings;
+
+    {
+        std::lock_guard lock(Rings->Mutex);
+        rings.reserve(Rings->Rings.size());
+
+        for (const std::unique_ptr<Ring>& ring : Rings->Rings)
+        {
+            rings.push_back(ring.get());
+        }
+    }
+
+    for (Ring* ring : rings)
+    {
+        const uint64_t readPosition = ring->ReadPosition.load(std::memory_order_relaxed);
+        const uint64_t writePosition = ring->WritePosition.load(std::memory_order_acquire);
+
+        if (readPosition == writePosition)
+        {
+            continue;
+        }
+
+        // records are written as a whole, so the ring always ends with a complete one
+        const size_t offset = static_cast<size_t>(readPosition % ANTCP_TRAFFIC_LOG_RING_SIZE);
+        const size_t size = static_cast<size_t>(writePosition - readPosition);
+        const size_t head = std::min(size, ANTCP_TRAFFIC_LOG_RING_SIZE - offset);
+
+        File.write(ring->Data.get() + offset, static_cast<std::streamsize>(head));
+        File.write(ring->Data.get(), static_cast<std::streamsize>(size - head));
+        ring->ReadPosition.store(writePosition, std::memory_order_release);
+    }
+}
+
+AnTcpTrafficLogStats AnTcpTrafficLog::GetStats() noexcept
+{
+    AnTcpTrafficLogStats stats{};
+    stats.Running = IsEnabled();
+
+    std::lock_guard lock(Rings->Mutex);
+
+    for (const std::unique_ptr<Ring>& ring : Rings->Rings)
+    {
+        stats.Records += ring->Records.load(std::memory_order_relaxed);
+        stats.Bytes += ring->Bytes.load(std::memory_order_relaxed);
+        stats.Dropped += ring->Dropped.load(std::memory_order_relaxed);
+    }
+
+    return stats;
+}
+
+bool AnTcpTrafficLogReader::Open(const std::string& path) noexcept
+{
+    Close();
+
+#ifdef _WIN32
+    FileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (FileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize{};
+
+    if (!GetFileSizeEx(FileHandle, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(AnTcpTrafficLogHeader)))
+    {
+        Close();
+        return false;
+    }
+
+    Mapping = CreateFileMappingA(FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    View = Mapping ? static_cast<const char*>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    ViewSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int file = open(path.c_str(), O_RDONLY);
+
+    if (file < 0)
+    {
+        return false;
+    }
+
+    struct stat fileStat{};
+
+    if (fstat(file, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(AnTcpTrafficLogHeader)))
+    {
+        close(file);
+        return false;
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+
+    // the mapping keeps the file open
+    View = view != MAP_FAILED ? static_cast<const char*>(view) : nullptr;
+    ViewSize = static_cast<size_t>(fileStat.st_size);
+#endif
+
+    if (!View || GetHeader().Magic != ANTCP_TRAFFIC_LOG_MAGIC || GetHeader().Version != ANTCP_TRAFFIC_LOG_VERSION)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void AnTcpTrafficLogReader::Close() noexcept
+{
+#ifdef _WIN32
+    if (View)
+    {
+        UnmapViewOfFile(View);
+    }
+
+    if (Mapping)
+    {
+        CloseHandle(Mapping);
+        Mapping = nullptr;
+    }
+
+    if (FileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(FileHandle);
+        FileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (View)
+    {
+        munmap(const_cast<char*>(View), ViewSize);
+    }
+#endif
+
+    View = nullptr;
+    ViewSize = 0;
+}
+
+std::vector<AnTcpTrafficRecord> AnTcpTrafficLogReader::GetRecords() const
+{
+    std::vector<AnTcpTrafficRecord> records;
+    size_t offset = sizeof(AnTcpTrafficLogHeader);
+
+    while (ViewSize - offset >= sizeof(AnTcpTrafficRecordHeader))
+    {
+        AnTcpTrafficRecordHeader header{};
+        memcpy(&header, View + offset, sizeof(header));
+
+        if (header.Size < sizeof(AnTcpTrafficRecordHeader) || header.Size > ViewSize - offset)
+        {
+            break;
+        }
+
+        records.push_back(AnTcpTrafficRecord{ header.Kind, header.FrameVersion, header.Connection, header.Time,
+            View + offset + sizeof(header), header.Size - sizeof(header) });
+
+        offset += header.Size;
+    }
+
+    // the threads wrote their records in order, the writer interleaved them in blocks
+    std::stable_sort(records.begin(), records.end(), [](const AnTcpTrafficRecord& a, const AnTcpTrafficRecord& b)
+    {
+        return a.Time < b.Time;
+    });
+
+    return records;
+}
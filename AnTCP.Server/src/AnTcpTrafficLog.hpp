@@ -0,0 +1,314 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AnTcpCallbackTable.hpp"
+#include "AnTcpConnectionTable.hpp"
+#include "AnTcpPlatform.hpp"
+#include "AnTcpSharedMemory.hpp"
+
+// first bytes of every traffic log ("ANTCPLOG") and the version of its format
+constexpr uint64_t ANTCP_TRAFFIC_LOG_MAGIC = 0x474F4C5043544E41;
+constexpr uint32_t ANTCP_TRAFFIC_LOG_VERSION = 1;
+
+// set in the header when the log contains the responses too
+constexpr uint32_t ANTCP_TRAFFIC_LOG_RESPONSES = 1;
+
+// buffer of every thread that records, records that don't fit until the writer emptied it are dropped
+constexpr size_t ANTCP_TRAFFIC_LOG_RING_SIZE = 256 * 1024;
+
+// how often the writer thread moves the buffers into the file
+constexpr std::chrono::milliseconds ANTCP_TRAFFIC_LOG_FLUSH_INTERVAL{ 5 };
+
+enum class AnTcpTrafficRecordKind : uint8_t
+{
+    // frame received from a client: type, request id with frame version 2 and payload
+    Request = 1,
+    // response sent to a client: type, u32 request id (0 for frame version 1) and payload
+    Response = 2,
+    // the connection was closed, no data
+    Close = 3
+};
+
+/// <summary>
+/// Start of a traffic log, followed by the records.
+/// </summary>
+struct AnTcpTrafficLogHeader
+{
+    uint64_t Magic;
+    uint32_t Version;
+    uint32_t Flags;
+
+    // when the log was started, nanoseconds since the unix epoch
+    int64_t StartTime;
+};
+
+/// <summary>
+/// Start of every record, followed by its data.
+/// </summary>
+struct AnTcpTrafficRecordHeader
+{
+    // size of the record including this header
+    uint32_t Size;
+    AnTcpTrafficRecordKind Kind;
+
+    // frame version of the connection when the frame was received or sent
+    uint8_t FrameVersion;
+    uint16_t Reserved;
+    AnTcpConnectionId Connection;
+
+    // nanoseconds since the log was started
+    int64_t Time;
+};
+
+static_assert(sizeof(AnTcpTrafficLogHeader) == 24 && sizeof(AnTcpTrafficRecordHeader) == 24, "the log format has no padding");
+
+/// <summary>
+/// Record of a traffic log, the data points into the mapped file.
+/// </summary>
+struct AnTcpTrafficRecord
+{
+    AnTcpTrafficRecordKind Kind;
+    uint8_t FrameVersion;
+    AnTcpConnectionId Connection;
+    int64_t Time;
+    const char* Data;
+    size_t Size;
+};
+
+struct AnTcpTrafficLogStats
+{
+    bool Running = false;
+
+    // records and bytes that made it into the buffers of the threads, the writer moves them into the file
+    uint64_t Records = 0;
+    uint64_t Bytes = 0;
+
+    // records that were dropped because the buffer of their thread was full
+    uint64_t Dropped = 0;
+};
+
+/// <summary>
+/// Captures the traffic of a server into a compact binary log, to replay it later. Every
+/// thread appends its records to a ring of its own without locks, a writer thread moves
+/// them into the file. Records of different threads are only ordered by their time.
+/// </summary>
+class AnTcpTrafficLog
+{
+private:
+    struct Ring
+    {
+        // only the thread that owns the ring writes, only the writer thread reads
+        alignas(ANTCP_CACHE_LINE_SIZE) std::atomic<uint64_t> WritePosition{ 0 };
+        std::atomic<uint64_t> Records{ 0 };
+        std::atomic<uint64_t> Bytes{ 0 };
+        std::atomic<uint64_t> Dropped{ 0 };
+
+        alignas(ANTCP_CACHE_LINE_SIZE) std::atomic<uint64_t> ReadPosition{ 0 };
+
+        std::unique_ptr<char[]> Data{ new char[ANTCP_TRAFFIC_LOG_RING_SIZE] };
+    };
+
+    // shared with the thread local handles, so exiting threads can return their ring after the server is gone
+    struct Registry
+    {
+        std::mutex Mutex;
+        std::vector<std::unique_ptr<Ring>> Rings;
+        std::vector<Ring*> FreeRings;
+    };
+
+    struct RingHandle
+    {
+        std::shared_ptr<Registry> Owner;
+        Ring* Instance;
+    };
+
+    struct ThreadRings
+    {
+        std::vector<RingHandle> Handles;
+
+        ~ThreadRings();
+    };
+
+    std::shared_ptr<Registry> Rings;
+    std::atomic<bool> Enabled;
+    std::atomic<bool> Responses;
+
+    // steady clock time of the start in nanoseconds, record times are relative to it
+    std::atomic<int64_t> StartTime;
+
+    // guards starting and stopping
+    std::mutex Mutex;
+    std::condition_variable Wakeup;
+    bool Stopping;
+    std::thread Writer;
+    std::ofstream File;
+
+    // rings of the current thread, one per server the thread recorded for
+    static inline thread_local ThreadRings CurrentRings{};
+
+public:
+    AnTcpTrafficLog()
+        : Rings(std::make_shared<Registry>()),
+        Enabled(false),
+        Responses(false),
+        StartTime(0),
+        Mutex(),
+        Wakeup(),
+        Stopping(false),
+        Writer(),
+        File()
+    {}
+
+    ~AnTcpTrafficLog()
+    {
+        Stop();
+    }
+
+    AnTcpTrafficLog(const AnTcpTrafficLog&) = delete;
+    AnTcpTrafficLog& operator=(const AnTcpTrafficLog&) = delete;
+
+    inline bool IsEnabled() const noexcept { return Enabled.load(std::memory_order_relaxed); }
+
+    inline bool IsLoggingResponses() const noexcept { return IsEnabled() && Responses.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Create the file and start recording.
+    /// </summary>
+    /// <param name="responses">Record the responses too, which is needed to compare them when replaying.</param>
+    /// <returns>True if the log was started, false if it is running already or the file could not be created.</returns>
+    bool Start(const std::string& path, bool responses) noexcept;
+
+    /// <summary>
+    /// Stop recording and write everything that was recorded so far into the file.
+    /// </summary>
+    void Stop() noexcept;
+
+    /// <summary>
+    /// Record a frame received from a client.
+    /// </summary>
+    /// <param name="frame">The frame without its size: type, request id with frame version 2 and payload.</param>
+    inline void RecordRequest(AnTcpConnectionId id, uint8_t frameVersion, const char* frame, size_t size) noexcept
+    {
+        Record(AnTcpTrafficRecordKind::Request, id, frameVersion, frame, size, nullptr, 0);
+    }
+
+    /// <summary>
+    /// Record a response sent to a client.
+    /// </summary>
+    inline void RecordResponse(AnTcpConnectionId id, uint8_t frameVersion, AnTcpMessageType type, AnTcpRequestId requestId, const void* data, size_t size) noexcept
+    {
+        char header[sizeof(AnTcpMessageType) + sizeof(AnTcpRequestId)];
+        header[0] = type;
+        memcpy(header + sizeof(AnTcpMessageType), &requestId, sizeof(AnTcpRequestId));
+        Record(AnTcpTrafficRecordKind::Response, id, frameVersion, header, sizeof(header), static_cast<const char*>(data), size);
+    }
+
+    /// <summary>
+    /// Record that a connection was closed.
+    /// </summary>
+    inline void RecordClose(AnTcpConnectionId id) noexcept
+    {
+        Record(AnTcpTrafficRecordKind::Close, id, 0, nullptr, 0, nullptr, 0);
+    }
+
+    /// <summary>
+    /// Sum up the counters of all threads.
+    /// </summary>
+    AnTcpTrafficLogStats GetStats() noexcept;
+
+private:
+    /// <summary>
+    /// Append a record of two parts to the ring of the current thread, it is dropped when the ring is full.
+    /// </summary>
+    void Record(AnTcpTrafficRecordKind kind, AnTcpConnectionId id, uint8_t frameVersion, const char* first, size_t firstSize, const char* second, size_t secondSize) noexcept;
+
+    /// <summary>
+    /// Get the ring of the current thread, creates one on first use.
+    /// </summary>
+    inline Ring& GetRing() noexcept
+    {
+        for (const RingHandle& handle : CurrentRings.Handles)
+        {
+            if (handle.Owner == Rings)
+            {
+                return *handle.Instance;
+            }
+        }
+
+        return AddRing();
+    }
+
+    Ring& AddRing() noexcept;
+
+    /// <summary>
+    /// Routine of the writer thread, moves the rings into the file until the log is stopped.
+    /// </summary>
+    void RunWriter() noexcept;
+
+    /// <summary>
+    /// Move everything the rings contain into the file.
+    /// </summary>
+    void Drain() noexcept;
+};
+
+/// <summary>
+/// Reads a traffic log, the file is mapped into memory instead of being read.
+/// </summary>
+class AnTcpTrafficLogReader
+{
+private:
+    const char* View;
+    size_t ViewSize;
+
+#ifdef _WIN32
+    HANDLE FileHandle;
+    HANDLE Mapping;
+#endif
+
+public:
+    AnTcpTrafficLogReader()
+        : View(nullptr),
+        ViewSize(0)
+#ifdef _WIN32
+        , FileHandle(INVALID_HANDLE_VALUE),
+        Mapping(nullptr)
+#endif
+    {}
+
+    ~AnTcpTrafficLogReader()
+    {
+        Close();
+    }
+
+    AnTcpTrafficLogReader(const AnTcpTrafficLogReader&) = delete;
+    AnTcpTrafficLogReader& operator=(const AnTcpTrafficLogReader&) = delete;
+
+    /// <summary>
+    /// Map a log and check its header.
+    /// </summary>
+    /// <returns>True if the file is a traffic log of a known version, false if not.</returns>
+    bool Open(const std::string& path) noexcept;
+
+    void Close() noexcept;
+
+    inline const AnTcpTrafficLogHeader& GetHeader() const noexcept
+    {
+        return *reinterpret_cast<const AnTcpTrafficLogHeader*>(View);
+    }
+
+    /// <summary>
+    /// Get all records ordered by their time, they stay valid while the log is open. A record
+    /// that was cut off, because the server stopped while writing it, ends the log.
+    /// </summary>
+    std::vector<AnTcpTrafficRecord> GetRecords() const;
+};
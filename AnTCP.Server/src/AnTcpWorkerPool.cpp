@@ -0,0 +1,148 @@
+#include "AnTcpWorkerPool.hpp"
+
+#include <algorithm>
+
+void AnTcpWorkerPool::Start(unsigned int workerCount) noexcept
+{
+    if (IsRunning())
+    {
+        return;
+    }
+
+    ShouldExit = false;
+    workerCount = workerCount > 0 ? workerCount : std::max(1u, std::thread::hardware_concurrency());
+
+    // create all queues before the first worker starts stealing from them
+    for (unsigned int i = 0; i < workerCount; ++i)
+    {
+        Workers.push_back(new Worker());
+    }
+
+    for (size_t i = 0; i < Workers.size(); ++i)
+    {
+        Workers[i]->Thread = new std::thread(&AnTcpWorkerPool::Run, this, i);
+    }
+}
+
+void AnTcpWorkerPool::Stop() noexcept
+{
+    if (!IsRunning())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock(SleepMutex);
+        ShouldExit = true;
+    }
+
+    SleepCondition.notify_all();
+
+    for (Worker* worker : Workers)
+    {
+        worker->Thread->join();
+        delete worker->Thread;
+    }
+
+    for (Worker* worker : Workers)
+    {
+        delete worker;
+    }
+
+    Workers.clear();
+}
+
+void AnTcpWorkerPool::Submit(AnTcpJob&& job, AnTcpPriority priority) noexcept
+{
+    // jobs queued by a worker stay on it, everything else is spread over all workers
+    const size_t index = CurrentWorker < Workers.size() ? CurrentWorker : NextWorker++ % Workers.size();
+    const size_t lane = static_cast<size_t>(priority);
+
+    {
+        std::lock_guard lock(Workers[index]->Mutex);
+        Workers[index]->Jobs[lane].push_back(std::move(job));
+    }
+
+    LaneJobs[lane]++;
+    QueuedJobs++;
+
+    // only take the sleep mutex when someone is sleeping, the counters are sequentially
+    // consistent so either we see the sleeper or the sleeper sees the queued job
+    if (SleepingWorkers > 0)
+    {
+        {
+            std::lock_guard lock(SleepMutex);
+        }
+
+        SleepCondition.notify_one();
+    }
+}
+
+void AnTcpWorkerPool::Run(size_t index) noexcept
+{
+    CurrentWorker = index;
+    AnTcpJob job;
+
+    while (true)
+    {
+        if (TakeJob(index, job))
+        {
+            job();
+            job = nullptr;
+            continue;
+        }
+
+        std::unique_lock lock(SleepMutex);
+        SleepingWorkers++;
+
+        // finish every queued job before exiting
+        SleepCondition.wait(lock, [this]() { return QueuedJobs > 0 || ShouldExit; });
+        SleepingWorkers--;
+
+        if (QueuedJobs == 0 && ShouldExit)
+        {
+            break;
+        }
+    }
+
+    CurrentWorker = SIZE_MAX;
+}
+
+bool AnTcpWorkerPool::TakeJob(size_t index, AnTcpJob& job) noexcept
+{
+    for (size_t lane = 0; lane < ANTCP_PRIORITY_COUNT; ++lane)
+    {
+        if (LaneJobs[lane] == 0)
+        {
+            continue;
+        }
+
+        // own queue first in fifo order, then steal the newest job of the others
+        for (size_t i = 0; i < Workers.size(); ++i)
+        {
+            Worker* worker = Workers[(index + i) % Workers.size()];
+            std::lock_guard lock(worker->Mutex);
+            std::deque<AnTcpJob>& jobs = worker->Jobs[lane];
+
+            if (!jobs.empty())
+            {
+                if (i == 0)
+                {
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                else
+                {
+                    job = std::move(jobs.back());
+                    jobs.pop_back();
+                }
+
+                LaneJobs[lane]--;
+                QueuedJobs--;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
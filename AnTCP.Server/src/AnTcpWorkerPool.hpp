@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AnTcpCallbackTable.hpp"
+
+// job executed by the worker pool
+typedef std::function<void()> AnTcpJob;
+
+/// <summary>
+/// Fixed size pool of worker threads that executes callbacks off the I/O threads.
+/// Every worker has its own queue, jobs are spread over the queues and idle
+/// workers steal jobs from the others. Each queue has a lane per AnTcpPriority,
+/// higher lanes of all queues are emptied before a worker looks at a lower one.
+/// </summary>
+class AnTcpWorkerPool
+{
+private:
+    struct Worker
+    {
+        std::mutex Mutex;
+        std::array<std::deque<AnTcpJob>, ANTCP_PRIORITY_COUNT> Jobs;
+        std::thread* Thread = nullptr;
+    };
+
+    std::vector<Worker*> Workers;
+    std::atomic<bool> ShouldExit;
+    std::atomic<size_t> NextWorker;
+    std::atomic<size_t> QueuedJobs;
+
+    // queued jobs per lane, empty lanes are skipped without locking the queues
+    std::array<std::atomic<size_t>, ANTCP_PRIORITY_COUNT> LaneJobs;
+    std::atomic<size_t> SleepingWorkers;
+
+    std::mutex SleepMutex;
+    std::condition_variable SleepCondition;
+
+    // index of the worker running on this thread, used to queue follow up jobs locally
+    static inline thread_local size_t CurrentWorker = SIZE_MAX;
+
+public:
+    AnTcpWorkerPool()
+        : Workers(),
+        ShouldExit(false),
+        NextWorker(0),
+        QueuedJobs(0),
+        LaneJobs(),
+        SleepingWorkers(0),
+        SleepMutex(),
+        SleepCondition()
+    {}
+
+    ~AnTcpWorkerPool()
+    {
+        Stop();
+    }
+
+    AnTcpWorkerPool(const AnTcpWorkerPool&) = delete;
+    AnTcpWorkerPool& operator=(const AnTcpWorkerPool&) = delete;
+
+    /// <summary>
+    /// Spawn the worker threads.
+    /// </summary>
+    /// <param name="workerCount">Number of workers, 0 uses one per hardware thread.</param>
+    void Start(unsigned int workerCount) noexcept;
+
+    /// <summary>
+    /// Execute all queued jobs and join the worker threads.
+    /// </summary>
+    void Stop() noexcept;
+
+    /// <summary>
+    /// Whether the workers are running.
+    /// </summary>
+    inline bool IsRunning() const noexcept { return !Workers.empty(); }
+
+    /// <summary>
+    /// Get the number of workers.
+    /// </summary>
+    inline size_t GetWorkerCount() const noexcept { return Workers.size(); }
+
+    /// <summary>
+    /// Whether jobs of a higher lane than the given one are queued, long running jobs can step aside for them.
+    /// </summary>
+    inline bool HasJobsAbove(AnTcpPriority priority) const noexcept
+    {
+        for (size_t lane = 0; lane < static_cast<size_t>(priority); ++lane)
+        {
+            if (LaneJobs[lane] > 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /// <summary>
+    /// Queue a job, it will be executed by one of the workers.
+    /// </summary>
+    /// <param name="job">Job to execute.</param>
+    /// <param name="priority">Lane of the job.</param>
+    void Submit(AnTcpJob&& job, AnTcpPriority priority = AnTcpPriority::Normal) noexcept;
+
+private:
+    /// <summary>
+    /// Routine of a worker thread.
+    /// </summary>
+    void Run(size_t index) noexcept;
+
+    /// <summary>
+    /// Take a job of the highest lane that has one, from the workers own queue or stolen from another worker.
+    /// </summary>
+    /// <returns>True if a job was taken, false if all queues are empty.</returns>
+    bool TakeJob(size_t index, AnTcpJob& job) noexcept;
+};